@@ -0,0 +1,166 @@
+#include "async_executor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+WorkerPool::WorkerPool(std::size_t threads) {
+  m_threads.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    m_threads.emplace_back([this] { run(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard lock(m_mtx);
+    m_stop = true;
+  }
+  m_cv.notify_all();
+  for (auto &t : m_threads) {
+    t.join();
+  }
+}
+
+void WorkerPool::enqueue(std::coroutine_handle<> h) {
+  {
+    std::lock_guard lock(m_mtx);
+    m_queue.push_back(h);
+  }
+  m_cv.notify_one();
+}
+
+// drains the queue before stopping, so no scheduled coroutine is left
+// suspended
+void WorkerPool::run() {
+  for (;;) {
+    std::unique_lock lock(m_mtx);
+    m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+    if (m_queue.empty()) {
+      return;
+    }
+    auto h = m_queue.front();
+    m_queue.pop_front();
+    lock.unlock();
+    h.resume();
+  }
+}
+
+Reactor::Reactor() {
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+  }
+  m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (m_wake < 0) {
+    const auto err = errno;
+    close(m_epoll);
+    throw std::system_error(err, std::generic_category(), "eventfd");
+  }
+  epoll_event ev{.events = EPOLLIN, .data = {.ptr = nullptr}};
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev) != 0) {
+    const auto err = errno;
+    close(m_wake);
+    close(m_epoll);
+    throw std::system_error(err, std::generic_category(), "epoll_ctl");
+  }
+  m_thread = std::thread([this] { run(); });
+}
+
+// coroutines still waiting for readiness are not resumed
+Reactor::~Reactor() {
+  m_stop = true;
+  const std::uint64_t one = 1;
+  [[maybe_unused]] auto res = write(m_wake, &one, sizeof(one));
+  m_thread.join();
+  close(m_wake);
+  close(m_epoll);
+}
+
+// registrations are one-shot, the coroutine is resumed at most once per wait
+// and a descriptor can be waited for again by re-arming it. The lock is held
+// while registering, so the reactor can neither time the wait out nor resume
+// it before it is fully registered.
+void Reactor::watch(Awaiter &awaiter) {
+  std::lock_guard lock(m_mtx);
+  epoll_event ev{.events = (awaiter.write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT,
+                 .data = {.ptr = &awaiter}};
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, awaiter.fd, &ev) != 0 &&
+      (errno != EEXIST ||
+       epoll_ctl(m_epoll, EPOLL_CTL_MOD, awaiter.fd, &ev) != 0)) {
+    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+  }
+  if (awaiter.deadline != clock::time_point::max()) {
+    const bool earliest =
+        m_timers.empty() || awaiter.deadline < m_timers.begin()->first;
+    m_timers.emplace(awaiter.deadline, &awaiter);
+    // the reactor may be waiting with a later timeout
+    if (earliest) {
+      const std::uint64_t one = 1;
+      [[maybe_unused]] auto res = write(m_wake, &one, sizeof(one));
+    }
+  }
+}
+
+// milliseconds until the earliest deadline, rounded up, -1 if there is none
+int Reactor::next_timeout() const {
+  if (m_timers.empty()) {
+    return -1;
+  }
+  const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+      m_timers.begin()->first - clock::now());
+  return static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(
+      left.count(), 0, std::numeric_limits<int>::max()));
+}
+
+void Reactor::run() {
+  std::array<epoll_event, 16> events{};
+  std::vector<Awaiter *> ready;
+  for (;;) {
+    int timeout = 0;
+    {
+      std::lock_guard lock(m_mtx);
+      timeout = next_timeout();
+    }
+    const int n = epoll_wait(m_epoll, events.data(), events.size(), timeout);
+    if (n < 0 && errno != EINTR) {
+      return;
+    }
+    ready.clear();
+    {
+      std::lock_guard lock(m_mtx);
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.ptr == nullptr) {
+          std::uint64_t count = 0;
+          [[maybe_unused]] auto res = read(m_wake, &count, sizeof(count));
+          continue;
+        }
+        auto *awaiter = static_cast<Awaiter *>(events[i].data.ptr);
+        m_timers.erase({awaiter->deadline, awaiter});
+        ready.push_back(awaiter);
+      }
+      const auto now = clock::now();
+      while (!m_timers.empty() && m_timers.begin()->first <= now) {
+        auto *awaiter = m_timers.begin()->second;
+        m_timers.erase(m_timers.begin());
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, awaiter->fd, nullptr);
+        awaiter->timed_out = true;
+        ready.push_back(awaiter);
+      }
+    }
+    if (m_stop) {
+      return;
+    }
+    // resumed coroutines may wait again, so not under the lock
+    for (auto *awaiter : ready) {
+      awaiter->handle.resume();
+    }
+  }
+}
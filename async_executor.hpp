@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed number of threads resuming coroutines, blocking calls (ioctls) are
+// offloaded here so they do not stall the caller's event loop
+class WorkerPool {
+public:
+  explicit WorkerPool(std::size_t threads = 2);
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+  ~WorkerPool();
+
+  // co_await pool.schedule() continues the coroutine on a worker thread
+  auto schedule() noexcept {
+    struct Awaiter {
+      WorkerPool &pool;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> h) { pool.enqueue(h); }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{*this};
+  }
+
+  std::size_t size() const noexcept { return m_threads.size(); }
+
+  // resumes h on a worker thread
+  void enqueue(std::coroutine_handle<> h);
+
+private:
+  void run();
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  std::deque<std::coroutine_handle<>> m_queue;
+  bool m_stop = false;
+  std::vector<std::thread> m_threads;
+};
+
+// Single threaded epoll loop resuming coroutines waiting for file descriptor
+// readiness
+class Reactor {
+public:
+  using clock = std::chrono::steady_clock;
+
+  Reactor();
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+  ~Reactor();
+
+  // co_await reactor.readable(fd) continues the coroutine on the reactor
+  // thread once fd is readable, or has an error or hangup pending. Given a
+  // deadline, it continues once the deadline passed as well and evaluates to
+  // false then.
+  auto readable(int fd, clock::time_point deadline = clock::time_point::max())
+      noexcept {
+    return Awaiter{*this, fd, false, deadline};
+  }
+  auto writable(int fd, clock::time_point deadline = clock::time_point::max())
+      noexcept {
+    return Awaiter{*this, fd, true, deadline};
+  }
+
+private:
+  struct Awaiter {
+    Reactor &reactor;
+    int fd;
+    bool write;
+    clock::time_point deadline;
+    std::coroutine_handle<> handle{};
+    bool timed_out = false;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+      handle = h;
+      reactor.watch(*this);
+    }
+    bool await_resume() const noexcept { return !timed_out; }
+  };
+
+  void watch(Awaiter &awaiter);
+  void run();
+  int next_timeout() const;
+
+  int m_epoll = -1;
+  int m_wake = -1;
+  std::atomic<bool> m_stop{};
+  // waits with a deadline, ordered by it
+  std::mutex m_mtx;
+  std::set<std::pair<clock::time_point, Awaiter *>> m_timers;
+  std::thread m_thread;
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+template <typename T> class Task;
+
+namespace detail {
+
+template <typename T> struct TaskResult {
+  std::optional<T> value;
+  std::exception_ptr error;
+
+  template <typename U> void return_value(U &&val) {
+    value.emplace(std::forward<U>(val));
+  }
+  T take() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return std::move(*value);
+  }
+};
+
+template <> struct TaskResult<void> {
+  std::exception_ptr error;
+
+  void return_void() noexcept {}
+  void take() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
+
+template <typename T> struct TaskPromise : TaskResult<T> {
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+
+  Task<T> get_return_object() noexcept;
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  auto final_suspend() noexcept {
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<TaskPromise> h) noexcept {
+        return h.promise().continuation;
+      }
+      void await_resume() noexcept {}
+    };
+    return FinalAwaiter{};
+  }
+  void unhandled_exception() noexcept {
+    this->error = std::current_exception();
+  }
+};
+
+// fire and forget coroutine, used to start tasks from non-coroutine code
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+} // namespace detail
+
+// Lazily started coroutine, runs when awaited and resumes the awaiting
+// coroutine once done
+template <typename T = void> class [[nodiscard]] Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  explicit Task(handle_type h) noexcept : m_handle{h} {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  Task(Task &&other) noexcept : m_handle{std::exchange(other.m_handle, {})} {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (m_handle)
+        m_handle.destroy();
+      m_handle = std::exchange(other.m_handle, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (m_handle)
+      m_handle.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept {
+    m_handle.promise().continuation = cont;
+    return m_handle;
+  }
+  T await_resume() { return m_handle.promise().take(); }
+
+private:
+  handle_type m_handle;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>{std::coroutine_handle<TaskPromise>::from_promise(*this)};
+}
+
+namespace detail {
+
+struct SyncWaitState {
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool done = false;
+
+  void notify() {
+    std::lock_guard lock(mtx);
+    done = true;
+    // notified under the lock, so the waiter cannot destroy the state before
+    // this returns
+    cv.notify_all();
+  }
+  void wait() {
+    std::unique_lock lock(mtx);
+    cv.wait(lock, [this] { return done; });
+  }
+};
+
+template <typename T>
+Detached sync_wait_impl(Task<T> &task, TaskResult<T> &result,
+                        SyncWaitState &state) {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+    } else {
+      result.return_value(co_await task);
+    }
+  } catch (...) {
+    result.error = std::current_exception();
+  }
+  state.notify();
+}
+
+template <typename T> struct WhenAllState {
+  explicit WhenAllState(std::size_t n) : remaining{n + 1}, results(n) {}
+  std::atomic<std::size_t> remaining;
+  std::coroutine_handle<> waiter;
+  std::vector<TaskResult<T>> results;
+
+  void complete() {
+    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      waiter.resume();
+    }
+  }
+};
+
+template <typename T>
+Detached when_all_impl(Task<T> &task, WhenAllState<T> &state, std::size_t i) {
+  try {
+    state.results[i].return_value(co_await task);
+  } catch (...) {
+    state.results[i].error = std::current_exception();
+  }
+  state.complete();
+}
+
+} // namespace detail
+
+// blocks the calling thread until the task completes
+template <typename T> T sync_wait(Task<T> task) {
+  detail::TaskResult<T> result;
+  detail::SyncWaitState state;
+  detail::sync_wait_impl(task, result, state);
+  state.wait();
+  return result.take();
+}
+
+// runs the tasks concurrently and resumes once all of them completed, the
+// first error, if any, is rethrown after all of them are done
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks) {
+  detail::WhenAllState<T> state(tasks.size());
+  struct Awaiter {
+    std::vector<Task<T>> &tasks;
+    detail::WhenAllState<T> &state;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+      state.waiter = h;
+      for (std::size_t i = 0; i < tasks.size(); ++i) {
+        detail::when_all_impl(tasks[i], state, i);
+      }
+      // resume right away if every task completed synchronously
+      return state.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+    void await_resume() const noexcept {}
+  };
+  co_await Awaiter{tasks, state};
+  std::vector<T> res;
+  res.reserve(state.results.size());
+  for (auto &r : state.results) {
+    res.push_back(r.take());
+  }
+  co_return res;
+}
@@ -0,0 +1,46 @@
+#include "atomic_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <system_error>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+void write_file_atomically(fs::path const &path, std::string_view contents,
+                           bool sync) {
+  if (path.has_parent_path()) {
+    fs::create_directories(path.parent_path());
+  }
+  auto tmp_path = path;
+  tmp_path += fmt::format(".{}.tmp", getpid());
+  {
+    std::unique_ptr<FILE, decltype(&fclose)> tmp(fopen(tmp_path.c_str(), "w"),
+                                                 &fclose);
+    if (!tmp) {
+      throw std::system_error(errno, std::generic_category(),
+                              "failed to open " + tmp_path.string());
+    }
+    if (fwrite(contents.data(), 1, contents.size(), tmp.get()) !=
+            contents.size() ||
+        fflush(tmp.get()) != 0 || (sync && fsync(fileno(tmp.get())) != 0)) {
+      const std::system_error err(errno, std::generic_category(),
+                                  "failed to write " + tmp_path.string());
+      tmp.reset();
+      std::error_code ignored;
+      fs::remove(tmp_path, ignored);
+      throw err;
+    }
+  }
+  std::error_code ec;
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    std::error_code ignored;
+    fs::remove(tmp_path, ignored);
+    throw std::system_error(ec, "failed to replace " + path.string());
+  }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+// Replaces path with contents through a temporary file next to it and a
+// rename, so readers never see a partial file. Creates the parent
+// directories. With sync the data reaches the disk before the rename, for
+// files written right before halting. Throws std::system_error and leaves
+// no temporary file behind.
+void write_file_atomically(std::filesystem::path const &path,
+                           std::string_view contents, bool sync = false);
@@ -0,0 +1,67 @@
+// Compares querying the alarm through the in-process C API against spawning
+// the command line tool, which is what agents did before the library existed.
+//
+// usage: mrhat-rtcwake-bench-api <mrhat-rtcwake binary> [iterations] [adjfile]
+
+#include <mrhat_rtcwake.h>
+
+#include "bench_util.hpp"
+
+#include <fmt/format.h>
+
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+void check(int res, mrhat_rtcwake const *handle) {
+  if (res != 0) {
+    fmt::print(stderr, "mrhat-rtcwake api error: {}\n",
+               mrhat_rtcwake_last_error(handle));
+    std::exit(1);
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fmt::print(stderr,
+               "usage: {} <mrhat-rtcwake binary> [iterations] [adjfile]\n",
+               argv[0]);
+    return 1;
+  }
+  const std::string cli = argv[1];
+  const unsigned iterations = argc > 2 ? std::stoul(argv[2]) : 200;
+  const std::string adjfile = argc > 3 ? argv[3] : "/etc/adjtime";
+
+  mrhat_rtcwake_options opts{};
+  mrhat_rtcwake_default_options(&opts);
+  opts.adjfile = adjfile.c_str();
+  opts.status_file = nullptr;
+
+  // repeated reads within the session window of RTCSession are served from
+  // its cache, open+show+close is the cost of an uncached query
+  report("api show (open once, cached)", [&] {
+    mrhat_rtcwake *handle = nullptr;
+    check(mrhat_rtcwake_open(&opts, &handle), nullptr);
+    auto h = measure(iterations, [&] {
+      mrhat_rtcwake_alarm alarm{};
+      check(mrhat_rtcwake_show(handle, &alarm), handle);
+    });
+    mrhat_rtcwake_close(handle);
+    return h;
+  }());
+
+  report("api open+show+close", measure(iterations, [&] {
+           mrhat_rtcwake *handle = nullptr;
+           check(mrhat_rtcwake_open(&opts, &handle), nullptr);
+           mrhat_rtcwake_alarm alarm{};
+           check(mrhat_rtcwake_show(handle, &alarm), handle);
+           mrhat_rtcwake_close(handle);
+         }));
+
+  report("cli fork/exec show",
+         spawn_n(iterations, {cli, "--mode", "show", "--adjfile", adjfile}));
+  return 0;
+}
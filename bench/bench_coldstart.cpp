@@ -0,0 +1,41 @@
+// Cold start latency of the command line tool per mode, each iteration is a
+// fresh process, so it includes opening only the resources the mode needs.
+//
+// usage: mrhat-rtcwake-bench-coldstart <mrhat-rtcwake binary> [iterations]
+//        [extra arguments...]
+
+#include "bench_util.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fmt::print(stderr,
+               "usage: {} <mrhat-rtcwake binary> [iterations] [extra "
+               "arguments...]\n",
+               argv[0]);
+    return 1;
+  }
+  const std::string cli = argv[1];
+  const unsigned iterations = argc > 2 ? std::stoul(argv[2]) : 100;
+  const std::vector<std::string> extra(argv + std::min(argc, 3), argv + argc);
+
+  const std::vector<std::pair<std::string, std::vector<std::string>>> modes = {
+      {"show --output epoch", {"--mode", "show", "--output", "epoch"}},
+      {"show (text)", {"--mode", "show"}},
+      {"show --cached", {"--mode", "show", "--cached"}},
+      {"disable", {"--mode", "disable"}},
+  };
+  for (auto const &[name, mode_args] : modes) {
+    std::vector<std::string> args{cli};
+    args.insert(args.end(), mode_args.begin(), mode_args.end());
+    args.insert(args.end(), extra.begin(), extra.end());
+    report(name, spawn_n(iterations, std::move(args)));
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+// Compares the type erased RTC stack with the compile-time backend: the time
+// conversions asking IRTC::type() against the ones specialized on the clock
+// kind, and, given a device, RTC_RD_TIME through IRTC against a direct call
+// on RTCDevice.
+//
+// usage: mrhat-rtcwake-bench-devirt [iterations] [device]
+
+#include <irtc.hpp>
+#include <rtc_device.hpp>
+#include <rtc_utils.hpp>
+
+#include <latency_histogram.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using Clock = IRTC::Clock;
+
+// a conversion takes well below the microsecond resolution of
+// LatencyHistogram, so the mean over all iterations is reported
+template <typename F>
+void measure(const char *name, unsigned iterations, F &&f) {
+  long long sink = 0;
+  const auto start = clock_type::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    sink += f(i);
+  }
+  const auto elapsed = clock_type::now() - start;
+  fmt::print("{:<28} n={:<8} mean={}ns ({})\n", name, iterations,
+             std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                     .count() /
+                 std::max(iterations, 1u),
+             sink & 1);
+}
+
+template <typename F> LatencyHistogram measure_device(unsigned n, F &&f) {
+  LatencyHistogram h;
+  for (unsigned i = 0; i < n; ++i) {
+    const auto start = clock_type::now();
+    f();
+    h.record(clock_type::now() - start);
+  }
+  return h;
+}
+
+void report(const char *name, LatencyHistogram const &h) {
+  fmt::print("{:<28} n={:<8} mean={:>6}us p50={:>6}us p99={:>6}us\n", name,
+             h.count(), h.sum().count() / std::max<std::uint64_t>(h.count(), 1),
+             h.percentile(0.5).count(), h.percentile(0.99).count());
+}
+
+rtc_time at(unsigned i) {
+  rtc_time tm{};
+  tm.tm_year = 124;
+  tm.tm_mon = 7;
+  tm.tm_mday = 18;
+  tm.tm_sec = static_cast<int>(i % 86400);
+  return tm;
+}
+
+long long secs(std::chrono::system_clock::time_point tp) {
+  return std::chrono::system_clock::to_time_t(tp);
+}
+
+template <Clock C> void compare_conversions(unsigned iterations) {
+  const auto rtc =
+      MockRTC::get("rtc0", C == Clock::UTC ? "0.0 0 0.0\n0\nUTC\n"
+                                           : "0.0 0 0.0\n0\nLOCAL\n");
+  // through a reference, so the compiler cannot see the dynamic type
+  IRTC const &erased = *rtc;
+  const bool utc = C == Clock::UTC;
+  measure(utc ? "rtc_to_sys IRTC (utc)" : "rtc_to_sys IRTC (local)",
+          iterations,
+          [&](unsigned i) { return secs(rtc_to_sys(at(i), erased)); });
+  measure(utc ? "rtc_to_sys<UTC>" : "rtc_to_sys<LOCAL>", iterations,
+          [](unsigned i) { return secs(rtc_to_sys<C>(at(i))); });
+  const auto base = rtc_to_sys<C>(at(0));
+  measure(utc ? "sys_to_rtc IRTC (utc)" : "sys_to_rtc IRTC (local)",
+          iterations, [&](unsigned i) {
+            return sys_to_rtc(base + std::chrono::seconds{i}, erased).tm_sec;
+          });
+  measure(utc ? "sys_to_rtc<UTC>" : "sys_to_rtc<LOCAL>", iterations,
+          [&](unsigned i) {
+            return sys_to_rtc<C>(base + std::chrono::seconds{i}).tm_sec;
+          });
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const unsigned iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+  compare_conversions<Clock::UTC>(iterations);
+  compare_conversions<Clock::LOCAL>(iterations);
+
+  if (argc > 2) {
+    // the ioctl dominates, the difference is the dispatch and retry wrapper
+    const std::string device = argv[2];
+    const unsigned n = std::min(iterations, 10000u);
+    const auto erased = open_rtc_device<StandardAlarm>(device, true);
+    report("get_time IRTC", measure_device(n, [&] { erased->get_time(); }));
+    RTCDevice<StandardAlarm, Clock::UTC> dev{device};
+    report("get_time RTCDevice", measure_device(n, [&] { dev.get_time(); }));
+  }
+  return 0;
+}
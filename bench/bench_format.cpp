@@ -0,0 +1,64 @@
+// Compares the fixed layout timestamp formatters used by --output json|epoch
+// with the date::format path of the text output.
+//
+// usage: mrhat-rtcwake-bench-format [iterations]
+
+#include <time_format.hpp>
+
+#include <date/tz.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// same as the text output of the command line tool
+auto format_date(std::chrono::sys_seconds tp) {
+  return date::format("%a %d %b %X %Z %Y",
+                      date::make_zoned(date::current_zone(), tp));
+}
+
+// formatting takes well below the microsecond resolution of
+// LatencyHistogram, so the mean over all iterations is reported
+template <typename F>
+void measure(const char *name, unsigned iterations, F &&f) {
+  const std::chrono::sys_seconds base{std::chrono::seconds{1724016152}};
+  std::size_t sink = 0;
+  const auto start = clock_type::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    sink += f(base + std::chrono::seconds{i});
+  }
+  const auto elapsed = clock_type::now() - start;
+  fmt::print("{:<24} n={:<8} mean={}ns ({} chars)\n", name, iterations,
+             std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                     .count() /
+                 std::max(iterations, 1u),
+             sink);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const unsigned iterations = argc > 1 ? std::stoul(argv[1]) : 100000;
+
+  // the first lookup loads the zone database, which the text output pays for
+  // on every invocation
+  const auto start = clock_type::now();
+  date::current_zone();
+  fmt::print("{:<24} {}us\n", "tzdb load",
+             std::chrono::duration_cast<std::chrono::microseconds>(
+                 clock_type::now() - start)
+                 .count());
+
+  measure("format_date (local)", iterations,
+          [](auto tp) { return format_date(tp).size(); });
+  measure("format_iso8601", iterations,
+          [](auto tp) { return Iso8601(tp).view().size(); });
+  measure("format_epoch", iterations,
+          [](auto tp) { return Epoch(tp).view().size(); });
+  return 0;
+}
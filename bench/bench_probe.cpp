@@ -0,0 +1,88 @@
+// Cost of selecting the device backend in IRTC::get: probing the ioctls of
+// the driver against reading the cached result of an earlier invocation. The
+// cache is kept in a temporary directory, /run is left alone.
+//
+// usage: mrhat-rtcwake-bench-probe [device] [iterations]
+
+#include <rtc_registry.hpp>
+
+#include <latency_histogram.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename F> LatencyHistogram measure(unsigned iterations, F &&f) {
+  LatencyHistogram h;
+  for (unsigned i = 0; i < iterations; ++i) {
+    const auto start = clock_type::now();
+    f();
+    h.record(clock_type::now() - start);
+  }
+  return h;
+}
+
+void report(const char *name, LatencyHistogram const &h) {
+  fmt::print("{:<28} n={:<6} mean={:>8}us p50={:>8}us p99={:>8}us\n", name,
+             h.count(), h.sum().count() / std::max<std::uint64_t>(h.count(), 1),
+             h.percentile(0.5).count(), h.percentile(0.99).count());
+}
+
+// the probe of IRTC::get, opening the device on the first request
+IoctlProbe device_probe(fs::path const &dev, int &fd) {
+  return [&dev, &fd](unsigned long request) {
+    if (fd < 0 && (fd = open(dev.c_str(), O_RDONLY | O_CLOEXEC)) < 0) {
+      fmt::print(stderr, "failed to open {}\n", dev.c_str());
+      std::exit(1);
+    }
+    rtc_wkalrm alarm{};
+    return ioctl(fd, request, &alarm) == 0 ? 0 : errno;
+  };
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const fs::path dev = argc > 1 ? argv[1] : "/dev/rtc0";
+  const unsigned iterations = argc > 2 ? std::stoul(argv[2]) : 1000;
+  const auto dir = fs::temp_directory_path() /
+                   fmt::format("mrhat-rtcwake-bench-probe-{}", getpid());
+  const auto cache = dir / "rtc.backend";
+
+  const auto key = probe_key(dev);
+  auto resolve = [&] {
+    int fd = -1;
+    const auto res =
+        resolve_rtc_backend(rtc_backends(), key, cache, device_probe(dev, fd));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return res;
+  };
+
+  report("probe key", measure(iterations, [&] { probe_key(dev); }));
+  report("probe (cache miss)", measure(iterations, [&] {
+           fs::remove(cache);
+           resolve();
+         }));
+  const auto res = resolve();
+  report("cached", measure(iterations, [&] { resolve(); }));
+  fmt::print("{} uses the {} backend\n", dev.c_str(), res.backend->name);
+  fs::remove_all(dir);
+  return 0;
+}
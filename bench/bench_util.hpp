@@ -0,0 +1,70 @@
+#pragma once
+
+#include <latency_histogram.hpp>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// timing and reporting shared by the benchmarks comparing latencies
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename F> LatencyHistogram measure(unsigned iterations, F &&f) {
+  LatencyHistogram h;
+  for (unsigned i = 0; i < iterations; ++i) {
+    const auto start = clock_type::now();
+    f();
+    h.record(clock_type::now() - start);
+  }
+  return h;
+}
+
+inline void report(std::string_view name, LatencyHistogram const &h) {
+  fmt::print("{:<28} n={:<6} mean={:>8}us p50={:>8}us p99={:>8}us\n", name,
+             h.count(), h.sum().count() / std::max<std::uint64_t>(h.count(), 1),
+             h.percentile(0.5).count(), h.percentile(0.99).count());
+}
+
+// runs args[0] with args to completion iterations times, its output going to
+// /dev/null, exits if it cannot be spawned or fails
+inline LatencyHistogram spawn_n(unsigned iterations,
+                                std::vector<std::string> args) {
+  std::vector<char *> cargs;
+  for (auto &a : args) {
+    cargs.push_back(a.data());
+  }
+  cargs.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  auto h = measure(iterations, [&] {
+    pid_t pid{};
+    if (posix_spawn(&pid, args[0].c_str(), &actions, nullptr, cargs.data(),
+                    environ) != 0) {
+      fmt::print(stderr, "failed to spawn {}\n", args[0]);
+      std::exit(1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fmt::print(stderr, "{} failed\n", fmt::join(args, " "));
+      std::exit(1);
+    }
+  });
+  posix_spawn_file_actions_destroy(&actions);
+  return h;
+}
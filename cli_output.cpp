@@ -0,0 +1,114 @@
+#include "cli_output.hpp"
+
+#include <json_string.hpp>
+#include <time_format.hpp>
+
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+std::string format_date(RTCWake::sys_seconds tp) {
+  const auto t = static_cast<std::time_t>(tp.time_since_epoch().count());
+  std::tm tm{};
+  if (localtime_r(&t, &tm) == nullptr) {
+    throw std::runtime_error("failed to convert to local time");
+  }
+  char buf[64];
+  return {buf, std::strftime(buf, sizeof(buf), "%a %d %b %X %Z %Y", &tm)};
+}
+
+void print_time(Output out, std::string_view key, RTCWake::sys_seconds tp) {
+  if (out == Output::JSON) {
+    fmt::print("{{\"{}\":{},\"{}_iso\":\"{}\"}}\n", key, Epoch(tp).view(), key,
+               Iso8601(tp).view());
+  } else {
+    fmt::print("{}\n", Epoch(tp).view());
+  }
+}
+
+void print_alarm(RTCWake::AlarmState const &state, Output out) {
+  switch (out) {
+  case Output::JSON:
+    if (state.enabled) {
+      fmt::print("{{\"enabled\":true,\"pending\":{},\"wakeup\":{},"
+                 "\"wakeup_iso\":\"{}\"}}\n",
+                 state.pending, Epoch(state.wakeup).view(),
+                 Iso8601(state.wakeup).view());
+    } else {
+      fmt::print("{{\"enabled\":false,\"pending\":{},\"wakeup\":0,"
+                 "\"wakeup_iso\":null}}\n",
+                 state.pending);
+    }
+    break;
+  case Output::EPOCH:
+    fmt::print("{}\n", state.enabled ? Epoch(state.wakeup).view() : "0");
+    break;
+  case Output::TEXT:
+    if (state.enabled) {
+      fmt::print("alarm: on {}\n", format_date(state.wakeup));
+    } else {
+      fmt::print("alarm: off\n");
+    }
+    break;
+  }
+}
+
+void print_scheduled(RTCWake::ScheduleResult const &res, std::string_view dev,
+                     Output out) {
+  switch (out) {
+  case Output::JSON:
+    fmt::print("{{\"device\":{},\"now\":{},\"now_iso\":\"{}\","
+               "\"wakeup\":{},\"wakeup_iso\":\"{}\"}}\n",
+               json_string(dev), Epoch(res.now).view(), Iso8601(res.now).view(),
+               Epoch(res.wakeup).view(), Iso8601(res.wakeup).view());
+    break;
+  case Output::EPOCH:
+    print_time(out, "wakeup", res.wakeup);
+    break;
+  case Output::TEXT:
+    fmt::print("mrhat-rtcwake: wakeup using /dev/{} at {}\n", dev,
+               format_date(res.wakeup));
+    break;
+  }
+}
+
+void print_coalesced(WakeCoordinator::Batch const &batch, Output out) {
+  switch (out) {
+  case Output::JSON:
+    fmt::print("{{\"coalesced\":true,\"leader\":{},\"halt\":{},"
+               "\"wakeup\":{},\"wakeup_iso\":\"{}\"}}\n",
+               batch.leader, batch.halt, Epoch(batch.wakeup).view(),
+               Iso8601(batch.wakeup).view());
+    break;
+  case Output::EPOCH:
+    print_time(out, "wakeup", batch.wakeup);
+    break;
+  case Output::TEXT:
+    fmt::print("mrhat-rtcwake: coalesced into the wakeup of pid {} at {}\n",
+               batch.leader, format_date(batch.wakeup));
+    break;
+  }
+}
+
+void print_decision(PowerDecision const &decision, Output out) {
+  if (out == Output::TEXT) {
+    fmt::print("mrhat-rtcwake: {} for {}s until wakeup\n",
+               to_string(decision.action), decision.interval.count());
+  } else {
+    fmt::print("{}\n", to_json(decision));
+  }
+}
+
+void print_reconciled(RTCWake::ReconcileResult const &res, Output out) {
+  const bool alarm = res.reason == RTCWake::WakeReason::ALARM;
+  if (out == Output::TEXT) {
+    fmt::print("mrhat-rtcwake: woke by {}{}{}\n", alarm ? "alarm" : "power on",
+               res.cleared ? ", alarm cleared" : "",
+               res.unnotified ? ", reset on halt cleared" : "");
+  } else {
+    fmt::print("{{\"reason\":\"{}\",\"cleared\":{},\"unnotified\":{}}}\n",
+               alarm ? "alarm" : "power_on", res.cleared, res.unnotified);
+  }
+}
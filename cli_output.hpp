@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cost_model.hpp>
+#include <rtcwake.hpp>
+#include <wake_coordinator.hpp>
+
+#include <string>
+#include <string_view>
+
+// Output shared by mrhat-rtcwake and mrhat-rtcwake-min, so both print the
+// same. It is written through stdio, and dates are formatted in the local
+// zone of the C library, which only reads /etc/localtime instead of loading
+// the zone database.
+
+enum class Output { TEXT, JSON, EPOCH };
+
+// e.g. Sun 18 Aug 21:22:32 UTC 2024
+std::string format_date(RTCWake::sys_seconds tp);
+
+// a time in the machine readable formats, text is formatted by the callers
+void print_time(Output out, std::string_view key, RTCWake::sys_seconds tp);
+void print_alarm(RTCWake::AlarmState const &state, Output out);
+void print_scheduled(RTCWake::ScheduleResult const &res, std::string_view dev,
+                     Output out);
+void print_coalesced(WakeCoordinator::Batch const &batch, Output out);
+void print_decision(PowerDecision const &decision, Output out);
+// no dates, so the zone database stays unloaded at boot
+void print_reconciled(RTCWake::ReconcileResult const &res, Output out);
@@ -0,0 +1,163 @@
+#include "cost_model.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace {
+
+using std::chrono::seconds;
+
+constexpr std::array actions{PowerAction::WAIT, PowerAction::SUSPEND,
+                             PowerAction::HALT};
+
+template <typename T>
+T parse_value(std::string_view key, std::string_view val) {
+  T res{};
+  const auto [ptr, ec] =
+      std::from_chars(val.data(), val.data() + val.size(), res);
+  if (val.empty() || ec != std::errc() || ptr != val.data() + val.size() ||
+      res < 0) {
+    throw std::runtime_error(
+        fmt::format("invalid cost model value {}={}", key, val));
+  }
+  return res;
+}
+
+double secs(seconds s) { return static_cast<double>(s.count()); }
+
+std::size_t index(PowerAction action) {
+  return static_cast<std::size_t>(action);
+}
+
+} // namespace
+
+std::string_view to_string(PowerAction action) {
+  switch (action) {
+  case PowerAction::WAIT:
+    return "wait";
+  case PowerAction::SUSPEND:
+    return "suspend";
+  case PowerAction::HALT:
+    return "halt";
+  }
+  return "unknown";
+}
+
+CostProfile parse_cost_profile(std::string_view spec, CostProfile base) {
+  while (!spec.empty()) {
+    const auto comma = spec.find(',');
+    const auto item = spec.substr(0, comma);
+    spec = comma == std::string_view::npos ? "" : spec.substr(comma + 1);
+    const auto eq = item.find('=');
+    if (eq == std::string_view::npos) {
+      throw std::runtime_error(
+          fmt::format("invalid cost model entry {}, expected key=value", item));
+    }
+    const auto key = item.substr(0, eq);
+    const auto val = item.substr(eq + 1);
+    const auto time = [&] { return seconds{parse_value<long>(key, val)}; };
+    const auto power = [&] { return parse_value<double>(key, val); };
+    if (key == "halt") {
+      base.halt_time = time();
+    } else if (key == "boot") {
+      base.boot_time = time();
+    } else if (key == "suspend_time") {
+      base.suspend_time = time();
+    } else if (key == "resume") {
+      base.resume_time = time();
+    } else if (key == "margin") {
+      base.margin = time();
+    } else if (key == "active") {
+      base.active_power = power();
+    } else if (key == "idle") {
+      base.idle_power = power();
+    } else if (key == "off") {
+      base.off_power = power();
+    } else if (key == "suspend") {
+      base.suspend_power = power();
+    } else {
+      throw std::runtime_error(fmt::format("unknown cost model key {}", key));
+    }
+  }
+  return base;
+}
+
+CostProfile learn_cost_profile(std::span<WakeRecord const> records,
+                               CostProfile base) {
+  std::vector<std::int32_t> boots;
+  for (auto const &r : records) {
+    // the value of a boot is how long it took until hctosys ran
+    if (r.kind == WakeRecord::Kind::BOOTED && r.value > 0) {
+      boots.push_back(r.value);
+    }
+  }
+  if (boots.empty()) {
+    return base;
+  }
+  // the median, so an hctosys run long after a boot does not count
+  const auto mid = boots.begin() + static_cast<std::ptrdiff_t>(boots.size() / 2);
+  std::nth_element(boots.begin(), mid, boots.end());
+  std::int64_t median = *mid;
+  if (boots.size() % 2 == 0) {
+    median = (median + *std::max_element(boots.begin(), mid)) / 2;
+  }
+  base.boot_time = seconds{median};
+  return base;
+}
+
+PowerDecision choose_power_action(CostProfile const &p, seconds interval) {
+  PowerDecision res{.action = PowerAction::WAIT, .interval = interval};
+  // every action is accounted until the system is up again after the alarm
+  const auto recovery = std::max(p.boot_time, p.resume_time);
+  const auto t = secs(interval);
+  res.energy[index(PowerAction::WAIT)] =
+      p.idle_power * (t + secs(recovery));
+  if (p.suspend_power && interval >= p.suspend_time + p.margin) {
+    res.energy[index(PowerAction::SUSPEND)] =
+        p.active_power * secs(p.suspend_time) +
+        *p.suspend_power * (t - secs(p.suspend_time)) +
+        p.active_power * secs(p.resume_time) +
+        p.idle_power * secs(recovery - p.resume_time);
+  }
+  if (interval >= p.halt_time + p.margin) {
+    res.energy[index(PowerAction::HALT)] =
+        p.active_power * secs(p.halt_time) +
+        p.off_power * (t - secs(p.halt_time)) +
+        p.active_power * secs(p.boot_time) +
+        p.idle_power * secs(recovery - p.boot_time);
+  }
+  res.action = cheapest(res, actions);
+  return res;
+}
+
+PowerAction cheapest(PowerDecision const &decision,
+                     std::span<PowerAction const> among) {
+  auto res = PowerAction::WAIT;
+  for (const auto action : among) {
+    const auto &e = decision.energy[index(action)];
+    if (e && *e < *decision.energy[index(res)]) {
+      res = action;
+    }
+  }
+  return res;
+}
+
+std::string to_json(PowerDecision const &decision) {
+  std::string res = fmt::format("{{\"action\":\"{}\",\"interval_s\":{},"
+                                "\"energy_j\":{{",
+                                to_string(decision.action),
+                                decision.interval.count());
+  for (const char *sep = ""; const auto action : actions) {
+    const auto &e = decision.energy[index(action)];
+    res += fmt::format("{}\"{}\":{}", std::exchange(sep, ","),
+                       to_string(action),
+                       e ? fmt::format("{:.1f}", *e) : "null");
+  }
+  res += "}}";
+  return res;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <wake_journal.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// How the system spends the time until the wake time
+enum class PowerAction : std::int32_t {
+  // stays up, blocking until the alarm fires
+  WAIT,
+  // suspends to RAM, the alarm resumes it
+  SUSPEND,
+  // halts, the alarm boots it again
+  HALT,
+};
+
+std::string_view to_string(PowerAction action);
+
+// Timings and power draw of the device the wake cycle runs on
+struct CostProfile {
+  // from the request until the system is off, and from the alarm until it
+  // is up again
+  std::chrono::seconds halt_time{15};
+  std::chrono::seconds boot_time{40};
+  std::chrono::seconds suspend_time{2};
+  std::chrono::seconds resume_time{3};
+  // watts while halting, booting, suspending or resuming
+  double active_power = 3.0;
+  double idle_power = 2.0;
+  double off_power = 0.05;
+  // unset if the system cannot suspend
+  std::optional<double> suspend_power;
+  // the system has to be down this long before the alarm, so the wake does
+  // not pass while it is still going down
+  std::chrono::seconds margin{10};
+};
+
+// updates base from a comma separated list of key=value, seconds for halt,
+// boot, suspend_time, resume and margin and watts for active, idle, off and
+// suspend, e.g. "halt=20,boot=45,suspend=0.4". Throws if malformed.
+CostProfile parse_cost_profile(std::string_view spec, CostProfile base = {});
+
+// base with the median boot time measured at the boots recorded in the
+// journal, if there are any
+CostProfile learn_cost_profile(std::span<WakeRecord const> records,
+                               CostProfile base = {});
+
+struct PowerDecision {
+  PowerAction action = PowerAction::WAIT;
+  std::chrono::seconds interval{};
+  // joules each action takes until the system is up again after the alarm,
+  // by PowerAction, unset if the action cannot make it before the wake time
+  std::array<std::optional<double>, 3> energy{};
+};
+
+// the feasible action taking the least energy, preferring the less
+// disruptive one on a tie
+PowerDecision choose_power_action(CostProfile const &profile,
+                                  std::chrono::seconds interval);
+// the feasible action of decision among the given ones taking the least
+// energy, WAIT if none is cheaper
+PowerAction cheapest(PowerDecision const &decision,
+                     std::span<PowerAction const> among);
+
+std::string to_json(PowerDecision const &decision);
@@ -2,8 +2,44 @@
 
 #include <linux/rtc.h>
 
+#include <mrhat_integration.hpp>
+#include <rtc_retry.hpp>
+
+#include <cstddef>
+#include <ctime>
+#include <filesystem>
+#include <initializer_list>
 #include <memory>
 #include <string_view>
+#include <vector>
+
+// rtc_time has the leading fields of struct tm, but not necessarily its
+// layout, so they are copied one by one
+inline rtc_time to_rtc_time(std::tm const &t) noexcept {
+  return rtc_time{.tm_sec = t.tm_sec,
+                  .tm_min = t.tm_min,
+                  .tm_hour = t.tm_hour,
+                  .tm_mday = t.tm_mday,
+                  .tm_mon = t.tm_mon,
+                  .tm_year = t.tm_year,
+                  .tm_wday = t.tm_wday,
+                  .tm_yday = t.tm_yday,
+                  .tm_isdst = t.tm_isdst};
+}
+
+inline std::tm to_tm(rtc_time const &t) noexcept {
+  std::tm res{};
+  res.tm_sec = t.tm_sec;
+  res.tm_min = t.tm_min;
+  res.tm_hour = t.tm_hour;
+  res.tm_mday = t.tm_mday;
+  res.tm_mon = t.tm_mon;
+  res.tm_year = t.tm_year;
+  res.tm_wday = t.tm_wday;
+  res.tm_yday = t.tm_yday;
+  res.tm_isdst = t.tm_isdst;
+  return res;
+}
 
 struct IRTC {
   enum class Clock { LOCAL, UTC, INVALID };
@@ -12,18 +48,35 @@ struct IRTC {
     int port = 0;
     int reg = 0;
     int bit = 0;
+    // written along with the reset on halt bit, in the same request
+    std::vector<RegisterWrite> registers{};
+    // state last written to the daemon, empty to write it every time
+    std::filesystem::path register_cache{};
   };
 
   virtual rtc_time get_time() const = 0;
+  virtual void set_time(rtc_time const &time) = 0;
+  // blocks until the next update interrupt (second boundary) of the RTC and
+  // returns the time read right after the edge
+  virtual rtc_time wait_update() const = 0;
   virtual void set_wakeup(rtc_time const &time) = 0;
   virtual rtc_wkalrm get_wakeup() const = 0;
   virtual void clear_wakeup() = 0;
+  // clears the alarm given its currently armed state, which saves the read
+  // clear_wakeup() needs on drivers that only support read-modify-write
+  virtual void disable_wakeup(rtc_wkalrm const &armed) = 0;
   virtual Clock type() const noexcept = 0;
   virtual std::string_view name() const noexcept = 0;
   virtual bool notify_listener(IntegrationInfo const &info) const noexcept = 0;
   virtual bool
   unnotify_listener(IntegrationInfo const &info) const noexcept = 0;
 
+  // transient ioctl failures are retried according to the policy
+  virtual void set_retry_policy(RetryPolicy const &policy) = 0;
+  virtual RetryStats retry_stats() const noexcept = 0;
+
+  // opens the device, without an adjustment file the clock type is left to
+  // a layer above (see LazyRTC) and the backend reports UTC
   static std::unique_ptr<IRTC> get(std::string_view name,
                                    std::string_view adj = {});
 
@@ -33,8 +86,11 @@ struct IRTC {
 
 struct MockRTC : IRTC {
 
-  virtual void set_time(rtc_time const &time) = 0;
   virtual void wakeup_occured() = 0;
+  // number of ioctls the device backends would have issued for the calls made
+  virtual std::size_t ioctl_count() const noexcept = 0;
+  // the next simulated ioctls fail with the given errnos, 0 lets one succeed
+  virtual void inject_faults(std::initializer_list<int> errnos) = 0;
   static std::unique_ptr<MockRTC> get(std::string_view name,
                                       std::string_view adj = {});
 };
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+// s as a quoted JSON string, for names and paths in the JSON outputs
+inline std::string json_string(std::string_view s) {
+  std::string res = "\"";
+  for (const char c : s) {
+    switch (c) {
+    case '"':
+      res += "\\\"";
+      break;
+    case '\\':
+      res += "\\\\";
+      break;
+    case '\n':
+      res += "\\n";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        res += fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+      } else {
+        res += c;
+      }
+    }
+  }
+  res += '"';
+  return res;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+// HDR style log-linear histogram of latencies in microseconds. Every power of
+// two range is split into 2^sub_bits linear sub-buckets, which bounds the
+// relative error of a recorded value to 1/2^sub_bits over the whole range.
+class LatencyHistogram {
+public:
+  static constexpr unsigned sub_bits = 3;
+  static constexpr std::uint64_t sub_count = 1u << sub_bits;
+  // values are clamped to ~2^36us, which is about 19 hours
+  static constexpr unsigned max_bits = 36;
+  static constexpr std::size_t bucket_count =
+      (max_bits - sub_bits + 1) * sub_count;
+
+  using duration = std::chrono::microseconds;
+
+  // buckets include their upper bound, as the le buckets of Prometheus do
+  static constexpr std::size_t index_of(std::uint64_t us) noexcept {
+    us = std::min<std::uint64_t>(us, std::uint64_t{1} << max_bits);
+    us = us > 0 ? us - 1 : 0;
+    if (us < sub_count) {
+      return us;
+    }
+    const unsigned shift = std::bit_width(us) - 1 - sub_bits;
+    return (shift + 1) * sub_count + ((us >> shift) - sub_count);
+  }
+
+  // inclusive upper bound of the values counted in the bucket at idx
+  static constexpr std::uint64_t upper_bound(std::size_t idx) noexcept {
+    if (idx < sub_count) {
+      return idx + 1;
+    }
+    const auto shift = idx / sub_count - 1;
+    const auto mantissa = idx % sub_count + sub_count;
+    return (mantissa + 1) << shift;
+  }
+
+  void record(std::chrono::nanoseconds d) noexcept {
+    const auto us = std::chrono::duration_cast<duration>(d).count();
+    const auto val = static_cast<std::uint64_t>(std::max<decltype(us)>(us, 0));
+    ++m_buckets[index_of(val)];
+    ++m_count;
+    m_sum += val;
+  }
+
+  void merge(LatencyHistogram const &other) noexcept {
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+  }
+
+  // upper bound of the bucket containing the q-th quantile, q in [0, 1]
+  duration percentile(double q) const noexcept {
+    if (m_count == 0) {
+      return duration{};
+    }
+    const auto rank = std::max<std::uint64_t>(
+        1, static_cast<std::uint64_t>(q * static_cast<double>(m_count) + 0.5));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      seen += m_buckets[i];
+      if (seen >= rank) {
+        return duration{upper_bound(i)};
+      }
+    }
+    return duration{upper_bound(bucket_count - 1)};
+  }
+
+  // number of recorded values up to and including the given bound, exact if
+  // the bound is a bucket boundary, e.g. a power of two
+  std::uint64_t count_at_most(std::uint64_t us) const noexcept {
+    std::uint64_t res = 0;
+    for (std::size_t i = 0; i < bucket_count && upper_bound(i) <= us; ++i) {
+      res += m_buckets[i];
+    }
+    return res;
+  }
+
+  std::uint64_t count() const noexcept { return m_count; }
+  duration sum() const noexcept { return duration(m_sum); }
+  std::array<std::uint64_t, bucket_count> const &buckets() const noexcept {
+    return m_buckets;
+  }
+  std::array<std::uint64_t, bucket_count> &buckets() noexcept {
+    return m_buckets;
+  }
+  void set_totals(std::uint64_t count, std::uint64_t sum_us) noexcept {
+    m_count = count;
+    m_sum = sum_us;
+  }
+
+private:
+  std::array<std::uint64_t, bucket_count> m_buckets{};
+  std::uint64_t m_count = 0;
+  std::uint64_t m_sum = 0;
+};
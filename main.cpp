@@ -1,28 +1,32 @@
 #include <chrono>
 #include <concepts>
-#include <fcntl.h>
-#include <iterator>
 #include <linux/rtc.h>
-#include <sys/ioctl.h>
 #include <system_error>
-#include <unistd.h>
 
 #include <argparse/argparse.hpp>
 #include <fmt/format.h>
 
 #include <algorithm>
-#include <array>
+#include <cstdio>
 #include <ctime>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
-#include <ranges>
-#include <sstream>
 
+#include <cli_output.hpp>
+#include <cost_model.hpp>
 #include <irtc.hpp>
+#include <json_string.hpp>
 #include <mrhat_integration.hpp>
+#include <page_cache.hpp>
+#include <rtc_drift.hpp>
+#include <rtc_multi.hpp>
+#include <rtc_plan.hpp>
 #include <rtc_utils.hpp>
-namespace fs = std::filesystem;
+#include <rtcwake.hpp>
+#include <status_page.hpp>
+#include <time_format.hpp>
+#include <wake_coordinator.hpp>
+#include <wake_journal.hpp>
 
 enum class Verbosity { ERROR = 0, INFO = 1, DEBUG = 2, MAX = DEBUG };
 
@@ -60,17 +64,122 @@ std::unique_ptr<AugmentedParser> get_parser() {
       .default_value("/etc/adjtime"s)
       .help("Specify an alternative path to the adjust file.");
   program->add_argument("-d", "--device")
-      .help("Use the specified device instead of rtc0 as realtime clock.")
+      .help("Use the specified device instead of rtc0 as realtime clock. A "
+            "comma separated list of devices, or all, queries (show), arms "
+            "(no) or disables them concurrently and reports per device.")
       .default_value("rtc0"s);
   program->add_argument("--list-modes")
       .help("List available --mode option arguments.")
       .flag();
   program->add_argument("--mode")
-      .help("Go into the given standby state.")
-      .choices("standby"s, "no"s, "disable"s, "show"s)
+      .help("Go into the given standby state. auto arms the alarm and then "
+            "halts (standby), suspends or waits in-process, whichever takes "
+            "the least energy until the wake time, see --cost-model. "
+            "reconcile is run at boot: it exits 0 if the alarm woke the "
+            "system and 200 after a power-on, and clears the fired alarm and "
+            "the reset on halt bit. calibrate measures the RTC drift against "
+            "the synchronized system clock and writes it to --adjfile.")
+      .choices("standby"s, "no"s, "disable"s, "show"s, "hctosys"s,
+               "systohc"s, "warmup"s, "journal"s, "auto"s, "reconcile"s,
+               "calibrate"s)
       .default_value("standby"s);
+  program->add_argument("--output")
+      .help("Output format of show, the wakeup confirmation and verbose "
+            "times: text, json (UTC) or epoch (seconds since the epoch, 0 if "
+            "the alarm is off). Several devices are always reported in json.")
+      .choices("text"s, "json"s, "epoch"s)
+      .default_value("text"s);
+  program->add_argument("--plan")
+      .help("Print what the invocation would do as JSON instead of doing it: "
+            "the wake time, the RX8130 minute truncation, reset on halt, the "
+            "halt command and the time to halt predicted from the latencies "
+            "recorded in --metrics-file. Runs against a mock RTC set to the "
+            "time read from the device, nothing is armed, signalled or "
+            "halted.")
+      .flag();
+  program->add_argument("--cached")
+      .help("with --mode show, report the alarm state last published to the "
+            "status file instead of querying the device")
+      .flag();
+  program->add_argument("--status-file")
+      .help("Status page the alarm state is published to.")
+      .default_value(std::string(StatusPage::default_path));
+  program->add_argument("--retry-attempts")
+      .help("Attempts made for an RTC ioctl failing with a transient error.")
+      .default_value(5u)
+      .scan<'u', unsigned>();
+  program->add_argument("--retry-deadline")
+      .help("Time in milliseconds spent on retrying the RTC ioctls of "
+            "one operation.")
+      .default_value(2000u)
+      .scan<'u', unsigned>();
+  program->add_argument("--metrics-file")
+      .help("Export RTC call statistics to this Prometheus textfile "
+            "collector file.");
+  program->add_argument("--page-cache-paths")
+      .help("With --mode standby, save the page cache resident ranges of these "
+            "files to --page-cache-index before halting: files, directories "
+            "or pid:<n> for the files mapped by a process.")
+      .nargs(argparse::nargs_pattern::at_least_one);
+  program->add_argument("--page-cache-index")
+      .help("Page cache snapshot saved before halting and read into the page "
+            "cache by --mode warmup.")
+      .default_value("/var/lib/mrhat-rtcwake/page-cache.idx"s);
+  program->add_argument("--page-cache-threads")
+      .help("Files read in parallel by --mode warmup.")
+      .default_value(4u)
+      .scan<'u', unsigned>();
+  program->add_argument("--journal")
+      .help("Wake journal arming, clearing, halting and booting (hctosys) are "
+            "recorded to, and read by --mode journal.")
+      .default_value(std::string(WakeJournal::default_path));
+  program->add_argument("--cost-model")
+      .help("Cost model of --mode auto as comma separated key=value: seconds "
+            "for halt, boot, suspend_time, resume and margin, watts for "
+            "active, idle, off and suspend (unset if the system cannot "
+            "suspend). The boot time defaults to the median of the boots "
+            "recorded in --journal.");
+  program->add_argument("--calibrate-duration")
+      .help("Seconds --mode calibrate samples the RTC for, the longer the "
+            "more accurate the drift.")
+      .default_value(3600u)
+      .scan<'u', unsigned>();
+  program->add_argument("--calibrate-interval")
+      .help("Seconds between the samples of --mode calibrate.")
+      .default_value(10u)
+      .scan<'u', unsigned>();
+#ifdef MRHAT_RTCWAKE_MOCK_DEVICE
+  // lets the end to end gates stand in for halting, never in device builds
+  program->add_argument("--poweroff")
+      .help("Command exec'd with --halt to halt the system.")
+      .default_value("/usr/sbin/poweroff"s);
+#endif
+  program->add_argument("--lock-file")
+      .help("Lock file serializing concurrent invocations arming (no) or "
+            "halting (standby), used if given or with --coalesce-window, "
+            "empty to not coordinate them. Arming is not coordinated if it "
+            "cannot be opened.")
+      .default_value(std::string(WakeCoordinator::default_path));
+  program->add_argument("--coalesce-window")
+      .help("Milliseconds an invocation waits for concurrent ones to join "
+            "its request: the earliest wake time of them is armed, and only "
+            "it signals mrhat-daemon and halts if any of them asked to.")
+      .default_value(0u)
+      .scan<'u', unsigned>();
+  program->add_argument("--spread")
+      .help("Minutes the wake time is delayed by at most: each board wakes at "
+            "its own offset in whole minutes within the window, derived from "
+            "--spread-id, so a fleet given the same wake time does not wake "
+            "at once.")
+      .default_value(0u)
+      .scan<'u', unsigned>();
+  program->add_argument("--spread-id")
+      .help("Identity the --spread offset is derived from, defaults to "
+            "/etc/machine-id.");
   program->add_argument("-f", "--force")
-      .help("use --force flag when entering the specified mode")
+      .help("use --force flag when entering the specified mode, with "
+            "--mode calibrate calibrate against an unsynchronized system "
+            "clock")
       .flag();
   program->add_argument("--mrhat-daemon-port")
       .help("Listen port of mrhat-daemon to signal reset on halt at.")
@@ -82,6 +191,16 @@ std::unique_ptr<AugmentedParser> get_parser() {
       .help(
           "Reset action bit in the reset action register on the MrHat device.")
       .default_value(0);
+  program->add_argument("--register-cache")
+      .help("Register bits last written to mrhat-daemon, valid until the "
+            "next boot or daemon restart. Writes the daemon already holds "
+            "are skipped, empty to write them every time.")
+      .default_value(std::string(default_register_cache_path));
+  program->add_argument("--mrhat-register")
+      .help("Further MCU register bits written as reg/bit/value along with "
+            "the reset on halt bit before halting, e.g. 9/2/1. All of them "
+            "are written in one request, or none is.")
+      .nargs(argparse::nargs_pattern::at_least_one);
   auto &date_group = program->add_mutually_exclusive_group();
   date_group.add_argument("--date").help(
       "Set the wakeup time to the value of the timestamp.");
@@ -89,66 +208,215 @@ std::unique_ptr<AugmentedParser> get_parser() {
       .help("Set the wakeup time to seconds in the future from now.");
   date_group.add_argument("-t", "--time")
       .help("Set the wakeup time to the absolute time time_t.");
+  program->add_argument("--dst")
+      .help("With --date, the instant a local time skipped or repeated by a "
+            "daylight saving transition resolves to: earliest or latest.")
+      .choices("earliest"s, "latest"s)
+      .default_value("earliest"s);
   return std::move(parser);
 }
 
-std::string read_adjfile(fs::path adjfile) {
-  if (!fs::exists(adjfile) || !fs::is_regular_file(adjfile)) {
-    throw std::runtime_error(fmt::format(
-        "adjustment file {} non-existent or non-regular", adjfile.c_str()));
+std::optional<RTCWake::WakeSpec>
+get_wake_spec(argparse::ArgumentParser const &parser) {
+  using Kind = RTCWake::WakeSpec::Kind;
+  if (parser.is_used("--date")) {
+    const auto dst = parser.get<std::string>("--dst") == "latest"
+                         ? TransitionTable::Choose::LATEST
+                         : TransitionTable::Choose::EARLIEST;
+    return RTCWake::WakeSpec{Kind::DATE, parser.get<std::string>("--date"),
+                             dst};
   }
-  std::ifstream ifs(adjfile);
-  if (!ifs) {
-    throw std::runtime_error(
-        fmt::format("failed to read adjustment file {}", adjfile.c_str()));
+  if (parser.is_used("--seconds")) {
+    return RTCWake::WakeSpec{Kind::SECONDS,
+                             parser.get<std::string>("--seconds")};
   }
+  if (parser.is_used("--time")) {
+    return RTCWake::WakeSpec{Kind::TIME, parser.get<std::string>("--time")};
+  }
+  return {};
+}
 
-  std::stringstream buff;
-  buff << ifs.rdbuf();
-  return buff.str();
+RTCWake::Options get_options(AugmentedParser const &aug_parser) {
+  auto const &parser = aug_parser.parser;
+  RTCWake::Options opts{};
+  opts.device = parser.get<std::string>("--device");
+  opts.adjfile = parser.get<std::string>("--adjfile");
+  opts.status_file = parser.get<std::string>("--status-file");
+  if (parser.is_used("--metrics-file")) {
+    opts.metrics_file = parser.get<std::string>("--metrics-file");
+  }
+  opts.retry.max_attempts = parser.get<unsigned>("--retry-attempts");
+  opts.retry.deadline =
+      std::chrono::milliseconds{parser.get<unsigned>("--retry-deadline")};
+  opts.integration = {parser.get<int>("--mrhat-daemon-port"),
+                      parser.get<int>("--rst-action-register"),
+                      parser.get<int>("--rst-action-bit")};
+  opts.integration.register_cache = parser.get<std::string>("--register-cache");
+  if (parser.is_used("--mrhat-register")) {
+    for (auto const &spec :
+         parser.get<std::vector<std::string>>("--mrhat-register")) {
+      opts.integration.registers.push_back(parse_register_write(spec));
+    }
+  }
+  if (parser.is_used("--page-cache-paths")) {
+    opts.page_cache_paths =
+        parser.get<std::vector<std::string>>("--page-cache-paths");
+    check_cache_specs(opts.page_cache_paths);
+    opts.page_cache_index = parser.get<std::string>("--page-cache-index");
+  }
+  opts.journal_file = parser.get<std::string>("--journal");
+  opts.spread_window = std::chrono::minutes{parser.get<unsigned>("--spread")};
+  if (parser.is_used("--spread-id")) {
+    opts.spread_identity = parser.get<std::string>("--spread-id");
+  }
+#ifdef MRHAT_RTCWAKE_MOCK_DEVICE
+  opts.poweroff = parser.get<std::string>("--poweroff");
+#endif
+  opts.force = parser["--force"] == true;
+  opts.verbose = aug_parser.verbosity > 0;
+  return opts;
 }
 
-std::optional<rtc_time> get_date_spec(argparse::ArgumentParser const &parser,
-                                      IRTC const &rtc, rtc_time tm_now) {
-  if (parser.is_used("--date")) {
-    const auto d = parser.get<std::string>("--date");
-    return resolve_parsed_time(parse_time(d), rtc, tm_now);
+Output get_output(argparse::ArgumentParser const &parser) {
+  const auto out = parser.get<std::string>("--output");
+  return out == "json" ? Output::JSON
+         : out == "epoch" ? Output::EPOCH
+                          : Output::TEXT;
+}
+
+// exit code of --mode reconcile after a power-on, above the errno values
+// errors exit with
+constexpr int exit_power_on = 200;
+
+// the boot time measured at the recorded boots, overridden by --cost-model
+CostProfile get_cost_profile(argparse::ArgumentParser const &parser) {
+  const auto records =
+      read_wake_journal(parser.get<std::string>("--journal"));
+  auto profile = learn_cost_profile(records);
+  if (parser.is_used("--cost-model")) {
+    profile =
+        parse_cost_profile(parser.get<std::string>("--cost-model"), profile);
   }
-  if (parser.is_used("--seconds")) {
-    const auto secs = parser.get<std::string>("--seconds");
-    std::string_view s(secs);
-    const auto val = parse_chars<unsigned long>(s.begin(), s.end());
-    return resolve_parsed_time(std::chrono::seconds{val}, rtc, tm_now);
+  return profile;
+}
+
+// spends the time until the armed wakeup as decided by --mode auto, halting
+// is left to the standby path
+void await_wakeup(RTCWake &wake, PowerAction action,
+                  RTCWake::sys_seconds wakeup) {
+  if (action == PowerAction::SUSPEND) {
+    std::fflush(stdout);
+    if (const int error = wake.suspend(); error != 0) {
+      throw std::system_error(error, std::generic_category(),
+                              "failed to suspend");
+    }
+  } else if (action == PowerAction::WAIT) {
+    wake.wait_until(wakeup);
   }
-  if (parser.is_used("--time")) {
-    const auto t = parser.get<std::string>("--time");
-    std::string_view tsv(t);
-    const auto val = parse_chars<std::time_t>(tsv.begin(), tsv.end());
-    return sys_to_rtc(std::chrono::system_clock::from_time_t(val), rtc);
+}
+
+// handles several devices concurrently, printing a JSON report
+int run_multi_device(std::vector<std::string> const &devices,
+                     std::string const &mode,
+                     AugmentedParser const &aug_parser) {
+  using namespace std::literals;
+  if (aug_parser.parser["--plan"] == true) {
+    throw std::runtime_error("--plan is not supported with several devices");
   }
-  return {};
+  MultiDevice multi(devices, get_options(aug_parser));
+  const auto wake_spec = get_wake_spec(aug_parser.parser);
+  MultiDeviceReport report;
+  if (mode == "show"s) {
+    report = multi.query();
+  } else if (mode == "disable"s) {
+    report = multi.disable();
+  } else if (mode == "no"s && wake_spec.has_value()) {
+    report = multi.arm(*wake_spec);
+  } else if (mode == "no"s) {
+    throw std::runtime_error(
+        "must provide wake time (see --seconds, --time and --date options)");
+  } else {
+    throw std::runtime_error(fmt::format(
+        "--mode {} is not supported with several devices", mode));
+  }
+  std::cout << to_json(report) << '\n';
+  return report.ok() ? 0 : -1;
 }
 
-template <typename T>
-concept String = std::convertible_to<T, std::string>;
-
-template <String Prog, String... Args>
-auto do_exec(Prog &&prog, Args &&...args) {
-  std::string ps(std::forward<Prog>(prog));
-  std::array as = {std::string(std::forward<Args>(args))...};
-  char *execargs[sizeof...(Args) + 2] = {};
-  execargs[0] = ps.data();
-  namespace rg = std::ranges;
-  namespace rgv = std::ranges::views;
-  auto cstr = as | rgv::transform([](auto &s) { return s.data(); });
-  auto cr =
-      rg::copy(rg::begin(cstr), rg::end(cstr), std::next(rg::begin(execargs)));
-  *cr.out = nullptr;
-  execv(ps.c_str(), execargs);
-  return errno;
+// boot time replay of the page cache snapshot, nothing to do if no snapshot
+// was taken yet
+int warmup(argparse::ArgumentParser const &parser, bool verbose) {
+  const std::filesystem::path index_path =
+      parser.get<std::string>("--page-cache-index");
+  if (!std::filesystem::exists(index_path)) {
+    if (verbose) {
+      std::cout << "no page cache snapshot at " << index_path.string()
+                << '\n';
+    }
+    return 0;
+  }
+  const auto stats =
+      replay_page_cache(read_page_cache_index(index_path),
+                        parser.get<unsigned>("--page-cache-threads"));
+  if (verbose) {
+    fmt::print("read ahead {} bytes in {} ranges of {} files, {} missing\n",
+               stats.bytes, stats.ranges, stats.files, stats.missing);
+  }
+  return 0;
 }
 
-auto format_date(auto d) { return date::format("%a %d %b %X %Z %Y", d); }
+// the recorded wake cycles and how accurately the alarms woke the system
+int print_journal(std::filesystem::path const &path, Output out) {
+  const auto records = read_wake_journal(path);
+  const auto summary = summarize(records);
+  if (out == Output::JSON) {
+    std::cout << to_json(records, summary) << '\n';
+    return 0;
+  }
+  auto sys = [](std::int64_t t) {
+    return RTCWake::sys_seconds{std::chrono::seconds{t}};
+  };
+  for (auto const &r : records) {
+    fmt::print("{:>6} {} {:<11}", r.seq, Iso8601(sys(r.at)).view(),
+               to_string(r.kind));
+    switch (r.kind) {
+    case WakeRecord::Kind::ARMED:
+      fmt::print(" wakeup {}", Iso8601(sys(r.wakeup)).view());
+      break;
+    case WakeRecord::Kind::NOTIFIED:
+      fmt::print(" {}", r.value != 0 ? "acknowledged" : "not acknowledged");
+      break;
+    case WakeRecord::Kind::HALT_FAILED:
+      fmt::print(" {}", std::generic_category().message(r.value));
+      break;
+    case WakeRecord::Kind::DECIDED:
+      fmt::print(" {} until {}", to_string(static_cast<PowerAction>(r.value)),
+                 Iso8601(sys(r.wakeup)).view());
+      break;
+    case WakeRecord::Kind::RECONCILED:
+      fmt::print(" {}{}",
+                 r.value & WakeRecord::reconciled_alarm ? "alarm" : "power on",
+                 r.value & WakeRecord::reconciled_notified
+                     ? ", reset on halt still set"
+                     : "");
+      break;
+    default:
+      break;
+    }
+    fmt::print("\n");
+  }
+  fmt::print("{} records, {} armed, {} wakes, {} other boots, {} notify "
+             "failures, {} halt failures\n",
+             summary.records, summary.armed, summary.wakes,
+             summary.other_boots, summary.notify_failures,
+             summary.halt_failures);
+  if (summary.wakes != 0) {
+    fmt::print("boot minus wake time: mean {}s, min {}s, max {}s\n",
+               summary.mean_error.count(), summary.min_error.count(),
+               summary.max_error.count());
+  }
+  return 0;
+}
 
 int main(int argc, char *argv[]) try {
   using namespace std::literals;
@@ -159,62 +427,200 @@ int main(int argc, char *argv[]) try {
   const auto verbose = verbosity(aug_parser.verbosity);
 
   if (parser["--list-modes"] == true) {
-    std::cout << "standby no disable show\n";
+    std::cout
+        << "standby no disable show hctosys systohc warmup journal auto "
+           "reconcile calibrate\n";
     return 0;
   }
 
-  auto rtc = IRTC::get(parser.get<std::string>("--device"),
-                       read_adjfile(parser.get<std::string>("--adjfile")));
+  const auto mode = parser.get<std::string>("--mode");
+  const auto output = get_output(parser);
+  if (mode == "show"s && parser["--cached"] == true &&
+      parser["--plan"] == false) {
+    // falls through to querying the device if nothing was published yet
+    if (const auto state =
+            RTCWake::show_cached(parser.get<std::string>("--status-file"))) {
+      print_alarm(*state, output);
+      return 0;
+    }
+  }
 
-  const auto rtctime = rtc->get_time();
-  const auto datespec = get_date_spec(parser, *rtc, rtctime);
+  if (mode == "warmup"s) {
+    return warmup(parser, pparser->verbosity > 0);
+  }
+  if (mode == "journal"s) {
+    return print_journal(parser.get<std::string>("--journal"), output);
+  }
 
-  if (pparser->verbosity) {
-    std::cout << "Current RTC time is(local):"
-              << format_date(rtc_to_zoned(rtctime, *rtc)) << '\n';
+  const auto device_arg = parser.get<std::string>("--device");
+  const auto devices = parse_device_list(device_arg);
+  if (devices.size() > 1 || device_arg == "all"s) {
+    return run_multi_device(devices, mode, aug_parser);
   }
-  const auto mode = parser.get<std::string>("--mode");
-  if (mode == "show"s) {
-    auto wktime = rtc->get_wakeup();
-    if (wktime.enabled) {
-      std::cout << "alarm: on " << format_date(rtc_to_zoned(wktime.time, *rtc))
-                << '\n';
+
+  auto opts = get_options(aug_parser);
+  opts.device = devices.front();
+  std::optional<DryRun> dry_run;
+  if (parser["--plan"] == true) {
+    if (mode == "hctosys"s || mode == "systohc"s || mode == "reconcile"s ||
+        mode == "calibrate"s) {
+      throw std::runtime_error(
+          fmt::format("--plan is not supported with --mode {}", mode));
+    }
+    dry_run.emplace(opts);
+  }
+  // the device, adjfile and zone database are only touched once needed
+  RTCWake wake(dry_run ? dry_run->options() : std::move(opts),
+               dry_run ? dry_run->backend()
+                       : [](std::string const &device) {
+                           return IRTC::get(device);
+                         });
+
+  if (mode == "reconcile"s) {
+    const auto res = wake.reconcile();
+    if (pparser->verbosity) {
+      print_reconciled(res, output);
+    }
+    return res.reason == RTCWake::WakeReason::ALARM ? 0 : exit_power_on;
+  } else if (mode == "hctosys"s) {
+    const auto systime =
+        std::chrono::floor<std::chrono::seconds>(wake.hctosys());
+    if (pparser->verbosity && output != Output::TEXT) {
+      print_time(output, "system_time", systime);
+    } else if (pparser->verbosity) {
+      fmt::print("System time set from RTC to(local):{}\n",
+                 format_date(systime));
+    }
+    return 0;
+  } else if (mode == "calibrate"s) {
+    const auto res = wake.calibrate(
+        {.duration = std::chrono::seconds{
+             parser.get<unsigned>("--calibrate-duration")},
+         .interval = std::chrono::seconds{
+             parser.get<unsigned>("--calibrate-interval")}});
+    if (output != Output::TEXT) {
+      std::cout << to_json(res) << '\n';
     } else {
-      std::cout << "alarm: off\n";
+      fmt::print("mrhat-rtcwake: RTC drift {:+.3f} s/day ({:+.2f} +/- {:.2f} "
+                 "ppm) over {} samples, written to {}\n",
+                 res.seconds_per_day(), res.ppm(), res.rate_error * 1e6,
+                 res.samples, parser.get<std::string>("--adjfile"));
     }
     return 0;
-  } else if (mode == "disable"s) {
-    rtc->clear_wakeup();
+  } else if (mode == "systohc"s) {
+    const auto rtctime = wake.systohc();
+    const auto secs = std::chrono::floor<std::chrono::seconds>(
+        rtc_to_sys(rtctime, wake.rtc()));
+    if (pparser->verbosity && output != Output::TEXT) {
+      print_time(output, "rtc_time", secs);
+    } else if (pparser->verbosity) {
+      fmt::print("RTC time set from system clock to(local):{}\n",
+                 format_date(secs));
+    }
     return 0;
-  } else if (datespec.has_value() && (mode == "no"s || mode == "standby"s)) {
-    if (rtc_to_zoned(*datespec, *rtc).get_local_time() <=
-        rtc_to_zoned(rtctime, *rtc).get_local_time()) {
-      throw std::runtime_error("wakeup time is in the past or now");
-    }
-    rtc->set_wakeup(*datespec);
-    std::cout << fmt::format("mrhat-rtcwake: wakeup using /dev/{} at ",
-                             rtc->name())
-              << format_date(rtc_to_zoned(*datespec, *rtc)) << '\n';
-    if (mode != "no") {
-      IRTC::IntegrationInfo const info{parser.get<int>("--mrhat-daemon-port"),
-                                       parser.get<int>("--rst-action-register"),
-                                       parser.get<int>("--rst-action-bit")};
-      bool const notified = rtc->notify_listener(info);
-      const auto err = parser["--force"] == true
-                           ? do_exec("/usr/sbin/poweroff", "--halt", "--force")
-                           : do_exec("/usr/sbin/poweroff", "--halt");
-
-      // if do_exec does not fail we shouldn't be here, so we know that an error
-      // occurred and the reset on halt bit
-      if (notified) {
-        rtc->unnotify_listener(info);
+  }
+
+  // the plan is the only output of a dry run
+  const bool print = !dry_run.has_value();
+  if (print && pparser->verbosity) {
+    auto &rtc = wake.rtc();
+    const auto now = std::chrono::floor<std::chrono::seconds>(
+        rtc_to_sys(rtc.get_time(), rtc));
+    if (output != Output::TEXT) {
+      print_time(output, "rtc_time", now);
+    } else {
+      fmt::print("Current RTC time is(local):{}\n", format_date(now));
+    }
+  }
+  const auto wake_spec = get_wake_spec(parser);
+  // coordinating takes a coalescing window or a lock file given explicitly,
+  // a dry run has nothing to coordinate
+  const auto lock_file = parser.get<std::string>("--lock-file");
+  const std::chrono::milliseconds window{
+      parser.get<unsigned>("--coalesce-window")};
+  std::unique_ptr<WakeCoordinator> coordinator;
+  if (wake_spec && !dry_run && !lock_file.empty() &&
+      (window.count() > 0 || parser.is_used("--lock-file"))) {
+    coordinator = open_coordinator(lock_file, window);
+  }
+  const bool coordinate = coordinator != nullptr;
+  const bool choose = mode == "auto"s && wake_spec.has_value();
+  // a coordinated request decides for the wake time of its batch instead
+  DecideAction decide;
+  if (choose) {
+    decide = [&, profile = get_cost_profile(parser)](
+                 RTCWake::sys_seconds wakeup) {
+      const auto decision = wake.choose_action(wakeup, profile);
+      if (print && pparser->verbosity) {
+        print_decision(decision, output);
       }
-      throw std::system_error(err, std::generic_category());
+      return decision;
+    };
+  }
+  std::optional<PowerDecision> decision;
+  if (choose && !coordinate) {
+    decision = decide(wake.resolve(*wake_spec));
+  }
+  // auto arms as no or standby, depending on the decision
+  const auto arm_mode = !decision                                ? mode
+                        : decision->action == PowerAction::HALT ? "standby"s
+                                                                 : "no"s;
+  const bool arming = wake_spec.has_value() &&
+                      (arm_mode == "no"s || arm_mode == "standby"s || choose);
+  if (mode == "show"s) {
+    const auto state = wake.show();
+    if (print) {
+      print_alarm(state, output);
     }
-    return 0;
+  } else if (mode == "disable"s) {
+    wake.disable();
+  } else if (arming && coordinate) {
+    const auto res = schedule_coalesced(
+        wake, *coordinator, *wake_spec, arm_mode == "standby"s,
+        [&](RTCWake::ScheduleResult const &scheduled) {
+          print_scheduled(scheduled, wake.rtc().name(), output);
+          // poweroff replaces the process, buffered output would be lost
+          std::fflush(stdout);
+        },
+        decide);
+    if (res.batch.role == WakeCoordinator::Batch::Role::FOLLOWER) {
+      print_coalesced(res.batch, output);
+    }
+    if (res.halted) {
+      throw std::system_error(res.halted->error, std::generic_category());
+    }
+    if (res.decision) {
+      await_wakeup(wake, res.decision->action, res.batch.wakeup);
+    }
+  } else if (arming) {
+    const auto scheduled = wake.schedule(*wake_spec);
+    if (print) {
+      print_scheduled(scheduled, wake.rtc().name(), output);
+    } else {
+      dry_run->scheduled(scheduled);
+    }
+    if (decision && !dry_run) {
+      await_wakeup(wake, decision->action, scheduled.wakeup);
+    }
+    if (arm_mode != "no") {
+      // poweroff replaces the process, buffered output would be lost
+      std::fflush(stdout);
+      // if halting does not fail we shouldn't be here, so we know that an
+      // error occurred and the reset on halt bit has been cleared, unless
+      // halting was only recorded by the dry run
+      const auto halted = wake.halt();
+      if (!dry_run) {
+        throw std::system_error(halted.error, std::generic_category());
+      }
+    }
+  } else {
+    throw std::runtime_error(
+        "must provide wake time (see --seconds, --time and --date options)");
+  }
+  if (dry_run) {
+    std::cout << to_json(dry_run->plan(arm_mode)) << '\n';
   }
-  throw std::runtime_error(
-      "must provide wake time (see --seconds, --time and --date options)");
+  return 0;
 
 } catch (std::system_error const &e) {
   std::cerr << "mrhat-rtcwake: " << e.what() << '\n';
@@ -0,0 +1,367 @@
+// Minimal footprint variant of mrhat-rtcwake for the modes run on every boot
+// and shutdown. It takes the same options and exits with the same codes, but
+// parses them with a table instead of argparse, writes through stdio instead
+// of iostream, and prints dates in the local zone of the C library, so the
+// zone database is only loaded for absolute --date values and mrhat-daemon is
+// only contacted when halting or reconciling. The other modes and options are
+// left to mrhat-rtcwake.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <cli_output.hpp>
+#include <irtc.hpp>
+#include <json_string.hpp>
+#include <mrhat_integration.hpp>
+#include <rtc_utils.hpp>
+#include <rtcwake.hpp>
+#include <status_page.hpp>
+#include <time_format.hpp>
+#include <wake_coordinator.hpp>
+#include <wake_journal.hpp>
+
+namespace {
+
+constexpr auto modes = "standby no disable show hctosys systohc reconcile";
+
+// exit code of --mode reconcile after a power-on, as in mrhat-rtcwake
+constexpr int exit_power_on = 200;
+
+struct Args {
+  int verbosity = 0;
+  bool force = false;
+  bool cached = false;
+  bool list_modes = false;
+  bool lock_file_given = false;
+  std::string mode = "standby";
+  std::string output = "text";
+  std::string adjfile = "/etc/adjtime";
+  std::string device = "rtc0";
+  std::string status_file = StatusPage::default_path;
+  std::string journal = WakeJournal::default_path;
+  std::string poweroff = "/usr/sbin/poweroff";
+  std::string lock_file = WakeCoordinator::default_path;
+  std::string register_cache = default_register_cache_path;
+  std::string spread_id;
+  std::string dst = "earliest";
+  std::string retry_attempts = "5";
+  std::string retry_deadline = "2000";
+  std::string coalesce_window = "0";
+  std::string spread = "0";
+  std::string port = "9000";
+  std::string rst_action_register = "8";
+  std::string rst_action_bit = "0";
+  std::vector<std::string> registers;
+  std::optional<RTCWake::WakeSpec> wake_spec;
+};
+
+struct ValueOption {
+  std::string_view name;
+  std::string_view short_name;
+  std::string Args::*value;
+};
+
+constexpr ValueOption value_options[] = {
+    {"--mode", "", &Args::mode},
+    {"--output", "", &Args::output},
+    {"--adjfile", "-A", &Args::adjfile},
+    {"--device", "-d", &Args::device},
+    {"--status-file", "", &Args::status_file},
+    {"--journal", "", &Args::journal},
+#ifdef MRHAT_RTCWAKE_MOCK_DEVICE
+    {"--poweroff", "", &Args::poweroff},
+#endif
+    {"--lock-file", "", &Args::lock_file},
+    {"--register-cache", "", &Args::register_cache},
+    {"--spread-id", "", &Args::spread_id},
+    {"--dst", "", &Args::dst},
+    {"--retry-attempts", "", &Args::retry_attempts},
+    {"--retry-deadline", "", &Args::retry_deadline},
+    {"--coalesce-window", "", &Args::coalesce_window},
+    {"--spread", "", &Args::spread},
+    {"--mrhat-daemon-port", "", &Args::port},
+    {"--rst-action-register", "", &Args::rst_action_register},
+    {"--rst-action-bit", "", &Args::rst_action_bit},
+};
+
+void usage() {
+  fmt::print("Usage: mrhat-rtcwake-min [--help] [--version] [--verbose]... "
+             "[--adjfile VAR] [--device VAR] [--list-modes] [--mode VAR] "
+             "[--output VAR] [--force] [[--date VAR]|[--seconds VAR]|[--time "
+             "VAR]]\n\n"
+             "The frequent modes of mrhat-rtcwake ({}) with its options, "
+             "see mrhat-rtcwake --help.\n",
+             modes);
+}
+
+template <typename T> T to_number(std::string_view name, std::string_view s) {
+  T val{};
+  const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), val);
+  if (ec != std::errc() || ptr != s.data() + s.size()) {
+    throw std::runtime_error(fmt::format("invalid value for {}: {}", name, s));
+  }
+  return val;
+}
+
+void set_wake_spec(Args &args, RTCWake::WakeSpec::Kind kind,
+                   std::string value) {
+  if (args.wake_spec) {
+    throw std::runtime_error(
+        "--date, --seconds and --time are mutually exclusive");
+  }
+  args.wake_spec = RTCWake::WakeSpec{kind, std::move(value)};
+}
+
+// returns nullopt if the invocation is done, e.g. after --help
+std::optional<Args> parse_args(int argc, char *argv[]) {
+  using Kind = RTCWake::WakeSpec::Kind;
+  Args args;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    std::optional<std::string_view> inline_value;
+    if (const auto eq = arg.find('='); arg.starts_with("--") &&
+                                       eq != std::string_view::npos) {
+      inline_value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    }
+    const auto value = [&]() -> std::string {
+      if (inline_value) {
+        return std::string(*inline_value);
+      }
+      if (i + 1 >= argc) {
+        throw std::runtime_error(fmt::format("{}: expected a value", arg));
+      }
+      return argv[++i];
+    };
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return std::nullopt;
+    }
+    if (arg == "--version") {
+      fmt::print("{}\n", MRHATRTCWAKE_VER);
+      return std::nullopt;
+    }
+    if (arg == "-v" || arg == "--verbose") {
+      ++args.verbosity;
+    } else if (arg == "-f" || arg == "--force") {
+      args.force = true;
+    } else if (arg == "--cached") {
+      args.cached = true;
+    } else if (arg == "--list-modes") {
+      args.list_modes = true;
+    } else if (arg == "--date") {
+      set_wake_spec(args, Kind::DATE, value());
+    } else if (arg == "-s" || arg == "--seconds") {
+      set_wake_spec(args, Kind::SECONDS, value());
+    } else if (arg == "-t" || arg == "--time") {
+      set_wake_spec(args, Kind::TIME, value());
+    } else if (arg == "--mrhat-register") {
+      // one or more values, up to the next option
+      args.registers.push_back(value());
+      while (i + 1 < argc && argv[i + 1][0] != '-') {
+        args.registers.emplace_back(argv[++i]);
+      }
+    } else {
+      const auto *opt = std::find_if(
+          std::begin(value_options), std::end(value_options),
+          [&](auto const &o) {
+            return o.name == arg || (!o.short_name.empty() &&
+                                     o.short_name == arg);
+          });
+      if (opt == std::end(value_options)) {
+        throw std::runtime_error(fmt::format(
+            "{}: unknown option, or only supported by mrhat-rtcwake", arg));
+      }
+      args.*(opt->value) = value();
+      args.lock_file_given |= opt->value == &Args::lock_file;
+    }
+  }
+  if (args.output != "text" && args.output != "json" &&
+      args.output != "epoch") {
+    throw std::runtime_error(
+        fmt::format("invalid value for --output: {}", args.output));
+  }
+  if (args.dst != "earliest" && args.dst != "latest") {
+    throw std::runtime_error(
+        fmt::format("invalid value for --dst: {}", args.dst));
+  }
+  if (args.wake_spec && args.wake_spec->kind == Kind::DATE) {
+    args.wake_spec->dst = args.dst == "latest"
+                              ? TransitionTable::Choose::LATEST
+                              : TransitionTable::Choose::EARLIEST;
+  }
+  return args;
+}
+
+RTCWake::Options get_options(Args const &args) {
+  RTCWake::Options opts{};
+  opts.device = args.device;
+  opts.adjfile = args.adjfile;
+  opts.status_file = args.status_file;
+  opts.retry.max_attempts =
+      to_number<unsigned>("--retry-attempts", args.retry_attempts);
+  opts.retry.deadline = std::chrono::milliseconds{
+      to_number<unsigned>("--retry-deadline", args.retry_deadline)};
+  opts.integration = {
+      to_number<int>("--mrhat-daemon-port", args.port),
+      to_number<int>("--rst-action-register", args.rst_action_register),
+      to_number<int>("--rst-action-bit", args.rst_action_bit)};
+  opts.integration.register_cache = args.register_cache;
+  for (auto const &spec : args.registers) {
+    opts.integration.registers.push_back(parse_register_write(spec));
+  }
+  opts.journal_file = args.journal;
+  opts.poweroff = args.poweroff;
+  opts.spread_window =
+      std::chrono::minutes{to_number<unsigned>("--spread", args.spread)};
+  opts.spread_identity = args.spread_id;
+  opts.force = args.force;
+  opts.verbose = args.verbosity > 0;
+  return opts;
+}
+
+int run(Args const &args) {
+  const auto output = args.output == "json"    ? Output::JSON
+                      : args.output == "epoch" ? Output::EPOCH
+                                               : Output::TEXT;
+  const auto &mode = args.mode;
+  if (mode == "show" && args.cached) {
+    if (const auto state = RTCWake::show_cached(args.status_file)) {
+      print_alarm(*state, output);
+      return 0;
+    }
+  }
+  if (mode != "standby" && mode != "no" && mode != "disable" &&
+      mode != "show" && mode != "hctosys" && mode != "systohc" &&
+      mode != "reconcile") {
+    throw std::runtime_error(fmt::format(
+        "--mode {} is only supported by mrhat-rtcwake", mode));
+  }
+  if (args.device.find(',') != std::string::npos || args.device == "all") {
+    throw std::runtime_error(
+        "several devices are only supported by mrhat-rtcwake");
+  }
+
+  RTCWake wake(get_options(args));
+  if (mode == "reconcile") {
+    const auto res = wake.reconcile();
+    if (args.verbosity) {
+      print_reconciled(res, output);
+    }
+    return res.reason == RTCWake::WakeReason::ALARM ? 0 : exit_power_on;
+  }
+  if (mode == "hctosys") {
+    const auto systime = wake.hctosys();
+    const auto secs = std::chrono::floor<std::chrono::seconds>(systime);
+    if (args.verbosity && output != Output::TEXT) {
+      print_time(output, "system_time", secs);
+    } else if (args.verbosity) {
+      fmt::print("System time set from RTC to(local):{}\n",
+                 format_date(secs));
+    }
+    return 0;
+  }
+  if (mode == "systohc") {
+    const auto rtctime = wake.systohc();
+    const auto secs = std::chrono::floor<std::chrono::seconds>(
+        rtc_to_sys(rtctime, wake.rtc()));
+    if (args.verbosity && output != Output::TEXT) {
+      print_time(output, "rtc_time", secs);
+    } else if (args.verbosity) {
+      fmt::print("RTC time set from system clock to(local):{}\n",
+                 format_date(secs));
+    }
+    return 0;
+  }
+
+  if (args.verbosity) {
+    auto &rtc = wake.rtc();
+    const auto now = std::chrono::floor<std::chrono::seconds>(
+        rtc_to_sys(rtc.get_time(), rtc));
+    if (output != Output::TEXT) {
+      print_time(output, "rtc_time", now);
+    } else {
+      fmt::print("Current RTC time is(local):{}\n", format_date(now));
+    }
+  }
+  if (mode == "show") {
+    print_alarm(wake.show(), output);
+    return 0;
+  }
+  if (mode == "disable") {
+    wake.disable();
+    return 0;
+  }
+  if (!args.wake_spec) {
+    throw std::runtime_error(
+        "must provide wake time (see --seconds, --time and --date options)");
+  }
+  const bool halt = mode == "standby";
+  // coordinating takes a coalescing window or a lock file given explicitly
+  const std::chrono::milliseconds window{
+      to_number<unsigned>("--coalesce-window", args.coalesce_window)};
+  std::unique_ptr<WakeCoordinator> coordinator;
+  if (!args.lock_file.empty() &&
+      (window.count() > 0 || args.lock_file_given)) {
+    coordinator = open_coordinator(args.lock_file, window);
+  }
+  if (coordinator) {
+    const auto res = schedule_coalesced(
+        wake, *coordinator, *args.wake_spec, halt,
+        [&](RTCWake::ScheduleResult const &scheduled) {
+          print_scheduled(scheduled, wake.rtc().name(), output);
+          // poweroff replaces the process, buffered output would be lost
+          std::fflush(stdout);
+        });
+    if (res.batch.role == WakeCoordinator::Batch::Role::FOLLOWER) {
+      print_coalesced(res.batch, output);
+    }
+    if (res.halted) {
+      throw std::system_error(res.halted->error, std::generic_category());
+    }
+    return 0;
+  }
+  print_scheduled(wake.schedule(*args.wake_spec), wake.rtc().name(), output);
+  if (halt) {
+    std::fflush(stdout);
+    // only returns if halting failed, the reset on halt bit is cleared then
+    throw std::system_error(wake.halt().error, std::generic_category());
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) try {
+  const auto args = parse_args(argc, argv);
+  if (!args) {
+    return 0;
+  }
+  if (args->list_modes) {
+    fmt::print("{}\n", modes);
+    return 0;
+  }
+  return run(*args);
+} catch (std::system_error const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: {}\n", e.what());
+  return e.code().value();
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: {}\n", e.what());
+  return -1;
+} catch (...) {
+  fmt::print(stderr, "mrhat-rtcwake: unknown exception occured...\n");
+  return -1;
+}
@@ -4,24 +4,422 @@
 
 #include "mrhat_integration.hpp"
 
-#include <iostream>
+#include <atomic_file.hpp>
 
-bool MrHatIntegration::signal_reset_on_halt() { return api_impl(true); }
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 
-bool MrHatIntegration::clear_reset_on_halt() { return api_impl(false); }
+namespace fs = std::filesystem;
+
+namespace {
+
+using Status = RegisterWriteResult::Status;
+
+constexpr auto batch_endpoint = "/api/registers";
+
+std::atomic<std::uint64_t> g_connections{0};
+
+httplib::Client connect(std::uint16_t port) {
+  g_connections.fetch_add(1, std::memory_order_relaxed);
+  return httplib::Client("localhost", port);
+}
+
+bool success(httplib::Result const &res) {
+  return res && res->status >= 200 && res->status < 300;
+}
+
+std::string endpoint(RegisterWrite const &write) {
+  return "/api/register/" + to_string(write);
+}
+
+// the value the daemon reports for the bit of write, unset if it does not
+std::optional<bool> read_bit(httplib::Client &cli, RegisterWrite const &write) {
+  const auto res =
+      cli.Get(fmt::format("/api/register/{}/{}", write.reg, write.bit));
+  // daemons without the read endpoint do not know
+  if (!success(res)) {
+    return {};
+  }
+  std::string_view value(res->body);
+  while (!value.empty() &&
+         std::isspace(static_cast<unsigned char>(value.back()))) {
+    value.remove_suffix(1);
+  }
+  if (value != "0" && value != "1") {
+    return {};
+  }
+  return value == "1";
+}
+
+std::vector<RegisterWriteResult> results(std::span<RegisterWrite const> writes,
+                                         Status status) {
+  std::vector<RegisterWriteResult> res;
+  for (auto const &w : writes) {
+    res.push_back({w, status});
+  }
+  return res;
+}
+
+// a rejected batch answers with a "reg/bit/value status" line per write, in
+// the order of the request; no write of it was applied
+std::vector<RegisterWriteResult>
+rejected_batch(std::span<RegisterWrite const> writes, std::string_view body) {
+  auto res = results(writes, Status::SKIPPED);
+  std::size_t i = 0;
+  bool failed = false;
+  while (!body.empty() && i < res.size()) {
+    const auto eol = body.find('\n');
+    const auto line = body.substr(0, eol);
+    body = eol == std::string_view::npos ? "" : body.substr(eol + 1);
+    if (line.ends_with(" failed")) {
+      res[i].status = Status::FAILED;
+      failed = true;
+    }
+    ++i;
+  }
+  // the daemon did not say which one
+  if (!failed) {
+    res = results(writes, Status::FAILED);
+  }
+  return res;
+}
+
+bool same_bit(RegisterWrite const &a, RegisterWrite const &b) {
+  return a.reg == b.reg && a.bit == b.bit;
+}
+
+// inode of the socket listening on the port in /proc/net/tcp or tcp6, 0 if
+// there is none
+std::uint64_t listener_inode(fs::path const &proc_net, std::uint16_t port) {
+  for (const auto *table : {"tcp", "tcp6"}) {
+    std::ifstream ifs(proc_net / table);
+    std::string line;
+    // the header
+    std::getline(ifs, line);
+    while (std::getline(ifs, line)) {
+      std::istringstream fields(line);
+      std::string slot, local, remote, state, queues, timer, retransmits;
+      std::string uid, timeout;
+      std::uint64_t inode = 0;
+      if (!(fields >> slot >> local >> remote >> state >> queues >> timer >>
+            retransmits >> uid >> timeout >> inode) ||
+          state != "0A") {
+        continue;
+      }
+      // address:port in hex
+      const auto hex = std::string_view(local).substr(local.rfind(':') + 1);
+      unsigned local_port = 0;
+      const auto [ptr, ec] = std::from_chars(
+          hex.data(), hex.data() + hex.size(), local_port, 16);
+      if (ec == std::errc() && ptr == hex.data() + hex.size() &&
+          local_port == port) {
+        return inode;
+      }
+    }
+  }
+  return 0;
+}
+
+} // namespace
+
+RegisterCacheKey register_cache_key(std::uint16_t port,
+                                    fs::path const &boot_id,
+                                    fs::path const &proc_net) {
+  RegisterCacheKey key{{}, listener_inode(proc_net, port)};
+  std::ifstream(boot_id) >> key.boot_id;
+  return key;
+}
+
+RegisterCache read_register_cache(fs::path const &path) {
+  std::ifstream ifs(path);
+  RegisterCache cache;
+  if (!(ifs >> cache.key.boot_id >> cache.key.listener >> cache.stats.hits >>
+        cache.stats.queried >> cache.stats.misses)) {
+    return {};
+  }
+  // an empty boot id would not read back as a field
+  if (cache.key.boot_id == "-") {
+    cache.key.boot_id.clear();
+  }
+  std::string spec;
+  try {
+    while (ifs >> spec) {
+      cache.bits.push_back(parse_register_write(spec));
+    }
+  } catch (std::runtime_error const &) {
+    return {};
+  }
+  return cache;
+}
+
+void write_register_cache(fs::path const &path,
+                          RegisterCache const &cache) noexcept try {
+  auto contents = fmt::format(
+      "{} {}\n{} {} {}\n", cache.key.boot_id.empty() ? "-" : cache.key.boot_id,
+      cache.key.listener, cache.stats.hits, cache.stats.queried,
+      cache.stats.misses);
+  for (auto const &w : cache.bits) {
+    contents += to_string(w) + '\n';
+  }
+  write_file_atomically(path, contents);
+} catch (std::exception const &) {
+  // e.g. /run is not writable for the user, the next run writes again
+}
+
+RegisterWrite parse_register_write(std::string_view spec) {
+  const auto invalid = [spec](std::string_view why) {
+    return std::runtime_error(
+        fmt::format("invalid register write {}, {}", spec, why));
+  };
+  unsigned fields[3]{};
+  auto rest = spec;
+  for (std::size_t i = 0; i < std::size(fields); ++i) {
+    const auto sep = rest.find('/');
+    const bool last = i + 1 == std::size(fields);
+    const auto part = rest.substr(0, sep);
+    const auto [ptr, ec] =
+        std::from_chars(part.data(), part.data() + part.size(), fields[i]);
+    if (last != (sep == std::string_view::npos) || part.empty() ||
+        ec != std::errc() || ptr != part.data() + part.size()) {
+      throw invalid("expected reg/bit/value");
+    }
+    rest = last ? "" : rest.substr(sep + 1);
+  }
+  if (fields[1] > 7 || fields[2] > 1) {
+    throw invalid("bit is 0-7 and value 0 or 1");
+  }
+  return {fields[0], fields[1], fields[2] == 1};
+}
+
+std::string to_string(RegisterWrite const &write) {
+  return fmt::format("{}/{}/{}", write.reg, write.bit, write.value ? 1 : 0);
+}
+
+std::string_view to_string(RegisterWriteResult::Status status) {
+  switch (status) {
+  case Status::APPLIED:
+    return "applied";
+  case Status::FAILED:
+    return "failed";
+  case Status::SKIPPED:
+    return "skipped";
+  case Status::ROLLED_BACK:
+    return "rolled_back";
+  }
+  return "unknown";
+}
+
+bool RegisterBatchResult::ok() const noexcept {
+  return std::all_of(writes.begin(), writes.end(), [](auto const &w) {
+    return w.status == Status::APPLIED;
+  });
+}
+
+bool MrHatIntegration::signal_reset_on_halt() {
+  if (!register_cache.empty()) {
+    return cached_impl(true);
+  }
+  return registers.empty() ? api_impl(true) : batch_impl(true);
+}
+
+bool MrHatIntegration::clear_reset_on_halt() {
+  if (!register_cache.empty()) {
+    return cached_impl(false);
+  }
+  return registers.empty() ? api_impl(false) : batch_impl(false);
+}
+
+std::vector<RegisterWrite>
+MrHatIntegration::reset_on_halt_writes(bool set) const {
+  std::vector<RegisterWrite> writes{{rst_action_reg, rst_action_bit, set}};
+  for (auto w : registers) {
+    if (!set) {
+      const auto it = std::find_if(prior.begin(), prior.end(), [&](auto &p) {
+        return same_bit(p, w);
+      });
+      w.value = it != prior.end() ? it->value : !w.value;
+    }
+    writes.push_back(w);
+  }
+  return writes;
+}
+
+bool MrHatIntegration::cached_impl(bool set) {
+  const auto writes = reset_on_halt_writes(set);
+  const auto key = register_cache_key(port);
+  auto cache = read_register_cache(register_cache);
+  if (cache.key.boot_id != key.boot_id) {
+    // the counters start over with the boot
+    cache = {};
+  }
+  if (cache.key != key) {
+    cache.key = key;
+    cache.bits.clear();
+  }
+  const auto held = [&](RegisterWrite const &w) {
+    return std::find(cache.bits.begin(), cache.bits.end(), w) !=
+           cache.bits.end();
+  };
+  const auto known = [&](RegisterWrite const &w) {
+    return std::any_of(cache.bits.begin(), cache.bits.end(),
+                       [&](auto const &c) { return same_bit(c, w); });
+  };
+  bool ok = true;
+  if (key.listener != 0 && std::all_of(writes.begin(), writes.end(), held)) {
+    ++stats.hits;
+    ++cache.stats.hits;
+    if (set) {
+      prior = registers;
+    }
+  } else if (key.listener != 0 &&
+             std::none_of(writes.begin(), writes.end(), known) &&
+             query_matches(writes)) {
+    // only asked when the state is unknown, e.g. after a daemon restart; a
+    // known state that differs is written right away
+    ++stats.queried;
+    ++cache.stats.queried;
+    if (set) {
+      prior = registers;
+    }
+  } else {
+    ++stats.misses;
+    ++cache.stats.misses;
+    ok = registers.empty() ? api_impl(set) : batch_impl(set);
+    // registers the daemon did not report keep the value the cache knows
+    for (auto const &c : cache.bits) {
+      const auto same = [&](auto const &w) { return same_bit(w, c); };
+      if (set && std::any_of(registers.begin(), registers.end(), same) &&
+          std::none_of(prior.begin(), prior.end(), same)) {
+        prior.push_back(c);
+      }
+    }
+  }
+  // a failed write leaves the bits unknown
+  std::erase_if(cache.bits, [&](RegisterWrite const &c) {
+    return std::any_of(writes.begin(), writes.end(),
+                       [&](auto const &w) { return same_bit(c, w); });
+  });
+  if (ok) {
+    cache.bits.insert(cache.bits.end(), writes.begin(), writes.end());
+  }
+  write_register_cache(register_cache, cache);
+  return ok;
+}
+
+bool MrHatIntegration::query_matches(std::span<RegisterWrite const> writes) {
+  return std::ranges::equal(read_registers(writes), writes);
+}
+
+std::vector<RegisterWrite>
+MrHatIntegration::read_registers(std::span<RegisterWrite const> bits) {
+  auto cli = connect(port);
+  cli.set_keep_alive(true);
+  std::vector<RegisterWrite> res;
+  for (auto w : bits) {
+    const auto value = read_bit(cli, w);
+    if (!value) {
+      continue;
+    }
+    w.value = *value;
+    res.push_back(w);
+  }
+  return res;
+}
 
 bool MrHatIntegration::api_impl(bool set) {
-  httplib::Client cli("localhost", port);
+  auto cli = connect(port);
   const auto endpoint = fmt::format("/api/register/{}/{}/{}", rst_action_reg,
                                     rst_action_bit, set ? 1 : 0);
   if (auto res = cli.Post(endpoint);
       res && (res->status >= 200 && res->status < 300)) {
     return true;
   } else {
-    std::cerr << fmt::format("error sending reset on halt action to "
-                             "http://localhost:{}{} status:{} code:{}\n",
-                             port, endpoint, res ? res->status : -1,
-                             static_cast<int>(res.error()));
+    fmt::print(stderr, "error sending reset on halt action to "
+               "http://localhost:{}{} status:{} code:{}\n",
+               port, endpoint, res ? res->status : -1,
+               static_cast<int>(res.error()));
     return false;
   }
 }
+
+bool MrHatIntegration::batch_impl(bool set) {
+  if (set) {
+    prior = read_registers(registers);
+  }
+  const auto writes = reset_on_halt_writes(set);
+  const auto res = write_registers(writes);
+  if (!res.ok()) {
+    for (auto const &w : res.writes) {
+      fmt::print(stderr, "reset on halt register write {} {}\n",
+                 to_string(w.write), to_string(w.status));
+    }
+  }
+  return res.ok();
+}
+
+std::uint64_t MrHatIntegration::connections() noexcept {
+  return g_connections.load(std::memory_order_relaxed);
+}
+
+RegisterBatchResult
+MrHatIntegration::write_registers(std::span<RegisterWrite const> writes) {
+  auto cli = connect(port);
+  cli.set_keep_alive(true);
+  std::string body;
+  for (auto const &w : writes) {
+    body += to_string(w) + '\n';
+  }
+  auto res = cli.Post(batch_endpoint, body, "text/plain");
+  if (success(res)) {
+    return {.writes = results(writes, Status::APPLIED), .batched = true};
+  }
+  if (!res) {
+    fmt::print(stderr, "error sending register writes to "
+               "http://localhost:{}{} code:{}\n",
+               port, batch_endpoint, static_cast<int>(res.error()));
+    return {.writes = results(writes, Status::FAILED), .batched = true};
+  }
+  if (res->status != 404) {
+    fmt::print(stderr, "register writes rejected by "
+               "http://localhost:{}{} status:{}\n",
+               port, batch_endpoint, res->status);
+    return {.writes = rejected_batch(writes, res->body), .batched = true};
+  }
+
+  // no batch endpoint, one request per register over the same connection,
+  // the values they have are read first to revert to them
+  std::vector<std::optional<bool>> before;
+  for (auto const &w : writes) {
+    before.push_back(read_bit(cli, w));
+  }
+  RegisterBatchResult batch{.writes = results(writes, Status::SKIPPED),
+                            .batched = false};
+  for (std::size_t i = 0; i < writes.size(); ++i) {
+    if (success(cli.Post(endpoint(writes[i])))) {
+      batch.writes[i].status = Status::APPLIED;
+      continue;
+    }
+    batch.writes[i].status = Status::FAILED;
+    fmt::print(stderr, "error sending register write to "
+               "http://localhost:{}{}\n",
+               port, endpoint(writes[i]));
+    // revert in reverse order, a write that cannot be reverted stays applied
+    for (auto j = i; j-- > 0;) {
+      auto undo = writes[j];
+      undo.value = before[j].value_or(!undo.value);
+      if (undo == writes[j] || success(cli.Post(endpoint(undo)))) {
+        batch.writes[j].status = Status::ROLLED_BACK;
+      }
+    }
+    break;
+  }
+  return batch;
+}
@@ -1,6 +1,94 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A bit of an MCU register of the MrHat, as in the register API of
+// mrhat-daemon
+struct RegisterWrite {
+  unsigned reg = 0;
+  unsigned bit = 0;
+  bool value = false;
+  bool operator==(RegisterWrite const &) const = default;
+};
+
+// parses reg/bit/value, e.g. 8/0/1, throws if malformed
+RegisterWrite parse_register_write(std::string_view spec);
+std::string to_string(RegisterWrite const &write);
+
+struct RegisterWriteResult {
+  enum class Status {
+    APPLIED,
+    // the write the batch failed on
+    FAILED,
+    // not attempted, or not applied as the batch failed
+    SKIPPED,
+    // applied before the batch failed, then reverted
+    ROLLED_BACK,
+  };
+  RegisterWrite write;
+  Status status = Status::SKIPPED;
+  bool operator==(RegisterWriteResult const &) const = default;
+};
+
+std::string_view to_string(RegisterWriteResult::Status status);
+
+struct RegisterBatchResult {
+  // in the order of the writes
+  std::vector<RegisterWriteResult> writes;
+  // the daemon took the batch in a single request, otherwise it was written
+  // one register at a time
+  bool batched = false;
+  bool ok() const noexcept;
+};
+
+// Identity of the register state held by mrhat-daemon, lost with a reboot
+// and with a restart of the daemon
+struct RegisterCacheKey {
+  std::string boot_id;
+  // inode of the socket the daemon listens on, a restarted daemon binds a new
+  // one; 0 if nothing listens on the port
+  std::uint64_t listener = 0;
+  bool operator==(RegisterCacheKey const &) const = default;
+};
+
+RegisterCacheKey
+register_cache_key(std::uint16_t port,
+                   std::filesystem::path const &boot_id =
+                       "/proc/sys/kernel/random/boot_id",
+                   std::filesystem::path const &proc_net = "/proc/net");
+
+struct RegisterCacheStats {
+  // writes skipped as the cached state already matched
+  std::uint64_t hits = 0;
+  // writes skipped as the daemon reported the state to match
+  std::uint64_t queried = 0;
+  // writes sent to the daemon
+  std::uint64_t misses = 0;
+  bool operator==(RegisterCacheStats const &) const = default;
+};
+
+// Register bits last written to mrhat-daemon. The bits are only trusted for
+// the key they were written with, the counters add up over a boot.
+struct RegisterCache {
+  RegisterCacheKey key;
+  RegisterCacheStats stats;
+  std::vector<RegisterWrite> bits;
+};
+
+// empty if the cache is missing or malformed
+RegisterCache read_register_cache(std::filesystem::path const &path);
+// written atomically, failures are ignored as the cache is only a shortcut
+void write_register_cache(std::filesystem::path const &path,
+                          RegisterCache const &cache) noexcept;
+
+inline constexpr auto default_register_cache_path =
+    "/run/mrhat-rtcwake/registers";
 
 struct MrHatIntegration {
 
@@ -8,12 +96,47 @@ struct MrHatIntegration {
   explicit MrHatIntegration(uint16_t p) : port{p} {}
   MrHatIntegration(uint16_t p, unsigned rst_act_reg, unsigned rst_action_b)
       : port{p}, rst_action_reg{rst_act_reg}, rst_action_bit{rst_action_b} {}
+  // the registers are written along with the reset on halt bit. Clearing it
+  // restores the values the daemon reported or the register cache held
+  // before this instance signalled, other registers are written inverted.
+  MrHatIntegration(uint16_t p, unsigned rst_act_reg, unsigned rst_action_b,
+                   std::vector<RegisterWrite> regs)
+      : port{p}, rst_action_reg{rst_act_reg}, rst_action_bit{rst_action_b},
+        registers{std::move(regs)} {}
   bool signal_reset_on_halt();
   bool clear_reset_on_halt();
+  // writes all registers or none in one request. Daemons without the batch
+  // endpoint get one request per register over the same connection, and the
+  // writes applied before a failing one are reverted to the values read
+  // beforehand, or inverted if the daemon did not report them.
+  RegisterBatchResult write_registers(std::span<RegisterWrite const> writes);
+
+  // skips writing the reset on halt bit and the registers if the cache says
+  // the daemon already holds them; an empty path writes them every time
+  void set_register_cache(std::filesystem::path path) {
+    register_cache = std::move(path);
+  }
+  // of this instance, the ones accumulated over the boot are in the cache
+  RegisterCacheStats const &cache_stats() const noexcept { return stats; }
+  // clients opened to mrhat-daemon by any instance of the process so far
+  static std::uint64_t connections() noexcept;
 
 private:
+  bool cached_impl(bool set);
+  // the daemon reports every bit to hold the value already
+  bool query_matches(std::span<RegisterWrite const> writes);
+  // the bits of writes with the values the daemon reports, leaving out the
+  // ones it does not
+  std::vector<RegisterWrite> read_registers(std::span<RegisterWrite const> bits);
   bool api_impl(bool set);
+  bool batch_impl(bool set);
+  std::vector<RegisterWrite> reset_on_halt_writes(bool set) const;
   uint16_t port = 9000;
   unsigned rst_action_reg = 8;
   unsigned rst_action_bit = 0;
+  std::vector<RegisterWrite> registers;
+  // values of registers before signalling, restored when clearing
+  std::vector<RegisterWrite> prior;
+  std::filesystem::path register_cache;
+  RegisterCacheStats stats;
 };
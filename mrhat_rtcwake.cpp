@@ -0,0 +1,169 @@
+#include "mrhat_rtcwake.h"
+
+#include <rtcwake.hpp>
+
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+struct mrhat_rtcwake {
+  std::unique_ptr<RTCWake> wake;
+  std::string error;
+};
+
+namespace {
+
+thread_local std::string open_error;
+
+// a NULL argument or options of an unknown layout, fails with -EINVAL
+struct InvalidArgument : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+template <typename T> T &non_null(T *p, const char *what) {
+  if (p == nullptr) {
+    throw InvalidArgument(std::string(what) + " is NULL");
+  }
+  return *p;
+}
+
+std::string &error_of(mrhat_rtcwake *handle) noexcept {
+  return handle != nullptr ? handle->error : open_error;
+}
+
+// maps exceptions to the exit codes of the command line tool
+template <typename F> int guarded(std::string &error, F &&f) noexcept {
+  try {
+    f();
+    error.clear();
+    return 0;
+  } catch (InvalidArgument const &e) {
+    error = e.what();
+    return -EINVAL;
+  } catch (std::system_error const &e) {
+    error = e.what();
+    return e.code().value();
+  } catch (std::exception const &e) {
+    error = e.what();
+    return -1;
+  } catch (...) {
+    error = "unknown exception occured...";
+    return -1;
+  }
+}
+
+RTCWake::Options to_options(mrhat_rtcwake_options const &opts) {
+  RTCWake::Options res{};
+  if (opts.device != nullptr) {
+    res.device = opts.device;
+  }
+  if (opts.adjfile != nullptr) {
+    res.adjfile = opts.adjfile;
+  }
+  res.status_file = opts.status_file != nullptr ? opts.status_file : "";
+  res.integration = {opts.daemon_port, opts.rst_action_register,
+                     opts.rst_action_bit};
+  res.force = opts.force != 0;
+  res.retry.max_attempts = opts.retry_attempts;
+  res.retry.deadline = std::chrono::milliseconds{opts.retry_deadline_ms};
+  return res;
+}
+
+} // namespace
+
+void mrhat_rtcwake_default_options(mrhat_rtcwake_options *opts) {
+  static const RTCWake::Options defaults{};
+  static const std::string device = defaults.device;
+  static const std::string adjfile = defaults.adjfile.string();
+  static const std::string status_file = defaults.status_file.string();
+  *opts = mrhat_rtcwake_options{
+      .size = sizeof(mrhat_rtcwake_options),
+      .device = device.c_str(),
+      .adjfile = adjfile.c_str(),
+      .status_file = status_file.c_str(),
+      .daemon_port = defaults.integration.port,
+      .rst_action_register = defaults.integration.reg,
+      .rst_action_bit = defaults.integration.bit,
+      .force = defaults.force,
+      .retry_attempts = defaults.retry.max_attempts,
+      .retry_deadline_ms =
+          static_cast<unsigned>(defaults.retry.deadline.count()),
+  };
+}
+
+int mrhat_rtcwake_open(const mrhat_rtcwake_options *opts,
+                       mrhat_rtcwake **handle) {
+  return guarded(open_error, [&] {
+    auto &out = non_null(handle, "handle");
+    mrhat_rtcwake_options defaults{};
+    if (opts == nullptr) {
+      mrhat_rtcwake_default_options(&defaults);
+      opts = &defaults;
+    }
+    // until fields are appended, only the layout of this header is known
+    if (opts->size != sizeof(mrhat_rtcwake_options)) {
+      throw InvalidArgument("options of unknown size " +
+                            std::to_string(opts->size) +
+                            ", see mrhat_rtcwake_default_options()");
+    }
+    auto res = std::make_unique<mrhat_rtcwake>();
+    res->wake = std::make_unique<RTCWake>(to_options(*opts));
+    res->wake->open();
+    out = res.release();
+  });
+}
+
+void mrhat_rtcwake_close(mrhat_rtcwake *handle) { delete handle; }
+
+int mrhat_rtcwake_show(mrhat_rtcwake *handle, mrhat_rtcwake_alarm *alarm) {
+  return guarded(error_of(handle), [&] {
+    auto &wake = *non_null(handle, "handle").wake;
+    auto &out = non_null(alarm, "alarm");
+    const auto state = wake.show();
+    out = mrhat_rtcwake_alarm{
+        .enabled = state.enabled,
+        .pending = state.pending,
+        .wakeup = state.wakeup.time_since_epoch().count(),
+    };
+  });
+}
+
+int mrhat_rtcwake_disable(mrhat_rtcwake *handle) {
+  return guarded(error_of(handle),
+                 [&] { non_null(handle, "handle").wake->disable(); });
+}
+
+int mrhat_rtcwake_schedule(mrhat_rtcwake *handle, mrhat_rtcwake_spec spec,
+                           const char *value,
+                           mrhat_rtcwake_schedule_result *result) {
+  return guarded(error_of(handle), [&] {
+    auto &wake = *non_null(handle, "handle").wake;
+    non_null(value, "wake time value");
+    using Kind = RTCWake::WakeSpec::Kind;
+    const auto kind = spec == MRHAT_RTCWAKE_SECONDS ? Kind::SECONDS
+                      : spec == MRHAT_RTCWAKE_TIME  ? Kind::TIME
+                                                    : Kind::DATE;
+    const auto res = wake.schedule({kind, value});
+    if (result != nullptr) {
+      *result = mrhat_rtcwake_schedule_result{
+          .now = res.now.time_since_epoch().count(),
+          .wakeup = res.wakeup.time_since_epoch().count(),
+      };
+    }
+  });
+}
+
+int mrhat_rtcwake_halt(mrhat_rtcwake *handle) {
+  return guarded(error_of(handle), [&] {
+    if (const auto res = non_null(handle, "handle").wake->halt();
+        res.error != 0) {
+      throw std::system_error(res.error, std::generic_category(), "halt");
+    }
+  });
+}
+
+const char *mrhat_rtcwake_last_error(const mrhat_rtcwake *handle) {
+  return handle != nullptr ? handle->error.c_str() : open_error.c_str();
+}
@@ -0,0 +1,88 @@
+#ifndef MRHAT_RTCWAKE_H
+#define MRHAT_RTCWAKE_H
+
+/* C ABI of the mrhat-rtcwake scheduling facade. Functions return 0 on
+ * success, a positive errno value on system errors, -EINVAL for a NULL
+ * handle, value or pointer to return through, and -1 on any other error.
+ * The message of the last error is available from
+ * mrhat_rtcwake_last_error(). */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(MRHAT_RTCWAKE_BUILDING)
+#define MRHAT_RTCWAKE_API __attribute__((visibility("default")))
+#else
+#define MRHAT_RTCWAKE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mrhat_rtcwake mrhat_rtcwake;
+
+typedef struct mrhat_rtcwake_options {
+  /* sizeof(mrhat_rtcwake_options) the caller was built with, set by
+   * mrhat_rtcwake_default_options(). Fields are only ever appended, so
+   * mrhat_rtcwake_open() knows which ones the caller has. */
+  size_t size;
+  const char *device;
+  const char *adjfile;
+  /* NULL or empty disables publishing to the status page */
+  const char *status_file;
+  int daemon_port;
+  int rst_action_register;
+  int rst_action_bit;
+  int force;
+  unsigned retry_attempts;
+  unsigned retry_deadline_ms;
+} mrhat_rtcwake_options;
+
+typedef enum mrhat_rtcwake_spec {
+  MRHAT_RTCWAKE_DATE = 0,
+  MRHAT_RTCWAKE_SECONDS = 1,
+  MRHAT_RTCWAKE_TIME = 2,
+} mrhat_rtcwake_spec;
+
+typedef struct mrhat_rtcwake_alarm {
+  int enabled;
+  int pending;
+  /* seconds since the epoch, 0 if not enabled */
+  int64_t wakeup;
+} mrhat_rtcwake_alarm;
+
+typedef struct mrhat_rtcwake_schedule_result {
+  int64_t now;
+  int64_t wakeup;
+} mrhat_rtcwake_schedule_result;
+
+MRHAT_RTCWAKE_API void
+mrhat_rtcwake_default_options(mrhat_rtcwake_options *opts);
+
+MRHAT_RTCWAKE_API int mrhat_rtcwake_open(const mrhat_rtcwake_options *opts,
+                                         mrhat_rtcwake **handle);
+MRHAT_RTCWAKE_API void mrhat_rtcwake_close(mrhat_rtcwake *handle);
+
+MRHAT_RTCWAKE_API int mrhat_rtcwake_show(mrhat_rtcwake *handle,
+                                         mrhat_rtcwake_alarm *alarm);
+MRHAT_RTCWAKE_API int mrhat_rtcwake_disable(mrhat_rtcwake *handle);
+/* value is the wake time as given to --date, --seconds or --time, result
+ * may be NULL */
+MRHAT_RTCWAKE_API int
+mrhat_rtcwake_schedule(mrhat_rtcwake *handle, mrhat_rtcwake_spec spec,
+                       const char *value,
+                       mrhat_rtcwake_schedule_result *result);
+/* signals reset on halt and halts the system, only returns on failure */
+MRHAT_RTCWAKE_API int mrhat_rtcwake_halt(mrhat_rtcwake *handle);
+
+/* message of the last failed call on the handle, or of the last failed
+ * mrhat_rtcwake_open() or call given a NULL handle if handle is NULL */
+MRHAT_RTCWAKE_API const char *
+mrhat_rtcwake_last_error(const mrhat_rtcwake *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,357 @@
+#include "page_cache.hpp"
+
+#include <atomic_file.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::uint32_t index_magic = 0x4350524d; // "MRPC"
+constexpr std::uint32_t index_version = 1;
+
+struct Fd {
+  explicit Fd(fs::path const &path)
+      : fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)} {}
+  Fd(const Fd &) = delete;
+  Fd &operator=(const Fd &) = delete;
+  ~Fd() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  int fd;
+};
+
+std::uint32_t page_size() {
+  return static_cast<std::uint32_t>(sysconf(_SC_PAGESIZE));
+}
+
+void put_u32(std::string &out, std::uint32_t v) {
+  char buff[sizeof(v)];
+  std::memcpy(buff, &v, sizeof(v));
+  out.append(buff, sizeof(v));
+}
+
+class Reader {
+public:
+  explicit Reader(std::string_view data) : m_data{data} {}
+  std::uint32_t u32() {
+    std::uint32_t v{};
+    std::memcpy(&v, take(sizeof(v)).data(), sizeof(v));
+    return v;
+  }
+  std::string_view take(std::size_t n) {
+    if (m_data.size() < n) {
+      throw std::runtime_error("page cache index is truncated");
+    }
+    const auto res = m_data.substr(0, n);
+    m_data.remove_prefix(n);
+    return res;
+  }
+
+private:
+  std::string_view m_data;
+};
+
+// resident runs of a single file, empty if it cannot be mapped
+std::vector<CachedRange> snapshot_file(fs::path const &path,
+                                       std::uint32_t file,
+                                       std::uint32_t page) {
+  Fd f(path);
+  struct stat st{};
+  if (f.fd < 0 || fstat(f.fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size == 0) {
+    return {};
+  }
+  const auto size = static_cast<std::size_t>(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, f.fd, 0);
+  if (addr == MAP_FAILED) {
+    return {};
+  }
+  std::vector<unsigned char> vec((size + page - 1) / page);
+  const int res = mincore(addr, size, vec.data());
+  munmap(addr, size);
+  if (res != 0) {
+    return {};
+  }
+  return resident_runs(vec, file);
+}
+
+ReplayStats replay_file(PageCacheIndex const &index, std::uint32_t file,
+                        std::span<CachedRange const> ranges) {
+  ReplayStats stats{.files = 1};
+  Fd f(index.files[file]);
+  struct stat st{};
+  if (f.fd < 0 || fstat(f.fd, &st) != 0) {
+    stats.missing = 1;
+    return stats;
+  }
+  const auto size = static_cast<std::uint64_t>(st.st_size);
+  for (auto const &r : ranges) {
+    const std::uint64_t off = std::uint64_t{r.first_page} * index.page_size;
+    if (off >= size) {
+      continue;
+    }
+    const auto len =
+        std::min<std::uint64_t>(std::uint64_t{r.pages} * index.page_size,
+                                size - off);
+    // readahead is not supported by every file system
+    if (readahead(f.fd, static_cast<off64_t>(off), len) != 0) {
+      posix_fadvise(f.fd, static_cast<off_t>(off), static_cast<off_t>(len),
+                    POSIX_FADV_WILLNEED);
+    }
+    ++stats.ranges;
+    stats.bytes += len;
+  }
+  return stats;
+}
+
+void accumulate(ReplayStats &total, ReplayStats const &s) {
+  total.files += s.files;
+  total.missing += s.missing;
+  total.ranges += s.ranges;
+  total.bytes += s.bytes;
+}
+
+// the process id of a pid:<n> spec, empty if spec is not one
+std::optional<int> spec_pid(std::string_view spec) {
+  if (!spec.starts_with("pid:")) {
+    return {};
+  }
+  spec.remove_prefix(4);
+  int pid = 0;
+  const auto [end, ec] =
+      std::from_chars(spec.data(), spec.data() + spec.size(), pid);
+  if (ec != std::errc{} || end != spec.data() + spec.size() || pid <= 0) {
+    return {};
+  }
+  return pid;
+}
+
+} // namespace
+
+std::vector<CachedRange> resident_runs(std::span<unsigned char const> vec,
+                                       std::uint32_t file) {
+  std::vector<CachedRange> res;
+  for (std::size_t i = 0; i < vec.size();) {
+    if ((vec[i] & 1) == 0) {
+      ++i;
+      continue;
+    }
+    const auto first = i;
+    while (i < vec.size() && (vec[i] & 1) != 0) {
+      ++i;
+    }
+    res.push_back({file, static_cast<std::uint32_t>(first),
+                   static_cast<std::uint32_t>(i - first)});
+  }
+  return res;
+}
+
+std::vector<fs::path> mapped_files(int pid, fs::path const &proc) {
+  std::ifstream maps(proc / std::to_string(pid) / "maps");
+  if (!maps) {
+    throw std::runtime_error(
+        fmt::format("failed to read the mappings of process {}", pid));
+  }
+  std::vector<fs::path> res;
+  std::unordered_set<std::string> seen;
+  std::string line;
+  while (std::getline(maps, line)) {
+    // address perms offset dev inode path
+    std::istringstream fields(line);
+    std::string addr, perms, offset, dev, inode;
+    fields >> addr >> perms >> offset >> dev >> inode >> std::ws;
+    std::string path;
+    std::getline(fields, path);
+    if (inode == "0" || !path.starts_with('/') ||
+        path.ends_with(" (deleted)")) {
+      continue;
+    }
+    if (seen.insert(path).second) {
+      res.emplace_back(std::move(path));
+    }
+  }
+  return res;
+}
+
+void check_cache_specs(std::span<std::string const> specs) {
+  for (auto const &spec : specs) {
+    if (spec.starts_with("pid:") && !spec_pid(spec)) {
+      throw std::runtime_error(
+          fmt::format("invalid page cache spec {}, expected pid:<n>", spec));
+    }
+  }
+}
+
+std::vector<fs::path> expand_cache_paths(std::span<std::string const> specs,
+                                         fs::path const &proc,
+                                         std::size_t max_files) {
+  std::vector<fs::path> res;
+  std::unordered_set<std::string> seen;
+  auto add = [&](fs::path p) {
+    if (seen.insert(p.string()).second) {
+      res.push_back(std::move(p));
+    }
+  };
+  for (auto const &spec : specs) {
+    if (res.size() >= max_files) {
+      break;
+    }
+    if (spec.starts_with("pid:")) {
+      const auto pid = spec_pid(spec);
+      if (!pid) {
+        continue;
+      }
+      std::vector<fs::path> mapped;
+      try {
+        mapped = mapped_files(*pid, proc);
+      } catch (std::runtime_error const &) {
+        // exited since
+        continue;
+      }
+      for (auto &p : mapped) {
+        add(std::move(p));
+      }
+    } else if (std::error_code ec; fs::is_directory(spec, ec)) {
+      for (auto it = fs::recursive_directory_iterator(
+               spec, fs::directory_options::skip_permission_denied, ec);
+           it != fs::recursive_directory_iterator() &&
+           res.size() < max_files;
+           it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+          add(it->path());
+        }
+      }
+    } else {
+      add(spec);
+    }
+  }
+  if (res.size() > max_files) {
+    res.resize(max_files);
+  }
+  return res;
+}
+
+PageCacheIndex snapshot_page_cache(std::span<fs::path const> files,
+                                   std::chrono::milliseconds budget) {
+  const auto deadline = std::chrono::steady_clock::now() + budget;
+  PageCacheIndex index{.page_size = page_size()};
+  for (auto const &path : files) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+    const auto file = static_cast<std::uint32_t>(index.files.size());
+    auto runs = snapshot_file(path, file, index.page_size);
+    if (!runs.empty()) {
+      index.files.push_back(path.string());
+      index.ranges.insert(index.ranges.end(), runs.begin(), runs.end());
+    }
+  }
+  return index;
+}
+
+void write_page_cache_index(fs::path const &path,
+                            PageCacheIndex const &index) {
+  std::string out;
+  put_u32(out, index_magic);
+  put_u32(out, index_version);
+  put_u32(out, index.page_size);
+  put_u32(out, static_cast<std::uint32_t>(index.files.size()));
+  put_u32(out, static_cast<std::uint32_t>(index.ranges.size()));
+  for (auto const &f : index.files) {
+    put_u32(out, static_cast<std::uint32_t>(f.size()));
+    out += f;
+  }
+  for (auto const &r : index.ranges) {
+    put_u32(out, r.file);
+    put_u32(out, r.first_page);
+    put_u32(out, r.pages);
+  }
+
+  // the index is written right before halting
+  write_file_atomically(path, out, true);
+}
+
+PageCacheIndex read_page_cache_index(fs::path const &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    throw std::runtime_error(
+        fmt::format("failed to read page cache index {}", path.c_str()));
+  }
+  const std::string data{std::istreambuf_iterator<char>(ifs),
+                         std::istreambuf_iterator<char>()};
+  Reader in(data);
+  if (in.u32() != index_magic || in.u32() != index_version) {
+    throw std::runtime_error(fmt::format(
+        "{} is not a page cache index of this version", path.c_str()));
+  }
+  PageCacheIndex index{.page_size = in.u32()};
+  const auto files = in.u32();
+  const auto ranges = in.u32();
+  for (std::uint32_t i = 0; i < files; ++i) {
+    index.files.emplace_back(in.take(in.u32()));
+  }
+  for (std::uint32_t i = 0; i < ranges; ++i) {
+    CachedRange r{in.u32(), in.u32(), in.u32()};
+    if (r.file >= files) {
+      throw std::runtime_error("page cache index refers to an unknown file");
+    }
+    index.ranges.push_back(r);
+  }
+  return index;
+}
+
+ReplayStats replay_page_cache(PageCacheIndex const &index, unsigned threads) {
+  // ranges of a file are contiguous in the index
+  std::vector<std::span<CachedRange const>> per_file;
+  for (auto it = index.ranges.begin(); it != index.ranges.end();) {
+    const auto end = std::find_if(it, index.ranges.end(), [&](auto const &r) {
+      return r.file != it->file;
+    });
+    per_file.emplace_back(it, end);
+    it = end;
+  }
+  if (per_file.empty()) {
+    return {};
+  }
+  std::atomic<std::size_t> next{0};
+  auto worker = [&] {
+    ReplayStats stats{};
+    for (auto i = next++; i < per_file.size(); i = next++) {
+      accumulate(stats,
+                 replay_file(index, per_file[i].front().file, per_file[i]));
+    }
+    return stats;
+  };
+  std::vector<std::future<ReplayStats>> workers;
+  const auto n = std::clamp<std::size_t>(threads, 1, per_file.size());
+  for (std::size_t i = 0; i < n; ++i) {
+    workers.push_back(std::async(std::launch::async, worker));
+  }
+  ReplayStats total{};
+  for (auto &w : workers) {
+    accumulate(total, w.get());
+  }
+  return total;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Resident pages of a file, as a run of whole pages
+struct CachedRange {
+  std::uint32_t file = 0;
+  std::uint32_t first_page = 0;
+  std::uint32_t pages = 0;
+  bool operator==(CachedRange const &) const = default;
+};
+
+// Hot file ranges captured before halting, replayed after the next boot so
+// the working set of the services is in the page cache by the time they
+// start
+struct PageCacheIndex {
+  std::uint32_t page_size = 0;
+  std::vector<std::string> files;
+  std::vector<CachedRange> ranges;
+  bool operator==(PageCacheIndex const &) const = default;
+};
+
+struct ReplayStats {
+  std::size_t files = 0;
+  // files that are gone or could not be opened since the snapshot
+  std::size_t missing = 0;
+  std::size_t ranges = 0;
+  std::uint64_t bytes = 0;
+};
+
+// coalesces the mincore vector of a file into runs of resident pages
+std::vector<CachedRange> resident_runs(std::span<unsigned char const> vec,
+                                       std::uint32_t file);
+
+// files mapped by a running process, from /proc/<pid>/maps
+std::vector<std::filesystem::path>
+mapped_files(int pid, std::filesystem::path const &proc = "/proc");
+
+// bounds of a snapshot taken right before halting
+struct SnapshotLimits {
+  std::size_t max_files = 4096;
+  // files not reached by then are left out
+  std::chrono::milliseconds budget{500};
+};
+
+// throws if a pid:<n> spec does not name a process id
+void check_cache_specs(std::span<std::string const> specs);
+
+// expands snapshot specs into at most max_files files: a regular file, every
+// regular file below a directory, or pid:<n> for the files mapped by a
+// process. Processes that are gone and malformed specs are skipped.
+std::vector<std::filesystem::path>
+expand_cache_paths(std::span<std::string const> specs,
+                   std::filesystem::path const &proc = "/proc",
+                   std::size_t max_files = SnapshotLimits{}.max_files);
+
+// resident ranges of the files, found with mincore on a mapping that is never
+// touched, so taking the snapshot does not change the page cache itself.
+// Files that cannot be opened are skipped, the ones left once the budget is
+// spent as well.
+PageCacheIndex
+snapshot_page_cache(std::span<std::filesystem::path const> files,
+                    std::chrono::milliseconds budget = SnapshotLimits{}.budget);
+
+// compact binary index, written atomically, creates the parent directory
+void write_page_cache_index(std::filesystem::path const &path,
+                            PageCacheIndex const &index);
+// throws if the index is missing or malformed
+PageCacheIndex read_page_cache_index(std::filesystem::path const &path);
+
+// reads the ranges into the page cache with readahead, files spread over
+// the given number of threads. Ranges are clamped to the current file sizes.
+ReplayStats replay_page_cache(PageCacheIndex const &index,
+                              unsigned threads = 4);
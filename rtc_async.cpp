@@ -0,0 +1,219 @@
+#include "rtc_async.hpp"
+
+#include <fmt/format.h>
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// takes the device if it is free, otherwise queues the call without holding
+// the worker
+bool AsyncRTC::Acquire::await_suspend(std::coroutine_handle<> h) {
+  std::lock_guard lock(rtc.m_mtx);
+  if (!rtc.m_busy) {
+    rtc.m_busy = true;
+    return false;
+  }
+  rtc.m_waiting.push_back(h);
+  return true;
+}
+
+// hands the device to the next queued call, which keeps it busy
+AsyncRTC::Release::~Release() {
+  std::coroutine_handle<> next;
+  {
+    std::lock_guard lock(rtc.m_mtx);
+    if (rtc.m_waiting.empty()) {
+      rtc.m_busy = false;
+      return;
+    }
+    next = rtc.m_waiting.front();
+    rtc.m_waiting.pop_front();
+  }
+  rtc.m_pool.enqueue(next);
+}
+
+Task<rtc_time> AsyncRTC::get_time() {
+  return offload([this] { return m_rtc.get_time(); });
+}
+
+Task<void> AsyncRTC::set_wakeup(rtc_time time) {
+  return offload([this, time] { m_rtc.set_wakeup(time); });
+}
+
+Task<rtc_wkalrm> AsyncRTC::get_wakeup() {
+  return offload([this] { return m_rtc.get_wakeup(); });
+}
+
+Task<void> AsyncRTC::clear_wakeup() {
+  return offload([this] { m_rtc.clear_wakeup(); });
+}
+
+Task<bool> AsyncRTC::notify_listener(IRTC::IntegrationInfo info) {
+  return offload([this, info] { return m_rtc.notify_listener(info); });
+}
+
+Task<bool> AsyncRTC::unnotify_listener(IRTC::IntegrationInfo info) {
+  return offload([this, info] { return m_rtc.unnotify_listener(info); });
+}
+
+namespace {
+
+struct FdGuard {
+  int fd;
+  ~FdGuard() {
+    if (fd >= 0)
+      close(fd);
+  }
+};
+
+int socket_error(int fd) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+    return errno;
+  }
+  return err;
+}
+
+// the loopback addresses localhost resolves to, without the blocking
+// resolver
+struct Loopback {
+  sockaddr_storage addr{};
+  socklen_t len = 0;
+};
+
+std::array<Loopback, 2> loopback_addresses(std::uint16_t port) {
+  std::array<Loopback, 2> res{};
+  auto &v6 = reinterpret_cast<sockaddr_in6 &>(res[0].addr);
+  v6.sin6_family = AF_INET6;
+  v6.sin6_port = htons(port);
+  v6.sin6_addr = in6addr_loopback;
+  res[0].len = sizeof(sockaddr_in6);
+  auto &v4 = reinterpret_cast<sockaddr_in &>(res[1].addr);
+  v4.sin_family = AF_INET;
+  v4.sin_port = htons(port);
+  v4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  res[1].len = sizeof(sockaddr_in);
+  return res;
+}
+
+std::system_error timed_out(const char *what) {
+  return std::system_error(ETIMEDOUT, std::generic_category(), what);
+}
+
+Task<int> connect_local(Reactor &reactor, std::uint16_t port,
+                        Reactor::clock::time_point deadline) {
+  int err = ECONNREFUSED;
+  for (auto const &lo : loopback_addresses(port)) {
+    FdGuard sock{socket(lo.addr.ss_family,
+                        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (sock.fd < 0) {
+      err = errno;
+      continue;
+    }
+    if (connect(sock.fd, reinterpret_cast<sockaddr const *>(&lo.addr),
+                lo.len) == 0) {
+      co_return std::exchange(sock.fd, -1);
+    }
+    if (errno != EINPROGRESS) {
+      err = errno;
+      continue;
+    }
+    if (!co_await reactor.writable(sock.fd, deadline)) {
+      throw timed_out("connect");
+    }
+    if (err = socket_error(sock.fd); err == 0) {
+      co_return std::exchange(sock.fd, -1);
+    }
+  }
+  throw std::system_error(err, std::generic_category(), "connect");
+}
+
+} // namespace
+
+Task<int> http_post(Reactor &reactor, std::uint16_t port, std::string target,
+                    std::chrono::milliseconds timeout) {
+  const auto deadline = Reactor::clock::now() + timeout;
+  FdGuard sock{co_await connect_local(reactor, port, deadline)};
+  const auto request = fmt::format("POST {} HTTP/1.1\r\n"
+                                   "Host: localhost:{}\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n\r\n",
+                                   target, port);
+  for (std::size_t sent = 0; sent < request.size();) {
+    const auto n = send(sock.fd, request.data() + sent, request.size() - sent,
+                        MSG_NOSIGNAL);
+    if (n >= 0) {
+      sent += n;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (!co_await reactor.writable(sock.fd, deadline)) {
+        throw timed_out("send");
+      }
+    } else if (errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(), "send");
+    }
+  }
+  // the server closes the connection after the response
+  std::string response;
+  for (char buff[512];;) {
+    const auto n = recv(sock.fd, buff, sizeof(buff), 0);
+    if (n > 0) {
+      response.append(buff, n);
+    } else if (n == 0) {
+      break;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (!co_await reactor.readable(sock.fd, deadline)) {
+        throw timed_out("recv");
+      }
+    } else if (errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(), "recv");
+    }
+  }
+  // status line: HTTP/1.1 200 OK
+  const auto sp = response.find(' ');
+  int status = 0;
+  if (sp == std::string::npos ||
+      std::from_chars(response.data() + sp + 1,
+                      response.data() + response.size(), status)
+              .ec != std::errc{}) {
+    throw std::runtime_error("malformed http response");
+  }
+  co_return status;
+}
+
+Task<bool> AsyncMrHatIntegration::signal_reset_on_halt() {
+  return api_impl(true);
+}
+
+Task<bool> AsyncMrHatIntegration::clear_reset_on_halt() {
+  return api_impl(false);
+}
+
+Task<bool> AsyncMrHatIntegration::api_impl(bool set) {
+  const auto endpoint = fmt::format("/api/register/{}/{}/{}", rst_action_reg,
+                                    rst_action_bit, set ? 1 : 0);
+  int status = -1;
+  std::string error;
+  try {
+    status = co_await http_post(reactor, port, endpoint, timeout);
+    if (status >= 200 && status < 300) {
+      co_return true;
+    }
+  } catch (std::exception const &e) {
+    error = e.what();
+  }
+  fmt::print(stderr, "error sending reset on halt action to "
+             "http://localhost:{}{} status:{} error:{}\n",
+             port, endpoint, status, error);
+  co_return false;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <async_executor.hpp>
+#include <async_task.hpp>
+#include <irtc.hpp>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+// Awaitable front of an IRTC, the blocking calls are run on the worker pool
+// and the awaiting coroutine continues on the worker thread. Calls on the
+// same device are serialized, calls on different devices run in parallel up
+// to the size of the pool. A call waiting for the device does not occupy a
+// worker, it is queued and handed the device by the call before it.
+class AsyncRTC {
+public:
+  AsyncRTC(IRTC &rtc, WorkerPool &pool) : m_rtc{rtc}, m_pool{pool} {}
+
+  Task<rtc_time> get_time();
+  Task<void> set_wakeup(rtc_time time);
+  Task<rtc_wkalrm> get_wakeup();
+  Task<void> clear_wakeup();
+  Task<bool> notify_listener(IRTC::IntegrationInfo info);
+  Task<bool> unnotify_listener(IRTC::IntegrationInfo info);
+
+  IRTC &rtc() noexcept { return m_rtc; }
+
+private:
+  struct Acquire {
+    AsyncRTC &rtc;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept {}
+  };
+  struct Release {
+    AsyncRTC &rtc;
+    ~Release();
+  };
+
+  template <typename F> Task<std::invoke_result_t<F &>> offload(F f) {
+    co_await m_pool.schedule();
+    co_await Acquire{*this};
+    Release release{*this};
+    co_return f();
+  }
+
+  IRTC &m_rtc;
+  WorkerPool &m_pool;
+  std::mutex m_mtx;
+  bool m_busy = false;
+  // calls waiting for the device, resumed on the pool in turn
+  std::deque<std::coroutine_handle<>> m_waiting;
+};
+
+// POSTs to target on the http server listening on port of the loopback
+// interface without blocking, returns the http status code. Throws if the
+// exchange did not complete within the timeout.
+Task<int> http_post(Reactor &reactor, std::uint16_t port, std::string target,
+                    std::chrono::milliseconds timeout);
+
+// Non-blocking counterpart of MrHatIntegration driven by the reactor
+struct AsyncMrHatIntegration {
+  static constexpr std::chrono::milliseconds default_timeout{5000};
+
+  AsyncMrHatIntegration(Reactor &r, uint16_t p = 9000, unsigned rst_act_reg = 8,
+                        unsigned rst_action_b = 0,
+                        std::chrono::milliseconds t = default_timeout)
+      : reactor{r}, port{p}, rst_action_reg{rst_act_reg},
+        rst_action_bit{rst_action_b}, timeout{t} {}
+  Task<bool> signal_reset_on_halt();
+  Task<bool> clear_reset_on_halt();
+
+private:
+  Task<bool> api_impl(bool set);
+  Reactor &reactor;
+  uint16_t port;
+  unsigned rst_action_reg;
+  unsigned rst_action_bit;
+  std::chrono::milliseconds timeout;
+};
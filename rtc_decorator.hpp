@@ -0,0 +1,44 @@
+#pragma once
+
+#include <irtc.hpp>
+
+#include <memory>
+#include <utility>
+
+// Base for IRTC layers stacked on top of a backend, every call is forwarded to
+// the wrapped instance unless the layer overrides it
+class RTCDecorator : public IRTC {
+public:
+  explicit RTCDecorator(std::unique_ptr<IRTC> inner)
+      : m_inner{std::move(inner)} {}
+
+  rtc_time get_time() const override { return m_inner->get_time(); }
+  void set_time(rtc_time const &time) override { m_inner->set_time(time); }
+  rtc_time wait_update() const override { return m_inner->wait_update(); }
+  void set_wakeup(rtc_time const &time) override { m_inner->set_wakeup(time); }
+  rtc_wkalrm get_wakeup() const override { return m_inner->get_wakeup(); }
+  void clear_wakeup() override { m_inner->clear_wakeup(); }
+  void disable_wakeup(rtc_wkalrm const &armed) override {
+    m_inner->disable_wakeup(armed);
+  }
+  Clock type() const noexcept override { return m_inner->type(); }
+  std::string_view name() const noexcept override { return m_inner->name(); }
+  bool notify_listener(IntegrationInfo const &info) const noexcept override {
+    return m_inner->notify_listener(info);
+  }
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept override {
+    return m_inner->unnotify_listener(info);
+  }
+  void set_retry_policy(RetryPolicy const &policy) override {
+    m_inner->set_retry_policy(policy);
+  }
+  RetryStats retry_stats() const noexcept override {
+    return m_inner->retry_stats();
+  }
+
+protected:
+  IRTC &inner() const noexcept { return *m_inner; }
+
+private:
+  std::unique_ptr<IRTC> m_inner;
+};
@@ -1,110 +1,73 @@
 #include "irtc.hpp"
 #include "mrhat_integration.hpp"
+#include "rtc_device.hpp"
+#include "rtc_registry.hpp"
+
+#include <cstdio>
 
-#include <fcntl.h>
-#include <iostream>
 #include <sys/ioctl.h>
-#include <system_error>
-#include <unistd.h>
-#include <utility>
 
 #include <fmt/format.h>
 
+// compiled for every target, the backend is registered where the driver
+// header is available
+#ifdef MRHAT_RTCWAKE_HAS_RX8130
+
 #include <rtc-rx8130.h>
 
-class RTC : public IRTC {
-public:
-  explicit RTC(std::string_view name, bool m_is_utc = true)
-      : m_name{name}, m_is_utc{m_is_utc} {
-    const auto &dev = fmt::format("/dev/{}", name);
-    if (m_fd = open(dev.c_str(), O_RDWR); m_fd < 0) {
-      throw std::system_error(errno, std::generic_category(),
-                              static_cast<std::string>(name));
-    }
-  }
-  std::string_view name() const noexcept override { return m_name; }
+namespace {
 
-  RTC(const RTC &) = delete;
-  RTC &operator=(const RTC &) = delete;
-  RTC(RTC &&other) : m_fd{std::exchange(other.m_fd, -1)} {}
-  RTC &operator=(RTC &&other) {
-    if (this != &other) {
-      if (m_fd >= 0)
-        close(m_fd);
-      m_fd = std::exchange(other.m_fd, -1);
+// the wake timer of the RX8130 driver, which resets the MCU through
+// mrhat-daemon on halt
+struct RX8130Alarm {
+  static void set(int fd, Retrier const &retry, rtc_time const &time) {
+    if (retry([&] { return ioctl(fd, SE_RTC_WKTIMER_SET, &time); }) != 0) {
+      throw retry_error(retry, "SE_RTC_WKTIMER_SET ioctl");
     }
-    return *this;
-  }
-  ~RTC() override {
-    if (m_fd >= 0)
-      close(m_fd);
   }
-  rtc_time get_time() const override {
-    rtc_time rtc_tm{};
-    auto retval = ioctl(m_fd, RTC_RD_TIME, &rtc_tm);
-    if (retval == -1) {
-      throw std::system_error(errno, std::generic_category(),
-                              "RTC_RD_TIME ioctl");
+  static rtc_wkalrm get(int fd, Retrier const &retry) {
+    rtc_wkalrm rtc_tm{};
+    if (retry([&] { return ioctl(fd, SE_RTC_WKTIMER_GET, &rtc_tm); })) {
+      throw retry_error(retry, "SE_RTC_WKTIMER_GET ioctl");
     }
     return rtc_tm;
   }
-  void set_wakeup(rtc_time const &time) override {
-    if (ioctl(m_fd, SE_RTC_WKTIMER_SET, &time) != 0) {
-      throw std::system_error(
-          errno, std::generic_category(),
-          static_cast<std::string>("SE_RTC_WKTIMER_SET ioctl"));
+  static void clear(int fd, Retrier const &retry) {
+    if (retry([&] { return ioctl(fd, SE_RTC_WKTIMER_SET, nullptr); }) != 0) {
+      throw retry_error(retry, "SE_RTC_WKTIMER_SET clear ioctl");
     }
   }
-  void clear_wakeup() override {
-    if (ioctl(m_fd, SE_RTC_WKTIMER_SET, nullptr) != 0) {
-      throw std::system_error(
-          errno, std::generic_category(),
-          static_cast<std::string>("SE_RTC_WKTIMER_SET clear ioctl"));
-    }
+  static void disable(int fd, Retrier const &retry, rtc_wkalrm const &) {
+    // the wakeup timer is cleared with a single write anyway
+    clear(fd, retry);
   }
 
-  rtc_wkalrm get_wakeup() const override {
-    rtc_wkalrm rtc_tm{};
-    if (ioctl(m_fd, SE_RTC_WKTIMER_GET, &rtc_tm)) {
-      throw std::system_error(
-          errno, std::generic_category(),
-          static_cast<std::string>("SE_RTC_WKTIMER_GET ioctl"));
-    }
-    return rtc_tm;
-  }
-
-  Clock type() const noexcept override {
-    return m_is_utc ? IRTC::Clock::UTC : IRTC::Clock::LOCAL;
-  }
-
-  bool notify_listener(IntegrationInfo const &info) const noexcept final {
-    MrHatIntegration mrhat(info.port, info.reg, info.bit);
+  static bool notify(IRTC::IntegrationInfo const &info) noexcept {
+    MrHatIntegration mrhat(info.port, info.reg, info.bit, info.registers);
+    mrhat.set_register_cache(info.register_cache);
     const auto rst = mrhat.signal_reset_on_halt();
     if (!rst) {
-      std::cerr << "!!!WARNING: could not set reset on halt bit!\n";
+      fmt::print(stderr, "!!!WARNING: could not set reset on halt bit!\n");
     }
     return rst;
   }
-
-  bool unnotify_listener(IntegrationInfo const &info) const noexcept final {
-    MrHatIntegration mrhat(info.port, info.reg, info.bit);
+  static bool unnotify(IRTC::IntegrationInfo const &info) noexcept {
+    MrHatIntegration mrhat(info.port, info.reg, info.bit, info.registers);
+    mrhat.set_register_cache(info.register_cache);
     const auto rst = mrhat.clear_reset_on_halt();
     if (!rst) {
-      std::cerr << "!!!WARNING: could not clear reset on halt bit!\n";
+      fmt::print(stderr, "!!!WARNING: could not clear reset on halt bit!\n");
     }
     return rst;
   }
-
-private:
-  int m_fd = -1;
-  bool m_is_utc = true;
-  std::string m_name;
 };
 
-std::unique_ptr<IRTC> IRTC::get(std::string_view name, std::string_view adj) {
-  return std::make_unique<RTC>(name, parse_adjfile(adj) == Clock::UTC);
-};
+std::unique_ptr<IRTC> open_rx8130(std::string_view name, bool is_utc) {
+  return open_rtc_device<RX8130Alarm>(name, is_utc);
+}
+
+} // namespace
+
+const RTCBackend rx8130_backend{"rx8130", SE_RTC_WKTIMER_GET, &open_rx8130};
 
-std::unique_ptr<MockRTC> get(std::string_view name, std::string_view adj) {
-  throw std::runtime_error("Not Implemented");
-}
\ No newline at end of file
+#endif
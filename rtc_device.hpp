@@ -0,0 +1,187 @@
+#pragma once
+
+#include <irtc.hpp>
+#include <rtc_retry.hpp>
+
+#include <linux/rtc.h>
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+// Alarm ioctls of the generic rtc class driver (RTC_WKALM_RD/SET), the
+// listener is not notified. Alarm policies of RTCDevice provide the same
+// static members.
+struct StandardAlarm {
+  static void set(int fd, Retrier const &retry, rtc_time const &time) {
+    struct rtc_wkalrm alarm{};
+    alarm.time = time;
+    alarm.enabled = 1;
+    if (retry([&] { return ioctl(fd, RTC_WKALM_SET, &alarm); }) != 0) {
+      throw retry_error(retry, "RTC_WKALM_SET ioctl");
+    }
+  }
+  static rtc_wkalrm get(int fd, Retrier const &retry) {
+    rtc_wkalrm alarm{};
+    if (retry([&] { return ioctl(fd, RTC_WKALM_RD, &alarm); }) != 0) {
+      throw retry_error(retry, "RTC_WKALM_RD ioctl");
+    }
+    return alarm;
+  }
+  static void disable(int fd, Retrier const &retry, rtc_wkalrm const &armed) {
+    rtc_wkalrm alarm = armed;
+    alarm.enabled = 0;
+    if (retry([&] { return ioctl(fd, RTC_WKALM_SET, &alarm); }) != 0) {
+      throw retry_error(retry, "RTC_WKALM_SET clear ioctl");
+    }
+  }
+  static void clear(int fd, Retrier const &retry) {
+    disable(fd, retry, get(fd, retry));
+  }
+  static bool notify(IRTC::IntegrationInfo const &) noexcept { return true; }
+  static bool unnotify(IRTC::IntegrationInfo const &) noexcept { return true; }
+};
+
+// A device backend with the alarm ioctls and the clock kind fixed at compile
+// time. It has no virtual functions, so calls on a concrete RTCDevice inline
+// and the conversions of rtc_utils.hpp pick mktime/timegm and
+// localtime_r/gmtime_r from RTCDevice::clock instead of asking type().
+template <typename Alarm, IRTC::Clock C> class RTCDevice {
+public:
+  using Clock = IRTC::Clock;
+  using IntegrationInfo = IRTC::IntegrationInfo;
+  static constexpr Clock clock = C;
+
+  explicit RTCDevice(std::string_view name) : m_name{name} {
+    const auto &dev = fmt::format("/dev/{}", name);
+    if (m_fd = open(dev.c_str(), O_RDWR | O_CLOEXEC); m_fd < 0) {
+      throw std::system_error(errno, std::generic_category(), m_name);
+    }
+  }
+  RTCDevice(const RTCDevice &) = delete;
+  RTCDevice &operator=(const RTCDevice &) = delete;
+  ~RTCDevice() {
+    if (m_fd >= 0)
+      close(m_fd);
+  }
+
+  std::string_view name() const noexcept { return m_name; }
+  constexpr Clock type() const noexcept { return clock; }
+
+  rtc_time get_time() const {
+    rtc_time rtc_tm{};
+    if (m_retry([&] { return ioctl(m_fd, RTC_RD_TIME, &rtc_tm); }) == -1) {
+      throw retry_error(m_retry, "RTC_RD_TIME ioctl");
+    }
+    return rtc_tm;
+  }
+  void set_time(rtc_time const &time) {
+    if (m_retry([&] { return ioctl(m_fd, RTC_SET_TIME, &time); }) != 0) {
+      throw retry_error(m_retry, "RTC_SET_TIME ioctl");
+    }
+  }
+  rtc_time wait_update() const {
+    if (m_retry([&] { return ioctl(m_fd, RTC_UIE_ON, 0); }) != 0) {
+      throw retry_error(m_retry, "RTC_UIE_ON ioctl");
+    }
+    // the update interrupt fires once a second, so anything above that means
+    // the driver does not deliver them
+    pollfd pfd{m_fd, POLLIN, 0};
+    unsigned long data{};
+    int err = 0;
+    if (const auto ready = poll(&pfd, 1, 2000); ready <= 0) {
+      err = ready == 0 ? ETIMEDOUT : errno;
+    } else if (read(m_fd, &data, sizeof(data)) == -1) {
+      err = errno;
+    }
+    ioctl(m_fd, RTC_UIE_OFF, 0);
+    if (err != 0) {
+      throw std::system_error(err, std::generic_category(),
+                              "RTC update interrupt read");
+    }
+    return get_time();
+  }
+
+  void set_wakeup(rtc_time const &time) { Alarm::set(m_fd, m_retry, time); }
+  rtc_wkalrm get_wakeup() const { return Alarm::get(m_fd, m_retry); }
+  void clear_wakeup() { Alarm::clear(m_fd, m_retry); }
+  void disable_wakeup(rtc_wkalrm const &armed) {
+    Alarm::disable(m_fd, m_retry, armed);
+  }
+
+  bool notify_listener(IntegrationInfo const &info) const noexcept {
+    return Alarm::notify(info);
+  }
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept {
+    return Alarm::unnotify(info);
+  }
+
+  void set_retry_policy(RetryPolicy const &policy) {
+    m_retry.set_policy(policy);
+  }
+  RetryStats retry_stats() const noexcept { return m_retry.stats(); }
+
+private:
+  int m_fd = -1;
+  Retrier m_retry;
+  std::string m_name;
+};
+
+// Type erases a compile-time backend such as RTCDevice for the layers that
+// hold an IRTC, every call is forwarded to the wrapped instance
+template <typename Device> class RTCAdapter final : public IRTC {
+public:
+  template <typename... Args>
+  explicit RTCAdapter(Args &&...args) : m_dev{std::forward<Args>(args)...} {}
+
+  rtc_time get_time() const override { return m_dev.get_time(); }
+  void set_time(rtc_time const &time) override { m_dev.set_time(time); }
+  rtc_time wait_update() const override { return m_dev.wait_update(); }
+  void set_wakeup(rtc_time const &time) override { m_dev.set_wakeup(time); }
+  rtc_wkalrm get_wakeup() const override { return m_dev.get_wakeup(); }
+  void clear_wakeup() override { m_dev.clear_wakeup(); }
+  void disable_wakeup(rtc_wkalrm const &armed) override {
+    m_dev.disable_wakeup(armed);
+  }
+  Clock type() const noexcept override { return m_dev.type(); }
+  std::string_view name() const noexcept override { return m_dev.name(); }
+  bool notify_listener(IntegrationInfo const &info) const noexcept override {
+    return m_dev.notify_listener(info);
+  }
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept override {
+    return m_dev.unnotify_listener(info);
+  }
+  void set_retry_policy(RetryPolicy const &policy) override {
+    m_dev.set_retry_policy(policy);
+  }
+  RetryStats retry_stats() const noexcept override {
+    return m_dev.retry_stats();
+  }
+
+  Device &device() noexcept { return m_dev; }
+  Device const &device() const noexcept { return m_dev; }
+
+private:
+  Device m_dev;
+};
+
+// opens the device as the RTCDevice of the given clock kind, behind IRTC
+template <typename Alarm>
+std::unique_ptr<IRTC> open_rtc_device(std::string_view name, bool is_utc) {
+  if (is_utc) {
+    return std::make_unique<RTCAdapter<RTCDevice<Alarm, IRTC::Clock::UTC>>>(
+        name);
+  }
+  return std::make_unique<RTCAdapter<RTCDevice<Alarm, IRTC::Clock::LOCAL>>>(
+      name);
+}
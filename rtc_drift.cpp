@@ -0,0 +1,63 @@
+#include "rtc_drift.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include <sys/timex.h>
+
+#include <fmt/format.h>
+
+namespace {
+
+std::vector<std::string> split_lines(std::string_view text) {
+  std::vector<std::string> res;
+  while (!text.empty()) {
+    const auto nl = text.find('\n');
+    res.emplace_back(text.substr(0, nl));
+    text = nl == std::string_view::npos ? "" : text.substr(nl + 1);
+  }
+  return res;
+}
+
+} // namespace
+
+std::optional<double> DriftEstimator::rate_error() const noexcept {
+  const auto r = rate();
+  if (!r || m_n < 3) {
+    return std::nullopt;
+  }
+  // residual sum of squares of the fitted line
+  const double rss = std::max(m_soo - *r * m_sto, 0.0);
+  return std::sqrt(rss / static_cast<double>(m_n - 2) / m_stt);
+}
+
+std::string set_adjfile_drift(std::string_view adj, double seconds_per_day,
+                              std::time_t calibrated) {
+  const auto lines = split_lines(adj);
+  std::istringstream first(lines.empty() ? std::string{} : lines[0]);
+  std::string drift;
+  std::string last_adjust;
+  std::string status;
+  if (lines.size() < 3 || !(first >> drift >> last_adjust >> status)) {
+    throw std::runtime_error("malformed adjustment file");
+  }
+  // the layout hwclock writes
+  return fmt::format("{:.6f} {} {}\n{}\n{}\n", seconds_per_day, last_adjust,
+                     status, calibrated, lines[2]);
+}
+
+bool system_clock_synchronized() noexcept {
+  // modes 0 only reads the state
+  timex tx{};
+  return ntp_adjtime(&tx) != TIME_ERROR;
+}
+
+std::string to_json(DriftResult const &result) {
+  return fmt::format("{{\"samples\":{},\"span_s\":{:.1f},\"drift_s_per_day\":"
+                     "{:.6f},\"drift_ppm\":{:.3f},\"drift_ppm_error\":{:.3f}}}",
+                     result.samples, result.span.count(),
+                     result.seconds_per_day(), result.ppm(),
+                     result.rate_error * 1e6);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Least squares fit of the RTC offset from the system clock over time,
+// updated one sample at a time in constant memory. The sums are kept centered
+// on the running means, so samples taken far from zero lose no precision.
+class DriftEstimator {
+public:
+  // offset (RTC minus system time) measured at system time t, in seconds
+  void add(double t, double offset) noexcept {
+    ++m_n;
+    const double dt = t - m_mean_t;
+    const double doff = offset - m_mean_off;
+    m_mean_t += dt / static_cast<double>(m_n);
+    m_mean_off += doff / static_cast<double>(m_n);
+    m_stt += dt * (t - m_mean_t);
+    m_sto += dt * (offset - m_mean_off);
+    m_soo += doff * (offset - m_mean_off);
+  }
+
+  std::size_t count() const noexcept { return m_n; }
+  // seconds the RTC gains per second of system time, unset until two samples
+  // at different times were added
+  std::optional<double> rate() const noexcept {
+    if (m_n < 2 || m_stt <= 0) {
+      return std::nullopt;
+    }
+    return m_sto / m_stt;
+  }
+  // standard error of the rate, unset with fewer than three samples
+  std::optional<double> rate_error() const noexcept;
+
+private:
+  std::size_t m_n = 0;
+  double m_mean_t = 0;
+  double m_mean_off = 0;
+  double m_stt = 0;
+  double m_sto = 0;
+  double m_soo = 0;
+};
+
+// A second boundary of the RTC and the system time it was observed at
+struct EdgeSample {
+  std::chrono::sys_seconds rtc;
+  std::chrono::system_clock::time_point sys;
+};
+
+struct CalibrationOptions {
+  std::chrono::seconds duration{3600};
+  // between the samples, each sample waits up to a second for the edge
+  std::chrono::seconds interval{10};
+};
+
+struct DriftResult {
+  std::size_t samples = 0;
+  // system time from the first to the last sample
+  std::chrono::duration<double> span{};
+  double rate = 0;
+  double rate_error = 0;
+
+  // the drift factor of the adjustment file: seconds gained per day
+  double seconds_per_day() const noexcept { return rate * 86400; }
+  double ppm() const noexcept { return rate * 1e6; }
+};
+
+// Samples an RTC edge with sample() every opts.interval over opts.duration,
+// sleep_for(interval) waits in between. Throws if the samples do not yield a
+// rate, e.g. because the duration is shorter than the interval.
+template <typename Sample, typename SleepFor>
+DriftResult calibrate_drift(CalibrationOptions const &opts, Sample &&sample,
+                            SleepFor &&sleep_for) {
+  const auto n =
+      opts.interval.count() > 0 ? opts.duration / opts.interval + 1 : 2;
+  DriftEstimator estimator;
+  std::optional<std::chrono::system_clock::time_point> first;
+  std::chrono::duration<double> t{};
+  for (std::int64_t i = 0; i < n; ++i) {
+    if (i != 0) {
+      sleep_for(opts.interval);
+    }
+    const EdgeSample edge = sample();
+    if (!first) {
+      first = edge.sys;
+    }
+    // relative to the first sample, the offsets are well below a second
+    t = edge.sys - *first;
+    const std::chrono::duration<double> offset = edge.rtc - edge.sys;
+    estimator.add(t.count(), offset.count());
+  }
+  const auto rate = estimator.rate();
+  if (!rate) {
+    throw std::runtime_error(
+        "calibration needs samples at two different times, the duration has "
+        "to exceed the interval");
+  }
+  return {.samples = estimator.count(),
+          .span = t,
+          .rate = *rate,
+          .rate_error = estimator.rate_error().value_or(0)};
+}
+
+// the adjustment file with the drift factor set and the calibration time
+// updated, the last adjustment and the clock type are kept. Throws if adj is
+// malformed.
+std::string set_adjfile_drift(std::string_view adj, double seconds_per_day,
+                              std::time_t calibrated);
+
+// the kernel considers the system clock synchronized, e.g. by NTP
+bool system_clock_synchronized() noexcept;
+
+std::string to_json(DriftResult const &result);
@@ -0,0 +1,263 @@
+#include "rtc_instrumented.hpp"
+
+#include <atomic_file.hpp>
+
+#include <chrono>
+#include <exception>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace {
+
+class CallTimer {
+public:
+  explicit CallTimer(CallStats &stats) noexcept : m_stats{stats} {
+    ++m_stats.calls;
+  }
+  CallTimer(const CallTimer &) = delete;
+  CallTimer &operator=(const CallTimer &) = delete;
+  ~CallTimer() {
+    m_stats.latency.record(std::chrono::steady_clock::now() - m_start);
+    if (std::uncaught_exceptions() > m_exceptions) {
+      ++m_stats.errors;
+    }
+  }
+
+private:
+  CallStats &m_stats;
+  int m_exceptions = std::uncaught_exceptions();
+  std::chrono::steady_clock::time_point m_start =
+      std::chrono::steady_clock::now();
+};
+
+bool count_failure(CallStats &stats, bool result) noexcept {
+  if (!result) {
+    ++stats.errors;
+  }
+  return result;
+}
+
+constexpr std::uint32_t state_magic = 0x4d52534d; // "MRSM"
+// 2: buckets include their upper bound
+constexpr std::uint32_t state_version = 2;
+
+struct StateHeader {
+  std::uint32_t magic = state_magic;
+  std::uint32_t version = state_version;
+  std::uint32_t methods = static_cast<std::uint32_t>(
+      InstrumentedRTC::Method::COUNT);
+  std::uint32_t buckets = LatencyHistogram::bucket_count;
+};
+
+struct MethodRecord {
+  std::uint64_t calls;
+  std::uint64_t errors;
+  std::uint64_t count;
+  std::uint64_t sum;
+  std::array<std::uint64_t, LatencyHistogram::bucket_count> buckets;
+};
+
+// a state file in an unknown format is dropped instead of failing the export
+void merge_state(int fd, InstrumentedRTC::Stats &stats) {
+  StateHeader header{};
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      header.magic != state_magic || header.version != state_version ||
+      header.methods != stats.size() ||
+      header.buckets != LatencyHistogram::bucket_count) {
+    return;
+  }
+  std::vector<MethodRecord> records(stats.size());
+  const auto size = records.size() * sizeof(MethodRecord);
+  if (pread(fd, records.data(), size, sizeof(header)) !=
+      static_cast<ssize_t>(size)) {
+    return;
+  }
+  for (std::size_t i = 0; i < stats.size(); ++i) {
+    auto const &rec = records[i];
+    LatencyHistogram prev;
+    prev.buckets() = rec.buckets;
+    prev.set_totals(rec.count, rec.sum);
+    stats[i].calls += rec.calls;
+    stats[i].errors += rec.errors;
+    stats[i].latency.merge(prev);
+  }
+}
+
+void write_state(int fd, InstrumentedRTC::Stats const &stats) {
+  std::vector<MethodRecord> records(stats.size());
+  for (std::size_t i = 0; i < stats.size(); ++i) {
+    records[i] = {stats[i].calls, stats[i].errors, stats[i].latency.count(),
+                  static_cast<std::uint64_t>(stats[i].latency.sum().count()),
+                  stats[i].latency.buckets()};
+  }
+  const StateHeader header{};
+  const auto size = records.size() * sizeof(MethodRecord);
+  if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      pwrite(fd, records.data(), size, sizeof(header)) !=
+          static_cast<ssize_t>(size)) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to write metrics state");
+  }
+}
+
+} // namespace
+
+rtc_time InstrumentedRTC::get_time() const {
+  CallTimer timer(stats_of(Method::get_time));
+  return RTCDecorator::get_time();
+}
+
+void InstrumentedRTC::set_time(rtc_time const &time) {
+  CallTimer timer(stats_of(Method::set_time));
+  RTCDecorator::set_time(time);
+}
+
+rtc_time InstrumentedRTC::wait_update() const {
+  CallTimer timer(stats_of(Method::wait_update));
+  return RTCDecorator::wait_update();
+}
+
+void InstrumentedRTC::set_wakeup(rtc_time const &time) {
+  CallTimer timer(stats_of(Method::set_wakeup));
+  RTCDecorator::set_wakeup(time);
+}
+
+rtc_wkalrm InstrumentedRTC::get_wakeup() const {
+  CallTimer timer(stats_of(Method::get_wakeup));
+  return RTCDecorator::get_wakeup();
+}
+
+void InstrumentedRTC::clear_wakeup() {
+  CallTimer timer(stats_of(Method::clear_wakeup));
+  RTCDecorator::clear_wakeup();
+}
+
+void InstrumentedRTC::disable_wakeup(rtc_wkalrm const &armed) {
+  CallTimer timer(stats_of(Method::disable_wakeup));
+  RTCDecorator::disable_wakeup(armed);
+}
+
+bool InstrumentedRTC::notify_listener(
+    IntegrationInfo const &info) const noexcept {
+  auto &stats = stats_of(Method::notify_listener);
+  CallTimer timer(stats);
+  return count_failure(stats, RTCDecorator::notify_listener(info));
+}
+
+bool InstrumentedRTC::unnotify_listener(
+    IntegrationInfo const &info) const noexcept {
+  auto &stats = stats_of(Method::unnotify_listener);
+  CallTimer timer(stats);
+  return count_failure(stats, RTCDecorator::unnotify_listener(info));
+}
+
+std::string to_prometheus(InstrumentedRTC::Stats const &stats,
+                          std::string_view device) {
+  constexpr auto prefix = "mrhat_rtcwake_rtc";
+  std::string out;
+  auto it = std::back_inserter(out);
+  auto for_each_called = [&](auto &&f) {
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+      if (stats[i].calls != 0) {
+        f(InstrumentedRTC::method_names[i], stats[i]);
+      }
+    }
+  };
+
+  fmt::format_to(it,
+                 "# HELP {0}_calls_total Number of calls to the RTC backend.\n"
+                 "# TYPE {0}_calls_total counter\n",
+                 prefix);
+  for_each_called([&](auto method, CallStats const &s) {
+    fmt::format_to(it, "{}_calls_total{{device=\"{}\",method=\"{}\"}} {}\n",
+                   prefix, device, method, s.calls);
+  });
+  fmt::format_to(it,
+                 "# HELP {0}_errors_total Number of failed calls to the RTC "
+                 "backend.\n"
+                 "# TYPE {0}_errors_total counter\n",
+                 prefix);
+  for_each_called([&](auto method, CallStats const &s) {
+    fmt::format_to(it, "{}_errors_total{{device=\"{}\",method=\"{}\"}} {}\n",
+                   prefix, device, method, s.errors);
+  });
+  fmt::format_to(it,
+                 "# HELP {0}_latency_seconds Latency of calls to the RTC "
+                 "backend.\n"
+                 "# TYPE {0}_latency_seconds histogram\n",
+                 prefix);
+  for_each_called([&](auto method, CallStats const &s) {
+    // power of two bounds from 16us to ~16s fall on bucket boundaries
+    for (unsigned bit = 4; bit <= 24; ++bit) {
+      const std::uint64_t bound = std::uint64_t{1} << bit;
+      fmt::format_to(
+          it,
+          "{}_latency_seconds_bucket{{device=\"{}\",method=\"{}\",le=\"{}\"}} "
+          "{}\n",
+          prefix, device, method, static_cast<double>(bound) / 1e6,
+          s.latency.count_at_most(bound));
+    }
+    fmt::format_to(
+        it,
+        "{0}_latency_seconds_bucket{{device=\"{1}\",method=\"{2}\",le=\"+"
+        "Inf\"}} {3}\n"
+        "{0}_latency_seconds_sum{{device=\"{1}\",method=\"{2}\"}} {4}\n"
+        "{0}_latency_seconds_count{{device=\"{1}\",method=\"{2}\"}} {3}\n",
+        prefix, device, method, s.latency.count(),
+        static_cast<double>(s.latency.sum().count()) / 1e6);
+  });
+  return out;
+}
+
+void export_metrics(std::filesystem::path const &textfile,
+                    InstrumentedRTC::Stats const &stats,
+                    std::string_view device) {
+  auto state_path = textfile;
+  state_path += ".state";
+  const int fd = open(state_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to open " + state_path.string());
+  }
+  struct FdGuard {
+    int fd;
+    ~FdGuard() { close(fd); }
+  } guard{fd};
+  // concurrent invocations must not lose each other's updates
+  if (flock(fd, LOCK_EX) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to lock " + state_path.string());
+  }
+  auto merged = stats;
+  merge_state(fd, merged);
+  write_state(fd, merged);
+
+  write_file_atomically(textfile, to_prometheus(merged, device));
+}
+
+InstrumentedRTC::Stats read_metrics(std::filesystem::path const &textfile) {
+  InstrumentedRTC::Stats stats{};
+  auto state_path = textfile;
+  state_path += ".state";
+  const int fd = open(state_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return stats;
+  }
+  struct FdGuard {
+    int fd;
+    ~FdGuard() { close(fd); }
+  } guard{fd};
+  // an export in progress rewrites the file in place
+  if (flock(fd, LOCK_SH) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to lock " + state_path.string());
+  }
+  merge_state(fd, stats);
+  return stats;
+}
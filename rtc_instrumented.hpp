@@ -0,0 +1,75 @@
+#pragma once
+
+#include <latency_histogram.hpp>
+#include <rtc_decorator.hpp>
+
+#include <array>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+struct CallStats {
+  std::uint64_t calls = 0;
+  std::uint64_t errors = 0;
+  LatencyHistogram latency;
+};
+
+// Records call count, errors and latency distribution of every IRTC call
+// forwarded to the wrapped backend
+class InstrumentedRTC : public RTCDecorator {
+public:
+  enum class Method {
+    get_time,
+    set_time,
+    wait_update,
+    set_wakeup,
+    get_wakeup,
+    clear_wakeup,
+    disable_wakeup,
+    notify_listener,
+    unnotify_listener,
+    COUNT
+  };
+  static constexpr std::array<std::string_view,
+                              static_cast<std::size_t>(Method::COUNT)>
+      method_names = {"get_time",          "set_time",       "wait_update",
+                      "set_wakeup",        "get_wakeup",     "clear_wakeup",
+                      "disable_wakeup",    "notify_listener",
+                      "unnotify_listener"};
+  using Stats = std::array<CallStats, static_cast<std::size_t>(Method::COUNT)>;
+
+  using RTCDecorator::RTCDecorator;
+
+  rtc_time get_time() const override;
+  void set_time(rtc_time const &time) override;
+  rtc_time wait_update() const override;
+  void set_wakeup(rtc_time const &time) override;
+  rtc_wkalrm get_wakeup() const override;
+  void clear_wakeup() override;
+  void disable_wakeup(rtc_wkalrm const &armed) override;
+  bool notify_listener(IntegrationInfo const &info) const noexcept override;
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept override;
+
+  Stats const &stats() const noexcept { return m_stats; }
+
+private:
+  CallStats &stats_of(Method m) const noexcept {
+    return m_stats[static_cast<std::size_t>(m)];
+  }
+  mutable Stats m_stats{};
+};
+
+// Prometheus text exposition of the stats, labelled with the device name
+std::string to_prometheus(InstrumentedRTC::Stats const &stats,
+                          std::string_view device);
+
+// Adds the stats to the ones accumulated by earlier invocations in the state
+// file next to the textfile, then atomically rewrites the textfile for the
+// node_exporter textfile collector.
+void export_metrics(std::filesystem::path const &textfile,
+                    InstrumentedRTC::Stats const &stats,
+                    std::string_view device);
+
+// Stats accumulated by export_metrics in the state file next to the textfile,
+// all zero if there is none yet or it is in an unknown format
+InstrumentedRTC::Stats read_metrics(std::filesystem::path const &textfile);
@@ -0,0 +1,51 @@
+#include "rtc_lazy.hpp"
+
+#include <cstdio>
+
+#include <fmt/format.h>
+
+IRTC &LazyRTC::backend() const {
+  if (!m_backend) {
+    auto rtc = m_open();
+    if (m_policy) {
+      rtc->set_retry_policy(*m_policy);
+    }
+    m_backend = std::move(rtc);
+  }
+  return *m_backend;
+}
+
+auto LazyRTC::resolve_clock() const -> Clock {
+  if (m_clock == Clock::INVALID) {
+    m_clock = parse_adjfile(m_load_adj());
+  }
+  return m_clock;
+}
+
+bool LazyRTC::notify_listener(IntegrationInfo const &info) const noexcept try {
+  return backend().notify_listener(info);
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: failed to open {}: {}\n",
+             m_name, e.what());
+  return false;
+}
+
+bool LazyRTC::unnotify_listener(
+    IntegrationInfo const &info) const noexcept try {
+  return backend().unnotify_listener(info);
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: failed to open {}: {}\n",
+             m_name, e.what());
+  return false;
+}
+
+void LazyRTC::set_retry_policy(RetryPolicy const &policy) {
+  m_policy = policy;
+  if (m_backend) {
+    m_backend->set_retry_policy(policy);
+  }
+}
+
+RetryStats LazyRTC::retry_stats() const noexcept {
+  return m_backend ? m_backend->retry_stats() : RetryStats{};
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <irtc.hpp>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+// Defers opening the device and reading the adjustment file to the first call
+// that needs them, so an invocation only touches what its mode requires. The
+// device is opened by the first RTC operation, the clock type is read by
+// resolve_clock(), until then type() reports INVALID. rtc_utils.hpp converts
+// from an INVALID clock as UTC but to it as local time, so the clock has to
+// be resolved before any conversion or publishing it, see RTCWake::rtc().
+class LazyRTC : public IRTC {
+public:
+  using Open = std::function<std::unique_ptr<IRTC>()>;
+  using LoadAdj = std::function<std::string()>;
+
+  LazyRTC(std::string name, Open open, LoadAdj load_adj)
+      : m_name{std::move(name)}, m_open{std::move(open)},
+        m_load_adj{std::move(load_adj)} {}
+
+  rtc_time get_time() const override { return backend().get_time(); }
+  void set_time(rtc_time const &time) override { backend().set_time(time); }
+  rtc_time wait_update() const override { return backend().wait_update(); }
+  void set_wakeup(rtc_time const &time) override {
+    backend().set_wakeup(time);
+  }
+  rtc_wkalrm get_wakeup() const override { return backend().get_wakeup(); }
+  void clear_wakeup() override { backend().clear_wakeup(); }
+  void disable_wakeup(rtc_wkalrm const &armed) override {
+    backend().disable_wakeup(armed);
+  }
+  Clock type() const noexcept override { return m_clock; }
+  std::string_view name() const noexcept override { return m_name; }
+  bool notify_listener(IntegrationInfo const &info) const noexcept override;
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept override;
+  void set_retry_policy(RetryPolicy const &policy) override;
+  RetryStats retry_stats() const noexcept override;
+
+  // opens the device if not done yet
+  void open() const { backend(); }
+  // reads the adjustment file once, throws if it is missing or malformed
+  Clock resolve_clock() const;
+
+  bool opened() const noexcept { return m_backend != nullptr; }
+  bool clock_resolved() const noexcept { return m_clock != Clock::INVALID; }
+
+private:
+  IRTC &backend() const;
+
+  std::string m_name;
+  Open m_open;
+  LoadAdj m_load_adj;
+  std::optional<RetryPolicy> m_policy;
+  mutable std::unique_ptr<IRTC> m_backend;
+  mutable Clock m_clock = Clock::INVALID;
+};
@@ -1,5 +1,10 @@
 #include "irtc.hpp"
+#include "mrhat_integration.hpp"
+#include "rtc_decorator.hpp"
 
+#include <cerrno>
+#include <ctime>
+#include <deque>
 #include <map>
 #include <string>
 #include <utility>
@@ -7,18 +12,47 @@
 namespace {
 
 struct MockRTCImpl : MockRTC {
-  MockRTCImpl(std::string_view adj) : m_clock(IRTC::parse_adjfile(adj)) {}
-  rtc_time get_time() const override { return m_tm; }
+  MockRTCImpl(std::string_view adj)
+      : m_clock(adj.empty() ? Clock::UTC : IRTC::parse_adjfile(adj)) {}
+  rtc_time get_time() const override {
+    simulate_ioctl("RTC_RD_TIME ioctl");
+    return m_tm;
+  }
+  rtc_time wait_update() const override {
+    simulate_ioctl("RTC_UIE_ON ioctl");
+    // RTC_UIE_OFF is not checked by the device backends either
+    ++m_ioctls;
+    simulate_ioctl("RTC_RD_TIME ioctl");
+    // simulated update edge: the next second boundary is reached instantly
+    auto time = to_tm(m_tm);
+    time.tm_sec += 1;
+    const auto ts = timegm(&time);
+    gmtime_r(&ts, &time);
+    m_tm = to_rtc_time(time);
+    return m_tm;
+  }
   void set_wakeup(rtc_time const &time) override {
     // TODO check time for past
+    simulate_ioctl("RTC_WKALM_SET ioctl");
     m_wakeup.time = time;
     m_wakeup.enabled = 1;
     m_wakeup.pending = 0;
   }
-  rtc_wkalrm get_wakeup() const override { return m_wakeup; }
-  void clear_wakeup() override {}
+  rtc_wkalrm get_wakeup() const override {
+    simulate_ioctl("RTC_WKALM_RD ioctl");
+    return m_wakeup;
+  }
+  void clear_wakeup() override { disable_wakeup(get_wakeup()); }
+  void disable_wakeup(rtc_wkalrm const &) override {
+    simulate_ioctl("RTC_WKALM_SET clear ioctl");
+    m_wakeup.enabled = 0;
+    m_wakeup.pending = 0;
+  }
   Clock type() const noexcept override { return m_clock; }
-  void set_time(rtc_time const &time) override { m_tm = time; }
+  void set_time(rtc_time const &time) override {
+    simulate_ioctl("RTC_SET_TIME ioctl");
+    m_tm = time;
+  }
   void wakeup_occured() override {
     if (!m_wakeup.enabled) {
       throw std::logic_error("rtc wakeup was not armed");
@@ -26,6 +60,14 @@ struct MockRTCImpl : MockRTC {
     m_wakeup.pending = 1;
   }
   std::string_view name() const noexcept override { return "mock"; }
+  std::size_t ioctl_count() const noexcept override { return m_ioctls; }
+  void inject_faults(std::initializer_list<int> errnos) override {
+    m_faults.insert(m_faults.end(), errnos);
+  }
+  void set_retry_policy(RetryPolicy const &policy) override {
+    m_retry.set_policy(policy);
+  }
+  RetryStats retry_stats() const noexcept override { return m_retry.stats(); }
   bool notify_listener(IntegrationInfo const &) const noexcept final {
     // nothing to do here;
     return true;
@@ -36,9 +78,32 @@ struct MockRTCImpl : MockRTC {
   }
 
 private:
-  rtc_time m_tm{};
+  // counts an ioctl, which fails with the next injected fault if there is one
+  void simulate_ioctl(const char *what) const {
+    const auto res = m_retry([this] {
+      ++m_ioctls;
+      if (m_faults.empty()) {
+        return 0;
+      }
+      const int err = m_faults.front();
+      m_faults.pop_front();
+      if (err != 0) {
+        errno = err;
+        return -1;
+      }
+      return 0;
+    });
+    if (res != 0) {
+      throw retry_error(m_retry, what);
+    }
+  }
+
+  mutable rtc_time m_tm{};
   rtc_wkalrm m_wakeup{};
   Clock m_clock{};
+  mutable std::size_t m_ioctls = 0;
+  mutable std::deque<int> m_faults;
+  Retrier m_retry;
 };
 
 } // namespace
@@ -48,6 +113,39 @@ std::unique_ptr<MockRTC> MockRTC::get(std::string_view name,
   return std::make_unique<MockRTCImpl>(adj);
 }
 
+#ifdef MRHAT_RTCWAKE_MOCK_DEVICE
+namespace {
+
+// stands in for the RX8130 board: runs at the system time and signals reset
+// on halt to mrhat-daemon, so the CLI can be driven end to end
+class MockDevice : public RTCDecorator {
+public:
+  explicit MockDevice(std::unique_ptr<MockRTC> mock)
+      : RTCDecorator{std::move(mock)} {
+    const auto now = std::time(nullptr);
+    struct tm time{};
+    if (type() == Clock::LOCAL) {
+      localtime_r(&now, &time);
+    } else {
+      gmtime_r(&now, &time);
+    }
+    inner().set_time(to_rtc_time(time));
+  }
+  bool notify_listener(IntegrationInfo const &info) const noexcept override {
+    MrHatIntegration mrhat(info.port, info.reg, info.bit, info.registers);
+    mrhat.set_register_cache(info.register_cache);
+    return mrhat.signal_reset_on_halt();
+  }
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept override {
+    MrHatIntegration mrhat(info.port, info.reg, info.bit, info.registers);
+    mrhat.set_register_cache(info.register_cache);
+    return mrhat.clear_reset_on_halt();
+  }
+};
+
+} // namespace
+
 std::unique_ptr<IRTC> IRTC::get(std::string_view name, std::string_view adj) {
-  return std::make_unique<MockRTCImpl>(adj);
-}
\ No newline at end of file
+  return std::make_unique<MockDevice>(MockRTC::get(name, adj));
+}
+#endif
\ No newline at end of file
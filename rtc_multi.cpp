@@ -0,0 +1,176 @@
+#include "rtc_multi.hpp"
+
+#include <json_string.hpp>
+#include <rtc_utils.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <charconv>
+#include <future>
+#include <ranges>
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+namespace chr = std::chrono;
+
+namespace {
+
+std::optional<unsigned> rtc_index(std::string_view name) {
+  constexpr std::string_view prefix = "rtc";
+  if (!name.starts_with(prefix) || name.size() == prefix.size()) {
+    return {};
+  }
+  unsigned idx = 0;
+  const auto *first = name.data() + prefix.size();
+  const auto *last = name.data() + name.size();
+  if (auto [ptr, ec] = std::from_chars(first, last, idx);
+      ec != std::errc{} || ptr != last) {
+    return {};
+  }
+  return idx;
+}
+
+void read_time(RTCWake &wake, DeviceReport &report) {
+  const auto tm = wake.rtc().get_time();
+  const auto now = chr::floor<chr::seconds>(chr::system_clock::now());
+  report.time = chr::floor<chr::seconds>(rtc_to_sys(tm, wake.rtc()));
+  report.offset = report.time - now;
+}
+
+} // namespace
+
+std::vector<std::string> list_rtc_devices(fs::path const &dev) {
+  std::vector<std::pair<unsigned, std::string>> found;
+  std::error_code ec;
+  for (auto const &entry : fs::directory_iterator(dev, ec)) {
+    auto name = entry.path().filename().string();
+    if (const auto idx = rtc_index(name)) {
+      found.emplace_back(*idx, std::move(name));
+    }
+  }
+  std::ranges::sort(found);
+  std::vector<std::string> res;
+  for (auto &[idx, name] : found) {
+    res.push_back(std::move(name));
+  }
+  return res;
+}
+
+std::vector<std::string> parse_device_list(std::string_view arg,
+                                           fs::path const &dev) {
+  std::vector<std::string> res;
+  if (arg == "all") {
+    res = list_rtc_devices(dev);
+    if (res.empty()) {
+      throw std::runtime_error(
+          fmt::format("no RTC devices found in {}", dev.string()));
+    }
+    return res;
+  }
+  for (const auto part : arg | std::views::split(',')) {
+    if (std::string name(part.begin(), part.end()); !name.empty()) {
+      res.push_back(std::move(name));
+    }
+  }
+  if (res.empty()) {
+    throw std::runtime_error("no RTC device given");
+  }
+  return res;
+}
+
+bool MultiDeviceReport::ok() const noexcept {
+  return std::ranges::all_of(
+      devices, [](DeviceReport const &d) { return d.error.empty(); });
+}
+
+MultiDevice::MultiDevice(std::vector<std::string> devices,
+                         RTCWake::Options opts)
+    : MultiDevice(std::move(devices), opts,
+                  [adj = read_adjfile(opts.adjfile)](std::string const &dev) {
+                    return IRTC::get(dev, adj);
+                  }) {}
+
+MultiDevice::MultiDevice(std::vector<std::string> devices,
+                         RTCWake::Options opts, Backend backend)
+    : m_devices{std::move(devices)}, m_opts{std::move(opts)},
+      m_backend{std::move(backend)} {
+  m_opts.status_file.clear();
+}
+
+MultiDeviceReport MultiDevice::query() const {
+  return run([](RTCWake &wake, DeviceReport &report) {
+    read_time(wake, report);
+    report.alarm = wake.show();
+  });
+}
+
+MultiDeviceReport MultiDevice::arm(RTCWake::WakeSpec const &spec) const {
+  return run([&spec](RTCWake &wake, DeviceReport &report) {
+    const auto res = wake.schedule(spec);
+    report.time = res.now;
+    report.offset =
+        res.now - chr::floor<chr::seconds>(chr::system_clock::now());
+    report.alarm = {.enabled = true, .pending = false, .wakeup = res.wakeup};
+  });
+}
+
+MultiDeviceReport MultiDevice::disable() const {
+  return run([](RTCWake &wake, DeviceReport &report) {
+    read_time(wake, report);
+    wake.disable();
+  });
+}
+
+MultiDeviceReport MultiDevice::run(Op const &op) const {
+  using clock = chr::steady_clock;
+  const auto start = clock::now();
+  std::vector<std::future<DeviceReport>> pending;
+  pending.reserve(m_devices.size());
+  for (auto const &device : m_devices) {
+    pending.push_back(std::async(std::launch::async, [&, device] {
+      DeviceReport report;
+      report.device = device;
+      const auto t0 = clock::now();
+      try {
+        auto opts = m_opts;
+        opts.device = device;
+        RTCWake wake(std::move(opts), m_backend(device));
+        op(wake, report);
+      } catch (std::exception const &e) {
+        report.error = e.what();
+      }
+      report.latency = chr::duration_cast<chr::microseconds>(clock::now() - t0);
+      return report;
+    }));
+  }
+  MultiDeviceReport res;
+  for (auto &f : pending) {
+    res.devices.push_back(f.get());
+  }
+  res.latency = chr::duration_cast<chr::microseconds>(clock::now() - start);
+  return res;
+}
+
+std::string to_json(MultiDeviceReport const &report) {
+  std::string res =
+      fmt::format("{{\"latency_us\":{},\"devices\":[", report.latency.count());
+  for (std::size_t i = 0; i < report.devices.size(); ++i) {
+    auto const &d = report.devices[i];
+    res += fmt::format("{}{{\"device\":{},\"ok\":{},", i > 0 ? "," : "",
+                       json_string(d.device), d.error.empty());
+    if (d.error.empty()) {
+      res += fmt::format("\"time\":{},\"offset_s\":{},\"alarm\":{{\"enabled\":"
+                         "{},\"pending\":{},\"wakeup\":{}}},",
+                         d.time.time_since_epoch().count(), d.offset.count(),
+                         d.alarm.enabled, d.alarm.pending,
+                         d.alarm.wakeup.time_since_epoch().count());
+    } else {
+      res += fmt::format("\"error\":{},", json_string(d.error));
+    }
+    res += fmt::format("\"latency_us\":{}}}", d.latency.count());
+  }
+  res += "]}";
+  return res;
+}
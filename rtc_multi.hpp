@@ -0,0 +1,73 @@
+#pragma once
+
+#include <rtcwake.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// names of the RTC character devices in dev, rtc0, rtc1, ... in numeric order
+std::vector<std::string>
+list_rtc_devices(std::filesystem::path const &dev = "/dev");
+
+// --device argument: a single name, a comma separated list, or "all" for
+// every device found by list_rtc_devices
+std::vector<std::string>
+parse_device_list(std::string_view arg,
+                  std::filesystem::path const &dev = "/dev");
+
+// Outcome of an operation on one of several devices
+struct DeviceReport {
+  std::string device;
+  // empty if the operation succeeded
+  std::string error;
+  // RTC time read during the operation, and its offset from the system clock
+  RTCWake::sys_seconds time{};
+  std::chrono::seconds offset{};
+  RTCWake::AlarmState alarm{};
+  // time spent on the device, including opening it
+  std::chrono::microseconds latency{};
+};
+
+struct MultiDeviceReport {
+  std::vector<DeviceReport> devices;
+  // wall time of the whole operation, bound by the slowest device
+  std::chrono::microseconds latency{};
+
+  bool ok() const noexcept;
+};
+
+// Runs the same operation on several devices concurrently, each device in its
+// own thread with its own RTCWake instance. Failures are reported per device
+// instead of aborting the others. The status page is not published, it
+// describes a single device.
+class MultiDevice {
+public:
+  using Backend = std::function<std::unique_ptr<IRTC>(std::string const &)>;
+
+  // opens the devices with IRTC::get and the adjfile of opts
+  MultiDevice(std::vector<std::string> devices, RTCWake::Options opts);
+  MultiDevice(std::vector<std::string> devices, RTCWake::Options opts,
+              Backend backend);
+
+  // reads the time and alarm state of every device
+  MultiDeviceReport query() const;
+  // arms every device for the wake time, resolved against each device's time
+  MultiDeviceReport arm(RTCWake::WakeSpec const &spec) const;
+  MultiDeviceReport disable() const;
+
+private:
+  using Op = std::function<void(RTCWake &, DeviceReport &)>;
+  MultiDeviceReport run(Op const &op) const;
+
+  std::vector<std::string> m_devices;
+  RTCWake::Options m_opts;
+  Backend m_backend;
+};
+
+std::string to_json(MultiDeviceReport const &report);
@@ -0,0 +1,168 @@
+#include "rtc_plan.hpp"
+
+#include <json_string.hpp>
+#include <rtc_instrumented.hpp>
+#include <rtc_utils.hpp>
+#include <time_format.hpp>
+#include <tz_transitions.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace {
+
+using namespace std::chrono;
+
+// YYYY-MM-DDTHH:MM:SS+HH:MM
+std::string local_iso8601(sys_seconds tp, seconds offset) {
+  const Iso8601 local(tp + offset);
+  const auto hm = duration_cast<minutes>(offset < seconds{0} ? -offset
+                                                              : offset);
+  // without the Z
+  return fmt::format("{}{}{:02}:{:02}",
+                     local.view().substr(0, local.view().size() - 1),
+                     offset < seconds{0} ? '-' : '+', hm.count() / 60,
+                     hm.count() % 60);
+}
+
+} // namespace
+
+RTCWake::sys_seconds rx8130_effective_wakeup(RTCWake::sys_seconds now,
+                                             RTCWake::sys_seconds wakeup) {
+  const auto remaining = floor<minutes>(wakeup - now);
+  return now + std::max(remaining, rx8130_granularity);
+}
+
+DryRun::DryRun(RTCWake::Options opts, RTCWake::Backend device)
+    : m_opts{std::move(opts)}, m_device{std::move(device)} {}
+
+RTCWake::Options DryRun::options() {
+  auto opts = m_opts;
+  opts.status_file.clear();
+  opts.metrics_file.clear();
+  opts.page_cache_index.clear();
+  opts.journal_file.clear();
+  opts.halt = [this](bool force) {
+    m_halt_force = force;
+    return 0;
+  };
+  return opts;
+}
+
+RTCWake::Backend DryRun::backend() {
+  return [this, adjfile = m_opts.adjfile](std::string const &device) {
+    // a missing adjustment file fails once the clock type is resolved, like
+    // it would without the dry run
+    std::string adj;
+    try {
+      adj = read_adjfile(adjfile);
+    } catch (std::exception const &) {
+    }
+    auto mock = MockRTC::get(device, adj);
+    // only read, the plan resolves against the time the device keeps
+    mock->set_time(m_device(device)->get_time());
+    auto rtc = std::make_unique<InstrumentedRTC>(std::move(mock));
+    m_calls = rtc.get();
+    return rtc;
+  };
+}
+
+ShutdownPlan DryRun::plan(std::string_view mode) const {
+  using Method = InstrumentedRTC::Method;
+  ShutdownPlan plan{.mode = std::string(mode),
+                    .device = m_opts.device,
+                    .schedule = m_schedule,
+                    .integration = m_opts.integration};
+  if (m_schedule) {
+    plan.effective_wakeup =
+        rx8130_effective_wakeup(m_schedule->now, m_schedule->wakeup);
+    plan.local_offset =
+        TransitionTable::current().offset_at(plan.effective_wakeup);
+  }
+  if (m_halt_force) {
+    plan.halt = poweroff_argv(*m_halt_force, m_opts.poweroff);
+  }
+  if (m_calls == nullptr) {
+    return plan;
+  }
+  auto const &calls = m_calls->stats();
+  auto const &notify =
+      calls[static_cast<std::size_t>(Method::notify_listener)];
+  // the stub always succeeds, only the attempt tells something
+  plan.reset_on_halt = notify.calls != 0;
+
+  const auto recorded = m_opts.metrics_file.empty()
+                            ? InstrumentedRTC::Stats{}
+                            : read_metrics(m_opts.metrics_file);
+  for (std::size_t i = 0; i < calls.size(); ++i) {
+    if (calls[i].calls == 0) {
+      continue;
+    }
+    auto const &latency = recorded[i].latency;
+    PlannedPhase phase{.method = InstrumentedRTC::method_names[i],
+                       .calls = calls[i].calls,
+                       .samples = latency.count()};
+    if (latency.count() != 0) {
+      phase.mean =
+          latency.sum() / static_cast<std::int64_t>(latency.count());
+      phase.p99 = latency.percentile(0.99);
+    }
+    const auto n = static_cast<std::int64_t>(phase.calls);
+    plan.predicted_mean += phase.mean * n;
+    plan.predicted_p99 += phase.p99 * n;
+    plan.phases.push_back(phase);
+  }
+  return plan;
+}
+
+std::string to_json(ShutdownPlan const &plan) {
+  std::string res = fmt::format("{{\"mode\":\"{}\",\"device\":{},",
+                                plan.mode, json_string(plan.device));
+  if (auto const &s = plan.schedule) {
+    const auto shift = plan.effective_wakeup - s->wakeup;
+    res += fmt::format(
+        "\"now\":{},\"now_iso\":\"{}\",\"wakeup\":{{\"requested\":{},"
+        "\"requested_iso\":\"{}\",\"effective\":{},\"effective_iso\":\"{}\","
+        "\"effective_local\":\"{}\",\"granularity_s\":{},\"shift_s\":{}}},",
+        Epoch(s->now).view(), Iso8601(s->now).view(), Epoch(s->wakeup).view(),
+        Iso8601(s->wakeup).view(), Epoch(plan.effective_wakeup).view(),
+        Iso8601(plan.effective_wakeup).view(),
+        local_iso8601(plan.effective_wakeup, plan.local_offset),
+        seconds{rx8130_granularity}.count(), shift.count());
+  } else {
+    res += "\"wakeup\":null,";
+  }
+  res += fmt::format("\"reset_on_halt\":{{\"would_signal\":{},\"port\":{},"
+                     "\"register\":{},\"bit\":{}",
+                     plan.reset_on_halt, plan.integration.port,
+                     plan.integration.reg, plan.integration.bit);
+  // the further registers written along, if any
+  for (const char *sep = ",\"registers\":[\"";
+       auto const &w : plan.integration.registers) {
+    res += std::exchange(sep, "\",\"") + to_string(w);
+  }
+  res += plan.integration.registers.empty() ? "}," : "\"]},";
+  if (plan.halt.empty()) {
+    res += "\"halt\":null,";
+  } else {
+    res += "\"halt\":{\"command\":[";
+    for (const char *sep = ""; auto const &arg : plan.halt) {
+      res += std::exchange(sep, ",") + json_string(arg);
+    }
+    res += "]},";
+  }
+  res += "\"phases\":[";
+  for (const char *sep = ""; auto const &p : plan.phases) {
+    res += fmt::format("{}{{\"method\":\"{}\",\"calls\":{},\"samples\":{},"
+                       "\"mean_us\":{},\"p99_us\":{}}}",
+                       std::exchange(sep, ","), p.method, p.calls, p.samples,
+                       p.mean.count(), p.p99.count());
+  }
+  res += fmt::format("],\"predicted_time_to_halt_us\":{{\"mean\":{},"
+                     "\"p99\":{}}}}}",
+                     plan.predicted_mean.count(), plan.predicted_p99.count());
+  return res;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <rtcwake.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class InstrumentedRTC;
+
+// the RX8130 wakeup timer counts whole minutes from the moment it is armed
+inline constexpr std::chrono::minutes rx8130_granularity{1};
+
+// when the RX8130 fires if armed at now for wakeup: the remaining time is
+// truncated to whole minutes, but is at least one minute
+RTCWake::sys_seconds rx8130_effective_wakeup(RTCWake::sys_seconds now,
+                                             RTCWake::sys_seconds wakeup);
+
+// An RTC method the invocation calls, with the latencies earlier invocations
+// recorded for it in the metrics file
+struct PlannedPhase {
+  std::string_view method;
+  std::uint64_t calls = 0;
+  // number of recorded latencies, 0 if the method was never timed
+  std::uint64_t samples = 0;
+  std::chrono::microseconds mean{};
+  std::chrono::microseconds p99{};
+};
+
+// What an invocation would do, see DryRun
+struct ShutdownPlan {
+  std::string mode;
+  std::string device;
+  // set if a wake time was resolved
+  std::optional<RTCWake::ScheduleResult> schedule;
+  RTCWake::sys_seconds effective_wakeup{};
+  // UTC offset of the local zone at the effective wake time
+  std::chrono::seconds local_offset{};
+  // the invocation would signal reset on halt to mrhat-daemon before halting,
+  // whether the daemon would take it is not known without asking it
+  bool reset_on_halt = false;
+  IRTC::IntegrationInfo integration{};
+  // poweroff command line, empty if the invocation does not halt
+  std::vector<std::string> halt;
+  std::vector<PlannedPhase> phases;
+  // time from the first RTC call to exec'ing poweroff, from the mean and the
+  // p99 of the recorded latencies
+  std::chrono::microseconds predicted_mean{};
+  std::chrono::microseconds predicted_p99{};
+};
+
+std::string to_json(ShutdownPlan const &plan);
+
+// Runs an invocation without changing the hardware: the RTC is a mock set to
+// the time read from the device, with the clock type of the adjustment file,
+// its listener stub stands in for mrhat-daemon and halting is only recorded.
+// Neither the status page, the metrics, the page cache snapshot nor the wake
+// journal are written, the metrics file of opts is only read for the
+// latencies earlier invocations recorded.
+class DryRun {
+public:
+  // device opens the RTC the time is read from
+  explicit DryRun(RTCWake::Options opts,
+                  RTCWake::Backend device = [](std::string const &name) {
+                    return IRTC::get(name);
+                  });
+  DryRun(const DryRun &) = delete;
+  DryRun &operator=(const DryRun &) = delete;
+
+  // options for the RTCWake running the invocation, refers to this instance
+  RTCWake::Options options();
+  RTCWake::Backend backend();
+
+  void scheduled(RTCWake::ScheduleResult const &res) { m_schedule = res; }
+  ShutdownPlan plan(std::string_view mode) const;
+
+private:
+  RTCWake::Options m_opts;
+  RTCWake::Backend m_device;
+  InstrumentedRTC const *m_calls = nullptr;
+  std::optional<RTCWake::ScheduleResult> m_schedule;
+  std::optional<bool> m_halt_force;
+};
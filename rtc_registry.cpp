@@ -0,0 +1,139 @@
+#include "rtc_registry.hpp"
+
+#include <atomic_file.hpp>
+
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr RTCBackend const *registered[] = {
+#ifdef MRHAT_RTCWAKE_HAS_RX8130
+    &rx8130_backend,
+#endif
+    &standard_backend,
+};
+
+// the driver does not know the request at all
+bool unsupported(int err) { return err == ENOTTY || err == EINVAL; }
+
+// an empty boot id would not read back as a field
+std::string_view boot_field(ProbeKey const &key) {
+  if (key.boot_id.empty()) {
+    return "-";
+  }
+  return key.boot_id;
+}
+
+struct ProbeFd {
+  ProbeFd() = default;
+  ProbeFd(const ProbeFd &) = delete;
+  ProbeFd &operator=(const ProbeFd &) = delete;
+  ~ProbeFd() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  int fd = -1;
+};
+
+} // namespace
+
+std::span<RTCBackend const *const> rtc_backends() { return registered; }
+
+ProbeKey probe_key(fs::path const &device, fs::path const &boot_id) {
+  struct stat st{};
+  if (stat(device.c_str(), &st) != 0) {
+    throw std::system_error(errno, std::generic_category(), device.string());
+  }
+  ProbeKey key{{}, st.st_rdev};
+  // without a boot id the cache is still keyed by the device node
+  std::ifstream(boot_id) >> key.boot_id;
+  return key;
+}
+
+RTCBackend const &
+select_rtc_backend(std::span<RTCBackend const *const> backends,
+                   IoctlProbe const &probe) {
+  if (backends.empty()) {
+    throw std::runtime_error("no RTC backend is registered");
+  }
+  for (auto const *backend : backends) {
+    if (!unsupported(probe(backend->probe_request))) {
+      return *backend;
+    }
+  }
+  return *backends.back();
+}
+
+std::optional<std::string> read_probe_cache(fs::path const &path,
+                                            ProbeKey const &key) {
+  std::ifstream ifs(path);
+  ProbeKey cached{};
+  std::string backend;
+  if (!(ifs >> cached.boot_id >> cached.rdev >> backend) ||
+      cached.boot_id != boot_field(key) || cached.rdev != key.rdev) {
+    return std::nullopt;
+  }
+  return backend;
+}
+
+void write_probe_cache(fs::path const &path, ProbeKey const &key,
+                       std::string_view backend) noexcept try {
+  write_file_atomically(
+      path, fmt::format("{} {} {}\n", boot_field(key), key.rdev, backend));
+} catch (std::exception const &) {
+  // e.g. /run is not writable for the user, the next run probes again
+}
+
+ProbeResult resolve_rtc_backend(std::span<RTCBackend const *const> backends,
+                                ProbeKey const &key, fs::path const &cache,
+                                IoctlProbe const &probe) {
+  if (const auto name = read_probe_cache(cache, key)) {
+    for (auto const *backend : backends) {
+      if (backend->name == *name) {
+        return {backend, true};
+      }
+    }
+  }
+  auto const &backend = select_rtc_backend(backends, probe);
+  write_probe_cache(cache, key, backend.name);
+  return {&backend, false};
+}
+
+fs::path probe_cache_path(std::string_view device) {
+  return fs::path(default_probe_cache_dir) / fmt::format("{}.backend", device);
+}
+
+#ifndef MRHAT_RTCWAKE_MOCK_DEVICE
+std::unique_ptr<IRTC> IRTC::get(std::string_view name, std::string_view adj) {
+  const auto dev = fmt::format("/dev/{}", name);
+  const auto key = probe_key(dev);
+  // the device is only opened for probing on a cache miss
+  ProbeFd dev_fd;
+  const auto probe = [&](unsigned long request) {
+    auto &fd = dev_fd.fd;
+    if (fd < 0 && (fd = open(dev.c_str(), O_RDONLY | O_CLOEXEC)) < 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              static_cast<std::string>(name));
+    }
+    rtc_wkalrm alarm{};
+    return ioctl(fd, request, &alarm) == 0 ? 0 : errno;
+  };
+  const auto res =
+      resolve_rtc_backend(rtc_backends(), key, probe_cache_path(name), probe);
+  return res.backend->open(name,
+                           adj.empty() || parse_adjfile(adj) == Clock::UTC);
+}
+#endif
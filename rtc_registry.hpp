@@ -0,0 +1,85 @@
+#pragma once
+
+#include <irtc.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// the RX8130 wake timer backend needs the ioctl definitions of its driver
+#if __has_include(<rtc-rx8130.h>)
+#define MRHAT_RTCWAKE_HAS_RX8130 1
+#endif
+
+// A device backend, selected at runtime by the ioctls the driver supports
+struct RTCBackend {
+  std::string_view name;
+  // read-only ioctl the backend relies on, taking a rtc_wkalrm
+  unsigned long probe_request = 0;
+  std::unique_ptr<IRTC> (*open)(std::string_view device, bool is_utc) =
+      nullptr;
+};
+
+#ifdef MRHAT_RTCWAKE_HAS_RX8130
+// SE_RTC_WKTIMER_GET/SET of the RX8130 driver
+extern const RTCBackend rx8130_backend;
+#endif
+// RTC_WKALM_RD/SET of the generic rtc class driver
+extern const RTCBackend standard_backend;
+
+// the compiled in backends, in order of preference, the last one is the
+// fallback
+std::span<RTCBackend const *const> rtc_backends();
+
+// Identity of a probed device: the cached result is only used for the same
+// device node within the same boot
+struct ProbeKey {
+  std::string boot_id;
+  std::uint64_t rdev = 0;
+  bool operator==(ProbeKey const &) const = default;
+};
+
+// throws if the device node cannot be stat'ed
+ProbeKey probe_key(std::filesystem::path const &device,
+                   std::filesystem::path const &boot_id =
+                       "/proc/sys/kernel/random/boot_id");
+
+// issues a probe request, returns 0 or the errno of the ioctl
+using IoctlProbe = std::function<int(unsigned long request)>;
+
+// first backend whose probe request the driver recognises, the last one if
+// none does: an RTC without alarm support can still be read and set.
+// Transient errors such as EBUSY still mean the request is known.
+RTCBackend const &
+select_rtc_backend(std::span<RTCBackend const *const> backends,
+                   IoctlProbe const &probe);
+
+// name of the cached backend, nullopt if the cache is missing, malformed or
+// was written for another key
+std::optional<std::string>
+read_probe_cache(std::filesystem::path const &path, ProbeKey const &key);
+// written atomically, failures are ignored as the cache is only a shortcut
+void write_probe_cache(std::filesystem::path const &path, ProbeKey const &key,
+                       std::string_view backend) noexcept;
+
+struct ProbeResult {
+  RTCBackend const *backend = nullptr;
+  // the backend came from the cache, the device was not probed
+  bool cached = false;
+};
+
+// the cached backend if it is still registered, otherwise probes and caches
+// the result
+ProbeResult resolve_rtc_backend(std::span<RTCBackend const *const> backends,
+                                ProbeKey const &key,
+                                std::filesystem::path const &cache,
+                                IoctlProbe const &probe);
+
+// cache of the probe results, one file per device
+inline constexpr auto default_probe_cache_dir = "/run/mrhat-rtcwake";
+std::filesystem::path probe_cache_path(std::string_view device);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+
+struct RetryPolicy {
+  // attempts per call, including the first one
+  unsigned max_attempts = 5;
+  std::chrono::milliseconds initial_backoff{5};
+  std::chrono::milliseconds max_backoff{200};
+  // retry budget of an operation, shared by its calls while a
+  // Retrier::Budget is alive and started by each call otherwise, so a busy
+  // bus delays an operation by about this much at most
+  std::chrono::milliseconds deadline{2000};
+};
+
+struct RetryStats {
+  std::uint64_t calls = 0;
+  std::uint64_t attempts = 0;
+  // attempts made by the most recent call
+  unsigned last_attempts = 0;
+};
+
+// errors the RX8130 driver reports while the I2C bus is busy
+inline bool is_transient(int err) noexcept {
+  return err == EBUSY || err == EINTR || err == EAGAIN || err == ETIMEDOUT;
+}
+
+// Repeats ioctl style calls (returning -1 and setting errno on failure) that
+// failed with a transient error, with exponential backoff until the attempts
+// or the deadline run out.
+class Retrier {
+public:
+  using clock = std::chrono::steady_clock;
+
+  // Deadline shared by the retried calls made on this thread while it is
+  // alive, e.g. the ioctls of one halt, instead of one per call. Nested
+  // budgets keep the outer deadline.
+  class Budget {
+  public:
+    explicit Budget(std::chrono::milliseconds deadline) noexcept
+        : m_outer{s_deadline} {
+      if (!m_outer) {
+        s_deadline = clock::now() + deadline;
+      }
+    }
+    Budget(const Budget &) = delete;
+    Budget &operator=(const Budget &) = delete;
+    ~Budget() { s_deadline = m_outer; }
+
+  private:
+    std::optional<clock::time_point> m_outer;
+  };
+
+  explicit Retrier(RetryPolicy policy = {}) { set_policy(policy); }
+
+  void set_policy(RetryPolicy policy) noexcept { m_policy = policy; }
+  RetryPolicy const &policy() const noexcept { return m_policy; }
+  RetryStats const &stats() const noexcept { return m_stats; }
+
+  // errno is left as set by the last attempt
+  template <typename Op> auto operator()(Op &&op) const {
+    ++m_stats.calls;
+    const auto deadline =
+        s_deadline.value_or(clock::now() + m_policy.deadline);
+    auto backoff = m_policy.initial_backoff;
+    for (unsigned attempt = 1;; ++attempt) {
+      ++m_stats.attempts;
+      m_stats.last_attempts = attempt;
+      const auto res = op();
+      if (res != -1) {
+        return res;
+      }
+      const int err = errno;
+      if (!is_transient(err) || attempt >= m_policy.max_attempts ||
+          clock::now() + backoff > deadline) {
+        errno = err;
+        return res;
+      }
+      std::this_thread::sleep_for(backoff);
+      backoff = std::min(backoff * 2, m_policy.max_backoff);
+    }
+  }
+
+private:
+  static inline thread_local std::optional<clock::time_point> s_deadline;
+
+  RetryPolicy m_policy;
+  mutable RetryStats m_stats;
+};
+
+// error for a failed retried call, mentioning the attempts when it was retried
+inline std::system_error retry_error(Retrier const &retry, std::string what) {
+  const int err = errno;
+  if (const auto attempts = retry.stats().last_attempts; attempts > 1) {
+    what += " (after " + std::to_string(attempts) + " attempts)";
+  }
+  return std::system_error(err, std::generic_category(), what);
+}
@@ -0,0 +1,67 @@
+#include "rtc_session.hpp"
+
+namespace {
+bool same_time(rtc_time const &lhs, rtc_time const &rhs) noexcept {
+  return lhs.tm_sec == rhs.tm_sec && lhs.tm_min == rhs.tm_min &&
+         lhs.tm_hour == rhs.tm_hour && lhs.tm_mday == rhs.tm_mday &&
+         lhs.tm_mon == rhs.tm_mon && lhs.tm_year == rhs.tm_year;
+}
+} // namespace
+
+rtc_time RTCSession::get_time() const {
+  if (!fresh(m_time)) {
+    m_time = Cached<rtc_time>{inner().get_time(), clock::now()};
+  }
+  return m_time->value;
+}
+
+// only values read from the device are cached, a driver may round or reject
+// what is written
+void RTCSession::set_time(rtc_time const &time) {
+  m_time.reset();
+  inner().set_time(time);
+}
+
+rtc_time RTCSession::wait_update() const {
+  const auto time = inner().wait_update();
+  m_time = Cached<rtc_time>{time, clock::now()};
+  return time;
+}
+
+void RTCSession::set_wakeup(rtc_time const &time) {
+  if (fresh(m_alarm) && m_alarm->value.enabled && !m_alarm->value.pending &&
+      same_time(m_alarm->value.time, time)) {
+    return;
+  }
+  m_alarm.reset();
+  inner().set_wakeup(time);
+}
+
+rtc_wkalrm RTCSession::get_wakeup() const {
+  if (!fresh(m_alarm)) {
+    m_alarm = Cached<rtc_wkalrm>{inner().get_wakeup(), clock::now()};
+  }
+  return m_alarm->value;
+}
+
+void RTCSession::clear_wakeup() {
+  if (fresh(m_alarm)) {
+    disable_wakeup(m_alarm->value);
+    return;
+  }
+  m_alarm.reset();
+  inner().clear_wakeup();
+}
+
+void RTCSession::disable_wakeup(rtc_wkalrm const &armed) {
+  if (!armed.enabled && !armed.pending) {
+    return;
+  }
+  m_alarm.reset();
+  inner().disable_wakeup(armed);
+}
+
+void RTCSession::invalidate() noexcept {
+  m_time.reset();
+  m_alarm.reset();
+}
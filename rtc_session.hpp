@@ -0,0 +1,47 @@
+#pragma once
+
+#include <rtc_decorator.hpp>
+
+#include <chrono>
+#include <optional>
+
+// Transaction over an RTC backend for the duration of one invocation. Reads
+// are served from a cache for a bounded window, writes that would not change
+// the armed alarm are skipped, and clearing an alarm whose state is known
+// skips the read of the read-modify-write sequence. Writes drop the cached
+// value, so reading back what was written reaches the device.
+class RTCSession : public RTCDecorator {
+public:
+  using clock = std::chrono::steady_clock;
+  static constexpr clock::duration default_window =
+      std::chrono::milliseconds{250};
+
+  explicit RTCSession(std::unique_ptr<IRTC> inner,
+                      clock::duration window = default_window)
+      : RTCDecorator{std::move(inner)}, m_window{window} {}
+
+  rtc_time get_time() const override;
+  void set_time(rtc_time const &time) override;
+  rtc_time wait_update() const override;
+  void set_wakeup(rtc_time const &time) override;
+  rtc_wkalrm get_wakeup() const override;
+  void clear_wakeup() override;
+  void disable_wakeup(rtc_wkalrm const &armed) override;
+
+  // drops every cached read, e.g. after another process touched the device
+  void invalidate() noexcept;
+
+private:
+  template <typename T> struct Cached {
+    T value{};
+    clock::time_point at{};
+  };
+  template <typename T>
+  bool fresh(std::optional<Cached<T>> const &entry) const noexcept {
+    return entry && clock::now() - entry->at <= m_window;
+  }
+
+  clock::duration m_window;
+  mutable std::optional<Cached<rtc_time>> m_time;
+  mutable std::optional<Cached<rtc_wkalrm>> m_alarm;
+};
@@ -5,6 +5,7 @@
 
 #include <charconv>
 #include <chrono>
+#include <concepts>
 #include <ctime>
 #include <initializer_list>
 #include <regex>
@@ -17,6 +18,7 @@
 #include <fmt/format.h>
 
 #include <irtc.hpp>
+#include <tz_transitions.hpp>
 
 template <typename T, std::input_iterator It, std::sentinel_for<It> Sen>
 inline auto parse_chars(It first, Sen last) {
@@ -28,27 +30,115 @@ inline auto parse_chars(It first, Sen last) {
   return val;
 }
 
-inline std::chrono::system_clock::time_point rtc_to_sys(rtc_time const &tm,
-                                                        IRTC const &rtc) {
-
-  struct tm time{};
-  std::memcpy(&time, &tm, std::min(sizeof(tm), sizeof(time)));
-  const auto ts =
-      rtc.type() == IRTC::Clock::LOCAL ? mktime(&time) : timegm(&time);
+// RTC time of a clock kind known at compile time, an INVALID clock is taken
+// as UTC
+template <IRTC::Clock C>
+inline std::chrono::system_clock::time_point rtc_to_sys(rtc_time const &tm) {
+  auto time = to_tm(tm);
+  time_t ts{};
+  if constexpr (C == IRTC::Clock::LOCAL) {
+    ts = mktime(&time);
+  } else {
+    ts = timegm(&time);
+  }
   return std::chrono::system_clock::from_time_t(ts);
 }
 
-inline rtc_time sys_to_rtc(std::chrono::system_clock::time_point tp,
-                           IRTC const &rtc) {
+// an INVALID clock is taken as local time
+template <IRTC::Clock C>
+inline rtc_time sys_to_rtc(std::chrono::system_clock::time_point tp) {
   struct tm time{};
-  rtc_time rtc_tm{};
   const auto timep = std::chrono::system_clock::to_time_t(tp);
-  auto func = rtc.type() == IRTC::Clock::UTC ? gmtime_r : localtime_r;
-  if (func(&timep, &time) == nullptr) {
+  struct tm *res = nullptr;
+  if constexpr (C == IRTC::Clock::UTC) {
+    res = gmtime_r(&timep, &time);
+  } else {
+    res = localtime_r(&timep, &time);
+  }
+  if (res == nullptr) {
     throw std::system_error(errno, std::generic_category());
   }
-  std::memcpy(&rtc_tm, &time, std::min(sizeof(rtc_tm), sizeof(time)));
-  return rtc_tm;
+  return to_rtc_time(time);
+}
+
+// a backend with its clock kind fixed at compile time, see RTCDevice
+template <typename RTC>
+concept StaticClockRTC = requires {
+  { RTC::clock } -> std::convertible_to<IRTC::Clock>;
+};
+
+template <StaticClockRTC RTC>
+inline std::chrono::system_clock::time_point rtc_to_sys(rtc_time const &tm,
+                                                        RTC const &) {
+  return rtc_to_sys<RTC::clock>(tm);
+}
+
+template <StaticClockRTC RTC>
+inline rtc_time sys_to_rtc(std::chrono::system_clock::time_point tp,
+                           RTC const &) {
+  return sys_to_rtc<RTC::clock>(tp);
+}
+
+inline std::chrono::system_clock::time_point rtc_to_sys(rtc_time const &tm,
+                                                        IRTC const &rtc) {
+  return rtc.type() == IRTC::Clock::LOCAL ? rtc_to_sys<IRTC::Clock::LOCAL>(tm)
+                                          : rtc_to_sys<IRTC::Clock::UTC>(tm);
+}
+
+inline rtc_time sys_to_rtc(std::chrono::system_clock::time_point tp,
+                           IRTC const &rtc) {
+  return rtc.type() == IRTC::Clock::UTC ? sys_to_rtc<IRTC::Clock::UTC>(tp)
+                                        : sys_to_rtc<IRTC::Clock::LOCAL>(tp);
+}
+
+// Sets the system clock from the RTC. The RTC is read right after its update
+// interrupt, so the returned second boundary is exact instead of being off by
+// up to a second as with a plain RTC_RD_TIME. RTC is an IRTC or a
+// compile-time backend such as RTCDevice.
+template <typename RTC, typename SetSysClock>
+inline std::chrono::system_clock::time_point hctosys(RTC const &rtc,
+                                                     SetSysClock &&set_clock) {
+  const auto edge = rtc_to_sys(rtc.wait_update(), rtc);
+  set_clock(edge);
+  return edge;
+}
+
+// Sets the RTC from the system clock. The write is delayed to the next second
+// boundary of the system clock, as writing the time restarts the RTC's
+// sub-second divider.
+template <typename RTC, typename SleepUntil>
+inline rtc_time systohc(RTC &rtc, SleepUntil &&sleep_until) {
+  const auto boundary = std::chrono::ceil<std::chrono::seconds>(
+      std::chrono::system_clock::now());
+  sleep_until(std::chrono::system_clock::time_point{boundary});
+  const auto tm = sys_to_rtc(boundary, rtc);
+  rtc.set_time(tm);
+  return tm;
+}
+
+inline void set_system_clock(std::chrono::system_clock::time_point tp) {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      tp.time_since_epoch());
+  const auto secs = std::chrono::floor<std::chrono::seconds>(ns);
+  const timespec ts{static_cast<time_t>(secs.count()),
+                    static_cast<long>((ns - secs).count())};
+  if (clock_settime(CLOCK_REALTIME, &ts) != 0) {
+    throw std::system_error(errno, std::generic_category(), "clock_settime");
+  }
+}
+
+inline void sleep_until_realtime(std::chrono::system_clock::time_point tp) {
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      tp.time_since_epoch());
+  const auto secs = std::chrono::floor<std::chrono::seconds>(ns);
+  const timespec ts{static_cast<time_t>(secs.count()),
+                    static_cast<long>((ns - secs).count())};
+  while (const auto err =
+             clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, nullptr)) {
+    if (err != EINTR) {
+      throw std::system_error(err, std::generic_category(), "clock_nanosleep");
+    }
+  }
 }
 
 template <typename TZPtr>
@@ -64,10 +154,13 @@ inline auto rtc_to_zoned(rtc_time const &tm, IRTC const &rtc) {
 }
 
 using sys_duration = std::chrono::system_clock::duration;
-struct Tomorrow {};
+using sys_time_point = std::chrono::sys_time<sys_duration>;
+// midnight may fall into a gap or an overlap like any other local time
+struct Tomorrow {
+  TransitionTable::Choose choose = TransitionTable::Choose::EARLIEST;
+};
 
-using parsed_time =
-    std::variant<sys_duration, date::zoned_time<sys_duration>, Tomorrow>;
+using parsed_time = std::variant<sys_duration, sys_time_point, Tomorrow>;
 
 inline sys_duration parse_relative_time(std::string_view date_in) {
   constexpr auto &rel_time_re_str =
@@ -113,8 +206,19 @@ inline std::tm get_tm_now() {
   return tmnow;
 }
 
-inline date::zoned_time<sys_duration>
-parse_time_abs(std::string_view date_in, std::tm tm_now = get_tm_now()) {
+// local date and time in the strptime fields, out of range fields carry
+// over like with mktime
+inline std::chrono::local_seconds tm_to_local(std::tm const &t) {
+  using namespace std::chrono;
+  const auto month = year{t.tm_year + 1900} / January + months{t.tm_mon};
+  return local_days{month / 1} + days{t.tm_mday - 1} + hours{t.tm_hour} +
+         minutes{t.tm_min} + seconds{t.tm_sec};
+}
+
+inline sys_time_point
+parse_time_abs(std::string_view date_in, std::tm tm_now = get_tm_now(),
+               TransitionTable::Choose choose =
+                   TransitionTable::Choose::EARLIEST) {
   using namespace std::string_literals;
   static const auto specstrs = {"%Y%m%d%H%M%S"s,   "%Y-%m-%d %H:%M:%S"s,
                                 "%Y-%m-%d %H:%M"s, "%Y-%m-%d"s,
@@ -124,19 +228,18 @@ parse_time_abs(std::string_view date_in, std::tm tm_now = get_tm_now()) {
   for (auto spec : specstrs) {
     if (const auto endp = strptime(datestr.c_str(), spec.c_str(), &t);
         endp == datestr.c_str() + datestr.size()) {
-      t.tm_isdst = -1;
       if (t.tm_year == 0 && t.tm_mon == 0 && t.tm_mday == 0) {
         t.tm_year = tm_now.tm_year;
         t.tm_mon = tm_now.tm_mon;
         t.tm_mday = tm_now.tm_mday;
       }
-      auto timeval = std::mktime(&t);
-      if (timeval < 0) {
+      const auto systime =
+          TransitionTable::current().to_sys(tm_to_local(t), choose);
+      if (systime.time_since_epoch().count() < 0) {
         throw std::runtime_error(
-            fmt::format("failed to do mktime on {}", date_in));
+            fmt::format("date before the epoch: {}", date_in));
       }
-      const auto systime = std::chrono::system_clock::from_time_t(timeval);
-      return date::make_zoned(date::current_zone(), systime);
+      return std::chrono::time_point_cast<sys_duration>(systime);
     }
     t = {};
   }
@@ -144,38 +247,43 @@ parse_time_abs(std::string_view date_in, std::tm tm_now = get_tm_now()) {
       fmt::format("unrecognized date specifier:{}", date_in)};
 }
 
-inline parsed_time parse_time(std::string_view date_in) {
+inline parsed_time parse_time(std::string_view date_in,
+                              TransitionTable::Choose choose =
+                                  TransitionTable::Choose::EARLIEST) {
   using namespace std::string_view_literals;
   if (date_in == "tomorrow"sv) {
-    return Tomorrow{};
+    return Tomorrow{choose};
   }
   if (date_in.starts_with("+")) {
     return parse_relative_time(date_in);
   }
-  return parse_time_abs(date_in);
+  return parse_time_abs(date_in, get_tm_now(), choose);
 }
 
+// the wake time is delayed by spread, see spread_offset
 inline rtc_time resolve_parsed_time(parsed_time const &tm, IRTC const &_rtc,
-                                    rtc_time tm_now) {
+                                    rtc_time tm_now,
+                                    std::chrono::minutes spread = {}) {
   struct {
     IRTC const &rtc;
     rtc_time tm_now;
+    std::chrono::minutes spread;
     rtc_time operator()(sys_duration const &d) const {
       const auto curr_time = rtc_to_sys(tm_now, rtc);
       const auto wakeup = curr_time + d;
-      return sys_to_rtc(wakeup, rtc);
+      return sys_to_rtc(wakeup + spread, rtc);
     }
-    rtc_time operator()(date::zoned_time<sys_duration> const &dt) const {
-      return sys_to_rtc(dt.get_sys_time(), rtc);
+    rtc_time operator()(sys_time_point const &tp) const {
+      return sys_to_rtc(tp + spread, rtc);
     }
-    rtc_time operator()(Tomorrow const &) const {
-      using namespace date;
-      const auto local = rtc_to_zoned(tm_now, rtc).get_local_time();
-      const auto tomorrow = local + days{1};
-      const auto midnight = floor<days>(tomorrow);
-      return sys_to_rtc(make_zoned(current_zone(), midnight).get_sys_time(),
-                        rtc);
+    rtc_time operator()(Tomorrow const &t) const {
+      using namespace std::chrono;
+      auto const &table = TransitionTable::current();
+      const auto local =
+          table.to_local(floor<seconds>(rtc_to_sys(tm_now, rtc)));
+      const auto midnight = floor<days>(local) + days{1};
+      return sys_to_rtc(table.to_sys(midnight, t.choose) + spread, rtc);
     }
-  } resolver{_rtc, tm_now};
+  } resolver{_rtc, tm_now, spread};
   return std::visit(resolver, tm);
 }
@@ -0,0 +1,514 @@
+#include "rtcwake.hpp"
+
+#include <atomic_file.hpp>
+#include <mrhat_integration.hpp>
+#include <rtc_instrumented.hpp>
+#include <rtc_lazy.hpp>
+#include <rtc_session.hpp>
+#include <rtc_utils.hpp>
+#include <wake_journal.hpp>
+#include <wake_spread.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+rtc_time resolve_wake_spec(RTCWake::WakeSpec const &spec, IRTC const &rtc,
+                           rtc_time tm_now, std::chrono::minutes spread,
+                           RTCWake::Resources &touched) {
+  using Kind = RTCWake::WakeSpec::Kind;
+  std::string_view val(spec.value);
+  switch (spec.kind) {
+  case Kind::DATE: {
+    // only absolute dates and tomorrow look up the zone
+    const auto lookups = TransitionTable::lookups();
+    const auto res =
+        resolve_parsed_time(parse_time(val, spec.dst), rtc, tm_now, spread);
+    touched.tzdb |= TransitionTable::lookups() != lookups;
+    return res;
+  }
+  case Kind::SECONDS:
+    return resolve_parsed_time(
+        std::chrono::seconds{parse_chars<unsigned long>(val.begin(), val.end())},
+        rtc, tm_now, spread);
+  case Kind::TIME:
+    return sys_to_rtc(std::chrono::system_clock::from_time_t(
+                          parse_chars<std::time_t>(val.begin(), val.end())) +
+                          spread,
+                      rtc);
+  }
+  throw std::logic_error{"shouldn't reach this line"};
+}
+
+auto to_seconds(std::chrono::system_clock::time_point tp) {
+  return std::chrono::floor<std::chrono::seconds>(tp);
+}
+
+std::int64_t epoch_now() {
+  return to_seconds(std::chrono::system_clock::now())
+      .time_since_epoch()
+      .count();
+}
+
+// replaces the file atomically, so a reader never sees a partial one
+void write_adjfile(fs::path const &adjfile, std::string const &adj) {
+  write_file_atomically(adjfile, adj);
+}
+
+// time since the kernel started, including suspend
+std::chrono::seconds since_boot() {
+  timespec ts{};
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return std::chrono::seconds{ts.tv_sec};
+}
+
+} // namespace
+
+std::vector<std::string> poweroff_argv(bool force,
+                                       std::string const &command) {
+  std::vector<std::string> argv{command, "--halt"};
+  if (force) {
+    argv.emplace_back("--force");
+  }
+  return argv;
+}
+
+int poweroff_halt(bool force, std::string const &command) {
+  auto argv = poweroff_argv(force, command);
+  std::vector<char *> args;
+  for (auto &a : argv) {
+    args.push_back(a.data());
+  }
+  args.push_back(nullptr);
+  execv(args[0], args.data());
+  return errno;
+}
+
+std::string read_adjfile(fs::path const &adjfile) {
+  if (!fs::exists(adjfile) || !fs::is_regular_file(adjfile)) {
+    throw std::runtime_error(fmt::format(
+        "adjustment file {} non-existent or non-regular", adjfile.c_str()));
+  }
+  std::ifstream ifs(adjfile);
+  if (!ifs) {
+    throw std::runtime_error(
+        fmt::format("failed to read adjustment file {}", adjfile.c_str()));
+  }
+
+  std::stringstream buff;
+  buff << ifs.rdbuf();
+  return buff.str();
+}
+
+RTCWake::RTCWake(Options opts)
+    : RTCWake(std::move(opts),
+              [](std::string const &device) { return IRTC::get(device); }) {}
+
+RTCWake::RTCWake(Options opts, Backend backend) : m_opts{std::move(opts)} {
+  auto lazy = std::make_unique<LazyRTC>(
+      m_opts.device,
+      [backend = std::move(backend), device = m_opts.device] {
+        return backend(device);
+      },
+      [this] { return load_adjfile(); });
+  m_lazy = lazy.get();
+  stack(std::move(lazy));
+}
+
+RTCWake::RTCWake(Options opts, std::unique_ptr<IRTC> rtc)
+    : m_opts{std::move(opts)} {
+  m_touched.device = true;
+  stack(std::move(rtc));
+}
+
+void RTCWake::stack(std::unique_ptr<IRTC> rtc) {
+  if (!m_opts.metrics_file.empty()) {
+    auto instrumented = std::make_unique<InstrumentedRTC>(std::move(rtc));
+    m_instrumented = instrumented.get();
+    rtc = std::move(instrumented);
+  }
+  auto session = std::make_unique<RTCSession>(std::move(rtc));
+  m_session = session.get();
+  m_rtc = std::move(session);
+  m_rtc->set_retry_policy(m_opts.retry);
+}
+
+RTCWake::~RTCWake() { flush_metrics(); }
+
+auto RTCWake::show_cached(fs::path const &status_file)
+    -> std::optional<AlarmState> {
+  if (auto page = StatusPage::open_reader(status_file)) {
+    if (const auto status = page->snapshot()) {
+      return AlarmState{
+          .enabled = status->enabled,
+          .pending = false,
+          .wakeup = sys_seconds{std::chrono::seconds{status->wakeup}}};
+    }
+  }
+  return {};
+}
+
+auto RTCWake::show() -> AlarmState {
+  const Retrier::Budget budget{m_opts.retry.deadline};
+  const auto alarm = m_rtc->get_wakeup();
+  AlarmState state{.enabled = alarm.enabled != 0,
+                   .pending = alarm.pending != 0};
+  if (state.enabled) {
+    state.wakeup = to_seconds(rtc_to_sys(alarm.time, rtc()));
+  }
+  publish(state.wakeup.time_since_epoch().count(), state.enabled);
+  return state;
+}
+
+void RTCWake::disable() {
+  const Retrier::Budget budget{m_opts.retry.deadline};
+  m_rtc->clear_wakeup();
+  publish(0, false);
+  journal({.kind = WakeRecord::Kind::CLEARED, .at = epoch_now()});
+}
+
+auto RTCWake::resolve(WakeSpec const &spec) -> sys_seconds {
+  auto &rtc = this->rtc();
+  const auto rtc_now = rtc.get_time();
+  const auto wakeup = to_seconds(rtc_to_sys(
+      resolve_wake_spec(spec, rtc, rtc_now, spread(), m_touched), rtc));
+  if (wakeup <= to_seconds(rtc_to_sys(rtc_now, rtc))) {
+    throw std::runtime_error("wakeup time is in the past or now");
+  }
+  return wakeup;
+}
+
+auto RTCWake::schedule(WakeSpec const &spec) -> ScheduleResult {
+  const Retrier::Budget budget{m_opts.retry.deadline};
+  auto &rtc = this->rtc();
+  const auto now = rtc.get_time();
+  return arm(now, resolve_wake_spec(spec, rtc, now, spread(), m_touched));
+}
+
+auto RTCWake::schedule_at(sys_seconds wakeup) -> ScheduleResult {
+  const Retrier::Budget budget{m_opts.retry.deadline};
+  auto &rtc = this->rtc();
+  return arm(rtc.get_time(), sys_to_rtc(wakeup, rtc));
+}
+
+auto RTCWake::arm(rtc_time now, rtc_time wakeup) -> ScheduleResult {
+  ScheduleResult res{.rtc_now = now, .rtc_wakeup = wakeup};
+  auto &rtc = this->rtc();
+  res.now = to_seconds(rtc_to_sys(res.rtc_now, rtc));
+  res.wakeup = to_seconds(rtc_to_sys(res.rtc_wakeup, rtc));
+  if (res.wakeup <= res.now) {
+    throw std::runtime_error("wakeup time is in the past or now");
+  }
+  m_rtc->set_wakeup(res.rtc_wakeup);
+  publish(res.wakeup.time_since_epoch().count(), true);
+  journal({.kind = WakeRecord::Kind::ARMED,
+           .at = res.now.time_since_epoch().count(),
+           .wakeup = res.wakeup.time_since_epoch().count()});
+  return res;
+}
+
+auto RTCWake::halt() -> HaltResult {
+  const Retrier::Budget budget{m_opts.retry.deadline};
+  // before the listener is signalled, the snapshot is bounded but the time
+  // it takes must not count against the halt the daemon waits for
+  save_page_cache();
+  HaltResult res{.notified = notify_listener()};
+  journal({.kind = WakeRecord::Kind::NOTIFIED,
+           .at = epoch_now(),
+           .value = res.notified ? 1 : 0});
+  // the process is gone if halting succeeds, so export now
+  flush_metrics();
+  sync_journal();
+  res.error = m_opts.halt ? m_opts.halt(m_opts.force)
+                          : poweroff_halt(m_opts.force, m_opts.poweroff);
+  if (res.error != 0) {
+    journal({.kind = WakeRecord::Kind::HALT_FAILED,
+             .at = epoch_now(),
+             .value = res.error});
+  }
+  if (res.error != 0 && res.notified) {
+    unnotify_listener();
+  }
+  return res;
+}
+
+auto RTCWake::choose_action(WakeSpec const &spec, CostProfile const &profile)
+    -> PowerDecision {
+  auto &rtc = this->rtc();
+  const auto rtc_now = rtc.get_time();
+  const auto now = to_seconds(rtc_to_sys(rtc_now, rtc));
+  const auto wakeup = to_seconds(rtc_to_sys(
+      resolve_wake_spec(spec, rtc, rtc_now, spread(), m_touched), rtc));
+  return decide(now, wakeup, profile);
+}
+
+auto RTCWake::choose_action(sys_seconds wakeup, CostProfile const &profile)
+    -> PowerDecision {
+  auto &rtc = this->rtc();
+  return decide(to_seconds(rtc_to_sys(rtc.get_time(), rtc)), wakeup, profile);
+}
+
+PowerDecision RTCWake::decide(sys_seconds now, sys_seconds wakeup,
+                              CostProfile const &profile) {
+  auto res = choose_power_action(profile, wakeup - now);
+  journal({.kind = WakeRecord::Kind::DECIDED,
+           .at = now.time_since_epoch().count(),
+           .wakeup = wakeup.time_since_epoch().count(),
+           .value = static_cast<std::int32_t>(res.action)});
+  return res;
+}
+
+int RTCWake::suspend() {
+  // the journal has to survive a resume that never happens
+  sync_journal();
+  if (m_opts.suspend) {
+    return m_opts.suspend();
+  }
+  const int fd = ::open(m_opts.power_state.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno;
+  }
+  // the write returns once the system resumed
+  const int res = ::write(fd, "mem", 3) == 3 ? 0 : errno;
+  close(fd);
+  return res;
+}
+
+void RTCWake::wait_until(sys_seconds wakeup) {
+  std::this_thread::sleep_until(wakeup);
+}
+
+auto RTCWake::reconcile() -> ReconcileResult {
+  const Retrier::Budget budget{m_opts.retry.deadline};
+  // the alarm fires on its own, a cached read may predate it
+  m_session->invalidate();
+  const auto alarm = m_rtc->get_wakeup();
+  ReconcileResult res{.reason = alarm.pending != 0 ? WakeReason::ALARM
+                                                   : WakeReason::POWER_ON};
+  if (res.reason == WakeReason::ALARM) {
+    // the state was just read, so disabling skips the read-modify-write
+    m_rtc->disable_wakeup(alarm);
+    res.cleared = true;
+    publish(0, false);
+  }
+  // without a journal, only waking on the alarm tells that the system halted
+  // with the bit set
+  bool notified = listener_notified(res.reason == WakeReason::ALARM);
+  if (notified) {
+    res.unnotified = unnotify_listener();
+    notified = !res.unnotified;
+  }
+  std::int32_t value = 0;
+  if (res.reason == WakeReason::ALARM) {
+    value |= WakeRecord::reconciled_alarm;
+  }
+  if (notified) {
+    value |= WakeRecord::reconciled_notified;
+  }
+  journal({.kind = WakeRecord::Kind::RECONCILED,
+           .at = epoch_now(),
+           .value = value});
+  return res;
+}
+
+std::chrono::system_clock::time_point RTCWake::hctosys() {
+  const auto systime = ::hctosys(rtc(), set_system_clock);
+  // run at boot, so this is when the system came back. A run long after the
+  // boot records a boot time learn_cost_profile leaves out as an outlier.
+  const auto up = since_boot();
+  const auto booted = to_seconds(systime) - up;
+  journal({.kind = WakeRecord::Kind::BOOTED,
+           .at = booted.time_since_epoch().count(),
+           .value = static_cast<std::int32_t>(up.count())});
+  return systime;
+}
+
+rtc_time RTCWake::systohc() { return ::systohc(rtc(), sleep_until_realtime); }
+
+DriftResult RTCWake::calibrate(CalibrationOptions const &calibration) {
+  const bool synchronized = m_opts.clock_synchronized
+                                ? m_opts.clock_synchronized()
+                                : system_clock_synchronized();
+  if (!synchronized && !m_opts.force) {
+    throw std::runtime_error(
+        "the system clock is not synchronized, refusing to calibrate the RTC "
+        "against it");
+  }
+  auto &rtc = this->rtc();
+  const auto res = calibrate_drift(
+      calibration,
+      [&rtc] {
+        const auto edge = rtc.wait_update();
+        // as close to the edge as the read allows, its latency only shifts
+        // every offset alike
+        const auto sys = std::chrono::system_clock::now();
+        return EdgeSample{to_seconds(rtc_to_sys(edge, rtc)), sys};
+      },
+      [](std::chrono::seconds interval) {
+        std::this_thread::sleep_for(interval);
+      });
+  write_adjfile(m_opts.adjfile,
+                set_adjfile_drift(load_adjfile(),
+                                  res.seconds_per_day(), epoch_now()));
+  return res;
+}
+
+void RTCWake::open() {
+  if (m_lazy != nullptr) {
+    m_lazy->open();
+    m_lazy->resolve_clock();
+  }
+}
+
+IRTC &RTCWake::rtc() {
+  if (m_lazy != nullptr) {
+    m_lazy->resolve_clock();
+  }
+  return *m_rtc;
+}
+
+auto RTCWake::touched() const noexcept -> Resources {
+  auto res = m_touched;
+  if (m_lazy != nullptr) {
+    res.device = m_lazy->opened();
+  }
+  return res;
+}
+
+std::string RTCWake::load_adjfile() {
+  m_touched.adjfile = true;
+  return read_adjfile(m_opts.adjfile);
+}
+
+// the backend decides whether the listener is reached, only a connection
+// opened to it counts as touching the daemon
+bool RTCWake::notify_listener() noexcept {
+  const auto connections = MrHatIntegration::connections();
+  const bool res = m_rtc->notify_listener(m_opts.integration);
+  m_touched.daemon |= MrHatIntegration::connections() != connections;
+  return res;
+}
+
+bool RTCWake::unnotify_listener() noexcept {
+  const auto connections = MrHatIntegration::connections();
+  const bool res = m_rtc->unnotify_listener(m_opts.integration);
+  m_touched.daemon |= MrHatIntegration::connections() != connections;
+  return res;
+}
+
+// the status page is a convenience for readers, failing to update it must not
+// fail the operation itself
+void RTCWake::publish(std::time_t wakeup, bool enabled) const noexcept try {
+  if (!m_opts.status_file.empty()) {
+    // readers convert the wake time with the clock, an unresolved one would
+    // be published as INVALID
+    const auto clock =
+        m_lazy != nullptr ? m_lazy->resolve_clock() : m_rtc->type();
+    StatusPage::open_writer(m_opts.status_file)
+        .publish(wakeup, enabled, clock);
+  }
+} catch (std::exception const &e) {
+  if (m_opts.verbose) {
+    fmt::print(stderr, "mrhat-rtcwake: failed to publish status: {}\n",
+               e.what());
+  }
+}
+
+// a missing snapshot only makes the next boot slower, it must not prevent
+// halting
+void RTCWake::save_page_cache() const noexcept try {
+  if (!m_opts.page_cache_index.empty() && !m_opts.page_cache_paths.empty()) {
+    auto const &limits = m_opts.page_cache_limits;
+    const auto files = expand_cache_paths(m_opts.page_cache_paths, "/proc",
+                                          limits.max_files);
+    write_page_cache_index(m_opts.page_cache_index,
+                           snapshot_page_cache(files, limits.budget));
+  }
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: failed to save page cache snapshot: {}\n",
+             e.what());
+}
+
+// the journal is a record for later analysis, failing to append to it must
+// not fail the operation itself
+void RTCWake::journal(WakeRecord const &record) noexcept try {
+  if (m_opts.journal_file.empty()) {
+    return;
+  }
+  if (!m_journal) {
+    m_journal = std::make_unique<WakeJournal>(
+        WakeJournal::open_writer(m_opts.journal_file));
+  }
+  m_journal->append(record);
+} catch (std::exception const &e) {
+  if (m_opts.verbose) {
+    fmt::print(stderr,
+               "mrhat-rtcwake: failed to append to the wake journal: {}\n",
+               e.what());
+  }
+}
+
+void RTCWake::sync_journal() noexcept try {
+  if (m_journal) {
+    m_journal->sync();
+  }
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: failed to sync the wake journal: {}\n",
+             e.what());
+}
+
+// whether the journal tells that the listener is still notified, fallback
+// if there is no journal to tell
+bool RTCWake::listener_notified(bool fallback) const noexcept try {
+  if (m_opts.journal_file.empty()) {
+    return fallback;
+  }
+  const auto records = read_wake_journal(m_opts.journal_file);
+  if (records.empty()) {
+    return fallback;
+  }
+  return ::listener_notified(records);
+} catch (std::exception const &e) {
+  if (m_opts.verbose) {
+    fmt::print(stderr, "mrhat-rtcwake: failed to read the wake journal: {}\n",
+               e.what());
+  }
+  return fallback;
+}
+
+// read once, a missing machine id fails the first resolution instead of
+// silently waking the whole fleet at once
+std::chrono::minutes RTCWake::spread() {
+  if (!m_spread) {
+    m_spread = m_opts.spread_window.count() <= 1
+                   ? std::chrono::minutes{0}
+                   : spread_offset(m_opts.spread_identity.empty()
+                                       ? device_identity()
+                                       : m_opts.spread_identity,
+                                   m_opts.spread_window);
+  }
+  return *m_spread;
+}
+
+// exports the statistics of the instrumented backend once, either before the
+// process is replaced by poweroff or on destruction
+void RTCWake::flush_metrics() noexcept try {
+  if (auto const *r = std::exchange(m_instrumented, nullptr)) {
+    export_metrics(m_opts.metrics_file, r->stats(), r->name());
+  }
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: failed to export metrics: {}\n", e.what());
+}
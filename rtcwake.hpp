@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cost_model.hpp>
+#include <irtc.hpp>
+#include <page_cache.hpp>
+#include <rtc_drift.hpp>
+#include <rtc_retry.hpp>
+#include <status_page.hpp>
+#include <tz_transitions.hpp>
+
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class InstrumentedRTC;
+class LazyRTC;
+class RTCSession;
+class WakeJournal;
+struct WakeRecord;
+
+// command line poweroff_halt execs
+std::vector<std::string> poweroff_argv(bool force, std::string const &command);
+// execs the poweroff command with --halt, the default halt of RTCWake
+int poweroff_halt(bool force, std::string const &command);
+
+std::string read_adjfile(std::filesystem::path const &adjfile);
+
+// Scheduling facade doing what a single mrhat-rtcwake invocation does. An
+// instance keeps the device open, so agents can arm, query and clear wakeups
+// in-process instead of spawning the CLI for each operation.
+class RTCWake {
+public:
+  using sys_seconds = std::chrono::sys_seconds;
+
+  struct Options {
+    std::string device = "rtc0";
+    std::filesystem::path adjfile = "/etc/adjtime";
+    // status page the alarm state is published to, disabled if empty
+    std::filesystem::path status_file = StatusPage::default_path;
+    // Prometheus textfile to export RTC call statistics to, disabled if empty
+    std::filesystem::path metrics_file;
+    // show, disable, schedule, halt and reconcile retry all their ioctls
+    // under one deadline of the policy
+    RetryPolicy retry{};
+    IRTC::IntegrationInfo integration{9000, 8, 0};
+    bool force = false;
+    bool verbose = false;
+    // exec'd with --halt to halt the system
+    std::string poweroff = "/usr/sbin/poweroff";
+    // replaces the process with poweroff, returns the errno if it could not,
+    // unset execs the poweroff command
+    std::function<int(bool force)> halt;
+    // "mem" is written to it to suspend the system
+    std::filesystem::path power_state = "/sys/power/state";
+    // suspends the system and returns once resumed, returns the errno if it
+    // could not, unset writes power_state
+    std::function<int()> suspend;
+    // whether the system clock is synchronized, e.g. by NTP, for calibrate(),
+    // unset asks the kernel
+    std::function<bool()> clock_synchronized;
+    // hot ranges of these files are saved to page_cache_index before halting,
+    // see expand_cache_paths for the accepted specs
+    std::vector<std::string> page_cache_paths;
+    std::filesystem::path page_cache_index;
+    SnapshotLimits page_cache_limits{};
+    // arming, clearing, halting and booting are recorded to this wake
+    // journal, disabled if empty
+    std::filesystem::path journal_file;
+    // wake times are delayed by a per-device offset in whole minutes within
+    // this window, see spread_offset, 0 wakes at the requested time
+    std::chrono::minutes spread_window{0};
+    // identity the offset is derived from, empty uses the machine id
+    std::string spread_identity;
+  };
+
+  // how the wake time is given, matching the --date, --seconds and --time
+  // command line options
+  struct WakeSpec {
+    enum class Kind { DATE, SECONDS, TIME };
+    Kind kind = Kind::DATE;
+    std::string value;
+    // local dates skipped or repeated by a daylight saving transition
+    TransitionTable::Choose dst = TransitionTable::Choose::EARLIEST;
+  };
+
+  struct AlarmState {
+    bool enabled = false;
+    bool pending = false;
+    sys_seconds wakeup{};
+  };
+
+  struct ScheduleResult {
+    rtc_time rtc_now{};
+    rtc_time rtc_wakeup{};
+    sys_seconds now{};
+    sys_seconds wakeup{};
+  };
+
+  struct HaltResult {
+    bool notified = false;
+    int error = 0;
+  };
+
+  enum class WakeReason { ALARM, POWER_ON };
+
+  struct ReconcileResult {
+    WakeReason reason = WakeReason::POWER_ON;
+    // the fired alarm was disabled
+    bool cleared = false;
+    // the reset on halt bit was still set and the listener cleared it
+    bool unnotified = false;
+  };
+
+  // external resources an instance touched so far
+  struct Resources {
+    bool device = false;
+    bool adjfile = false;
+    // zone database, for absolute wake dates
+    bool tzdb = false;
+    // mrhat-daemon, signalled on halt
+    bool daemon = false;
+    bool operator==(Resources const &) const = default;
+  };
+
+  using Backend = std::function<std::unique_ptr<IRTC>(std::string const &)>;
+
+  // the device and the adjustment file are only opened once an operation
+  // needs them, see open() to open them right away
+  explicit RTCWake(Options opts);
+  // opens opts.device through the given backend factory, lazily as well
+  RTCWake(Options opts, Backend backend);
+  // uses the given, already opened backend instead of opening opts.device
+  RTCWake(Options opts, std::unique_ptr<IRTC> rtc);
+  RTCWake(const RTCWake &) = delete;
+  RTCWake &operator=(const RTCWake &) = delete;
+  ~RTCWake();
+
+  // alarm state last published to the status file, without touching the RTC
+  static std::optional<AlarmState>
+  show_cached(std::filesystem::path const &status_file);
+
+  AlarmState show();
+  void disable();
+  // the wake time spec resolves to against the current RTC time, without
+  // arming it, throws if it is not in the future
+  sys_seconds resolve(WakeSpec const &spec);
+  // resolves the wake time against the current RTC time and arms the alarm,
+  // throws if the wake time is not in the future
+  ScheduleResult schedule(WakeSpec const &spec);
+  // arms an already resolved wake time as is, e.g. of resolve(), so the
+  // spread is not applied again
+  ScheduleResult schedule_at(sys_seconds wakeup);
+  // saves the page cache snapshot, signals reset on halt to the listener and
+  // halts the system, only returns if halting failed, in which case the
+  // listener has been reverted
+  HaltResult halt();
+  // resolves the wake time against the current RTC time and chooses the
+  // action taking the least energy until then, records the decision
+  PowerDecision choose_action(WakeSpec const &spec, CostProfile const &profile);
+  // the same for an already resolved wake time
+  PowerDecision choose_action(sys_seconds wakeup, CostProfile const &profile);
+  // suspends to RAM, returns once resumed or the errno if suspending failed
+  int suspend();
+  // blocks until the wake time, for staying up until an armed alarm
+  void wait_until(sys_seconds wakeup);
+  // run at boot: tells whether the alarm woke the system, disables the fired
+  // alarm and clears the reset on halt bit if the last halt left it set. Reads
+  // the alarm once and loads neither the adjustment file nor the zone
+  // database.
+  ReconcileResult reconcile();
+
+  std::chrono::system_clock::time_point hctosys();
+  rtc_time systohc();
+  // measures the drift of the RTC against the synchronized system clock at
+  // its update edges and writes it to the adjustment file. Throws if the
+  // system clock is not synchronized, unless forced.
+  DriftResult calibrate(CalibrationOptions const &calibration);
+
+  // opens the device and reads the adjustment file if not done yet, so
+  // configuration errors surface right away
+  void open();
+  // the backend with its clock type resolved, for converting RTC times
+  IRTC &rtc();
+  Resources touched() const noexcept;
+
+private:
+  void stack(std::unique_ptr<IRTC> rtc);
+  ScheduleResult arm(rtc_time now, rtc_time wakeup);
+  void publish(std::time_t wakeup, bool enabled) const noexcept;
+  void flush_metrics() noexcept;
+  void save_page_cache() const noexcept;
+  void journal(WakeRecord const &record) noexcept;
+  void sync_journal() noexcept;
+  bool listener_notified(bool fallback) const noexcept;
+  std::string load_adjfile();
+  bool notify_listener() noexcept;
+  bool unnotify_listener() noexcept;
+  std::chrono::minutes spread();
+  PowerDecision decide(sys_seconds now, sys_seconds wakeup,
+                       CostProfile const &profile);
+
+  Options m_opts;
+  InstrumentedRTC const *m_instrumented = nullptr;
+  LazyRTC const *m_lazy = nullptr;
+  RTCSession *m_session = nullptr;
+  std::unique_ptr<IRTC> m_rtc;
+  std::unique_ptr<WakeJournal> m_journal;
+  std::optional<std::chrono::minutes> m_spread;
+  Resources m_touched{};
+};
@@ -0,0 +1,184 @@
+#include "status_page.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::uint32_t status_magic = 0x4d525743; // "MRWC"
+constexpr std::uint32_t status_version = 1;
+// a writer only holds the seqlock for a few stores, a reader giving up after
+// this many attempts falls back to the device
+constexpr unsigned snapshot_attempts = 1000;
+
+std::system_error errno_error(std::filesystem::path const &path,
+                              const char *what) {
+  return std::system_error(errno, std::generic_category(),
+                           std::string(what) + " " + path.string());
+}
+} // namespace
+
+struct StatusPage::Layout {
+  std::uint32_t magic;
+  std::uint32_t version;
+  // seqlock counter, odd while a write is in progress
+  std::atomic<std::uint64_t> seq;
+  std::atomic<std::int64_t> wakeup;
+  std::atomic<std::int64_t> updated;
+  std::atomic<std::uint32_t> enabled;
+  std::atomic<std::uint32_t> clock;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic<std::int64_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+StatusPage StatusPage::open_writer(std::filesystem::path const &path) {
+  std::filesystem::create_directories(path.parent_path());
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw errno_error(path, "failed to open status page");
+  }
+  // construct right away so the fd is closed on any error below
+  StatusPage page(fd, nullptr);
+  if (flock(fd, LOCK_EX) != 0) {
+    throw errno_error(path, "failed to lock status page");
+  }
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    throw errno_error(path, "failed to stat status page");
+  }
+  if (st.st_size < static_cast<off_t>(sizeof(Layout)) &&
+      ftruncate(fd, sizeof(Layout)) != 0) {
+    throw errno_error(path, "failed to size status page");
+  }
+  void *mem =
+      mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    throw errno_error(path, "failed to map status page");
+  }
+  page.m_page = static_cast<Layout *>(mem);
+  if (page.m_page->magic != status_magic ||
+      page.m_page->version != status_version) {
+    page.m_page->seq.store(0, std::memory_order_relaxed);
+    page.m_page->wakeup.store(0, std::memory_order_relaxed);
+    page.m_page->updated.store(0, std::memory_order_relaxed);
+    page.m_page->enabled.store(0, std::memory_order_relaxed);
+    page.m_page->clock.store(static_cast<std::uint32_t>(IRTC::Clock::INVALID),
+                             std::memory_order_relaxed);
+    page.m_page->version = status_version;
+    page.m_page->magic = status_magic;
+  }
+  // a writer killed inside publish left the seqlock odd, the lock tells that
+  // no write is in progress
+  if (const auto seq = page.m_page->seq.load(std::memory_order_relaxed);
+      seq & 1) {
+    page.m_page->seq.store(seq + 1, std::memory_order_release);
+  }
+  flock(fd, LOCK_UN);
+  return page;
+}
+
+std::optional<StatusPage>
+StatusPage::open_reader(std::filesystem::path const &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return {};
+    }
+    throw errno_error(path, "failed to open status page");
+  }
+  StatusPage page(fd, nullptr);
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    throw errno_error(path, "failed to stat status page");
+  }
+  if (st.st_size < static_cast<off_t>(sizeof(Layout))) {
+    return {};
+  }
+  void *mem = mmap(nullptr, sizeof(Layout), PROT_READ, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    throw errno_error(path, "failed to map status page");
+  }
+  page.m_page = static_cast<Layout *>(mem);
+  if (page.m_page->magic != status_magic ||
+      page.m_page->version != status_version) {
+    return {};
+  }
+  return page;
+}
+
+StatusPage::StatusPage(StatusPage &&other) noexcept
+    : m_fd{std::exchange(other.m_fd, -1)},
+      m_page{std::exchange(other.m_page, nullptr)} {}
+
+StatusPage &StatusPage::operator=(StatusPage &&other) noexcept {
+  if (this != &other) {
+    this->~StatusPage();
+    m_fd = std::exchange(other.m_fd, -1);
+    m_page = std::exchange(other.m_page, nullptr);
+  }
+  return *this;
+}
+
+StatusPage::~StatusPage() {
+  if (m_page != nullptr)
+    munmap(m_page, sizeof(Layout));
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+void StatusPage::publish(std::time_t wakeup, bool enabled, IRTC::Clock clock) {
+  const auto now = std::chrono::system_clock::to_time_t(
+      std::chrono::system_clock::now());
+  // writers in other processes are serialized by the file lock, the seqlock
+  // only protects the readers
+  flock(m_fd, LOCK_EX);
+  const auto seq = m_page->seq.load(std::memory_order_relaxed);
+  m_page->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_page->wakeup.store(wakeup, std::memory_order_relaxed);
+  m_page->updated.store(now, std::memory_order_relaxed);
+  m_page->enabled.store(enabled ? 1 : 0, std::memory_order_relaxed);
+  if (clock != IRTC::Clock::INVALID) {
+    m_page->clock.store(static_cast<std::uint32_t>(clock),
+                        std::memory_order_relaxed);
+  }
+  m_page->seq.store(seq + 2, std::memory_order_release);
+  flock(m_fd, LOCK_UN);
+}
+
+std::optional<StatusSnapshot> StatusPage::snapshot() const noexcept {
+  for (unsigned attempt = 0; attempt < snapshot_attempts; ++attempt) {
+    const auto seq1 = m_page->seq.load(std::memory_order_acquire);
+    if (seq1 & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    StatusSnapshot snap{
+        .wakeup = m_page->wakeup.load(std::memory_order_relaxed),
+        .enabled = m_page->enabled.load(std::memory_order_relaxed) != 0,
+        .clock = static_cast<IRTC::Clock>(
+            m_page->clock.load(std::memory_order_relaxed)),
+        .updated = m_page->updated.load(std::memory_order_relaxed),
+        .sequence = seq1 / 2,
+    };
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_page->seq.load(std::memory_order_relaxed) != seq1) {
+      continue;
+    }
+    if (snap.sequence == 0) {
+      return {};
+    }
+    return snap;
+  }
+  return {};
+}
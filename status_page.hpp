@@ -0,0 +1,51 @@
+#pragma once
+
+#include <irtc.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <optional>
+
+// Alarm state as last published by a mutating invocation
+struct StatusSnapshot {
+  std::time_t wakeup = 0;
+  bool enabled = false;
+  IRTC::Clock clock = IRTC::Clock::INVALID;
+  std::time_t updated = 0;
+  // number of publishes since the page was created
+  std::uint64_t sequence = 0;
+};
+
+// Memory mapped status page shared between invocations. Writers serialize on
+// an advisory lock, readers use the embedded seqlock so taking a snapshot of
+// a mapped page needs neither locks nor syscalls.
+class StatusPage {
+public:
+  static constexpr auto default_path = "/run/mrhat-rtcwake/status";
+
+  static StatusPage open_writer(std::filesystem::path const &path);
+  // returns an empty optional if the page does not exist yet
+  static std::optional<StatusPage>
+  open_reader(std::filesystem::path const &path);
+
+  StatusPage(const StatusPage &) = delete;
+  StatusPage &operator=(const StatusPage &) = delete;
+  StatusPage(StatusPage &&other) noexcept;
+  StatusPage &operator=(StatusPage &&other) noexcept;
+  ~StatusPage();
+
+  // an INVALID clock, e.g. of a device whose clock was not resolved, keeps
+  // the one published before
+  void publish(std::time_t wakeup, bool enabled, IRTC::Clock clock);
+  // returns an empty optional if nothing was published yet, or if a write
+  // stayed in progress for longer than a publish takes
+  std::optional<StatusSnapshot> snapshot() const noexcept;
+
+  struct Layout;
+
+private:
+  StatusPage(int fd, Layout *page) : m_fd{fd}, m_page{page} {}
+  int m_fd = -1;
+  Layout *m_page = nullptr;
+};
@@ -0,0 +1,179 @@
+// End to end latency gate: drives mrhat-rtcwake --mode standby against the
+// mock RTC and a stand-in mrhat-daemon per scenario of the budget file, with
+// poweroff replaced by this executable recording when the halt was requested.
+// Fails if the p50 or p99 time from spawning the CLI to its halt request
+// exceeds the budget of a scenario.
+//
+// usage: mrhat-rtcwake-e2e <mrhat-rtcwake binary> <budget file> [iterations]
+
+#include "standin_daemon.hpp"
+
+#include <latency_histogram.hpp>
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+// set for the poweroff stand-in, the file the halt request is recorded to
+constexpr auto halted_env = "MRHAT_RTCWAKE_E2E_HALTED";
+
+struct Scenario {
+  std::string name;
+  DaemonProfile daemon;
+  microseconds p50_budget{};
+  microseconds p99_budget{};
+};
+
+std::vector<Scenario> read_budgets(fs::path const &path) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    fmt::print(stderr, "failed to read {}\n", path.c_str());
+    std::exit(1);
+  }
+  std::vector<Scenario> res;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line.starts_with('#')) {
+      continue;
+    }
+    std::istringstream fields(line);
+    Scenario s;
+    std::int64_t latency = 0, jitter = 0, p50 = 0, p99 = 0;
+    if (!(fields >> s.name >> latency >> jitter >> s.daemon.error_rate >>
+          p50 >> p99)) {
+      fmt::print(stderr, "malformed budget line: {}\n", line);
+      std::exit(1);
+    }
+    s.daemon.latency = microseconds{latency};
+    s.daemon.jitter = microseconds{jitter};
+    s.p50_budget = microseconds{p50};
+    s.p99_budget = microseconds{p99};
+    res.push_back(std::move(s));
+  }
+  return res;
+}
+
+// the poweroff stand-in, exec'd by the CLI in place of halting
+int record_halt(const char *file) {
+  const auto now = clock_type::now().time_since_epoch().count();
+  std::ofstream(file) << now << '\n';
+  return 0;
+}
+
+// time from spawning the CLI to its halt request
+microseconds run_once(std::vector<std::string> args, fs::path const &halted) {
+  fs::remove(halted);
+  std::vector<char *> cargs;
+  for (auto &a : args) {
+    cargs.push_back(a.data());
+  }
+  cargs.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  const auto start = clock_type::now();
+  pid_t pid{};
+  if (posix_spawn(&pid, args[0].c_str(), &actions, nullptr, cargs.data(),
+                  environ) != 0) {
+    fmt::print(stderr, "failed to spawn {}\n", args[0]);
+    std::exit(1);
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  std::ifstream ifs(halted);
+  clock_type::rep at = 0;
+  if (!(ifs >> at) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fmt::print(stderr, "{} did not request a halt\n", args[0]);
+    std::exit(1);
+  }
+  return std::chrono::duration_cast<microseconds>(
+      clock_type::time_point{clock_type::duration{at}} - start);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (const char *file = std::getenv(halted_env)) {
+    return record_halt(file);
+  }
+  if (argc < 3) {
+    fmt::print(stderr,
+               "usage: {} <mrhat-rtcwake binary> <budget file> [iterations]\n",
+               argv[0]);
+    return 1;
+  }
+  const std::string cli = argv[1];
+  const auto scenarios = read_budgets(argv[2]);
+  const unsigned iterations = argc > 3 ? std::stoul(argv[3]) : 30;
+
+  const auto dir = fs::temp_directory_path() /
+                   fmt::format("mrhat-rtcwake-e2e-{}", getpid());
+  fs::create_directories(dir);
+  std::ofstream(dir / "adjtime") << "0.000000 1723331760 0.000000\n"
+                                    "1723331760\n"
+                                    "UTC\n";
+  const auto halted = dir / "halted";
+  setenv(halted_env, halted.c_str(), 1);
+  const auto self = fs::canonical("/proc/self/exe").string();
+
+  bool ok = true;
+  for (auto const &s : scenarios) {
+    StandInDaemon daemon(s.daemon);
+    const std::vector<std::string> args{
+        cli,
+        "--mode", "standby",
+        "--seconds", "600",
+        "--mrhat-daemon-port", std::to_string(daemon.port()),
+        "--adjfile", (dir / "adjtime").string(),
+        "--status-file", (dir / "status").string(),
+        "--journal", (dir / "wake.journal").string(),
+        "--lock-file", (dir / "wake.lock").string(),
+        "--register-cache", (dir / "registers").string(),
+        "--poweroff", self};
+    LatencyHistogram h;
+    for (unsigned i = 0; i < iterations; ++i) {
+      h.record(run_once(args, halted));
+    }
+    const auto p50 = h.percentile(0.5);
+    const auto p99 = h.percentile(0.99);
+    // every invocation signals reset on halt before halting
+    const bool notified = daemon.requests() == iterations;
+    const bool pass =
+        notified && p50 <= s.p50_budget && p99 <= s.p99_budget;
+    fmt::print("{:<16} n={:<4} p50={:>8}us (budget {:>8}us) p99={:>8}us "
+               "(budget {:>8}us) daemon errors={} {}\n",
+               s.name, h.count(), p50.count(), s.p50_budget.count(),
+               p99.count(), s.p99_budget.count(), daemon.errors(),
+               pass ? "ok" : "FAILED");
+    if (!notified) {
+      fmt::print("{}: {} notifications for {} invocations\n", s.name,
+                 daemon.requests(), iterations);
+    }
+    ok &= pass;
+  }
+  fs::remove_all(dir);
+  return ok ? 0 : 1;
+}
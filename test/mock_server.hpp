@@ -0,0 +1,189 @@
+#pragma once
+
+#include <httplib.h>
+
+#include <mrhat_integration.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct MockServer {
+  std::unique_ptr<httplib::Server> svr;
+  std::future<void> ft;
+  int port{};
+  std::atomic<int> reg_val{-1};
+  std::atomic<bool> error{};
+
+  void wait() {
+    svr->stop();
+    ft.wait();
+  }
+
+  ~MockServer() { wait(); }
+};
+
+inline std::unique_ptr<MockServer> get_mock_server(bool return_error = false) {
+  auto svr = std::make_unique<httplib::Server>();
+  if (!svr->is_valid()) {
+    throw std::runtime_error("Failed to set up mock server");
+  }
+  auto mock = std::make_unique<MockServer>(std::move(svr));
+  mock->svr->Post("/api/register/8/0/1",
+                  [mck_ = mock.get(), return_error](const httplib::Request &req,
+                                                    httplib::Response &res) {
+                    if (return_error) {
+                      res.status = 403;
+                    } else {
+                      mck_->reg_val = 1;
+                    }
+                  });
+  mock->svr->Post("/api/register/8/0/0",
+                  [mck_ = mock.get(), return_error](const httplib::Request &req,
+                                                    httplib::Response &res) {
+                    if (return_error) {
+                      res.status = 403;
+                    } else {
+                      mck_->reg_val = 0;
+                    }
+                  });
+  mock->svr->set_error_handler(
+      [mck_ = mock.get()](const httplib::Request &req, httplib::Response &res) {
+        mck_->error = true;
+      });
+
+  mock->port = mock->svr->bind_to_any_port("localhost");
+  mock->ft = std::async(std::launch::async, [svr_ = mock->svr.get()]() {
+    int a = 0;
+    svr_->listen_after_bind();
+  });
+
+  return std::move(mock);
+}
+
+// mrhat-daemon keeping the written register bits, with or without the batch
+// endpoint. Writes to failing_reg are rejected. Listens on port, any free one
+// if 0.
+struct RegisterMockServer {
+  std::unique_ptr<httplib::Server> svr;
+  std::future<void> ft;
+  int port{};
+  std::mutex mutex;
+  // (reg, bit) to value
+  std::map<std::pair<unsigned, unsigned>, int> bits;
+  std::atomic<int> batch_requests{};
+  std::atomic<int> single_requests{};
+  std::atomic<int> read_requests{};
+  // client ports seen, one per connection
+  std::set<int> connections;
+
+  int bit(unsigned reg, unsigned b) {
+    std::lock_guard lock(mutex);
+    const auto it = bits.find({reg, b});
+    return it == bits.end() ? -1 : it->second;
+  }
+
+  void wait() {
+    svr->stop();
+    ft.wait();
+  }
+
+  ~RegisterMockServer() { wait(); }
+};
+
+inline std::unique_ptr<RegisterMockServer>
+get_register_mock_server(bool batch, std::optional<unsigned> failing_reg = {},
+                         int port = 0) {
+  auto mock = std::make_unique<RegisterMockServer>();
+  mock->svr = std::make_unique<httplib::Server>();
+  if (!mock->svr->is_valid()) {
+    throw std::runtime_error("Failed to set up mock server");
+  }
+  auto *mck_ = mock.get();
+  if (batch) {
+    // all or nothing, answers with the status of each write
+    mock->svr->Post("/api/registers", [mck_, failing_reg](
+                                          const httplib::Request &req,
+                                          httplib::Response &res) {
+      ++mck_->batch_requests;
+      std::lock_guard lock(mck_->mutex);
+      mck_->connections.insert(req.remote_port);
+      std::vector<RegisterWrite> writes;
+      std::string_view body(req.body);
+      while (!body.empty()) {
+        const auto eol = body.find('\n');
+        writes.push_back(parse_register_write(body.substr(0, eol)));
+        body = eol == std::string_view::npos ? "" : body.substr(eol + 1);
+      }
+      const bool fail =
+          failing_reg && std::any_of(writes.begin(), writes.end(),
+                                     [&](auto const &w) {
+                                       return w.reg == *failing_reg;
+                                     });
+      std::string answer;
+      for (auto const &w : writes) {
+        const auto status = !fail                   ? "applied"
+                            : w.reg == *failing_reg ? "failed"
+                                                    : "skipped";
+        answer += to_string(w) + ' ' + status + '\n';
+        if (!fail) {
+          mck_->bits[{w.reg, w.bit}] = w.value ? 1 : 0;
+        }
+      }
+      res.status = fail ? 409 : 200;
+      res.set_content(answer, "text/plain");
+    });
+  }
+  mock->svr->Post(R"(/api/register/(\d+)/(\d+)/([01]))",
+                  [mck_, failing_reg](const httplib::Request &req,
+                                      httplib::Response &res) {
+                    ++mck_->single_requests;
+                    std::lock_guard lock(mck_->mutex);
+                    mck_->connections.insert(req.remote_port);
+                    const auto reg = std::stoul(req.matches[1]);
+                    if (failing_reg && reg == *failing_reg) {
+                      res.status = 500;
+                      return;
+                    }
+                    mck_->bits[{static_cast<unsigned>(reg),
+                                static_cast<unsigned>(
+                                    std::stoul(req.matches[2]))}] =
+                        std::stoi(req.matches[3]);
+                  });
+
+  mock->svr->Get(R"(/api/register/(\d+)/(\d+))",
+                 [mck_](const httplib::Request &req, httplib::Response &res) {
+                   ++mck_->read_requests;
+                   std::lock_guard lock(mck_->mutex);
+                   const auto it = mck_->bits.find(
+                       {static_cast<unsigned>(std::stoul(req.matches[1])),
+                        static_cast<unsigned>(std::stoul(req.matches[2]))});
+                   if (it == mck_->bits.end()) {
+                     res.status = 404;
+                     return;
+                   }
+                   res.set_content(std::to_string(it->second), "text/plain");
+                 });
+
+  if (port == 0) {
+    mock->port = mock->svr->bind_to_any_port("localhost");
+  } else if (mock->svr->bind_to_port("localhost", port)) {
+    mock->port = port;
+  } else {
+    throw std::runtime_error("Failed to bind mock server");
+  }
+  mock->ft = std::async(std::launch::async, [svr_ = mock->svr.get()]() {
+    svr_->listen_after_bind();
+  });
+  mock->svr->wait_until_ready();
+  return mock;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <httplib.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Response behaviour of the stand-in mrhat-daemon
+struct DaemonProfile {
+  // every request is answered after latency plus a uniformly distributed
+  // share of jitter
+  std::chrono::microseconds latency{};
+  std::chrono::microseconds jitter{};
+  // fraction of the requests answered with a server error
+  double error_rate = 0;
+};
+
+// Serves the register API of mrhat-daemon on a free localhost port, with the
+// latency and error distributions of the profile
+class StandInDaemon {
+public:
+  explicit StandInDaemon(DaemonProfile profile, unsigned seed = 1)
+      : m_profile{profile}, m_rng{seed} {
+    if (!m_svr.is_valid()) {
+      throw std::runtime_error("failed to set up the stand-in daemon");
+    }
+    m_svr.Post(R"(/api/register/(\d+)/(\d+)/([01]))",
+               [this](const httplib::Request &req, httplib::Response &res) {
+                 ++m_requests;
+                 const auto [delay, fail] = draw();
+                 std::this_thread::sleep_for(delay);
+                 if (fail) {
+                   ++m_errors;
+                   res.status = 500;
+                   return;
+                 }
+                 m_value = std::stoi(req.matches[3]);
+               });
+    m_port = m_svr.bind_to_any_port("localhost");
+    if (m_port < 0) {
+      throw std::runtime_error("failed to bind the stand-in daemon");
+    }
+    m_listener = std::async(std::launch::async,
+                            [this] { m_svr.listen_after_bind(); });
+    m_svr.wait_until_ready();
+  }
+  StandInDaemon(const StandInDaemon &) = delete;
+  StandInDaemon &operator=(const StandInDaemon &) = delete;
+  ~StandInDaemon() {
+    m_svr.stop();
+    m_listener.wait();
+  }
+
+  int port() const noexcept { return m_port; }
+  std::size_t requests() const noexcept { return m_requests; }
+  std::size_t errors() const noexcept { return m_errors; }
+  // last register value written, -1 if none was
+  int value() const noexcept { return m_value; }
+
+private:
+  std::pair<std::chrono::microseconds, bool> draw() {
+    std::lock_guard lock(m_mutex);
+    std::uniform_int_distribution<std::int64_t> jitter(
+        0, m_profile.jitter.count());
+    std::bernoulli_distribution fail(m_profile.error_rate);
+    return {m_profile.latency + std::chrono::microseconds{jitter(m_rng)},
+            fail(m_rng)};
+  }
+
+  DaemonProfile m_profile;
+  httplib::Server m_svr;
+  std::future<void> m_listener;
+  int m_port = -1;
+  std::mutex m_mutex;
+  std::mt19937 m_rng;
+  std::atomic<std::size_t> m_requests{0};
+  std::atomic<std::size_t> m_errors{0};
+  std::atomic<int> m_value{-1};
+};
@@ -0,0 +1,191 @@
+// Startup gate: runs mrhat-rtcwake and mrhat-rtcwake-min once per iteration
+// and mode of the budget file against the mock RTC, and measures the time
+// from spawning the tool to its exit and the peak resident set size reported
+// by wait4. Fails if the p50 time or the peak RSS of a mode exceeds its
+// budget.
+//
+// usage: mrhat-rtcwake-startup <mrhat-rtcwake binary> <mrhat-rtcwake-min
+//        binary> <budget file> [iterations]
+
+#include "standin_daemon.hpp"
+
+#include <latency_histogram.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+struct Budget {
+  std::string target;
+  std::string mode;
+  microseconds p50_budget{};
+  long rss_budget_kib = 0;
+};
+
+// arguments and expected exit code of a mode
+struct Mode {
+  std::vector<std::string> args;
+  int exit_code = 0;
+};
+
+std::vector<Budget> read_budgets(fs::path const &path) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    fmt::print(stderr, "failed to read {}\n", path.c_str());
+    std::exit(1);
+  }
+  std::vector<Budget> res;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line.starts_with('#')) {
+      continue;
+    }
+    std::istringstream fields(line);
+    Budget b;
+    std::int64_t p50 = 0;
+    if (!(fields >> b.target >> b.mode >> p50 >> b.rss_budget_kib)) {
+      fmt::print(stderr, "malformed budget line: {}\n", line);
+      std::exit(1);
+    }
+    b.p50_budget = microseconds{p50};
+    res.push_back(std::move(b));
+  }
+  return res;
+}
+
+struct Run {
+  microseconds elapsed{};
+  long maxrss_kib = 0;
+  int exit_code = 0;
+};
+
+Run run_once(std::vector<std::string> args) {
+  std::vector<char *> cargs;
+  for (auto &a : args) {
+    cargs.push_back(a.data());
+  }
+  cargs.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  const auto start = clock_type::now();
+  pid_t pid{};
+  if (posix_spawn(&pid, args[0].c_str(), &actions, nullptr, cargs.data(),
+                  environ) != 0) {
+    fmt::print(stderr, "failed to spawn {}\n", args[0]);
+    std::exit(1);
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  int status = 0;
+  rusage usage{};
+  wait4(pid, &status, 0, &usage);
+  const auto elapsed = std::chrono::duration_cast<microseconds>(
+      clock_type::now() - start);
+  // exit codes are reported modulo 256
+  return {elapsed, usage.ru_maxrss,
+          WIFEXITED(status) ? WEXITSTATUS(status) : -1};
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    fmt::print(stderr,
+               "usage: {} <mrhat-rtcwake binary> <mrhat-rtcwake-min binary> "
+               "<budget file> [iterations]\n",
+               argv[0]);
+    return 1;
+  }
+  const std::map<std::string, std::string> targets{{"full", argv[1]},
+                                                   {"min", argv[2]}};
+  const auto budgets = read_budgets(argv[3]);
+  const unsigned iterations = argc > 4 ? std::stoul(argv[4]) : 30;
+
+  const auto dir = fs::temp_directory_path() /
+                   fmt::format("mrhat-rtcwake-startup-{}", getpid());
+  fs::create_directories(dir);
+  std::ofstream(dir / "adjtime") << "0.000000 1723331760 0.000000\n"
+                                    "1723331760\n"
+                                    "UTC\n";
+  StandInDaemon daemon({});
+  // halting is replaced by a command exiting right away
+  const std::map<std::string, Mode> modes{
+      {"show", {{"--mode", "show"}}},
+      {"show_epoch", {{"--mode", "show", "--output", "epoch"}}},
+      {"disable", {{"--mode", "disable"}}},
+      {"no", {{"--mode", "no", "--seconds", "600"}}},
+      {"standby",
+       {{"--mode", "standby", "--seconds", "600", "--poweroff", "/bin/true"}}},
+      // the mock RTC never fired an alarm
+      {"reconcile", {{"--mode", "reconcile"}, 200}},
+  };
+
+  bool ok = true;
+  for (auto const &b : budgets) {
+    const auto target = targets.find(b.target);
+    const auto mode = modes.find(b.mode);
+    if (target == targets.end() || mode == modes.end()) {
+      fmt::print(stderr, "unknown target or mode: {} {}\n", b.target, b.mode);
+      return 1;
+    }
+    std::vector<std::string> args{target->second};
+    args.insert(args.end(), mode->second.args.begin(),
+                mode->second.args.end());
+    const std::vector<std::string> common{
+        "--adjfile", (dir / "adjtime").string(),
+        "--status-file", (dir / "status").string(),
+        "--journal", (dir / "wake.journal").string(),
+        "--lock-file", (dir / "wake.lock").string(),
+        "--register-cache", (dir / "registers").string(),
+        "--mrhat-daemon-port", std::to_string(daemon.port())};
+    args.insert(args.end(), common.begin(), common.end());
+
+    LatencyHistogram h;
+    long maxrss = 0;
+    bool exited = true;
+    for (unsigned i = 0; i < iterations; ++i) {
+      const auto run = run_once(args);
+      h.record(run.elapsed);
+      maxrss = std::max(maxrss, run.maxrss_kib);
+      exited &= run.exit_code == mode->second.exit_code;
+    }
+    const auto p50 = h.percentile(0.5);
+    const bool pass =
+        exited && p50 <= b.p50_budget && maxrss <= b.rss_budget_kib;
+    fmt::print("{:<5} {:<11} n={:<4} p50={:>7}us (budget {:>7}us) "
+               "rss={:>6}KiB (budget {:>6}KiB) {}\n",
+               b.target, b.mode, h.count(), p50.count(), b.p50_budget.count(),
+               maxrss, b.rss_budget_kib, pass ? "ok" : "FAILED");
+    if (!exited) {
+      fmt::print("{} {}: unexpected exit code\n", b.target, b.mode);
+    }
+    ok &= pass;
+  }
+  fs::remove_all(dir);
+  return ok ? 0 : 1;
+}
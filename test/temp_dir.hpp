@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+// directory of a test below the system temp directory, unique to the process
+// and removed along with its contents when the fixture goes out of scope
+struct TempDir {
+  explicit TempDir(std::string_view name)
+      : path{std::filesystem::temp_directory_path() /
+             fmt::format("mrhat-rtcwake-{}-{}", name, getpid())} {
+    std::filesystem::create_directories(path);
+  }
+  TempDir(const TempDir &) = delete;
+  TempDir &operator=(const TempDir &) = delete;
+  ~TempDir() { std::filesystem::remove_all(path); }
+  std::filesystem::path path;
+};
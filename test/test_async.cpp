@@ -0,0 +1,216 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_async.hpp>
+#include <rtc_decorator.hpp>
+
+#include "mock_server.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+Task<int> answer() { co_return 42; }
+
+Task<int> twice(Task<int> t) { co_return 2 * co_await t; }
+
+Task<void> fails() {
+  throw std::runtime_error("boom");
+  co_return;
+}
+
+std::unique_ptr<MockRTC> get_mock() {
+  auto rtc = MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                                  "1723331760\n"
+                                  "UTC\n");
+  rtc_time now{};
+  now.tm_year = 124;
+  now.tm_mon = 7;
+  now.tm_mday = 18;
+  now.tm_hour = 21;
+  rtc->set_time(now);
+  return rtc;
+}
+
+} // namespace
+
+TEST_CASE("tasks run when awaited", "[async]") {
+  REQUIRE(sync_wait(answer()) == 42);
+  REQUIRE(sync_wait(twice(answer())) == 84);
+  REQUIRE_THROWS_AS(sync_wait(fails()), std::runtime_error);
+}
+
+TEST_CASE("when_all collects the results in order", "[async]") {
+  std::vector<Task<int>> tasks;
+  tasks.push_back(answer());
+  tasks.push_back(twice(answer()));
+  REQUIRE(sync_wait(when_all(std::move(tasks))) == std::vector{42, 84});
+  REQUIRE(sync_wait(when_all(std::vector<Task<int>>{})).empty());
+}
+
+#if not defined(__SANITIZE_THREAD__)
+
+TEST_CASE("worker pool bounds the operations in flight", "[async]") {
+  WorkerPool pool(3);
+  std::atomic<int> running{0};
+  std::atomic<int> peak{0};
+  auto job = [&]() -> Task<int> {
+    co_await pool.schedule();
+    const int now = ++running;
+    int prev = peak;
+    while (prev < now && !peak.compare_exchange_weak(prev, now)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    --running;
+    co_return now;
+  };
+  std::vector<Task<int>> tasks;
+  for (int i = 0; i < 12; ++i) {
+    tasks.push_back(job());
+  }
+  REQUIRE(sync_wait(when_all(std::move(tasks))).size() == 12);
+  REQUIRE(peak > 1);
+  REQUIRE(peak <= 3);
+}
+
+TEST_CASE("async rtc on the mock backend", "[async]") {
+  auto mock = get_mock();
+  WorkerPool pool(2);
+  AsyncRTC rtc(*mock, pool);
+
+  SECTION("alarm round trip") {
+    const auto alarm = sync_wait([&]() -> Task<rtc_wkalrm> {
+      auto tm = co_await rtc.get_time();
+      tm.tm_hour += 1;
+      co_await rtc.set_wakeup(tm);
+      co_return co_await rtc.get_wakeup();
+    }());
+    REQUIRE(alarm.enabled == 1);
+    REQUIRE(alarm.time.tm_hour == 22);
+
+    sync_wait(rtc.clear_wakeup());
+    REQUIRE(sync_wait(rtc.get_wakeup()).enabled == 0);
+  }
+
+  SECTION("many reads in flight") {
+    std::vector<Task<rtc_time>> tasks;
+    for (int i = 0; i < 16; ++i) {
+      tasks.push_back(rtc.get_time());
+    }
+    const auto times = sync_wait(when_all(std::move(tasks)));
+    REQUIRE(times.size() == 16);
+    REQUIRE(std::ranges::all_of(
+        times, [](rtc_time const &tm) { return tm.tm_hour == 21; }));
+  }
+
+  SECTION("ioctl errors propagate to the awaiter") {
+    mock->inject_faults({EIO});
+    REQUIRE_THROWS_AS(sync_wait(rtc.get_time()), std::system_error);
+  }
+}
+
+TEST_CASE("calls queued on a busy device leave the workers free",
+          "[async]") {
+  using namespace std::chrono_literals;
+  struct SlowRTC : RTCDecorator {
+    using RTCDecorator::RTCDecorator;
+    rtc_time get_time() const override {
+      std::this_thread::sleep_for(200ms);
+      return RTCDecorator::get_time();
+    }
+  };
+  SlowRTC slow(get_mock());
+  auto fast = get_mock();
+  WorkerPool pool(2);
+  AsyncRTC slow_rtc(slow, pool);
+  AsyncRTC fast_rtc(*fast, pool);
+  const auto start = std::chrono::steady_clock::now();
+  auto elapsed = [start]() -> Task<std::chrono::steady_clock::duration> {
+    co_return std::chrono::steady_clock::now() - start;
+  };
+  auto timed = [&](AsyncRTC &rtc) -> Task<std::chrono::steady_clock::duration> {
+    co_await rtc.get_time();
+    co_return co_await elapsed();
+  };
+  std::vector<Task<std::chrono::steady_clock::duration>> tasks;
+  for (int i = 0; i < 3; ++i) {
+    tasks.push_back(timed(slow_rtc));
+  }
+  tasks.push_back(timed(fast_rtc));
+  const auto done = sync_wait(when_all(std::move(tasks)));
+  // the slow device takes a worker for each call in turn, the fast one gets
+  // the other right away
+  REQUIRE(done.back() < 150ms);
+  REQUIRE(*std::ranges::max_element(done) >= 600ms);
+}
+
+TEST_CASE("async mrhat integration for rst action", "[async]") {
+  Reactor reactor;
+
+  SECTION("set and cancel") {
+    auto mock = get_mock_server();
+    AsyncMrHatIntegration mrhat(reactor, mock->port);
+    REQUIRE(sync_wait(mrhat.signal_reset_on_halt()));
+    REQUIRE(mock->reg_val == 1);
+    REQUIRE(sync_wait(mrhat.clear_reset_on_halt()));
+    REQUIRE(mock->reg_val == 0);
+    mock->wait();
+    REQUIRE(mock->error == false);
+  }
+
+  SECTION("requests in flight concurrently") {
+    auto mock = get_mock_server();
+    AsyncMrHatIntegration mrhat(reactor, mock->port);
+    std::vector<Task<bool>> tasks;
+    for (int i = 0; i < 8; ++i) {
+      tasks.push_back(mrhat.signal_reset_on_halt());
+    }
+    const auto results = sync_wait(when_all(std::move(tasks)));
+    mock->wait();
+    REQUIRE(std::ranges::all_of(results, [](bool ok) { return ok; }));
+    REQUIRE(mock->reg_val == 1);
+  }
+
+  SECTION("when error is at server side") {
+    auto mock = get_mock_server(true);
+    AsyncMrHatIntegration mrhat(reactor, mock->port);
+    REQUIRE_FALSE(sync_wait(mrhat.signal_reset_on_halt()));
+    mock->wait();
+    REQUIRE(mock->reg_val == -1);
+  }
+
+  SECTION("when server not running") {
+    AsyncMrHatIntegration mrhat(reactor, 666);
+    REQUIRE_FALSE(sync_wait(mrhat.signal_reset_on_halt()));
+  }
+
+  SECTION("when server hangs") {
+    using namespace std::chrono_literals;
+    // accepted by the backlog but never answered
+    const int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE(sock >= 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    REQUIRE(bind(sock, reinterpret_cast<sockaddr *>(&addr), len) == 0);
+    REQUIRE(listen(sock, 4) == 0);
+    REQUIRE(getsockname(sock, reinterpret_cast<sockaddr *>(&addr), &len) == 0);
+    AsyncMrHatIntegration mrhat(reactor, ntohs(addr.sin_port), 8, 0, 100ms);
+    const auto start = std::chrono::steady_clock::now();
+    REQUIRE_FALSE(sync_wait(mrhat.signal_reset_on_halt()));
+    REQUIRE(std::chrono::steady_clock::now() - start < 2s);
+    close(sock);
+  }
+}
+
+#endif
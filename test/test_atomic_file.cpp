@@ -0,0 +1,49 @@
+#include <catch2/catch_all.hpp>
+
+#include <atomic_file.hpp>
+
+#include "temp_dir.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string slurp(fs::path const &path) {
+  std::ifstream ifs(path);
+  return {std::istreambuf_iterator<char>(ifs), {}};
+}
+
+} // namespace
+
+TEST_CASE("atomic file writes", "[atomic-file]") {
+  TempDir tmp{"atomic"};
+
+  SECTION("creates the parent directories") {
+    const auto path = tmp.path / "a" / "b" / "file";
+    write_file_atomically(path, "first\n");
+    REQUIRE(slurp(path) == "first\n");
+  }
+  SECTION("replaces the file and leaves no temporary behind") {
+    const auto path = tmp.path / "file";
+    write_file_atomically(path, "first\n");
+    write_file_atomically(path, "second\n", true);
+    REQUIRE(slurp(path) == "second\n");
+    REQUIRE(std::distance(fs::directory_iterator(tmp.path),
+                          fs::directory_iterator{}) == 1);
+  }
+  SECTION("a failed rename keeps the old file") {
+    // a directory in the way of the file
+    const auto path = tmp.path / "dir";
+    fs::create_directories(path / "child");
+    REQUIRE_THROWS_AS(write_file_atomically(path, "x"), std::system_error);
+    REQUIRE(fs::is_directory(path));
+    REQUIRE(std::distance(fs::directory_iterator(tmp.path),
+                          fs::directory_iterator{}) == 1);
+  }
+}
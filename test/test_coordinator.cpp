@@ -0,0 +1,432 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_decorator.hpp>
+#include <rtc_utils.hpp>
+#include <rtcwake.hpp>
+#include <wake_coordinator.hpp>
+#include <wake_spread.hpp>
+
+#include "temp_dir.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+using Role = WakeCoordinator::Batch::Role;
+using Kind = RTCWake::WakeSpec::Kind;
+
+namespace {
+
+// 2024-08-18T21:22:32Z, the time of the mock in every process
+constexpr std::int64_t mock_now = 1724016152;
+
+// single write appends, so lines of concurrent processes do not interleave
+void append(fs::path const &log, std::string const &line) {
+  const int fd =
+      open(log.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd >= 0) {
+    [[maybe_unused]] const auto n = write(fd, line.data(), line.size());
+    close(fd);
+  }
+}
+
+std::vector<std::string> read_log(fs::path const &log) {
+  std::vector<std::string> res;
+  std::ifstream ifs(log);
+  for (std::string line; std::getline(ifs, line);) {
+    res.push_back(line);
+  }
+  return res;
+}
+
+std::size_t count(std::vector<std::string> const &lines,
+                  std::string_view prefix) {
+  return std::count_if(lines.begin(), lines.end(), [&](auto const &l) {
+    return l.starts_with(prefix);
+  });
+}
+
+// logs arming and notifying of the mock, the alarm of every process stands
+// for the single one of the device
+class LoggingRTC : public RTCDecorator {
+public:
+  LoggingRTC(std::unique_ptr<IRTC> inner, fs::path log)
+      : RTCDecorator{std::move(inner)}, m_log{std::move(log)} {}
+  void set_wakeup(rtc_time const &time) override {
+    RTCDecorator::set_wakeup(time);
+    append(m_log, fmt::format("armed {}\n",
+                              std::chrono::system_clock::to_time_t(
+                                  rtc_to_sys(time, *this))));
+  }
+  bool notify_listener(IntegrationInfo const &) const noexcept override {
+    append(m_log, "notify\n");
+    return true;
+  }
+
+private:
+  fs::path m_log;
+};
+
+std::unique_ptr<RTCWake> make_wake(fs::path const &log, int halt_error = 0,
+                                   std::chrono::minutes spread = 0min) {
+  auto mock = MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                                   "1723331760\n"
+                                   "UTC\n");
+  mock->set_time(
+      sys_to_rtc(std::chrono::system_clock::from_time_t(mock_now), *mock));
+  RTCWake::Options opts{};
+  opts.status_file.clear();
+  opts.spread_window = spread;
+  opts.spread_identity = "mrhat-00042";
+  opts.halt = [log, halt_error](bool) {
+    append(log, "halt\n");
+    return halt_error;
+  };
+  return std::make_unique<RTCWake>(
+      std::move(opts), std::make_unique<LoggingRTC>(std::move(mock), log));
+}
+
+std::string_view to_string(Role role) {
+  switch (role) {
+  case Role::LEADER:
+    return "leader";
+  case Role::LATE:
+    return "late";
+  case Role::FOLLOWER:
+    return "follower";
+  }
+  return "unknown";
+}
+
+// the exit status of a child process, -1 if it did not exit normally
+int wait_exit(pid_t pid) {
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// whether a line starting with prefix got logged within the timeout
+bool wait_logged(fs::path const &log, std::string_view prefix,
+                 std::chrono::milliseconds timeout = 10s) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (count(read_log(log), prefix) == 0) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(10ms);
+  }
+  return true;
+}
+
+// whether a child process is still running
+bool running(pid_t pid) {
+  int status = 0;
+  return waitpid(pid, &status, WNOHANG) == 0;
+}
+
+// the system going down ends the processes waiting for it
+void shutdown(std::vector<pid_t> const &children) {
+  for (const auto pid : children) {
+    kill(pid, SIGKILL);
+  }
+  for (const auto pid : children) {
+    waitpid(pid, nullptr, 0);
+  }
+}
+
+} // namespace
+
+TEST_CASE("parallel invocations coalesce", "[coordinator]") {
+  TempDir dir{"coordinator"};
+  const auto lock_file = dir.path / "wake.lock";
+  const auto log = dir.path / "log";
+  constexpr int n = 24;
+  // closed by the parent to start the children at once
+  int start[2];
+  REQUIRE(pipe(start) == 0);
+  std::vector<pid_t> children;
+  for (int i = 0; i < n; ++i) {
+    const pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+      close(start[1]);
+      char c{};
+      [[maybe_unused]] auto r = read(start[0], &c, 1);
+      try {
+        WakeCoordinator coordinator(lock_file, 300ms);
+        auto wake = make_wake(log);
+        // every request asks for a different wake time, in random order
+        const auto seconds = 600 + 60 * ((i * 7) % n);
+        const auto res = schedule_coalesced(
+            *wake, coordinator, {Kind::SECONDS, std::to_string(seconds)},
+            true);
+        append(log, fmt::format("{}\n", to_string(res.batch.role)));
+      } catch (std::exception const &) {
+        append(log, "failed\n");
+      }
+      // halted, like the followers waiting for it the leader stays until
+      // the system is down
+      pause();
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+  close(start[0]);
+  close(start[1]);
+  REQUIRE(wait_logged(log, "leader"));
+  // every request made it into the batch or armed an earlier time
+  WakeCoordinator coordinator(lock_file, 0ms);
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  WakeCoordinator::Batch batch;
+  do {
+    std::this_thread::sleep_for(10ms);
+    batch = coordinator.join(
+        std::chrono::sys_seconds{std::chrono::seconds{mock_now + 86400}},
+        false);
+  } while (batch.members + count(read_log(log), "late") < n &&
+           std::chrono::steady_clock::now() < deadline);
+  CHECK(batch.role == Role::FOLLOWER);
+  CHECK(batch.halt);
+  CHECK(batch.members + count(read_log(log), "late") == n);
+  // followers asking to halt wait for the system to go down
+  std::this_thread::sleep_for(100ms);
+  for (const auto pid : children) {
+    CHECK(running(pid));
+  }
+  shutdown(children);
+
+  const auto lines = read_log(log);
+  REQUIRE(count(lines, "leader") == 1);
+  REQUIRE(count(lines, "follower") == 0);
+  REQUIRE(count(lines, "failed") == 0);
+  REQUIRE(count(lines, "notify") == 1);
+  REQUIRE(count(lines, "halt") == 1);
+  // the earliest wake time is armed last
+  std::vector<std::string> armed;
+  std::copy_if(lines.begin(), lines.end(), std::back_inserter(armed),
+               [](auto const &l) { return l.starts_with("armed"); });
+  REQUIRE_FALSE(armed.empty());
+  REQUIRE(armed.back() == fmt::format("armed {}", mock_now + 600));
+}
+
+TEST_CASE("request joining an open batch", "[coordinator]") {
+  TempDir dir{"coordinator"};
+  const auto lock_file = dir.path / "wake.lock";
+  const auto log = dir.path / "log";
+  int joining[2];
+  REQUIRE(pipe(joining) == 0);
+  const pid_t leader = fork();
+  REQUIRE(leader >= 0);
+  if (leader == 0) {
+    close(joining[0]);
+    int code = 0;
+    try {
+      WakeCoordinator coordinator(lock_file, 1s);
+      auto wake = make_wake(log);
+      [[maybe_unused]] auto w = write(joining[1], "x", 1);
+      const auto res = schedule_coalesced(*wake, coordinator,
+                                          {Kind::SECONDS, "3600"}, false);
+      code = res.batch.role == Role::LEADER && res.batch.members == 2 ? 0 : 2;
+    } catch (std::exception const &) {
+      code = 1;
+    }
+    _exit(code);
+  }
+  close(joining[1]);
+  char c{};
+  REQUIRE(read(joining[0], &c, 1) == 1);
+  close(joining[0]);
+  std::this_thread::sleep_for(200ms);
+
+  WakeCoordinator coordinator(lock_file, 1s);
+  auto wake = make_wake(log);
+  const auto res =
+      schedule_coalesced(*wake, coordinator, {Kind::SECONDS, "600"}, false);
+  CHECK(res.batch.role == Role::FOLLOWER);
+  CHECK(res.batch.leader == leader);
+  CHECK_FALSE(res.batch.halt);
+  CHECK(res.batch.members == 2);
+  CHECK(res.batch.wakeup.time_since_epoch().count() == mock_now + 600);
+  CHECK_FALSE(res.scheduled);
+  // the follower only returns once the leader armed the batch
+  REQUIRE(read_log(log) ==
+          std::vector<std::string>{fmt::format("armed {}", mock_now + 600)});
+  REQUIRE(wait_exit(leader) == 0);
+}
+
+TEST_CASE("members of a failed batch lead the next one", "[coordinator]") {
+  TempDir dir{"coordinator"};
+  const auto lock_file = dir.path / "wake.lock";
+  const auto log = dir.path / "log";
+  const pid_t follower = fork();
+  REQUIRE(follower >= 0);
+  if (follower == 0) {
+    int code = 0;
+    try {
+      // joins while the batch of the parent is open
+      std::this_thread::sleep_for(200ms);
+      WakeCoordinator coordinator(lock_file, 0ms);
+      auto wake = make_wake(log);
+      const auto res = schedule_coalesced(*wake, coordinator,
+                                          {Kind::SECONDS, "1200"}, true);
+      code = res.batch.role == Role::LEADER && res.batch.members == 1 &&
+                     res.halted && res.halted->error == 0
+                 ? 0
+                 : 2;
+    } catch (std::exception const &) {
+      code = 1;
+    }
+    _exit(code);
+  }
+  WakeCoordinator coordinator(lock_file, 1s);
+  auto wake = make_wake(log, EPERM);
+  const auto res =
+      schedule_coalesced(*wake, coordinator, {Kind::SECONDS, "600"}, true);
+  CHECK(res.batch.role == Role::LEADER);
+  CHECK(res.batch.members == 2);
+  REQUIRE(res.halted);
+  CHECK(res.halted->error == EPERM);
+  REQUIRE(wait_exit(follower) == 0);
+
+  REQUIRE(read_log(log) ==
+          std::vector<std::string>{fmt::format("armed {}", mock_now + 600),
+                                   "notify", "halt",
+                                   fmt::format("armed {}", mock_now + 1200),
+                                   "notify", "halt"});
+}
+
+TEST_CASE("batches of a single process", "[coordinator]") {
+  TempDir dir{"coordinator"};
+  const auto lock_file = dir.path / "wake.lock";
+  const auto log = dir.path / "log";
+
+  SECTION("arming only leaves no batch behind") {
+    WakeCoordinator coordinator(lock_file, 0ms);
+    auto wake = make_wake(log);
+    for (const auto *seconds : {"600", "1200"}) {
+      const auto res = schedule_coalesced(*wake, coordinator,
+                                          {Kind::SECONDS, seconds}, false);
+      CHECK(res.batch.role == Role::LEADER);
+      CHECK(res.batch.members == 1);
+      CHECK_FALSE(res.halted);
+    }
+    // later invocations replace the alarm as without coordination
+    REQUIRE(read_log(log) ==
+            std::vector<std::string>{fmt::format("armed {}", mock_now + 600),
+                                     fmt::format("armed {}", mock_now + 1200)});
+  }
+  SECTION("past wake times are rejected before joining") {
+    WakeCoordinator coordinator(lock_file, 0ms);
+    auto wake = make_wake(log);
+    REQUIRE_THROWS(schedule_coalesced(
+        *wake, coordinator, {Kind::TIME, std::to_string(mock_now)}, true));
+    const auto batch = coordinator.join(
+        std::chrono::sys_seconds{std::chrono::seconds{mock_now + 600}}, false);
+    CHECK(batch.role == Role::LEADER);
+    CHECK(batch.members == 1);
+    CHECK_FALSE(batch.halt);
+    REQUIRE(read_log(log).empty());
+  }
+  SECTION("a lock file that cannot be created leaves arming uncoordinated") {
+    // below a regular file, which fails for root as well
+    std::ofstream(dir.path / "file") << "";
+    const auto unusable = dir.path / "file" / "wake.lock";
+    REQUIRE_THROWS_AS(WakeCoordinator(unusable, 0ms), std::system_error);
+    REQUIRE(open_coordinator(unusable, 200ms) == nullptr);
+    REQUIRE(open_coordinator(lock_file, 200ms) != nullptr);
+  }
+  SECTION("the spread is applied once") {
+    WakeCoordinator coordinator(lock_file, 0ms);
+    auto wake = make_wake(log, 0, 30min);
+    const auto offset = spread_offset("mrhat-00042", 30min);
+    REQUIRE(offset > 0min);
+    const auto res = schedule_coalesced(*wake, coordinator,
+                                        {Kind::SECONDS, "600"}, false);
+    const auto expected = mock_now + 600 + offset / 1s;
+    CHECK(res.batch.wakeup.time_since_epoch().count() == expected);
+    REQUIRE(res.scheduled);
+    CHECK(res.scheduled->wakeup.time_since_epoch().count() == expected);
+    REQUIRE(read_log(log) ==
+            std::vector<std::string>{fmt::format("armed {}", expected)});
+  }
+  SECTION("the leader decides for the wake time of the batch") {
+    WakeCoordinator coordinator(lock_file, 0ms);
+    auto wake = make_wake(log);
+    std::vector<std::int64_t> decided;
+    const auto res = schedule_coalesced(
+        *wake, coordinator, {Kind::SECONDS, "600"}, false, {},
+        [&](std::chrono::sys_seconds wakeup) {
+          decided.push_back(wakeup.time_since_epoch().count());
+          return wake->choose_action(wakeup, CostProfile{});
+        });
+    REQUIRE(decided == std::vector<std::int64_t>{mock_now + 600});
+    REQUIRE(res.decision);
+    CHECK(res.decision->action == PowerAction::HALT);
+    // halting is cheapest, so the leader halts the batch
+    CHECK(res.batch.halt);
+    REQUIRE(res.halted);
+    REQUIRE(read_log(log) ==
+            std::vector<std::string>{fmt::format("armed {}", mock_now + 600),
+                                     "notify", "halt"});
+  }
+  SECTION("failed halt ends the batch") {
+    WakeCoordinator coordinator(lock_file, 0ms);
+    auto wake = make_wake(log, EPERM);
+    const auto res =
+        schedule_coalesced(*wake, coordinator, {Kind::SECONDS, "600"}, true);
+    REQUIRE(res.halted);
+    CHECK(res.halted->error == EPERM);
+    // another process leads a new batch instead of joining the failed one
+    const pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+      int code = 0;
+      try {
+        WakeCoordinator other(lock_file, 0ms);
+        const auto batch = other.join(
+            std::chrono::sys_seconds{std::chrono::seconds{mock_now + 1200}},
+            true);
+        code = batch.role == Role::LEADER ? 0 : 2;
+      } catch (std::exception const &) {
+        code = 1;
+      }
+      _exit(code);
+    }
+    REQUIRE(wait_exit(pid) == 0);
+  }
+  SECTION("batch of an exited leader is abandoned") {
+    const pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+      // exits holding the lock of an open batch, without arming
+      WakeCoordinator other(lock_file, 0ms);
+      other.join(std::chrono::sys_seconds{std::chrono::seconds{mock_now + 60}},
+                 true);
+      _exit(0);
+    }
+    REQUIRE(wait_exit(pid) == 0);
+    WakeCoordinator coordinator(lock_file, 0ms);
+    const auto batch = coordinator.join(
+        std::chrono::sys_seconds{std::chrono::seconds{mock_now + 600}}, false);
+    CHECK(batch.role == Role::LEADER);
+    CHECK(batch.members == 1);
+    CHECK_FALSE(batch.halt);
+    CHECK(batch.wakeup.time_since_epoch().count() == mock_now + 600);
+  }
+}
@@ -0,0 +1,223 @@
+#include <catch2/catch_all.hpp>
+
+#include <cost_model.hpp>
+#include <rtcwake.hpp>
+#include <wake_journal.hpp>
+
+#include "temp_dir.hpp"
+
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+
+CostProfile with_suspend() {
+  CostProfile p;
+  p.suspend_power = 0.4;
+  return p;
+}
+
+CostProfile slow_boot() {
+  CostProfile p;
+  p.boot_time = 120s;
+  return p;
+}
+
+// the board keeps drawing as much as idle while off
+CostProfile leaky_off() {
+  CostProfile p;
+  p.off_power = 2.0;
+  return p;
+}
+
+} // namespace
+
+TEST_CASE("power action table", "[cost_model]") {
+  using enum PowerAction;
+  struct Case {
+    const char *name;
+    CostProfile profile;
+    std::chrono::seconds interval;
+    PowerAction action;
+    bool can_suspend;
+    bool can_halt;
+  };
+  const auto c = GENERATE_REF(values<Case>({
+      {"in the past", {}, -5s, WAIT, false, false},
+      {"shorter than halting", {}, 5s, WAIT, false, false},
+      {"halting within the margin", {}, 24s, WAIT, false, false},
+      {"halting costs more than waiting", {}, 30s, WAIT, false, true},
+      {"halting pays off", {}, 60s, HALT, false, true},
+      {"long interval", {}, 3600s, HALT, false, true},
+      {"too short to suspend", with_suspend(), 5s, WAIT, false, false},
+      {"suspend", with_suspend(), 30s, SUSPEND, true, true},
+      {"suspend over halting", with_suspend(), 60s, SUSPEND, true, true},
+      {"halt over suspend", with_suspend(), 300s, HALT, true, true},
+      {"slow boot, short", slow_boot(), 60s, WAIT, false, true},
+      {"slow boot, long", slow_boot(), 300s, HALT, false, true},
+      {"leaky off, short", leaky_off(), 60s, WAIT, false, true},
+      {"leaky off, long", leaky_off(), 3600s, WAIT, false, true},
+  }));
+  CAPTURE(c.name);
+  const auto d = choose_power_action(c.profile, c.interval);
+  REQUIRE(d.action == c.action);
+  REQUIRE(d.interval == c.interval);
+  REQUIRE(d.energy[0].has_value());
+  REQUIRE(d.energy[1].has_value() == c.can_suspend);
+  REQUIRE(d.energy[2].has_value() == c.can_halt);
+}
+
+TEST_CASE("power action energy", "[cost_model]") {
+  SECTION("accounted until the system is up again") {
+    const auto d = choose_power_action(with_suspend(), 60s);
+    // idle for the interval and the boot it saves
+    REQUIRE(*d.energy[0] == Catch::Approx(2.0 * (60 + 40)));
+    REQUIRE(*d.energy[1] ==
+            Catch::Approx(3.0 * 2 + 0.4 * 58 + 3.0 * 3 + 2.0 * 37));
+    REQUIRE(*d.energy[2] == Catch::Approx(3.0 * 15 + 0.05 * 45 + 3.0 * 40));
+  }
+
+  SECTION("a tie prefers the less disruptive action") {
+    CostProfile p;
+    p.halt_time = p.boot_time = p.margin = 0s;
+    p.active_power = p.idle_power = p.off_power = 2.0;
+    p.suspend_power = 2.0;
+    const auto d = choose_power_action(p, 60s);
+    REQUIRE(*d.energy[0] == *d.energy[2]);
+    REQUIRE(d.action == PowerAction::WAIT);
+  }
+
+  SECTION("json") {
+    REQUIRE(to_json(choose_power_action({}, 5s)) ==
+            "{\"action\":\"wait\",\"interval_s\":5,\"energy_j\":{"
+            "\"wait\":90.0,\"suspend\":null,\"halt\":null}}");
+    REQUIRE(to_json(choose_power_action({}, 60s)) ==
+            "{\"action\":\"halt\",\"interval_s\":60,\"energy_j\":{"
+            "\"wait\":200.0,\"suspend\":null,\"halt\":167.2}}");
+  }
+}
+
+TEST_CASE("cost profile parsing", "[cost_model]") {
+  SECTION("keys") {
+    const auto p = parse_cost_profile(
+        "halt=20,boot=45,suspend_time=1,resume=4,margin=5,active=2.5,"
+        "idle=1.5,off=0,suspend=0.3");
+    REQUIRE(p.halt_time == 20s);
+    REQUIRE(p.boot_time == 45s);
+    REQUIRE(p.suspend_time == 1s);
+    REQUIRE(p.resume_time == 4s);
+    REQUIRE(p.margin == 5s);
+    REQUIRE(p.active_power == 2.5);
+    REQUIRE(p.idle_power == 1.5);
+    REQUIRE(p.off_power == 0.0);
+    REQUIRE(p.suspend_power == 0.3);
+  }
+
+  SECTION("unset keys keep the base") {
+    CostProfile base;
+    base.boot_time = 33s;
+    const auto p = parse_cost_profile("halt=20", base);
+    REQUIRE(p.halt_time == 20s);
+    REQUIRE(p.boot_time == 33s);
+    REQUIRE_FALSE(p.suspend_power.has_value());
+    REQUIRE(parse_cost_profile("", base).boot_time == 33s);
+  }
+
+  SECTION("malformed") {
+    const auto spec = GENERATE("halt", "halt=", "halt=x", "halt=-1",
+                               "boot=1.5", "idle=-2", "reboot=1");
+    CAPTURE(spec);
+    REQUIRE_THROWS_AS(parse_cost_profile(spec), std::runtime_error);
+  }
+}
+
+TEST_CASE("boot time learned from the journal", "[cost_model]") {
+  using Kind = WakeRecord::Kind;
+  CostProfile base;
+  base.boot_time = 99s;
+
+  SECTION("no boots keep the base") {
+    REQUIRE(learn_cost_profile({}, base).boot_time == 99s);
+    const std::vector<WakeRecord> records{
+        {.kind = Kind::ARMED, .value = 50},
+        {.kind = Kind::BOOTED, .value = 0}};
+    REQUIRE(learn_cost_profile(records, base).boot_time == 99s);
+  }
+
+  SECTION("mean of the measured boots") {
+    const std::vector<WakeRecord> records{
+        {.kind = Kind::BOOTED, .value = 30},
+        {.kind = Kind::ARMED, .value = 500},
+        {.kind = Kind::BOOTED, .value = 0},
+        {.kind = Kind::BOOTED, .value = 50}};
+    const auto p = learn_cost_profile(records, base);
+    REQUIRE(p.boot_time == 40s);
+    REQUIRE(p.halt_time == base.halt_time);
+  }
+
+  SECTION("a late hctosys does not count") {
+    const std::vector<WakeRecord> records{
+        {.kind = Kind::BOOTED, .value = 35},
+        {.kind = Kind::BOOTED, .value = 7200},
+        {.kind = Kind::BOOTED, .value = 40}};
+    REQUIRE(learn_cost_profile(records, base).boot_time == 40s);
+  }
+}
+
+TEST_CASE("cheapest action among some", "[cost_model]") {
+  CostProfile p;
+  p.suspend_power = 0.4;
+  const auto d = choose_power_action(p, 3600s);
+  REQUIRE(d.action == PowerAction::HALT);
+  REQUIRE(cheapest(d, std::array{PowerAction::WAIT, PowerAction::SUSPEND}) ==
+          PowerAction::SUSPEND);
+  p.suspend_power.reset();
+  REQUIRE(cheapest(choose_power_action(p, 3600s),
+                   std::array{PowerAction::WAIT, PowerAction::SUSPEND}) ==
+          PowerAction::WAIT);
+}
+
+TEST_CASE("automatic mode through the facade", "[cost_model]") {
+  TempDir tmp{"cost"};
+  const auto &dir = tmp.path;
+  RTCWake::Options opts{};
+  opts.status_file.clear();
+  opts.journal_file = dir / "wake.journal";
+  opts.power_state = dir / "state";
+  RTCWake wake(opts, MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n"));
+
+  SECTION("the decision is journaled") {
+    const auto d =
+        wake.choose_action({RTCWake::WakeSpec::Kind::SECONDS, "600"}, {});
+    REQUIRE(d.action == PowerAction::HALT);
+    REQUIRE(d.interval == 600s);
+    const auto records = read_wake_journal(opts.journal_file);
+    REQUIRE(records.size() == 1);
+    REQUIRE(records[0].kind == WakeRecord::Kind::DECIDED);
+    REQUIRE(records[0].wakeup - records[0].at == 600);
+    REQUIRE(records[0].value == static_cast<int>(PowerAction::HALT));
+  }
+
+  SECTION("suspending writes the power state") {
+    std::ofstream(dir / "state");
+    REQUIRE(wake.suspend() == 0);
+    std::ifstream state(dir / "state");
+    REQUIRE(std::string(std::istreambuf_iterator<char>(state), {}) == "mem");
+  }
+
+  SECTION("suspending fails without the power state") {
+    REQUIRE(wake.suspend() == ENOENT);
+  }
+}
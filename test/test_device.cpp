@@ -0,0 +1,154 @@
+#include <catch2/catch_all.hpp>
+
+#include <irtc.hpp>
+#include <rtc_device.hpp>
+#include <rtc_utils.hpp>
+
+#include <chrono>
+#include <string>
+#include <system_error>
+
+namespace ch = std::chrono;
+
+namespace {
+
+rtc_time get_rtc_time(int year, int month, int day, int hour, int min,
+                      int sec) {
+  rtc_time t{};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hour;
+  t.tm_min = min;
+  t.tm_sec = sec;
+  return t;
+}
+
+// compile-time backend without a device node, ticks a second per update
+template <IRTC::Clock C> struct FakeDevice {
+  using IntegrationInfo = IRTC::IntegrationInfo;
+  static constexpr IRTC::Clock clock = C;
+
+  explicit FakeDevice(rtc_time now) : now{now} {}
+
+  std::string_view name() const noexcept { return "fake"; }
+  constexpr IRTC::Clock type() const noexcept { return clock; }
+  rtc_time get_time() const { return now; }
+  void set_time(rtc_time const &time) { now = time; }
+  rtc_time wait_update() const {
+    ++now.tm_sec;
+    return now;
+  }
+  void set_wakeup(rtc_time const &time) {
+    alarm.time = time;
+    alarm.enabled = 1;
+  }
+  rtc_wkalrm get_wakeup() const { return alarm; }
+  void clear_wakeup() { alarm.enabled = 0; }
+  void disable_wakeup(rtc_wkalrm const &) { clear_wakeup(); }
+  bool notify_listener(IntegrationInfo const &) const noexcept {
+    return true;
+  }
+  bool unnotify_listener(IntegrationInfo const &) const noexcept {
+    return false;
+  }
+  void set_retry_policy(RetryPolicy const &policy) {
+    retries = policy.max_attempts;
+  }
+  RetryStats retry_stats() const noexcept { return {.calls = retries}; }
+
+  mutable rtc_time now;
+  rtc_wkalrm alarm{};
+  unsigned retries = 0;
+};
+
+using UTCDevice = FakeDevice<IRTC::Clock::UTC>;
+using LocalDevice = FakeDevice<IRTC::Clock::LOCAL>;
+
+} // namespace
+
+static_assert(StaticClockRTC<RTCDevice<StandardAlarm, IRTC::Clock::UTC>>);
+static_assert(!StaticClockRTC<IRTC>);
+static_assert(!StaticClockRTC<RTCAdapter<UTCDevice>>);
+
+TEST_CASE("compile-time clock conversions", "[device]") {
+  const auto tm = get_rtc_time(2024, 8, 18, 21, 22, 32);
+
+  SECTION("match the IRTC ones") {
+    const auto utc = MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n");
+    const auto local = MockRTC::get("rtc0", "0.0 0 0.0\n0\nLOCAL\n");
+    REQUIRE(rtc_to_sys<IRTC::Clock::UTC>(tm) == rtc_to_sys(tm, *utc));
+    REQUIRE(rtc_to_sys<IRTC::Clock::LOCAL>(tm) == rtc_to_sys(tm, *local));
+    const auto tp = rtc_to_sys(tm, *utc);
+    REQUIRE(sys_to_rtc<IRTC::Clock::UTC>(tp).tm_hour ==
+            sys_to_rtc(tp, *utc).tm_hour);
+    REQUIRE(sys_to_rtc<IRTC::Clock::LOCAL>(tp).tm_hour ==
+            sys_to_rtc(tp, *local).tm_hour);
+  }
+
+  SECTION("round trip") {
+    const auto tp = rtc_to_sys<IRTC::Clock::UTC>(tm);
+    REQUIRE(tp == ch::sys_days{ch::year{2024} / 8 / 18} + ch::hours{21} +
+                      ch::minutes{22} + ch::seconds{32});
+    const auto back = sys_to_rtc<IRTC::Clock::UTC>(tp);
+    REQUIRE(back.tm_year == tm.tm_year);
+    REQUIRE(back.tm_mday == tm.tm_mday);
+    REQUIRE(back.tm_sec == tm.tm_sec);
+  }
+
+  SECTION("picked from the backend type") {
+    const UTCDevice utc{tm};
+    const LocalDevice local{tm};
+    REQUIRE(rtc_to_sys(tm, utc) == rtc_to_sys<IRTC::Clock::UTC>(tm));
+    REQUIRE(rtc_to_sys(tm, local) == rtc_to_sys<IRTC::Clock::LOCAL>(tm));
+  }
+}
+
+TEST_CASE("compile-time backend", "[device]") {
+  const auto tm = get_rtc_time(2024, 8, 18, 21, 22, 32);
+
+  SECTION("hctosys without the adapter") {
+    UTCDevice dev{tm};
+    ch::system_clock::time_point set_to{};
+    hctosys(dev, [&](ch::system_clock::time_point tp) { set_to = tp; });
+    REQUIRE(set_to == rtc_to_sys<IRTC::Clock::UTC>(tm) + ch::seconds{1});
+  }
+
+  SECTION("systohc without the adapter") {
+    UTCDevice dev{tm};
+    ch::system_clock::time_point slept_until{};
+    const auto res = systohc(
+        dev, [&](ch::system_clock::time_point tp) { slept_until = tp; });
+    REQUIRE(rtc_to_sys(dev.get_time(), dev) == slept_until);
+    REQUIRE(rtc_to_sys(res, dev) == slept_until);
+  }
+
+  SECTION("adapter forwards to the device") {
+    RTCAdapter<LocalDevice> adapter{tm};
+    IRTC &rtc = adapter;
+    REQUIRE(rtc.type() == IRTC::Clock::LOCAL);
+    REQUIRE(rtc.name() == "fake");
+    REQUIRE(rtc_to_sys(rtc.get_time(), rtc) ==
+            rtc_to_sys(tm, adapter.device()));
+    const auto wake = get_rtc_time(2024, 8, 19, 0, 0, 0);
+    rtc.set_wakeup(wake);
+    REQUIRE(adapter.device().alarm.enabled == 1);
+    REQUIRE(rtc.get_wakeup().time.tm_mday == 19);
+    rtc.disable_wakeup(rtc.get_wakeup());
+    REQUIRE(adapter.device().alarm.enabled == 0);
+    REQUIRE(rtc.notify_listener({}));
+    REQUIRE_FALSE(rtc.unnotify_listener({}));
+    rtc.set_retry_policy({.max_attempts = 7});
+    REQUIRE(rtc.retry_stats().calls == 7);
+    REQUIRE(rtc.wait_update().tm_sec == 33);
+  }
+
+  SECTION("opening a missing device throws") {
+    REQUIRE_THROWS_AS(
+        (RTCDevice<StandardAlarm, IRTC::Clock::UTC>{"rtc-does-not-exist"}),
+        std::system_error);
+    REQUIRE_THROWS_AS(open_rtc_device<StandardAlarm>("rtc-does-not-exist",
+                                                     false),
+                      std::system_error);
+  }
+}
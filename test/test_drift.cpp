@@ -0,0 +1,195 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_drift.hpp>
+#include <rtcwake.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr double base = 1724016152.0;
+
+// RTC running at (1 + rate) times the system clock, its edges are observed
+// with a read latency of up to a few milliseconds
+struct SyntheticRTC {
+  double rate = 0;
+  // RTC minus system time at the start
+  double phase = 0.25;
+  double max_latency = 0.003;
+  // system time, advanced by sleeping and waiting for edges
+  double now = base;
+  std::uint32_t lcg = 12345;
+  int sleeps = 0;
+
+  double latency() {
+    lcg = lcg * 1664525u + 1013904223u;
+    return max_latency * static_cast<double>(lcg >> 8) / (1u << 24);
+  }
+
+  EdgeSample sample() {
+    // the first RTC second boundary after now
+    const double rtc_now = base + phase + (now - base) * (1 + rate);
+    const double edge = std::ceil(rtc_now);
+    const double sys_edge = base + (edge - base - phase) / (1 + rate);
+    now = sys_edge + latency();
+    const std::chrono::duration<double> sys{now};
+    return {std::chrono::sys_seconds{std::chrono::seconds{
+                static_cast<std::int64_t>(edge)}},
+            std::chrono::system_clock::time_point{
+                std::chrono::duration_cast<
+                    std::chrono::system_clock::duration>(sys)}};
+  }
+  void sleep_for(std::chrono::seconds s) {
+    ++sleeps;
+    now += static_cast<double>(s.count());
+  }
+};
+
+DriftResult calibrate(SyntheticRTC &rtc, CalibrationOptions const &opts) {
+  return calibrate_drift(
+      opts, [&] { return rtc.sample(); },
+      [&](std::chrono::seconds s) { rtc.sleep_for(s); });
+}
+
+} // namespace
+
+TEST_CASE("drift estimator", "[drift]") {
+  DriftEstimator e;
+  REQUIRE_FALSE(e.rate().has_value());
+
+  SECTION("needs two distinct times") {
+    e.add(10, 0.5);
+    e.add(10, 0.6);
+    REQUIRE_FALSE(e.rate().has_value());
+    e.add(20, 0.7);
+    REQUIRE(e.rate().has_value());
+  }
+
+  SECTION("exact line") {
+    for (int i = 0; i < 100; ++i) {
+      const double t = 1e9 + i * 10.0;
+      e.add(t, 0.3 + 20e-6 * (t - 1e9));
+    }
+    REQUIRE(e.count() == 100);
+    REQUIRE(*e.rate() == Catch::Approx(20e-6).margin(1e-12));
+    REQUIRE(*e.rate_error() == Catch::Approx(0).margin(1e-9));
+  }
+
+  SECTION("error grows with the noise") {
+    DriftEstimator noisy;
+    for (int i = 0; i < 100; ++i) {
+      e.add(i, 0.001 * (i % 2));
+      noisy.add(i, 0.01 * (i % 2));
+    }
+    REQUIRE(*e.rate_error() > 0);
+    REQUIRE(*noisy.rate_error() == Catch::Approx(*e.rate_error() * 10));
+  }
+}
+
+TEST_CASE("calibration against synthetic edges", "[drift]") {
+  const auto ppm = GENERATE(-50.0, -1.0, 0.0, 11.574, 100.0);
+  CAPTURE(ppm);
+  SyntheticRTC rtc{.rate = ppm * 1e-6};
+  const auto res = calibrate(rtc, {.duration = 3600s, .interval = 10s});
+  REQUIRE(res.samples == 361);
+  REQUIRE(rtc.sleeps == 360);
+  // every sample waits for the next edge on top of the interval
+  REQUIRE(res.span >= 3600s);
+  REQUIRE(res.span <= 3600s + 361s);
+  REQUIRE(res.ppm() == Catch::Approx(ppm).margin(0.1));
+  REQUIRE(res.seconds_per_day() ==
+          Catch::Approx(ppm * 0.0864).margin(0.1 * 0.0864));
+  REQUIRE(res.rate_error * 1e6 < 0.1);
+}
+
+TEST_CASE("calibration samples", "[drift]") {
+  SECTION("one per interval including both ends") {
+    SyntheticRTC rtc;
+    REQUIRE(calibrate(rtc, {.duration = 60s, .interval = 10s}).samples == 7);
+  }
+  SECTION("back to back edges without an interval") {
+    SyntheticRTC rtc;
+    const auto res = calibrate(rtc, {.duration = 60s, .interval = 0s});
+    REQUIRE(res.samples == 2);
+    REQUIRE(rtc.sleeps == 1);
+  }
+  SECTION("the duration has to cover an interval") {
+    SyntheticRTC rtc;
+    REQUIRE_THROWS_AS(calibrate(rtc, {.duration = 5s, .interval = 10s}),
+                      std::runtime_error);
+  }
+}
+
+TEST_CASE("adjustment file drift", "[drift]") {
+  SECTION("drift and calibration time are set") {
+    REQUIRE(set_adjfile_drift("0.000000 1723331760 0.000000\n"
+                              "1723331760\n"
+                              "UTC\n",
+                              -1.5, 1724016152) ==
+            "-1.500000 1723331760 0.000000\n"
+            "1724016152\n"
+            "UTC\n");
+  }
+  SECTION("clock type is kept") {
+    REQUIRE(set_adjfile_drift("0.5 0 0\n0\nLOCAL", 0.25, 7) ==
+            "0.250000 0 0\n7\nLOCAL\n");
+  }
+  SECTION("malformed") {
+    const auto adj = GENERATE("", "0.0 0\n0\nUTC\n", "0.0 0 0.0\n0\n");
+    CAPTURE(adj);
+    REQUIRE_THROWS_AS(set_adjfile_drift(adj, 0, 0), std::runtime_error);
+  }
+}
+
+TEST_CASE("calibration through the facade", "[drift]") {
+  const auto dir = fs::temp_directory_path() /
+                   fmt::format("mrhat-rtcwake-drift-{}", getpid());
+  fs::create_directories(dir);
+  std::ofstream(dir / "adjtime") << "0.000000 1723331760 0.000000\n"
+                                    "1723331760\n"
+                                    "UTC\n";
+  bool synchronized = false;
+  RTCWake::Options opts{};
+  opts.adjfile = dir / "adjtime";
+  opts.status_file.clear();
+  opts.clock_synchronized = [&] { return synchronized; };
+  auto rtc = MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n");
+  auto *mock = rtc.get();
+  RTCWake wake(opts, std::move(rtc));
+  auto read_adj = [&] {
+    std::ifstream ifs(dir / "adjtime");
+    return std::string(std::istreambuf_iterator<char>(ifs), {});
+  };
+
+  SECTION("refused against an unsynchronized clock") {
+    REQUIRE_THROWS_AS(wake.calibrate({.duration = 1s, .interval = 1s}),
+                      std::runtime_error);
+    REQUIRE(read_adj().starts_with("0.000000 "));
+  }
+  SECTION("the drift is written to the adjustment file") {
+    synchronized = true;
+    const auto before = mock->ioctl_count();
+    const auto res = wake.calibrate({.duration = 1s, .interval = 1s});
+    REQUIRE(res.samples == 2);
+    // an update interrupt and a read per sample, plus RTC_UIE_OFF
+    REQUIRE(mock->ioctl_count() - before == 6);
+    const auto adj = read_adj();
+    REQUIRE(adj.starts_with(fmt::format("{:.6f} 1723331760 0.000000\n",
+                                        res.seconds_per_day())));
+    REQUIRE(adj.ends_with("\nUTC\n"));
+  }
+  fs::remove_all(dir);
+}
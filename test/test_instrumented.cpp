@@ -0,0 +1,142 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_instrumented.hpp>
+
+#include <fmt/format.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+auto get_instrumented_mock() {
+  return std::make_unique<InstrumentedRTC>(
+      MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                           "1723331760\n"
+                           "UTC\n"));
+}
+
+CallStats const &stats_of(InstrumentedRTC const &rtc,
+                          InstrumentedRTC::Method m) {
+  return rtc.stats()[static_cast<std::size_t>(m)];
+}
+} // namespace
+
+TEST_CASE("latency histogram", "[instrumented]") {
+  using namespace std::chrono_literals;
+
+  SECTION("buckets cover the value they are indexed with") {
+    for (std::uint64_t us :
+         {0ull, 1ull, 7ull, 8ull, 9ull, 15ull, 16ull, 17ull, 1000ull,
+          123456ull, 1ull << 36}) {
+      const auto idx = LatencyHistogram::index_of(us);
+      REQUIRE(idx < LatencyHistogram::bucket_count);
+      REQUIRE(us <= LatencyHistogram::upper_bound(idx));
+      if (idx > 0) {
+        REQUIRE(us > LatencyHistogram::upper_bound(idx - 1));
+      }
+    }
+  }
+  SECTION("relative error is bounded") {
+    for (std::uint64_t us = 8; us < (1ull << 30); us = us * 3 + 1) {
+      const auto bound = LatencyHistogram::upper_bound(
+          LatencyHistogram::index_of(us));
+      REQUIRE(static_cast<double>(bound - us) / static_cast<double>(us) <=
+              1.0 / LatencyHistogram::sub_count);
+    }
+  }
+  SECTION("percentiles") {
+    LatencyHistogram h;
+    for (int i = 1; i <= 100; ++i) {
+      h.record(std::chrono::microseconds{i * 100});
+    }
+    REQUIRE(h.count() == 100);
+    REQUIRE(h.sum() == std::chrono::microseconds{505000});
+    const auto p50 = h.percentile(0.5);
+    REQUIRE(p50 >= 5000us);
+    REQUIRE(p50 <= 5000us + 5000us / LatencyHistogram::sub_count);
+    const auto p99 = h.percentile(0.99);
+    REQUIRE(p99 >= 9900us);
+    REQUIRE(p99 <= 9900us + 9900us / LatencyHistogram::sub_count);
+    REQUIRE(h.count_at_most(1024) == 10);
+  }
+  SECTION("bounds are inclusive") {
+    LatencyHistogram h;
+    h.record(1024us);
+    h.record(1025us);
+    REQUIRE(h.count_at_most(1024) == 1);
+    REQUIRE(h.count_at_most(2048) == 2);
+  }
+}
+
+TEST_CASE("instrumented rtc", "[instrumented]") {
+  using Method = InstrumentedRTC::Method;
+  auto rtc = get_instrumented_mock();
+
+  SECTION("calls are counted") {
+    rtc->get_time();
+    rtc->get_time();
+    rtc->get_wakeup();
+    REQUIRE(stats_of(*rtc, Method::get_time).calls == 2);
+    REQUIRE(stats_of(*rtc, Method::get_time).latency.count() == 2);
+    REQUIRE(stats_of(*rtc, Method::get_wakeup).calls == 1);
+    REQUIRE(stats_of(*rtc, Method::set_wakeup).calls == 0);
+  }
+  SECTION("exceptions are counted as errors") {
+    struct FailingRTC : RTCDecorator {
+      using RTCDecorator::RTCDecorator;
+      rtc_time get_time() const override {
+        throw std::system_error(EIO, std::generic_category(), "RTC_RD_TIME");
+      }
+    };
+    InstrumentedRTC failing(std::make_unique<FailingRTC>(
+        MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                             "1723331760\n"
+                             "UTC\n")));
+    REQUIRE_THROWS_AS(failing.get_time(), std::system_error);
+    failing.get_wakeup();
+    REQUIRE(stats_of(failing, Method::get_time).calls == 1);
+    REQUIRE(stats_of(failing, Method::get_time).errors == 1);
+    REQUIRE(stats_of(failing, Method::get_time).latency.count() == 1);
+    REQUIRE(stats_of(failing, Method::get_wakeup).errors == 0);
+  }
+  SECTION("prometheus export") {
+    rtc->get_time();
+    rtc->notify_listener({});
+    const auto text = to_prometheus(rtc->stats(), rtc->name());
+    REQUIRE_THAT(text, Catch::Matchers::ContainsSubstring(
+                           "mrhat_rtcwake_rtc_calls_total{device=\"mock\","
+                           "method=\"get_time\"} 1\n"));
+    REQUIRE_THAT(text, Catch::Matchers::ContainsSubstring(
+                           "mrhat_rtcwake_rtc_errors_total{device=\"mock\","
+                           "method=\"notify_listener\"} 0\n"));
+    REQUIRE_THAT(text, Catch::Matchers::ContainsSubstring(
+                           "mrhat_rtcwake_rtc_latency_seconds_count{device="
+                           "\"mock\",method=\"get_time\"} 1\n"));
+    REQUIRE_THAT(text, Catch::Matchers::ContainsSubstring(
+                           "# TYPE mrhat_rtcwake_rtc_latency_seconds "
+                           "histogram\n"));
+    REQUIRE(text.find("method=\"set_wakeup\"") == std::string::npos);
+  }
+  SECTION("textfile export accumulates across invocations") {
+    const auto dir = fs::temp_directory_path() /
+                     fmt::format("mrhat-rtcwake-metrics-{}", getpid());
+    fs::create_directories(dir);
+    const auto textfile = dir / "mrhat_rtcwake.prom";
+    rtc->get_time();
+    export_metrics(textfile, rtc->stats(), rtc->name());
+    export_metrics(textfile, rtc->stats(), rtc->name());
+    std::ifstream ifs(textfile);
+    std::stringstream buff;
+    buff << ifs.rdbuf();
+    REQUIRE_THAT(buff.str(), Catch::Matchers::ContainsSubstring(
+                                 "mrhat_rtcwake_rtc_calls_total{device="
+                                 "\"mock\",method=\"get_time\"} 2\n"));
+    fs::remove_all(dir);
+  }
+}
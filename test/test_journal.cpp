@@ -0,0 +1,339 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtcwake.hpp>
+#include <wake_journal.hpp>
+
+#include "temp_dir.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+using Kind = WakeRecord::Kind;
+
+namespace {
+
+constexpr std::size_t header_size = 32;
+constexpr std::size_t slot_size = 40;
+
+// records as appended, with their sequence numbers
+std::vector<WakeRecord> fill(WakeJournal &journal, int n) {
+  std::vector<WakeRecord> res;
+  for (int i = 0; i < n; ++i) {
+    WakeRecord r{.kind = i % 2 == 0 ? Kind::ARMED : Kind::NOTIFIED,
+                 .at = 1723000000 + i * 60,
+                 .wakeup = 1723000000 + i * 60 + 600,
+                 .value = i % 2};
+    r.seq = journal.append(r);
+    res.push_back(r);
+  }
+  return res;
+}
+
+void flip_byte(fs::path const &path, std::size_t offset) {
+  std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+  f.seekg(static_cast<std::streamoff>(offset));
+  const auto c = static_cast<char>(f.get() ^ 0x5a);
+  f.seekp(static_cast<std::streamoff>(offset));
+  f.put(c);
+}
+
+} // namespace
+
+TEST_CASE("wake journal round trip", "[journal]") {
+  TempDir tmp{"journal"};
+  const auto path = tmp.path / "wake.journal";
+  REQUIRE(read_wake_journal(path).empty());
+
+  std::vector<WakeRecord> written;
+  {
+    auto journal = WakeJournal::open_writer(path, 16);
+    REQUIRE(journal.capacity() == 16);
+    written = fill(journal, 5);
+    journal.sync();
+  }
+  REQUIRE(fs::file_size(path) == header_size + 16 * slot_size);
+  REQUIRE(written.front().seq == 1);
+  REQUIRE(read_wake_journal(path) == written);
+
+  SECTION("reopening continues the sequence and keeps the capacity") {
+    auto journal = WakeJournal::open_writer(path, 64);
+    REQUIRE(journal.capacity() == 16);
+    REQUIRE(journal.append({.kind = Kind::BOOTED, .at = 1723009999}) == 6);
+    const auto records = read_wake_journal(path);
+    REQUIRE(records.size() == 6);
+    REQUIRE(records.back().kind == Kind::BOOTED);
+  }
+  SECTION("concurrent writers do not overwrite each other") {
+    auto a = WakeJournal::open_writer(path);
+    auto b = WakeJournal::open_writer(path);
+    REQUIRE(a.append({.kind = Kind::CLEARED}) == 6);
+    REQUIRE(b.append({.kind = Kind::CLEARED}) == 7);
+    REQUIRE(a.append({.kind = Kind::CLEARED}) == 8);
+    REQUIRE(read_wake_journal(path).size() == 8);
+  }
+}
+
+TEST_CASE("wake journal ring", "[journal]") {
+  TempDir tmp{"journal"};
+  const auto path = tmp.path / "wake.journal";
+  auto journal = WakeJournal::open_writer(path, 4);
+  const auto written = fill(journal, 10);
+  // only the latest capacity records survive, in order
+  REQUIRE(read_wake_journal(path) ==
+          std::vector<WakeRecord>(written.end() - 4, written.end()));
+  REQUIRE(WakeJournal::open_writer(path).append({}) == 11);
+}
+
+TEST_CASE("wake journal truncated at any offset", "[journal]") {
+  TempDir tmp{"journal"};
+  const auto path = tmp.path / "wake.journal";
+  const auto copy = tmp.path / "truncated.journal";
+  // a wrapped ring, so the slot order differs from the sequence order
+  const std::uint32_t capacity = GENERATE(8u, 5u);
+  std::vector<WakeRecord> written;
+  {
+    auto journal = WakeJournal::open_writer(path, capacity);
+    written = fill(journal, 7);
+  }
+  const auto size = fs::file_size(path);
+  for (std::size_t offset = 0; offset <= size; ++offset) {
+    CAPTURE(capacity, offset);
+    fs::copy_file(path, copy, fs::copy_options::overwrite_existing);
+    fs::resize_file(copy, offset);
+
+    // every record whose slot is complete, and only records written
+    std::vector<WakeRecord> complete;
+    std::vector<WakeRecord> survivors;
+    for (auto const &r : written) {
+      const auto slot_end = header_size + (r.seq % capacity + 1) * slot_size;
+      if (r.seq + capacity > written.back().seq) {
+        survivors.push_back(r);
+        if (offset >= header_size && slot_end <= offset) {
+          complete.push_back(r);
+        }
+      }
+    }
+    const auto records = read_wake_journal(copy);
+    REQUIRE(std::is_sorted(records.begin(), records.end(),
+                           [](auto const &a, auto const &b) {
+                             return a.seq < b.seq;
+                           }));
+    for (auto const &r : records) {
+      REQUIRE(std::find(survivors.begin(), survivors.end(), r) !=
+              survivors.end());
+    }
+    for (auto const &r : complete) {
+      REQUIRE(std::find(records.begin(), records.end(), r) != records.end());
+    }
+
+    // a writer recovers the journal and continues after the intact records
+    auto journal = WakeJournal::open_writer(copy, capacity);
+    REQUIRE(fs::file_size(copy) == size);
+    const auto next = records.empty() ? 1 : records.back().seq + 1;
+    REQUIRE(journal.append({.kind = Kind::CLEARED}) == next);
+    auto after = read_wake_journal(copy);
+    REQUIRE_FALSE(after.empty());
+    REQUIRE(after.back().seq == next);
+    after.pop_back();
+    // earlier records are only lost to the slot the append reused
+    for (auto const &r : after) {
+      REQUIRE(std::find(records.begin(), records.end(), r) != records.end());
+    }
+  }
+}
+
+TEST_CASE("wake journal torn slots", "[journal]") {
+  TempDir tmp{"journal"};
+  const auto path = tmp.path / "wake.journal";
+  std::vector<WakeRecord> written;
+  {
+    auto journal = WakeJournal::open_writer(path, 8);
+    written = fill(journal, 4);
+  }
+  SECTION("a torn record is skipped") {
+    // a byte of the wake time of the second record
+    flip_byte(path, header_size + 2 * slot_size + 17);
+    auto expected = written;
+    expected.erase(expected.begin() + 1);
+    REQUIRE(read_wake_journal(path) == expected);
+  }
+  SECTION("a torn last record is overwritten by the next append") {
+    flip_byte(path, header_size + 4 * slot_size + 3);
+    REQUIRE(WakeJournal::open_writer(path).append({}) == 4);
+  }
+  SECTION("not a journal") {
+    flip_byte(path, 0);
+    REQUIRE_THROWS_AS(read_wake_journal(path), std::runtime_error);
+    const auto size = fs::file_size(path);
+    REQUIRE_THROWS_AS(WakeJournal::open_writer(path), std::runtime_error);
+    REQUIRE(fs::file_size(path) == size);
+  }
+  SECTION("creation interrupted before the header") {
+    const std::vector<char> zeroes(header_size);
+    std::fstream(path, std::ios::in | std::ios::out | std::ios::binary)
+        .write(zeroes.data(), static_cast<std::streamsize>(zeroes.size()));
+    // the writer starts over
+    REQUIRE(WakeJournal::open_writer(path).append({}) == 1);
+    REQUIRE(read_wake_journal(path).size() == 1);
+  }
+}
+
+TEST_CASE("wake journal refuses foreign files", "[journal]") {
+  TempDir tmp{"journal"};
+  const auto path = tmp.path / "adjtime";
+  const std::string content = "0.000000 1723331760 0.000000\n"
+                              "1723331760\n"
+                              "UTC\n";
+  std::ofstream(path) << content;
+  REQUIRE_THROWS_AS(WakeJournal::open_writer(path), std::runtime_error);
+  std::ifstream ifs(path);
+  REQUIRE(std::string(std::istreambuf_iterator<char>(ifs),
+                      std::istreambuf_iterator<char>()) == content);
+
+  SECTION("a file shorter than the header is taken over") {
+    std::ofstream(path) << "short";
+    REQUIRE(WakeJournal::open_writer(path).append({}) == 1);
+  }
+}
+
+TEST_CASE("wake accuracy summary", "[journal]") {
+  auto armed = [](std::int64_t at, std::int64_t wakeup) {
+    return WakeRecord{.kind = Kind::ARMED, .at = at, .wakeup = wakeup};
+  };
+  auto notified = [](std::int64_t at, bool ack) {
+    return WakeRecord{.kind = Kind::NOTIFIED, .at = at, .value = ack ? 1 : 0};
+  };
+  auto booted = [](std::int64_t at) {
+    return WakeRecord{.kind = Kind::BOOTED, .at = at};
+  };
+
+  struct Case {
+    const char *name;
+    std::vector<WakeRecord> records;
+    std::size_t wakes;
+    std::size_t other_boots;
+    std::chrono::seconds mean, min, max;
+  };
+  const auto c = GENERATE_REF(values<Case>({
+      {"nothing", {}, 0, 0, 0s, 0s, 0s},
+      {"woke late",
+       {armed(0, 600), notified(1, true), booted(610)},
+       1, 0, 10s, 10s, 10s},
+      {"several wakes",
+       {armed(0, 600), notified(1, true), booted(590), armed(1000, 1600),
+        notified(1001, false), booted(1630)},
+       2, 0, 10s, -10s, 30s},
+      {"armed again before halting",
+       {armed(0, 600), armed(10, 900), notified(11, true), booted(900)},
+       1, 0, 0s, 0s, 0s},
+      {"cleared before halting",
+       {armed(0, 600), {.kind = Kind::CLEARED, .at = 5}, notified(6, true),
+        booted(700)},
+       0, 1, 0s, 0s, 0s},
+      {"armed without halting",
+       {armed(0, 600), booted(700)},
+       0, 1, 0s, 0s, 0s},
+      {"halt failed",
+       {armed(0, 600), notified(1, true),
+        {.kind = Kind::HALT_FAILED, .at = 2, .value = EPERM}, booted(700)},
+       0, 1, 0s, 0s, 0s},
+      {"a boot consumes the alarm",
+       {armed(0, 600), notified(1, true), booted(600), booted(900)},
+       1, 1, 0s, 0s, 0s},
+  }));
+  CAPTURE(c.name);
+  const auto s = summarize(c.records);
+  REQUIRE(s.records == c.records.size());
+  REQUIRE(s.wakes == c.wakes);
+  REQUIRE(s.other_boots == c.other_boots);
+  REQUIRE(s.mean_error == c.mean);
+  REQUIRE(s.min_error == c.min);
+  REQUIRE(s.max_error == c.max);
+}
+
+TEST_CASE("wake journal json", "[journal]") {
+  const std::vector<WakeRecord> records{
+      {.seq = 1, .kind = Kind::ARMED, .at = 1723331760, .wakeup = 1723332360},
+      {.seq = 2, .kind = Kind::NOTIFIED, .at = 1723331761, .value = 1},
+      {.seq = 3, .kind = Kind::BOOTED, .at = 1723332370}};
+  const auto s = summarize(records);
+  REQUIRE(s.notify_failures == 0);
+  REQUIRE(to_json(records, s) ==
+          "{\"records\":[{\"seq\":1,\"kind\":\"armed\",\"at\":1723331760,"
+          "\"at_iso\":\"2024-08-10T23:16:00Z\",\"wakeup\":1723332360,"
+          "\"wakeup_iso\":\"2024-08-10T23:26:00Z\",\"value\":0},"
+          "{\"seq\":2,\"kind\":\"notified\",\"at\":1723331761,"
+          "\"at_iso\":\"2024-08-10T23:16:01Z\",\"value\":1},"
+          "{\"seq\":3,\"kind\":\"booted\",\"at\":1723332370,"
+          "\"at_iso\":\"2024-08-10T23:26:10Z\",\"value\":0}],"
+          "\"summary\":{\"records\":3,\"armed\":1,\"wakes\":1,"
+          "\"other_boots\":0,\"notify_failures\":0,\"halt_failures\":0,"
+          "\"error_s\":{\"mean\":10,\"min\":10,\"max\":10}}}");
+}
+
+TEST_CASE("wake cycle is journaled", "[journal]") {
+  TempDir tmp{"journal"};
+  RTCWake::Options opts{};
+  opts.status_file.clear();
+  opts.journal_file = tmp.path / "wake.journal";
+  opts.halt = [](bool) { return EPERM; };
+  RTCWake wake(opts, MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n"));
+
+  const auto res = wake.schedule({RTCWake::WakeSpec::Kind::SECONDS, "600"});
+  REQUIRE(wake.halt().error == EPERM);
+  wake.disable();
+
+  const auto records = read_wake_journal(opts.journal_file);
+  REQUIRE(records.size() == 4);
+  REQUIRE(records[0].kind == Kind::ARMED);
+  REQUIRE(records[0].at == res.now.time_since_epoch().count());
+  REQUIRE(records[0].wakeup == res.wakeup.time_since_epoch().count());
+  REQUIRE(records[1].kind == Kind::NOTIFIED);
+  REQUIRE(records[1].value == 1);
+  REQUIRE(records[2].kind == Kind::HALT_FAILED);
+  REQUIRE(records[2].value == EPERM);
+  REQUIRE(records[3].kind == Kind::CLEARED);
+
+  SECTION("a journal that cannot be written does not fail the operation") {
+    std::ofstream(tmp.path / "file");
+    opts.journal_file = tmp.path / "file" / "wake.journal";
+    RTCWake broken(opts, MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n"));
+    REQUIRE_NOTHROW(
+        broken.schedule({RTCWake::WakeSpec::Kind::SECONDS, "600"}));
+  }
+}
+
+TEST_CASE("listener state from the journal", "[journal]") {
+  auto notified = [](bool ack) {
+    return WakeRecord{.kind = Kind::NOTIFIED, .value = ack ? 1 : 0};
+  };
+  auto reconciled = [](std::int32_t value) {
+    return WakeRecord{.kind = Kind::RECONCILED, .value = value};
+  };
+  using R = std::vector<WakeRecord>;
+
+  REQUIRE_FALSE(listener_notified(R{}));
+  REQUIRE(listener_notified(R{notified(true)}));
+  REQUIRE_FALSE(listener_notified(R{notified(false)}));
+  // booting does not clear the bit, reconciling does
+  REQUIRE(
+      listener_notified(R{notified(true), {.kind = Kind::BOOTED, .at = 1}}));
+  REQUIRE_FALSE(listener_notified(
+      R{notified(true), reconciled(WakeRecord::reconciled_alarm)}));
+  REQUIRE(listener_notified(
+      R{notified(true), reconciled(WakeRecord::reconciled_notified)}));
+  REQUIRE_FALSE(listener_notified(
+      R{notified(true), {.kind = Kind::HALT_FAILED, .value = EPERM}}));
+}
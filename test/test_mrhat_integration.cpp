@@ -1,65 +1,74 @@
 #include <catch2/catch_all.hpp>
 
-#include <httplib.h>
+#include <mrhat_integration.hpp>
+
+#include "mock_server.hpp"
+#include "standin_daemon.hpp"
+#include "temp_dir.hpp"
 
-#include <atomic>
+#include <algorithm>
 #include <chrono>
-#include <future>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
 
-#include <mrhat_integration.hpp>
+TEST_CASE("register write parsing", "[mrhat-integration]") {
+  REQUIRE(parse_register_write("8/0/1") == RegisterWrite{8, 0, true});
+  REQUIRE(parse_register_write("12/7/0") == RegisterWrite{12, 7, false});
+  REQUIRE(to_string(RegisterWrite{9, 2, true}) == "9/2/1");
+  for (const auto *spec : {"", "8", "8/0", "8/0/1/1", "8/0/2", "8/8/1",
+                           "a/0/1", "8//1", "8/0/1 ", "-1/0/1"}) {
+    INFO(spec);
+    REQUIRE_THROWS_AS(parse_register_write(spec), std::runtime_error);
+  }
+}
 
-namespace chr = std::chrono;
-struct MockServer {
-  std::unique_ptr<httplib::Server> svr;
-  std::future<void> ft;
-  int port{};
-  std::atomic<int> reg_val{-1};
-  std::atomic<bool> error{};
-
-  void wait() {
-    svr->stop();
-    ft.wait();
-  }
-
-  ~MockServer() { wait(); }
-};
-
-std::unique_ptr<MockServer> get_mock_server(bool return_error = false) {
-  auto svr = std::make_unique<httplib::Server>();
-  if (!svr->is_valid()) {
-    throw std::runtime_error("Failed to set up mock server");
-  }
-  auto mock = std::make_unique<MockServer>(std::move(svr));
-  mock->svr->Post("/api/register/8/0/1",
-                  [mck_ = mock.get(), return_error](const httplib::Request &req,
-                                                    httplib::Response &res) {
-                    if (return_error) {
-                      res.status = 403;
-                    } else {
-                      mck_->reg_val = 1;
-                    }
-                  });
-  mock->svr->Post("/api/register/8/0/0",
-                  [mck_ = mock.get(), return_error](const httplib::Request &req,
-                                                    httplib::Response &res) {
-                    if (return_error) {
-                      res.status = 403;
-                    } else {
-                      mck_->reg_val = 0;
-                    }
-                  });
-  mock->svr->set_error_handler(
-      [mck_ = mock.get()](const httplib::Request &req, httplib::Response &res) {
-        mck_->error = true;
-      });
-
-  mock->port = mock->svr->bind_to_any_port("localhost");
-  mock->ft = std::async(std::launch::async, [svr_ = mock->svr.get()]() {
-    int a = 0;
-    svr_->listen_after_bind();
-  });
-
-  return std::move(mock);
+TEST_CASE("register cache file", "[mrhat-integration]") {
+  const TempDir tmp{"registers"};
+  const auto &dir = tmp.path;
+
+  SECTION("keyed by the boot and the listening socket") {
+    std::ofstream(dir / "boot_id") << "6f1c2a0e\n";
+    std::ofstream(dir / "tcp")
+        << "  sl  local_address rem_address   st tx_queue rx_queue tr "
+           "tm->when retrnsmt   uid  timeout inode\n"
+           "   0: 0100007F:2328 0100007F:A000 01 00000000:00000000 "
+           "00:00000000 00000000     0        0 999 1\n"
+           "   1: 0100007F:2328 00000000:0000 0A 00000000:00000000 "
+           "00:00000000 00000000     0        0 4242 1\n";
+    std::ofstream(dir / "tcp6")
+        << "  sl  local_address                         remote_address      "
+           "                  st tx_queue rx_queue tr tm->when retrnsmt   "
+           "uid  timeout inode\n"
+           "   0: 00000000000000000000000001000000:1F90 "
+           "00000000000000000000000000000000:0000 0A 00000000:00000000 "
+           "00:00000000 00000000     0        0 77 1\n";
+    REQUIRE(register_cache_key(9000, dir / "boot_id", dir) ==
+            RegisterCacheKey{"6f1c2a0e", 4242});
+    REQUIRE(register_cache_key(8080, dir / "boot_id", dir) ==
+            RegisterCacheKey{"6f1c2a0e", 77});
+    REQUIRE(register_cache_key(9001, dir / "missing", dir) ==
+            RegisterCacheKey{});
+  }
+  SECTION("round trip") {
+    const RegisterCache cache{{"6f1c2a0e", 4242}, {3, 1, 2}, {{8, 0, true}}};
+    write_register_cache(dir / "registers", cache);
+    const auto read = read_register_cache(dir / "registers");
+    REQUIRE(read.key == cache.key);
+    REQUIRE(read.stats == cache.stats);
+    REQUIRE(read.bits == cache.bits);
+    // without a boot id
+    write_register_cache(dir / "registers", {{"", 1}, {}, {}});
+    REQUIRE(read_register_cache(dir / "registers").key ==
+            RegisterCacheKey{"", 1});
+  }
+  SECTION("missing or malformed") {
+    REQUIRE(read_register_cache(dir / "missing").key == RegisterCacheKey{});
+    std::ofstream(dir / "registers") << "6f1c2a0e 4242\n3 1 2\n8/0/2\n";
+    const auto read = read_register_cache(dir / "registers");
+    REQUIRE(read.key == RegisterCacheKey{});
+    REQUIRE(read.bits.empty());
+  }
 }
 
 #if not defined(__SANITIZE_THREAD__)
@@ -103,4 +112,229 @@ TEST_CASE("when error is at server side", "[mrhat-integration]") {
   REQUIRE(mock->error == true);
 }
 
-#endif
\ No newline at end of file
+TEST_CASE("stand-in daemon latency and errors", "[mrhat-integration]") {
+  using namespace std::chrono_literals;
+  SECTION("answers after its latency") {
+    StandInDaemon daemon({.latency = 20ms});
+    MrHatIntegration mrhat(daemon.port());
+    const auto start = std::chrono::steady_clock::now();
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(std::chrono::steady_clock::now() - start >= 20ms);
+    REQUIRE(daemon.value() == 1);
+    REQUIRE(mrhat.clear_reset_on_halt());
+    REQUIRE(daemon.value() == 0);
+    REQUIRE(daemon.requests() == 2);
+  }
+  SECTION("fails the configured share of requests") {
+    StandInDaemon always({.error_rate = 1});
+    REQUIRE_FALSE(MrHatIntegration(always.port()).signal_reset_on_halt());
+    REQUIRE(always.errors() == 1);
+    REQUIRE(always.value() == -1);
+
+    StandInDaemon some({.error_rate = 0.5}, 7);
+    MrHatIntegration mrhat(some.port());
+    for (int i = 0; i < 40; ++i) {
+      mrhat.signal_reset_on_halt();
+    }
+    REQUIRE(some.errors() > 5);
+    REQUIRE(some.errors() < 35);
+  }
+}
+
+TEST_CASE("batched register writes", "[mrhat-integration]") {
+  using Status = RegisterWriteResult::Status;
+  const std::vector<RegisterWrite> writes{{8, 0, true}, {9, 2, true},
+                                          {10, 7, false}};
+
+  SECTION("in a single request") {
+    auto mock = get_register_mock_server(true);
+    MrHatIntegration mrhat(mock->port);
+    const auto res = mrhat.write_registers(writes);
+    REQUIRE(res.ok());
+    REQUIRE(res.batched);
+    REQUIRE(res.writes.size() == 3);
+    REQUIRE(mock->batch_requests == 1);
+    REQUIRE(mock->single_requests == 0);
+    REQUIRE(mock->bit(8, 0) == 1);
+    REQUIRE(mock->bit(9, 2) == 1);
+    REQUIRE(mock->bit(10, 7) == 0);
+  }
+  SECTION("rejected as a whole") {
+    auto mock = get_register_mock_server(true, 9);
+    MrHatIntegration mrhat(mock->port);
+    const auto res = mrhat.write_registers(writes);
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(res.batched);
+    REQUIRE(res.writes ==
+            std::vector<RegisterWriteResult>{{writes[0], Status::SKIPPED},
+                                             {writes[1], Status::FAILED},
+                                             {writes[2], Status::SKIPPED}});
+    REQUIRE(mock->bit(8, 0) == -1);
+    REQUIRE(mock->bit(10, 7) == -1);
+  }
+  SECTION("one register at a time over one connection") {
+    auto mock = get_register_mock_server(false);
+    MrHatIntegration mrhat(mock->port);
+    const auto res = mrhat.write_registers(writes);
+    REQUIRE(res.ok());
+    REQUIRE_FALSE(res.batched);
+    REQUIRE(mock->single_requests == 3);
+    REQUIRE(mock->connections.size() == 1);
+    REQUIRE(mock->bit(9, 2) == 1);
+  }
+  SECTION("one register at a time rolls back") {
+    auto mock = get_register_mock_server(false, 10);
+    MrHatIntegration mrhat(mock->port);
+    const auto res = mrhat.write_registers(writes);
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(res.writes ==
+            std::vector<RegisterWriteResult>{{writes[0], Status::ROLLED_BACK},
+                                             {writes[1], Status::ROLLED_BACK},
+                                             {writes[2], Status::FAILED}});
+    REQUIRE(mock->bit(8, 0) == 0);
+    REQUIRE(mock->bit(9, 2) == 0);
+  }
+  SECTION("rolls back to the values read before") {
+    auto mock = get_register_mock_server(false, 10);
+    mock->bits[{9, 2}] = 1;
+    MrHatIntegration mrhat(mock->port);
+    const auto res = mrhat.write_registers(writes);
+    REQUIRE(res.writes ==
+            std::vector<RegisterWriteResult>{{writes[0], Status::ROLLED_BACK},
+                                             {writes[1], Status::ROLLED_BACK},
+                                             {writes[2], Status::FAILED}});
+    // unknown to the daemon, so inverted
+    REQUIRE(mock->bit(8, 0) == 0);
+    // held the value already, nothing to revert
+    REQUIRE(mock->bit(9, 2) == 1);
+    REQUIRE(mock->single_requests == 4);
+  }
+  SECTION("daemon not running") {
+    const auto res = MrHatIntegration(666).write_registers(writes);
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(std::all_of(res.writes.begin(), res.writes.end(), [](auto &w) {
+      return w.status == Status::FAILED;
+    }));
+  }
+  SECTION("along with the reset on halt bit") {
+    auto mock = get_register_mock_server(true);
+    MrHatIntegration mrhat(mock->port, 8, 0, {{9, 2, true}, {10, 7, false}});
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(mock->batch_requests == 1);
+    REQUIRE(mock->bit(8, 0) == 1);
+    REQUIRE(mock->bit(9, 2) == 1);
+    REQUIRE(mock->bit(10, 7) == 0);
+    // clearing reverts the registers as well
+    REQUIRE(mrhat.clear_reset_on_halt());
+    REQUIRE(mock->batch_requests == 2);
+    REQUIRE(mock->bit(8, 0) == 0);
+    REQUIRE(mock->bit(9, 2) == 0);
+    REQUIRE(mock->bit(10, 7) == 1);
+  }
+  SECTION("clearing restores the values read before signalling") {
+    auto mock = get_register_mock_server(true);
+    mock->bits[{9, 2}] = 1;
+    mock->bits[{10, 7}] = 1;
+    MrHatIntegration mrhat(mock->port, 8, 0, {{9, 2, false}, {10, 7, false}});
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(mock->bit(9, 2) == 0);
+    REQUIRE(mock->bit(10, 7) == 0);
+    REQUIRE(mrhat.clear_reset_on_halt());
+    REQUIRE(mock->bit(8, 0) == 0);
+    REQUIRE(mock->bit(9, 2) == 1);
+    REQUIRE(mock->bit(10, 7) == 1);
+  }
+}
+
+TEST_CASE("cached register writes", "[mrhat-integration]") {
+  const TempDir tmp{"registers"};
+  const auto path = tmp.path / "registers";
+  auto mock = get_register_mock_server(false);
+  MrHatIntegration mrhat(mock->port);
+  mrhat.set_register_cache(path);
+
+  SECTION("skips writes the daemon already holds") {
+    // unknown at first, the daemon does not know the bit either
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(mock->read_requests == 1);
+    REQUIRE(mock->single_requests == 1);
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(mock->single_requests == 1);
+    // a known state that differs is written without asking
+    REQUIRE(mrhat.clear_reset_on_halt());
+    REQUIRE(mock->read_requests == 1);
+    REQUIRE(mock->single_requests == 2);
+    REQUIRE(mock->bit(8, 0) == 0);
+    REQUIRE(mrhat.cache_stats() == RegisterCacheStats{1, 0, 2});
+    // accumulated by the invocations of a boot
+    MrHatIntegration next(mock->port);
+    next.set_register_cache(path);
+    REQUIRE(next.clear_reset_on_halt());
+    REQUIRE(mock->single_requests == 2);
+    REQUIRE(read_register_cache(path).stats == RegisterCacheStats{2, 0, 2});
+  }
+  SECTION("asks the daemon after a reboot") {
+    REQUIRE(mrhat.signal_reset_on_halt());
+    auto cache = read_register_cache(path);
+    cache.key.boot_id = "previous";
+    write_register_cache(path, cache);
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(mock->read_requests == 2);
+    REQUIRE(mock->single_requests == 1);
+    // the counters start over with the boot
+    REQUIRE(read_register_cache(path).stats == RegisterCacheStats{0, 1, 0});
+  }
+  SECTION("writes again after a daemon restart") {
+    REQUIRE(mrhat.signal_reset_on_halt());
+    const auto port = mock->port;
+    mock.reset();
+    mock = get_register_mock_server(false, {}, port);
+    REQUIRE(mrhat.signal_reset_on_halt());
+    REQUIRE(mock->single_requests == 1);
+    REQUIRE(mock->bit(8, 0) == 1);
+  }
+  SECTION("forgets the bits of a failed write") {
+    auto failing = get_register_mock_server(true, 9);
+    MrHatIntegration batch(failing->port, 8, 0, {{9, 2, true}});
+    batch.set_register_cache(path);
+    REQUIRE_FALSE(batch.signal_reset_on_halt());
+    REQUIRE(read_register_cache(path).bits.empty());
+    REQUIRE_FALSE(batch.signal_reset_on_halt());
+    REQUIRE(failing->batch_requests == 2);
+  }
+  SECTION("daemon not running") {
+    MrHatIntegration none(666);
+    none.set_register_cache(path);
+    REQUIRE_FALSE(none.signal_reset_on_halt());
+    REQUIRE(none.cache_stats() == RegisterCacheStats{0, 0, 1});
+  }
+  SECTION("clearing restores the values the cache held") {
+    auto batch = get_register_mock_server(true);
+    const std::vector<RegisterWrite> regs{{9, 2, true}};
+    MrHatIntegration first(batch->port, 8, 0, regs);
+    first.set_register_cache(path);
+    REQUIRE(first.signal_reset_on_halt());
+    // the daemon holds the bits already, so nothing is written or read
+    MrHatIntegration again(batch->port, 8, 0, regs);
+    again.set_register_cache(path);
+    REQUIRE(again.signal_reset_on_halt());
+    REQUIRE(again.cache_stats() == RegisterCacheStats{1, 0, 0});
+    REQUIRE(again.clear_reset_on_halt());
+    REQUIRE(batch->bit(8, 0) == 0);
+    REQUIRE(batch->bit(9, 2) == 1);
+  }
+  SECTION("clearing restores the values the daemon reported") {
+    auto batch = get_register_mock_server(true);
+    batch->bits[{8, 0}] = 1;
+    batch->bits[{9, 2}] = 1;
+    MrHatIntegration queried(batch->port, 8, 0, {{9, 2, true}});
+    queried.set_register_cache(path);
+    REQUIRE(queried.signal_reset_on_halt());
+    REQUIRE(queried.cache_stats() == RegisterCacheStats{0, 1, 0});
+    REQUIRE(queried.clear_reset_on_halt());
+    REQUIRE(batch->bit(8, 0) == 0);
+    REQUIRE(batch->bit(9, 2) == 1);
+  }
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_decorator.hpp>
+#include <rtc_multi.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr std::string_view adj = "0.000000 1723331760 0.000000\n"
+                                 "1723331760\n"
+                                 "UTC\n";
+
+// 2024-08-18 21:00:00 UTC
+std::unique_ptr<MockRTC> get_mock(std::string const &device) {
+  auto rtc = MockRTC::get(device, adj);
+  rtc_time now{};
+  now.tm_year = 124;
+  now.tm_mon = 7;
+  now.tm_mday = 18;
+  now.tm_hour = 21;
+  rtc->set_time(now);
+  return rtc;
+}
+
+// stands in for an RTC behind a slow bus
+struct SlowRTC : RTCDecorator {
+  using RTCDecorator::RTCDecorator;
+  rtc_wkalrm get_wakeup() const override {
+    std::this_thread::sleep_for(100ms);
+    return RTCDecorator::get_wakeup();
+  }
+};
+
+RTCWake::Options options() {
+  RTCWake::Options opts{};
+  opts.halt = [](bool) { return 0; };
+  return opts;
+}
+
+} // namespace
+
+TEST_CASE("rtc device discovery", "[multi]") {
+  const auto dir = fs::temp_directory_path() / "mrhat-rtcwake-test-dev";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  for (auto name : {"rtc10", "rtc2", "rtc0", "rtc", "rtcx", "rtc1a", "tty0"}) {
+    std::ofstream(dir / name).put('\0');
+  }
+  REQUIRE(list_rtc_devices(dir) ==
+          std::vector<std::string>{"rtc0", "rtc2", "rtc10"});
+  REQUIRE(parse_device_list("all", dir) == list_rtc_devices(dir));
+  REQUIRE(parse_device_list("rtc1,,rtc3", dir) ==
+          std::vector<std::string>{"rtc1", "rtc3"});
+  REQUIRE(parse_device_list("rtc0") == std::vector<std::string>{"rtc0"});
+  REQUIRE_THROWS(parse_device_list(","));
+  REQUIRE_THROWS(parse_device_list("all", dir / "missing"));
+  fs::remove_all(dir);
+}
+
+TEST_CASE("devices are handled concurrently", "[multi]") {
+  MultiDevice multi({"rtc0", "rtc1", "rtc2", "rtc3"}, options(),
+                    [](std::string const &device) {
+                      return std::make_unique<SlowRTC>(get_mock(device));
+                    });
+  const auto report = multi.query();
+  REQUIRE(report.ok());
+  REQUIRE(report.devices.size() == 4);
+  for (auto const &d : report.devices) {
+    REQUIRE(d.latency >= 100ms);
+    REQUIRE_FALSE(d.alarm.enabled);
+  }
+  REQUIRE(report.devices[3].device == "rtc3");
+  // bound by the slowest device rather than the sum of them
+  REQUIRE(report.latency < 350ms);
+}
+
+TEST_CASE("arming several devices", "[multi]") {
+  MultiDevice multi({"rtc0", "rtc1"}, options(),
+                    [](std::string const &device) { return get_mock(device); });
+  const auto report = multi.arm({RTCWake::WakeSpec::Kind::SECONDS, "3600"});
+  REQUIRE(report.ok());
+  for (auto const &d : report.devices) {
+    REQUIRE(d.alarm.enabled);
+    REQUIRE(d.alarm.wakeup - d.time == 1h);
+    REQUIRE(d.time.time_since_epoch() == 1724014800s);
+  }
+}
+
+TEST_CASE("failing devices are reported", "[multi]") {
+  MultiDevice multi({"rtc0", "rtc1"}, options(),
+                    [](std::string const &device) -> std::unique_ptr<IRTC> {
+                      if (device == "rtc1") {
+                        throw std::runtime_error("no such \"device\"");
+                      }
+                      return get_mock(device);
+                    });
+  const auto report = multi.query();
+  REQUIRE_FALSE(report.ok());
+  REQUIRE(report.devices[0].error.empty());
+  REQUIRE(report.devices[1].error == "no such \"device\"");
+
+  const auto json = to_json(report);
+  REQUIRE(json.starts_with("{\"latency_us\":"));
+  REQUIRE(json.find("{\"device\":\"rtc0\",\"ok\":true,\"time\":1724014800,") !=
+          std::string::npos);
+  REQUIRE(json.find("{\"device\":\"rtc1\",\"ok\":false,"
+                    "\"error\":\"no such \\\"device\\\"\",") !=
+          std::string::npos);
+}
@@ -0,0 +1,230 @@
+#include <catch2/catch_all.hpp>
+
+#include <page_cache.hpp>
+#include <rtc_decorator.hpp>
+#include <rtcwake.hpp>
+
+#include "temp_dir.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+// calls back when the listener is signalled
+class SnapshotCheck : public RTCDecorator {
+public:
+  SnapshotCheck(std::unique_ptr<IRTC> inner, std::function<void()> on_notify)
+      : RTCDecorator{std::move(inner)}, m_on_notify{std::move(on_notify)} {}
+  bool notify_listener(IntegrationInfo const &info) const noexcept override {
+    m_on_notify();
+    return RTCDecorator::notify_listener(info);
+  }
+
+private:
+  std::function<void()> m_on_notify;
+};
+
+// a file of the given number of pages, read back so it is resident
+fs::path hot_file(fs::path const &path, std::size_t pages) {
+  {
+    std::ofstream ofs(path, std::ios::binary);
+    const std::string chunk(page, 'x');
+    for (std::size_t i = 0; i < pages; ++i) {
+      ofs << chunk;
+    }
+  }
+  std::ifstream ifs(path, std::ios::binary);
+  std::string content{std::istreambuf_iterator<char>(ifs),
+                      std::istreambuf_iterator<char>()};
+  REQUIRE(content.size() == pages * page);
+  return path;
+}
+
+} // namespace
+
+TEST_CASE("resident runs", "[page_cache]") {
+  SECTION("empty") { REQUIRE(resident_runs({}, 0).empty()); }
+  SECTION("coalesces consecutive pages") {
+    const std::vector<unsigned char> vec{1, 1, 0, 0, 1, 0, 1, 1, 1};
+    REQUIRE(resident_runs(vec, 3) ==
+            std::vector<CachedRange>{{3, 0, 2}, {3, 4, 1}, {3, 6, 3}});
+  }
+  SECTION("only the lowest bit counts") {
+    const std::vector<unsigned char> vec{2, 3, 0xfe};
+    REQUIRE(resident_runs(vec, 0) == std::vector<CachedRange>{{0, 1, 1}});
+  }
+}
+
+TEST_CASE("page cache paths", "[page_cache]") {
+  TempDir tmp{"page-cache"};
+  const auto a = hot_file(tmp.path / "a", 1);
+  fs::create_directories(tmp.path / "dir" / "sub");
+  const auto b = hot_file(tmp.path / "dir" / "b", 1);
+  const auto c = hot_file(tmp.path / "dir" / "sub" / "c", 1);
+
+  SECTION("files and directories, without duplicates") {
+    const std::vector<std::string> specs{
+        a.string(), (tmp.path / "dir").string(), b.string()};
+    auto files = expand_cache_paths(specs);
+    REQUIRE(files.size() == 3);
+    REQUIRE(files.front() == a);
+    std::sort(files.begin() + 1, files.end());
+    REQUIRE(files[1] == b);
+    REQUIRE(files[2] == c);
+  }
+  SECTION("files mapped by a process") {
+    const auto proc = tmp.path / "proc";
+    fs::create_directories(proc / "42");
+    std::ofstream(proc / "42" / "maps")
+        << "55d0c0000000-55d0c0001000 r--p 00000000 08:01 1234 /usr/bin/svc\n"
+           "55d0c0001000-55d0c0002000 r-xp 00001000 08:01 1234 /usr/bin/svc\n"
+           "7f0000000000-7f0000001000 r--p 00000000 08:01 99 "
+           "/usr/lib/lib x.so\n"
+           "7f0000002000-7f0000003000 rw-p 00000000 00:00 0 \n"
+           "7f0000003000-7f0000004000 r--p 00000000 08:01 98 /tmp/x "
+           "(deleted)\n"
+           "7ffd00000000-7ffd00001000 rw-p 00000000 00:00 0 [stack]\n";
+    REQUIRE(mapped_files(42, proc) ==
+            std::vector<fs::path>{"/usr/bin/svc", "/usr/lib/lib x.so"});
+    const std::vector<std::string> specs{"pid:42"};
+    REQUIRE(expand_cache_paths(specs, proc).size() == 2);
+    REQUIRE_THROWS_AS(mapped_files(43, proc), std::runtime_error);
+  }
+  SECTION("processes that are gone and malformed specs are skipped") {
+    const std::vector<std::string> specs{"pid:43", "pid:svc", a.string()};
+    REQUIRE(expand_cache_paths(specs, tmp.path / "proc") ==
+            std::vector<fs::path>{a});
+    REQUIRE_THROWS_AS(check_cache_specs(specs), std::runtime_error);
+    const std::vector<std::string> valid{"pid:43", a.string()};
+    REQUIRE_NOTHROW(check_cache_specs(valid));
+  }
+  SECTION("at most max_files") {
+    const std::vector<std::string> specs{(tmp.path / "dir").string(),
+                                         a.string()};
+    REQUIRE(expand_cache_paths(specs, "/proc", 1).size() == 1);
+  }
+  SECTION("the own process") {
+    const auto files = mapped_files(getpid());
+    REQUIRE_FALSE(files.empty());
+  }
+}
+
+TEST_CASE("page cache snapshot", "[page_cache]") {
+  TempDir tmp{"page-cache"};
+  const std::vector<fs::path> files{hot_file(tmp.path / "a", 8),
+                                    tmp.path / "missing",
+                                    hot_file(tmp.path / "b", 3)};
+  std::ofstream(tmp.path / "empty");
+
+  const auto index = snapshot_page_cache(files);
+  REQUIRE(index.page_size == page);
+  REQUIRE(index.files ==
+          std::vector<std::string>{files[0].string(), files[2].string()});
+  // just read, so every page is resident
+  REQUIRE(index.ranges ==
+          std::vector<CachedRange>{{0, 0, 8}, {1, 0, 3}});
+
+  SECTION("nothing once the budget is spent") {
+    const auto none = snapshot_page_cache(files, std::chrono::milliseconds{0});
+    REQUIRE(none.files.empty());
+  }
+  SECTION("the index directory is created") {
+    const auto path = tmp.path / "var" / "page-cache.idx";
+    write_page_cache_index(path, index);
+    REQUIRE(read_page_cache_index(path) == index);
+  }
+  SECTION("a failed write leaves no temporary file") {
+    const auto path = tmp.path / "index-dir";
+    fs::create_directories(path);
+    REQUIRE_THROWS(write_page_cache_index(path, index));
+    REQUIRE(std::distance(fs::directory_iterator(tmp.path),
+                          fs::directory_iterator()) == 4);
+  }
+  SECTION("index round trip") {
+    const auto path = tmp.path / "page-cache.idx";
+    write_page_cache_index(path, index);
+    REQUIRE(read_page_cache_index(path) == index);
+    REQUIRE(fs::file_size(path) ==
+            5 * 4 + 2 * 4 + files[0].string().size() +
+                files[2].string().size() + 2 * 3 * 4);
+  }
+  SECTION("malformed index") {
+    const auto path = tmp.path / "page-cache.idx";
+    write_page_cache_index(path, index);
+    SECTION("truncated") {
+      fs::resize_file(path, fs::file_size(path) - 1);
+      REQUIRE_THROWS_AS(read_page_cache_index(path), std::runtime_error);
+    }
+    SECTION("not an index") {
+      std::ofstream(path) << "not an index at all";
+      REQUIRE_THROWS_AS(read_page_cache_index(path), std::runtime_error);
+    }
+    SECTION("missing") {
+      REQUIRE_THROWS_AS(read_page_cache_index(tmp.path / "nope"),
+                        std::runtime_error);
+    }
+  }
+  SECTION("replay") {
+    const auto stats = replay_page_cache(index, 2);
+    REQUIRE(stats.files == 2);
+    REQUIRE(stats.missing == 0);
+    REQUIRE(stats.ranges == 2);
+    REQUIRE(stats.bytes == 11 * page);
+  }
+  SECTION("replay after the files changed") {
+    fs::remove(files[0]);
+    fs::resize_file(files[2], page + 10);
+    const auto stats = replay_page_cache(index, 4);
+    REQUIRE(stats.files == 2);
+    REQUIRE(stats.missing == 1);
+    REQUIRE(stats.bytes == page + 10);
+  }
+  SECTION("replay of nothing") {
+    REQUIRE(replay_page_cache(PageCacheIndex{}).files == 0);
+  }
+}
+
+TEST_CASE("page cache snapshot before halting", "[page_cache]") {
+  TempDir tmp{"page-cache"};
+  const auto hot = hot_file(tmp.path / "service.bin", 2);
+  RTCWake::Options opts{};
+  opts.status_file.clear();
+  opts.page_cache_paths = {hot.string()};
+  const auto index_path = tmp.path / "page-cache.idx";
+  opts.page_cache_index = index_path;
+  bool halted = false;
+  opts.halt = [&](bool) {
+    // the snapshot is complete before poweroff is exec'd
+    REQUIRE(fs::exists(index_path));
+    halted = true;
+    return EPERM;
+  };
+  // and before the listener is signalled
+  bool saved_before_notify = false;
+  RTCWake wake(std::move(opts),
+               std::make_unique<SnapshotCheck>(
+                   MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n"), [&] {
+                     saved_before_notify = fs::exists(index_path);
+                   }));
+  REQUIRE(wake.halt().error == EPERM);
+  REQUIRE(saved_before_notify);
+  REQUIRE(halted);
+  const auto index = read_page_cache_index(index_path);
+  REQUIRE(index.files == std::vector<std::string>{hot.string()});
+  REQUIRE(index.ranges == std::vector<CachedRange>{{0, 0, 2}});
+}
@@ -0,0 +1,186 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_instrumented.hpp>
+#include <rtc_plan.hpp>
+#include <rtc_utils.hpp>
+
+#include "temp_dir.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+
+RTCWake::Options plan_options(fs::path const &dir) {
+  RTCWake::Options opts{};
+  opts.adjfile = dir / "adjtime";
+  std::ofstream(opts.adjfile) << "0.000000 1723331760 0.000000\n"
+                                 "1723331760\n"
+                                 "UTC\n";
+  opts.status_file = dir / "status";
+  opts.halt = [](bool) -> int {
+    FAIL("the dry run must not halt");
+    return 0;
+  };
+  return opts;
+}
+
+RTCWake::sys_seconds at(int h, int m, int s) {
+  using namespace std::chrono;
+  return sys_days{year{2024} / August / 18} + hours{h} + minutes{m} +
+         seconds{s};
+}
+
+// the device the dry run reads the time from
+RTCWake::Backend device_at(RTCWake::sys_seconds now) {
+  return [now](std::string const &name) -> std::unique_ptr<IRTC> {
+    auto rtc = MockRTC::get(name, "0.0 0 0.0\n0\nUTC\n");
+    rtc->set_time(sys_to_rtc(now, *rtc));
+    return rtc;
+  };
+}
+
+} // namespace
+
+TEST_CASE("rx8130 wakeup granularity", "[plan]") {
+  const auto now = at(21, 0, 10);
+  SECTION("whole minutes are kept") {
+    REQUIRE(rx8130_effective_wakeup(now, at(21, 5, 10)) == at(21, 5, 10));
+  }
+  SECTION("the remaining time is truncated") {
+    REQUIRE(rx8130_effective_wakeup(now, at(21, 5, 59)) == at(21, 5, 10));
+    REQUIRE(rx8130_effective_wakeup(now, at(21, 3, 40)) == at(21, 3, 10));
+  }
+  SECTION("at least one minute") {
+    REQUIRE(rx8130_effective_wakeup(now, at(21, 0, 40)) == at(21, 1, 10));
+  }
+}
+
+TEST_CASE("dry run plans the invocation", "[plan]") {
+  TempDir tmp{"plan"};
+  auto opts = plan_options(tmp.path);
+  DryRun dry_run(opts, device_at(at(21, 22, 32)));
+  RTCWake wake(dry_run.options(), dry_run.backend());
+
+  SECTION("standby") {
+    const auto res = wake.schedule({RTCWake::WakeSpec::Kind::SECONDS, "150"});
+    dry_run.scheduled(res);
+    const auto halted = wake.halt();
+    REQUIRE(halted.error == 0);
+    const auto plan = dry_run.plan("standby");
+    REQUIRE(plan.schedule.has_value());
+    REQUIRE(plan.schedule->wakeup - plan.schedule->now == 150s);
+    REQUIRE(plan.effective_wakeup - plan.schedule->now == 120s);
+    REQUIRE(plan.reset_on_halt);
+    REQUIRE(plan.integration.port == 9000);
+    REQUIRE(plan.halt ==
+            std::vector<std::string>{"/usr/sbin/poweroff", "--halt"});
+    std::vector<std::string_view> methods;
+    for (auto const &p : plan.phases) {
+      methods.push_back(p.method);
+      REQUIRE(p.samples == 0);
+    }
+    REQUIRE(methods == std::vector<std::string_view>{"get_time", "set_wakeup",
+                                                     "notify_listener"});
+    REQUIRE(plan.predicted_mean == 0us);
+    // the mock runs at the time of the device
+    REQUIRE(plan.schedule->now == at(21, 22, 32));
+  }
+  SECTION("no") {
+    dry_run.scheduled(
+        wake.schedule({RTCWake::WakeSpec::Kind::DATE, "+1h"}));
+    const auto plan = dry_run.plan("no");
+    REQUIRE_FALSE(plan.reset_on_halt);
+    REQUIRE(plan.halt.empty());
+    REQUIRE(plan.effective_wakeup - plan.schedule->now == 1h);
+  }
+  SECTION("show") {
+    REQUIRE_FALSE(wake.show().enabled);
+    const auto plan = dry_run.plan("show");
+    REQUIRE_FALSE(plan.schedule.has_value());
+    REQUIRE(plan.phases.size() == 1);
+    REQUIRE(plan.phases.front().method == "get_wakeup");
+  }
+  SECTION("nothing is published") {
+    wake.schedule({RTCWake::WakeSpec::Kind::SECONDS, "150"});
+    REQUIRE_FALSE(fs::exists(opts.status_file));
+  }
+}
+
+TEST_CASE("dry run forced halt", "[plan]") {
+  TempDir tmp{"plan"};
+  auto opts = plan_options(tmp.path);
+  opts.force = true;
+  DryRun dry_run(opts, device_at(at(21, 22, 32)));
+  RTCWake wake(dry_run.options(), dry_run.backend());
+  dry_run.scheduled(wake.schedule({RTCWake::WakeSpec::Kind::SECONDS, "600"}));
+  wake.halt();
+  REQUIRE(dry_run.plan("standby").halt ==
+          std::vector<std::string>{"/usr/sbin/poweroff", "--halt", "--force"});
+}
+
+TEST_CASE("dry run predicts time to halt from recorded latencies", "[plan]") {
+  using Method = InstrumentedRTC::Method;
+  TempDir tmp{"plan"};
+  auto opts = plan_options(tmp.path);
+  opts.metrics_file = tmp.path / "mrhat_rtcwake.prom";
+
+  InstrumentedRTC::Stats recorded{};
+  auto record = [&](Method m, std::chrono::microseconds latency, int n) {
+    auto &s = recorded[static_cast<std::size_t>(m)];
+    for (int i = 0; i < n; ++i) {
+      ++s.calls;
+      s.latency.record(latency);
+    }
+  };
+  record(Method::get_time, 100us, 10);
+  record(Method::set_wakeup, 200us, 10);
+  record(Method::notify_listener, 4000us, 9);
+  record(Method::notify_listener, 8000us, 1);
+  export_metrics(opts.metrics_file, recorded, "rtc0");
+  REQUIRE(read_metrics(opts.metrics_file)[0].calls == 10);
+
+  DryRun dry_run(opts, device_at(at(21, 22, 32)));
+  RTCWake wake(dry_run.options(), dry_run.backend());
+  dry_run.scheduled(wake.schedule({RTCWake::WakeSpec::Kind::SECONDS, "600"}));
+  wake.halt();
+  const auto plan = dry_run.plan("standby");
+  REQUIRE(plan.phases.size() == 3);
+  REQUIRE(plan.phases[0].samples == 10);
+  REQUIRE(plan.phases[0].mean == 100us);
+  REQUIRE(plan.phases[2].mean == 4400us);
+  REQUIRE(plan.predicted_mean == 4700us);
+  REQUIRE(plan.predicted_p99 >= 8000us + 200us + 100us);
+
+  SECTION("the metrics are not written") {
+    REQUIRE(read_metrics(opts.metrics_file)[0].calls == 10);
+  }
+  SECTION("json") {
+    const auto json = to_json(plan);
+    REQUIRE_THAT(json, Catch::Matchers::StartsWith(
+                           "{\"mode\":\"standby\",\"device\":\"rtc0\","));
+    REQUIRE_THAT(json, Catch::Matchers::ContainsSubstring(
+                           "\"granularity_s\":60,\"shift_s\":0}"));
+    REQUIRE_THAT(json, Catch::Matchers::ContainsSubstring(
+                           "\"reset_on_halt\":{\"would_signal\":true,\"port\":"
+                           "9000,\"register\":8,\"bit\":0}"));
+    REQUIRE_THAT(json, Catch::Matchers::ContainsSubstring(
+                           "\"halt\":{\"command\":[\"/usr/sbin/poweroff\","
+                           "\"--halt\"]}"));
+    REQUIRE_THAT(json, Catch::Matchers::ContainsSubstring(
+                           "{\"method\":\"get_time\",\"calls\":1,\"samples\":"
+                           "10,\"mean_us\":100,"));
+    REQUIRE_THAT(json, Catch::Matchers::EndsWith(
+                           "\"predicted_time_to_halt_us\":{\"mean\":4700,"
+                           "\"p99\":" +
+                           std::to_string(plan.predicted_p99.count()) + "}}"));
+  }
+}
@@ -0,0 +1,172 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_registry.hpp>
+
+#include "temp_dir.hpp"
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::unique_ptr<IRTC> open_mock(std::string_view name, bool is_utc) {
+  return MockRTC::get(name, is_utc ? "0.0 0 0.0\n0\nUTC\n"
+                                   : "0.0 0 0.0\n0\nLOCAL\n");
+}
+
+constexpr unsigned long timer_request = 0x1001;
+constexpr unsigned long alarm_request = 0x1002;
+const RTCBackend timer_backend{"timer", timer_request, &open_mock};
+const RTCBackend alarm_backend{"alarm", alarm_request, &open_mock};
+constexpr RTCBackend const *backends[] = {&timer_backend, &alarm_backend};
+
+// ioctl responses of a driver, requests it does not know fail with ENOTTY
+struct FakeDriver {
+  std::map<unsigned long, int> responses;
+  mutable std::vector<unsigned long> probed;
+
+  IoctlProbe probe() const {
+    return [this](unsigned long request) {
+      probed.push_back(request);
+      const auto it = responses.find(request);
+      return it == responses.end() ? ENOTTY : it->second;
+    };
+  }
+};
+
+const ProbeKey key{"0b6a4b43-53b1-4a4d-9fd3-6d0c8f1e6f2a", 0xfc00};
+
+} // namespace
+
+TEST_CASE("backend selection", "[registry]") {
+  FakeDriver driver;
+  SECTION("the preferred backend") {
+    driver.responses = {{timer_request, 0}, {alarm_request, 0}};
+    REQUIRE(&select_rtc_backend(backends, driver.probe()) == &timer_backend);
+    REQUIRE(driver.probed == std::vector<unsigned long>{timer_request});
+  }
+  SECTION("unknown requests fall through") {
+    driver.responses = {{alarm_request, 0}};
+    REQUIRE(&select_rtc_backend(backends, driver.probe()) == &alarm_backend);
+    REQUIRE(driver.probed ==
+            std::vector<unsigned long>{timer_request, alarm_request});
+  }
+  SECTION("EINVAL means unsupported") {
+    driver.responses = {{timer_request, EINVAL}, {alarm_request, 0}};
+    REQUIRE(&select_rtc_backend(backends, driver.probe()) == &alarm_backend);
+  }
+  SECTION("a transient error still recognises the request") {
+    driver.responses = {{timer_request, EBUSY}};
+    REQUIRE(&select_rtc_backend(backends, driver.probe()) == &timer_backend);
+  }
+  SECTION("no alarm support falls back to the last backend") {
+    REQUIRE(&select_rtc_backend(backends, driver.probe()) == &alarm_backend);
+  }
+  SECTION("nothing registered") {
+    REQUIRE_THROWS_AS(select_rtc_backend({}, driver.probe()),
+                      std::runtime_error);
+  }
+}
+
+TEST_CASE("probe cache", "[registry]") {
+  TempDir tmp{"registry"};
+  const auto cache = tmp.path / "run" / "rtc0.backend";
+  FakeDriver driver;
+  driver.responses = {{alarm_request, 0}};
+
+  const auto first = resolve_rtc_backend(backends, key, cache, driver.probe());
+  REQUIRE(first.backend == &alarm_backend);
+  REQUIRE_FALSE(first.cached);
+  REQUIRE(read_probe_cache(cache, key) == "alarm");
+
+  SECTION("later invocations skip probing") {
+    driver.probed.clear();
+    const auto again =
+        resolve_rtc_backend(backends, key, cache, driver.probe());
+    REQUIRE(again.backend == &alarm_backend);
+    REQUIRE(again.cached);
+    REQUIRE(driver.probed.empty());
+    REQUIRE(again.backend->open("rtc0", true)->type() == IRTC::Clock::UTC);
+  }
+  SECTION("another boot probes again") {
+    auto rebooted = key;
+    rebooted.boot_id = "5c2b2f8e-3b0e-4c55-8d1e-2f7a9d1c0b3e";
+    REQUIRE_FALSE(read_probe_cache(cache, rebooted));
+    driver.responses = {{timer_request, 0}};
+    const auto res =
+        resolve_rtc_backend(backends, rebooted, cache, driver.probe());
+    REQUIRE_FALSE(res.cached);
+    REQUIRE(res.backend == &timer_backend);
+    REQUIRE(read_probe_cache(cache, rebooted) == "timer");
+  }
+  SECTION("another device node probes again") {
+    auto replaced = key;
+    replaced.rdev = 0xfc01;
+    REQUIRE_FALSE(resolve_rtc_backend(backends, replaced, cache,
+                                      driver.probe())
+                      .cached);
+  }
+  SECTION("a backend that is no longer registered") {
+    constexpr RTCBackend const *timer_only[] = {&timer_backend};
+    const auto res =
+        resolve_rtc_backend(timer_only, key, cache, driver.probe());
+    REQUIRE_FALSE(res.cached);
+    REQUIRE(res.backend == &timer_backend);
+  }
+  SECTION("malformed cache") {
+    std::ofstream(cache) << "garbage";
+    REQUIRE_FALSE(read_probe_cache(cache, key));
+    REQUIRE_FALSE(
+        resolve_rtc_backend(backends, key, cache, driver.probe()).cached);
+    REQUIRE(read_probe_cache(cache, key) == "alarm");
+  }
+  SECTION("without a boot id") {
+    const ProbeKey no_boot{{}, key.rdev};
+    resolve_rtc_backend(backends, no_boot, cache, driver.probe());
+    REQUIRE(read_probe_cache(cache, no_boot) == "alarm");
+    REQUIRE_FALSE(read_probe_cache(cache, key));
+  }
+}
+
+TEST_CASE("unwritable probe cache", "[registry]") {
+  TempDir tmp{"registry"};
+  std::ofstream(tmp.path / "file");
+  const auto cache = tmp.path / "file" / "rtc0.backend";
+  FakeDriver driver;
+  driver.responses = {{timer_request, 0}};
+  // the probe result is still used
+  REQUIRE(resolve_rtc_backend(backends, key, cache, driver.probe()).backend ==
+          &timer_backend);
+  REQUIRE_FALSE(fs::exists(cache));
+}
+
+TEST_CASE("registered backends", "[registry]") {
+  const auto registered = rtc_backends();
+  REQUIRE_FALSE(registered.empty());
+  // the generic driver interface is the fallback
+  REQUIRE(registered.back() == &standard_backend);
+#ifdef MRHAT_RTCWAKE_HAS_RX8130
+  REQUIRE(registered.front() == &rx8130_backend);
+#endif
+  REQUIRE(probe_cache_path("rtc0") == "/run/mrhat-rtcwake/rtc0.backend");
+}
+
+TEST_CASE("probe key", "[registry]") {
+  TempDir tmp{"registry"};
+  const auto boot_id = tmp.path / "boot_id";
+  std::ofstream(boot_id) << key.boot_id << '\n';
+  const auto res = probe_key("/dev/null", boot_id);
+  REQUIRE(res.boot_id == key.boot_id);
+  REQUIRE(res.rdev != 0);
+  REQUIRE(probe_key("/dev/null", tmp.path / "missing").boot_id.empty());
+  REQUIRE_THROWS_AS(probe_key(tmp.path / "rtc9", boot_id), std::system_error);
+}
@@ -0,0 +1,156 @@
+#include <catch2/catch_all.hpp>
+
+#include <irtc.hpp>
+#include <rtcwake.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <system_error>
+#include <thread>
+
+namespace {
+auto get_faulty_mock(RetryPolicy policy) {
+  auto rtc = MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                                  "1723331760\n"
+                                  "UTC\n");
+  rtc->set_retry_policy(policy);
+  return rtc;
+}
+
+RetryPolicy fast_policy() {
+  using namespace std::chrono_literals;
+  return RetryPolicy{.max_attempts = 4,
+                     .initial_backoff = 1ms,
+                     .max_backoff = 2ms,
+                     .deadline = 1000ms};
+}
+} // namespace
+
+TEST_CASE("transient error classification", "[retry]") {
+  REQUIRE(is_transient(EBUSY));
+  REQUIRE(is_transient(EINTR));
+  REQUIRE(is_transient(EAGAIN));
+  REQUIRE(is_transient(ETIMEDOUT));
+  REQUIRE_FALSE(is_transient(EINVAL));
+  REQUIRE_FALSE(is_transient(ENOTTY));
+  REQUIRE_FALSE(is_transient(EIO));
+}
+
+TEST_CASE("retrying transient ioctl failures", "[retry]") {
+  SECTION("transient errors are retried") {
+    auto rtc = get_faulty_mock(fast_policy());
+    rtc->inject_faults({EBUSY, EAGAIN, ETIMEDOUT});
+    REQUIRE_NOTHROW(rtc->get_time());
+    REQUIRE(rtc->retry_stats().last_attempts == 4);
+    REQUIRE(rtc->retry_stats().attempts == 4);
+    REQUIRE(rtc->retry_stats().calls == 1);
+    REQUIRE(rtc->ioctl_count() == 4);
+  }
+  SECTION("permanent errors fail right away") {
+    auto rtc = get_faulty_mock(fast_policy());
+    rtc->inject_faults({EINVAL});
+    REQUIRE_THROWS_AS(rtc->get_wakeup(), std::system_error);
+    REQUIRE(rtc->retry_stats().last_attempts == 1);
+  }
+  SECTION("attempts are bounded") {
+    auto rtc = get_faulty_mock(fast_policy());
+    rtc->inject_faults({EBUSY, EBUSY, EBUSY, EBUSY, 0});
+    try {
+      rtc->set_wakeup(rtc_time{});
+      FAIL("set_wakeup should have failed");
+    } catch (std::system_error const &e) {
+      REQUIRE(e.code().value() == EBUSY);
+      REQUIRE_THAT(e.what(),
+                   Catch::Matchers::ContainsSubstring("after 4 attempts"));
+    }
+    REQUIRE(rtc->retry_stats().last_attempts == 4);
+    REQUIRE_FALSE(rtc->get_wakeup().enabled);
+  }
+  SECTION("deadline bounds each call") {
+    using namespace std::chrono_literals;
+    auto policy = fast_policy();
+    policy.max_attempts = 100;
+    policy.initial_backoff = 10ms;
+    policy.max_backoff = 10ms;
+    policy.deadline = 25ms;
+    auto rtc = get_faulty_mock(policy);
+    rtc->inject_faults({EINTR, EINTR, EINTR, EINTR, EINTR, EINTR, EINTR,
+                        EINTR});
+    const auto start = std::chrono::steady_clock::now();
+    REQUIRE_THROWS_AS(rtc->get_time(), std::system_error);
+    REQUIRE(std::chrono::steady_clock::now() - start < 100ms);
+    const auto first = rtc->retry_stats().last_attempts;
+    REQUIRE(first >= 2);
+    REQUIRE(first <= 3);
+    // the next call gets a budget of its own
+    REQUIRE_THROWS_AS(rtc->get_time(), std::system_error);
+    REQUIRE(rtc->retry_stats().last_attempts >= 2);
+  }
+  SECTION("the budget does not run out with the lifetime of the backend") {
+    using namespace std::chrono_literals;
+    auto policy = fast_policy();
+    policy.deadline = 20ms;
+    auto rtc = get_faulty_mock(policy);
+    std::this_thread::sleep_for(30ms);
+    rtc->inject_faults({EBUSY, 0});
+    REQUIRE_NOTHROW(rtc->get_time());
+    REQUIRE(rtc->retry_stats().last_attempts == 2);
+  }
+}
+
+TEST_CASE("retry budget of an operation", "[retry]") {
+  using namespace std::chrono_literals;
+  auto policy = fast_policy();
+  policy.max_attempts = 100;
+  policy.initial_backoff = 20ms;
+  policy.max_backoff = 20ms;
+  policy.deadline = 60ms;
+
+  SECTION("consecutive calls stop at one deadline") {
+    auto rtc = get_faulty_mock(policy);
+    for (int i = 0; i < 30; ++i) {
+      rtc->inject_faults({EBUSY});
+    }
+    const auto start = std::chrono::steady_clock::now();
+    {
+      const Retrier::Budget budget{policy.deadline};
+      REQUIRE_THROWS_AS(rtc->get_time(), std::system_error);
+      REQUIRE(rtc->retry_stats().last_attempts >= 2);
+      // the rest of the budget is shorter than a backoff
+      REQUIRE_THROWS_AS(rtc->get_wakeup(), std::system_error);
+      REQUIRE(rtc->retry_stats().last_attempts == 1);
+      REQUIRE_THROWS_AS(rtc->set_wakeup(rtc_time{}), std::system_error);
+      REQUIRE(rtc->retry_stats().last_attempts == 1);
+    }
+    REQUIRE(std::chrono::steady_clock::now() - start < 200ms);
+    // calls outside the budget start their own deadline again
+    REQUIRE_THROWS_AS(rtc->get_time(), std::system_error);
+    REQUIRE(rtc->retry_stats().last_attempts >= 2);
+  }
+  SECTION("nested budgets keep the outer deadline") {
+    auto rtc = get_faulty_mock(policy);
+    for (int i = 0; i < 30; ++i) {
+      rtc->inject_faults({EBUSY});
+    }
+    const Retrier::Budget outer{policy.deadline};
+    REQUIRE_THROWS_AS(rtc->get_time(), std::system_error);
+    const Retrier::Budget inner{policy.deadline};
+    REQUIRE_THROWS_AS(rtc->get_time(), std::system_error);
+    REQUIRE(rtc->retry_stats().last_attempts == 1);
+  }
+  SECTION("the ioctls of a schedule share the budget") {
+    auto rtc = get_faulty_mock(policy);
+    auto *mock = rtc.get();
+    RTCWake wake({.status_file = {}, .retry = policy}, std::move(rtc));
+    // the time is read after two retries, arming is left the rest
+    mock->inject_faults({EBUSY, EBUSY, 0});
+    for (int i = 0; i < 30; ++i) {
+      mock->inject_faults({EBUSY});
+    }
+    REQUIRE_THROWS_AS(
+        wake.schedule({RTCWake::WakeSpec::Kind::SECONDS, "60"}),
+        std::system_error);
+    // a deadline of its own would have allowed four attempts
+    REQUIRE(mock->retry_stats().last_attempts <= 2);
+  }
+}
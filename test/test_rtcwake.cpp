@@ -0,0 +1,390 @@
+#include <catch2/catch_all.hpp>
+
+#include <mrhat_integration.hpp>
+#include <mrhat_rtcwake.h>
+#include <rtc_decorator.hpp>
+#include <rtcwake.hpp>
+#include <status_page.hpp>
+#include <wake_journal.hpp>
+
+#include "temp_dir.hpp"
+
+#include <fmt/format.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct FacadeFixture {
+  FacadeFixture() {
+    auto rtc = MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                                    "1723331760\n"
+                                    "UTC\n");
+    mock = rtc.get();
+    rtc_time now{};
+    now.tm_year = 124;
+    now.tm_mon = 7;
+    now.tm_mday = 18;
+    now.tm_hour = 21;
+    now.tm_min = 22;
+    now.tm_sec = 32;
+    mock->set_time(now);
+    RTCWake::Options opts{};
+    opts.status_file = dir / "status";
+    opts.halt = [this](bool force) {
+      ++halts;
+      halted_forced = force;
+      return halt_error;
+    };
+    wake = std::make_unique<RTCWake>(std::move(opts), std::move(rtc));
+  }
+
+  // outlives the facade
+  TempDir tmp{"facade"};
+  fs::path dir = tmp.path;
+  MockRTC *mock = nullptr;
+  std::unique_ptr<RTCWake> wake;
+  int halts = 0;
+  bool halted_forced = false;
+  int halt_error = 0;
+};
+
+// signals the listener through mrhat-daemon like the device backends do
+class DaemonRTC : public RTCDecorator {
+public:
+  using RTCDecorator::RTCDecorator;
+  bool notify_listener(IntegrationInfo const &info) const noexcept override {
+    return MrHatIntegration(info.port, info.reg, info.bit)
+        .signal_reset_on_halt();
+  }
+  bool unnotify_listener(IntegrationInfo const &info) const noexcept override {
+    return MrHatIntegration(info.port, info.reg, info.bit)
+        .clear_reset_on_halt();
+  }
+};
+
+} // namespace
+
+TEST_CASE("scheduling facade", "[rtcwake]") {
+  using Kind = RTCWake::WakeSpec::Kind;
+  FacadeFixture fx;
+
+  SECTION("show when disabled") {
+    const auto state = fx.wake->show();
+    REQUIRE_FALSE(state.enabled);
+    REQUIRE_FALSE(state.pending);
+  }
+  SECTION("schedule relative") {
+    const auto res = fx.wake->schedule({Kind::SECONDS, "120"});
+    REQUIRE(res.wakeup - res.now == std::chrono::seconds{120});
+    REQUIRE(res.now.time_since_epoch().count() == 1724016152);
+    const auto state = fx.wake->show();
+    REQUIRE(state.enabled);
+    REQUIRE(state.wakeup == res.wakeup);
+    REQUIRE(fx.mock->get_wakeup().enabled);
+  }
+  SECTION("schedule absolute epoch") {
+    const auto res = fx.wake->schedule({Kind::TIME, "1724020000"});
+    REQUIRE(res.wakeup.time_since_epoch().count() == 1724020000);
+  }
+  SECTION("schedule in the past") {
+    REQUIRE_THROWS_AS(fx.wake->schedule({Kind::TIME, "1724016152"}),
+                      std::runtime_error);
+    REQUIRE_FALSE(fx.mock->get_wakeup().enabled);
+  }
+  SECTION("schedule with invalid spec") {
+    REQUIRE_THROWS(fx.wake->schedule({Kind::DATE, "+3futtyfurutty"}));
+  }
+  SECTION("disable") {
+    fx.wake->schedule({Kind::DATE, "+1h"});
+    fx.wake->disable();
+    REQUIRE_FALSE(fx.mock->get_wakeup().enabled);
+    REQUIRE_FALSE(fx.wake->show().enabled);
+  }
+  SECTION("state is published") {
+    const auto res = fx.wake->schedule({Kind::SECONDS, "60"});
+    const auto cached = RTCWake::show_cached(fx.dir / "status");
+    REQUIRE(cached.has_value());
+    REQUIRE(cached->enabled);
+    REQUIRE(cached->wakeup == res.wakeup);
+  }
+  SECTION("halt") {
+    fx.wake->schedule({Kind::SECONDS, "60"});
+    const auto res = fx.wake->halt();
+    REQUIRE(res.notified);
+    REQUIRE(res.error == 0);
+    REQUIRE(fx.halts == 1);
+    REQUIRE_FALSE(fx.halted_forced);
+  }
+  SECTION("failed halt") {
+    fx.halt_error = EPERM;
+    const auto res = fx.wake->halt();
+    REQUIRE(res.error == EPERM);
+    REQUIRE(fx.halts == 1);
+  }
+}
+
+TEST_CASE("resources touched per mode", "[rtcwake]") {
+  using Kind = RTCWake::WakeSpec::Kind;
+  using Resources = RTCWake::Resources;
+  const TempDir tmp{"lazy"};
+  auto const &dir = tmp.path;
+  std::ofstream(dir / "adjtime") << "0.000000 1723331760 0.000000\n"
+                                    "1723331760\n"
+                                    "UTC\n";
+  bool armed = false;
+  bool via_daemon = false;
+  int opened = 0;
+  RTCWake::Options opts{};
+  opts.adjfile = dir / "adjtime";
+  opts.status_file.clear();
+  // nothing listens on it, a refused connection still reaches for the daemon
+  opts.integration.port = 1;
+  opts.halt = [](bool) { return 0; };
+  RTCWake wake(opts, [&](std::string const &device) -> std::unique_ptr<IRTC> {
+    ++opened;
+    auto rtc = MockRTC::get(device);
+    rtc_time now{};
+    now.tm_year = 124;
+    now.tm_mon = 7;
+    now.tm_mday = 18;
+    now.tm_hour = 21;
+    rtc->set_time(now);
+    if (armed) {
+      now.tm_hour += 1;
+      rtc->set_wakeup(now);
+    }
+    if (via_daemon) {
+      return std::make_unique<DaemonRTC>(std::move(rtc));
+    }
+    return rtc;
+  });
+
+  SECTION("nothing until an operation needs it") {
+    REQUIRE(wake.touched() == Resources{});
+  }
+  SECTION("show of a disabled alarm only reads the device") {
+    wake.show();
+    REQUIRE(wake.touched() == Resources{.device = true});
+  }
+  SECTION("show of an armed alarm converts its time") {
+    armed = true;
+    REQUIRE(wake.show().enabled);
+    REQUIRE(wake.touched() == Resources{.device = true, .adjfile = true});
+  }
+  SECTION("disable") {
+    wake.disable();
+    REQUIRE(wake.touched() == Resources{.device = true});
+  }
+  SECTION("schedule relative") {
+    wake.schedule({Kind::SECONDS, "60"});
+    wake.schedule({Kind::DATE, "+1h"});
+    REQUIRE(wake.touched() == Resources{.device = true, .adjfile = true});
+  }
+  SECTION("schedule absolute date") {
+    wake.schedule({Kind::DATE, "2024-08-19 07:00"});
+    REQUIRE(wake.touched() ==
+            Resources{.device = true, .adjfile = true, .tzdb = true});
+  }
+  SECTION("halt with a backend not using the daemon") {
+    wake.halt();
+    REQUIRE(wake.touched() == Resources{.device = true});
+  }
+  SECTION("halt") {
+    via_daemon = true;
+    wake.halt();
+    REQUIRE(wake.touched() == Resources{.device = true, .daemon = true});
+  }
+  SECTION("open") {
+    wake.open();
+    wake.show();
+    REQUIRE(wake.touched() == Resources{.device = true, .adjfile = true});
+  }
+  SECTION("reconcile only reads the device") {
+    armed = true;
+    REQUIRE(wake.reconcile().reason == RTCWake::WakeReason::POWER_ON);
+    REQUIRE(wake.touched() == Resources{.device = true});
+  }
+  REQUIRE(opened <= 1);
+}
+
+TEST_CASE("clock of a lazily opened device", "[rtcwake]") {
+  const TempDir tmp{"lazy-clock"};
+  auto const &dir = tmp.path;
+  std::ofstream(dir / "adjtime") << "0.000000 1723331760 0.000000\n"
+                                    "1723331760\n"
+                                    "UTC\n";
+  RTCWake::Options opts{};
+  opts.adjfile = dir / "adjtime";
+  opts.status_file = dir / "status";
+  RTCWake wake(opts, [](std::string const &device) -> std::unique_ptr<IRTC> {
+    return MockRTC::get(device);
+  });
+
+  SECTION("is resolved before publishing a disabled alarm") {
+    REQUIRE_FALSE(wake.show().enabled);
+    const auto status = StatusPage::open_reader(dir / "status")->snapshot();
+    REQUIRE(status.has_value());
+    REQUIRE(status->clock == IRTC::Clock::UTC);
+    REQUIRE(wake.touched().adjfile);
+  }
+  SECTION("is resolved before publishing a disable") {
+    wake.disable();
+    const auto status = StatusPage::open_reader(dir / "status")->snapshot();
+    REQUIRE(status->clock == IRTC::Clock::UTC);
+  }
+}
+
+TEST_CASE("boot reconciliation", "[rtcwake]") {
+  using Kind = RTCWake::WakeSpec::Kind;
+  using Reason = RTCWake::WakeReason;
+  FacadeFixture fx;
+
+  SECTION("woken by the alarm") {
+    fx.wake->schedule({Kind::SECONDS, "60"});
+    fx.mock->wakeup_occured();
+    const auto before = fx.mock->ioctl_count();
+    const auto res = fx.wake->reconcile();
+    REQUIRE(res.reason == Reason::ALARM);
+    REQUIRE(res.cleared);
+    // without a journal the alarm tells that the bit was set
+    REQUIRE(res.unnotified);
+    // one read and one write
+    REQUIRE(fx.mock->ioctl_count() - before == 2);
+    const auto alarm = fx.mock->get_wakeup();
+    REQUIRE_FALSE(alarm.enabled);
+    REQUIRE_FALSE(alarm.pending);
+    REQUIRE_FALSE(RTCWake::show_cached(fx.dir / "status")->enabled);
+  }
+  SECTION("powered on without an alarm") {
+    const auto before = fx.mock->ioctl_count();
+    const auto res = fx.wake->reconcile();
+    REQUIRE(res.reason == Reason::POWER_ON);
+    REQUIRE_FALSE(res.cleared);
+    REQUIRE_FALSE(res.unnotified);
+    REQUIRE(fx.mock->ioctl_count() - before == 1);
+    REQUIRE_FALSE(fx.wake->touched().daemon);
+  }
+  SECTION("powered on before the alarm keeps it armed") {
+    fx.wake->schedule({Kind::SECONDS, "60"});
+    const auto res = fx.wake->reconcile();
+    REQUIRE(res.reason == Reason::POWER_ON);
+    REQUIRE_FALSE(res.cleared);
+    REQUIRE(fx.mock->get_wakeup().enabled);
+  }
+}
+
+TEST_CASE("boot reconciliation with a journal", "[rtcwake]") {
+  using Kind = RTCWake::WakeSpec::Kind;
+  using Reason = RTCWake::WakeReason;
+  const TempDir tmp{"reconcile"};
+  auto const &dir = tmp.path;
+  auto rtc = MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n");
+  auto *mock = rtc.get();
+  RTCWake::Options opts{};
+  opts.status_file.clear();
+  opts.journal_file = dir / "wake.journal";
+  opts.halt = [](bool) { return 0; };
+  RTCWake wake(opts, std::move(rtc));
+
+  SECTION("the bit set by the last halt is cleared once") {
+    wake.schedule({Kind::SECONDS, "60"});
+    wake.halt();
+    // powered on by hand before the alarm, the bit is still set
+    const auto first = wake.reconcile();
+    REQUIRE(first.reason == Reason::POWER_ON);
+    REQUIRE(first.unnotified);
+    REQUIRE_FALSE(wake.reconcile().unnotified);
+  }
+  SECTION("waking on the alarm of a failed halt") {
+    opts.halt = [](bool) { return EPERM; };
+    RTCWake failing(opts, MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n"));
+    failing.schedule({Kind::SECONDS, "60"});
+    failing.halt();
+    mock->set_wakeup(mock->get_time());
+    mock->wakeup_occured();
+    const auto res = wake.reconcile();
+    REQUIRE(res.reason == Reason::ALARM);
+    // the failed halt reverted the listener already
+    REQUIRE_FALSE(res.unnotified);
+  }
+  SECTION("the reason is journaled") {
+    wake.schedule({Kind::SECONDS, "60"});
+    mock->wakeup_occured();
+    wake.reconcile();
+    const auto records = read_wake_journal(opts.journal_file);
+    REQUIRE(records.back().kind == WakeRecord::Kind::RECONCILED);
+    REQUIRE(records.back().value == WakeRecord::reconciled_alarm);
+  }
+}
+
+TEST_CASE("scheduling c api", "[rtcwake]") {
+  SECTION("default options") {
+    mrhat_rtcwake_options opts{};
+    mrhat_rtcwake_default_options(&opts);
+    REQUIRE(std::string(opts.device) == "rtc0");
+    REQUIRE(std::string(opts.adjfile) == "/etc/adjtime");
+    REQUIRE(opts.daemon_port == 9000);
+    REQUIRE(opts.rst_action_register == 8);
+    REQUIRE(opts.rst_action_bit == 0);
+    REQUIRE(opts.retry_attempts == RetryPolicy{}.max_attempts);
+    REQUIRE(opts.size == sizeof(mrhat_rtcwake_options));
+  }
+  SECTION("open reports errors") {
+    mrhat_rtcwake_options opts{};
+    mrhat_rtcwake_default_options(&opts);
+    opts.adjfile = "/nonexistent/adjtime";
+    mrhat_rtcwake *handle = nullptr;
+    REQUIRE(mrhat_rtcwake_open(&opts, &handle) == -1);
+    REQUIRE(handle == nullptr);
+    REQUIRE_THAT(mrhat_rtcwake_last_error(nullptr),
+                 Catch::Matchers::ContainsSubstring("/nonexistent/adjtime"));
+  }
+  SECTION("schedule rejects a NULL value") {
+    const TempDir tmp{"capi"};
+    auto const &dir = tmp.path;
+    std::ofstream(dir / "adjtime") << "0.000000 1723331760 0.000000\n"
+                                      "1723331760\n"
+                                      "UTC\n";
+    const auto adjfile = (dir / "adjtime").string();
+    mrhat_rtcwake_options opts{};
+    mrhat_rtcwake_default_options(&opts);
+    opts.adjfile = adjfile.c_str();
+    opts.status_file = nullptr;
+    mrhat_rtcwake *handle = nullptr;
+    REQUIRE(mrhat_rtcwake_open(&opts, &handle) == 0);
+    REQUIRE(mrhat_rtcwake_schedule(handle, MRHAT_RTCWAKE_SECONDS, nullptr,
+                                   nullptr) == -EINVAL);
+    REQUIRE_THAT(mrhat_rtcwake_last_error(handle),
+                 Catch::Matchers::ContainsSubstring("NULL"));
+    REQUIRE(mrhat_rtcwake_show(handle, nullptr) == -EINVAL);
+    mrhat_rtcwake_close(handle);
+  }
+  SECTION("NULL handles fail") {
+    mrhat_rtcwake_alarm alarm{};
+    REQUIRE(mrhat_rtcwake_show(nullptr, &alarm) == -EINVAL);
+    REQUIRE_THAT(mrhat_rtcwake_last_error(nullptr),
+                 Catch::Matchers::ContainsSubstring("handle is NULL"));
+    REQUIRE(mrhat_rtcwake_disable(nullptr) == -EINVAL);
+    REQUIRE(mrhat_rtcwake_schedule(nullptr, MRHAT_RTCWAKE_SECONDS, "60",
+                                   nullptr) == -EINVAL);
+    REQUIRE(mrhat_rtcwake_halt(nullptr) == -EINVAL);
+    REQUIRE(mrhat_rtcwake_open(nullptr, nullptr) == -EINVAL);
+  }
+  SECTION("options of another layout are rejected") {
+    mrhat_rtcwake_options opts{};
+    mrhat_rtcwake_default_options(&opts);
+    opts.size -= sizeof(unsigned);
+    mrhat_rtcwake *handle = nullptr;
+    REQUIRE(mrhat_rtcwake_open(&opts, &handle) == -EINVAL);
+    REQUIRE(handle == nullptr);
+    REQUIRE_THAT(mrhat_rtcwake_last_error(nullptr),
+                 Catch::Matchers::ContainsSubstring("unknown size"));
+  }
+}
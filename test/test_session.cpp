@@ -0,0 +1,205 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_session.hpp>
+#include <rtcwake.hpp>
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+std::unique_ptr<MockRTC> get_mock() {
+  auto rtc = MockRTC::get("rtc0", "0.000000 1723331760 0.000000\n"
+                                  "1723331760\n"
+                                  "UTC\n");
+  rtc_time now{};
+  now.tm_year = 124;
+  now.tm_mon = 7;
+  now.tm_mday = 18;
+  now.tm_hour = 21;
+  rtc->set_time(now);
+  return rtc;
+}
+
+struct SessionFixture {
+  SessionFixture(std::chrono::steady_clock::duration window =
+                     RTCSession::default_window) {
+    auto rtc = get_mock();
+    mock = rtc.get();
+    session = std::make_unique<RTCSession>(std::move(rtc), window);
+    baseline = mock->ioctl_count();
+  }
+  std::size_t issued() const { return mock->ioctl_count() - baseline; }
+  rtc_time in_hours(int h) const {
+    auto t = mock->get_time();
+    t.tm_hour += h;
+    return t;
+  }
+
+  MockRTC *mock = nullptr;
+  std::unique_ptr<RTCSession> session;
+  std::size_t baseline = 0;
+};
+
+// the facade over a counting mock, driven like the command line modes
+struct FacadeFixture {
+  FacadeFixture() {
+    auto rtc = get_mock();
+    mock = rtc.get();
+    RTCWake::Options opts{};
+    opts.status_file.clear();
+    opts.halt = [](bool) { return 0; };
+    wake = std::make_unique<RTCWake>(std::move(opts), std::move(rtc));
+    baseline = mock->ioctl_count();
+  }
+  std::size_t issued() const { return mock->ioctl_count() - baseline; }
+  // arms the mock directly, as a previous invocation did
+  void arm(int hours) {
+    auto t = mock->get_time();
+    t.tm_hour += hours;
+    mock->set_wakeup(t);
+    baseline = mock->ioctl_count();
+  }
+
+  MockRTC *mock = nullptr;
+  std::unique_ptr<RTCWake> wake;
+  std::size_t baseline = 0;
+};
+
+} // namespace
+
+TEST_CASE("ioctls issued per cli mode", "[session]") {
+  using Kind = RTCWake::WakeSpec::Kind;
+  FacadeFixture fx;
+  SECTION("show") {
+    REQUIRE_FALSE(fx.wake->show().enabled);
+    REQUIRE(fx.issued() == 1);
+  }
+  SECTION("show of an armed alarm") {
+    fx.arm(1);
+    REQUIRE(fx.wake->show().enabled);
+    REQUIRE(fx.issued() == 1);
+  }
+  SECTION("disable") {
+    fx.arm(1);
+    fx.wake->disable();
+    // the RTC_WKALM_RD/RTC_WKALM_SET pair
+    REQUIRE(fx.issued() == 2);
+    REQUIRE_FALSE(fx.mock->get_wakeup().enabled);
+  }
+  SECTION("disable when already disabled") {
+    fx.wake->disable();
+    // the state is not known beforehand, so the write is not skipped
+    REQUIRE(fx.issued() == 2);
+  }
+  SECTION("no") {
+    const auto res = fx.wake->schedule({Kind::SECONDS, "3600"});
+    // RTC_RD_TIME and RTC_WKALM_SET
+    REQUIRE(fx.issued() == 2);
+    REQUIRE(fx.mock->get_wakeup().enabled);
+    REQUIRE(res.wakeup - res.now == std::chrono::hours{1});
+  }
+  SECTION("standby") {
+    fx.wake->schedule({Kind::SECONDS, "3600"});
+    REQUIRE(fx.wake->halt().error == 0);
+    // signalling the listener and halting take no ioctl
+    REQUIRE(fx.issued() == 2);
+  }
+  SECTION("reconcile after a power on") {
+    fx.arm(1);
+    REQUIRE(fx.wake->reconcile().reason == RTCWake::WakeReason::POWER_ON);
+    REQUIRE(fx.issued() == 1);
+  }
+  SECTION("reconcile after the alarm fired") {
+    fx.arm(1);
+    fx.mock->wakeup_occured();
+    REQUIRE(fx.wake->reconcile().cleared);
+    // the alarm just read is disabled without reading it again
+    REQUIRE(fx.issued() == 2);
+  }
+  SECTION("systohc") {
+    fx.wake->systohc();
+    REQUIRE(fx.issued() == 1);
+  }
+}
+
+TEST_CASE("session reads and writes", "[session]") {
+  SessionFixture fx;
+  SECTION("disable after the alarm was read") {
+    fx.mock->set_wakeup(fx.in_hours(1));
+    fx.baseline = fx.mock->ioctl_count();
+    fx.session->get_wakeup();
+    fx.session->clear_wakeup();
+    // the read of the read-modify-write is served from the session
+    REQUIRE(fx.issued() == 2);
+    REQUIRE_FALSE(fx.mock->get_wakeup().enabled);
+  }
+  SECTION("arming with verification") {
+    const auto rtctime = fx.session->get_time();
+    auto wake = rtctime;
+    wake.tm_hour += 1;
+    fx.session->set_wakeup(wake);
+    const auto armed = fx.session->get_wakeup();
+    // the verification reads what the device holds, not what was written
+    REQUIRE(fx.issued() == 3);
+    REQUIRE(armed.enabled);
+    REQUIRE(armed.time.tm_hour == wake.tm_hour);
+  }
+  SECTION("verification sees the alarm the device altered") {
+    fx.session->set_wakeup(fx.in_hours(1));
+    const auto altered = fx.in_hours(2);
+    fx.mock->set_wakeup(altered);
+    REQUIRE(fx.session->get_wakeup().time.tm_hour == altered.tm_hour);
+  }
+  SECTION("re-arming the same alarm") {
+    const auto wake = fx.in_hours(1);
+    fx.mock->set_wakeup(wake);
+    fx.baseline = fx.mock->ioctl_count();
+    fx.session->get_wakeup();
+    fx.session->set_wakeup(wake);
+    REQUIRE(fx.issued() == 1);
+  }
+  SECTION("arming a different alarm") {
+    const auto wake = fx.in_hours(2);
+    fx.mock->set_wakeup(fx.in_hours(1));
+    fx.baseline = fx.mock->ioctl_count();
+    fx.session->get_wakeup();
+    fx.session->set_wakeup(wake);
+    REQUIRE(fx.issued() == 2);
+    REQUIRE(fx.mock->get_wakeup().time.tm_hour == wake.tm_hour);
+  }
+  SECTION("re-arming a fired alarm") {
+    const auto wake = fx.in_hours(1);
+    fx.mock->set_wakeup(wake);
+    fx.mock->wakeup_occured();
+    fx.baseline = fx.mock->ioctl_count();
+    fx.session->get_wakeup();
+    fx.session->set_wakeup(wake);
+    REQUIRE(fx.issued() == 2);
+  }
+  SECTION("update edge") {
+    // hctosys, which is not run through the facade as it sets the clock
+    fx.session->wait_update();
+    fx.session->get_time();
+    REQUIRE(fx.issued() == 3);
+  }
+}
+
+TEST_CASE("session cache window", "[session]") {
+  SECTION("reads are repeated after the window") {
+    SessionFixture fx{std::chrono::milliseconds{1}};
+    fx.session->get_wakeup();
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    fx.session->get_wakeup();
+    REQUIRE(fx.issued() == 2);
+  }
+  SECTION("invalidate drops cached reads") {
+    SessionFixture fx;
+    fx.session->get_time();
+    fx.session->invalidate();
+    fx.session->get_time();
+    REQUIRE(fx.issued() == 2);
+  }
+}
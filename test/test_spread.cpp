@@ -0,0 +1,171 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_plan.hpp>
+#include <rtc_utils.hpp>
+#include <rtcwake.hpp>
+#include <wake_spread.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace ch = std::chrono;
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto utc_adj = "0.0 0 0.0\n0\nUTC\n";
+
+RTCWake::sys_seconds at(int h, int m, int s) {
+  return ch::sys_days{ch::year{2024} / ch::August / 12} + ch::hours{h} +
+         ch::minutes{m} + ch::seconds{s};
+}
+
+// machine ids as systemd generates them, 128 random bits in hex
+std::vector<std::string> machine_ids(std::size_t n) {
+  std::mt19937_64 gen(42);
+  std::vector<std::string> ids;
+  for (std::size_t i = 0; i < n; ++i) {
+    ids.push_back(fmt::format("{:016x}{:016x}", gen(), gen()));
+  }
+  return ids;
+}
+
+std::vector<std::string> serials(std::size_t n) {
+  std::vector<std::string> ids;
+  for (std::size_t i = 0; i < n; ++i) {
+    ids.push_back(fmt::format("mrhat-{:05}", i));
+  }
+  return ids;
+}
+
+// Pearson's chi-squared statistic against the uniform distribution
+double chi_squared(std::vector<unsigned> const &counts, std::size_t total) {
+  const double expected =
+      static_cast<double>(total) / static_cast<double>(counts.size());
+  double chi2 = 0;
+  for (const auto c : counts) {
+    chi2 += (c - expected) * (c - expected) / expected;
+  }
+  return chi2;
+}
+
+// far in the tail of the distribution with counts.size() - 1 degrees of
+// freedom, a uniform spread stays below it
+double chi_squared_bound(std::size_t buckets) {
+  const auto df = static_cast<double>(buckets - 1);
+  return df + 5 * std::sqrt(2 * df);
+}
+
+} // namespace
+
+// the offset of a device must not change between releases either
+static_assert(identity_hash("4f9c1b2e8d7a4c3b9e0f1a2b3c4d5e6f") ==
+              0x5fccc1f39a1bfbaf);
+static_assert(identity_hash("") != identity_hash("a"));
+
+TEST_CASE("spread offsets", "[spread]") {
+  const auto id = "4f9c1b2e8d7a4c3b9e0f1a2b3c4d5e6f";
+
+  SECTION("whole minutes within the window") {
+    for (auto const &i : machine_ids(1000)) {
+      const auto offset = spread_offset(i, 45min);
+      REQUIRE(offset >= 0min);
+      REQUIRE(offset < 45min);
+    }
+  }
+  SECTION("nothing to spread over") {
+    REQUIRE(spread_offset(id, 0min) == 0min);
+    REQUIRE(spread_offset(id, 1min) == 0min);
+  }
+  SECTION("stable across invocations") {
+    REQUIRE(spread_offset(id, 60min) == 7min);
+    REQUIRE(spread_offset(std::string(id), 60min) == 7min);
+  }
+}
+
+TEST_CASE("spread over a simulated fleet", "[spread]") {
+  const auto window = GENERATE(7min, 60min, 240min);
+  const auto ids = GENERATE(machine_ids(10000), serials(10000));
+  CAPTURE(window, ids.front());
+  const auto buckets = static_cast<std::size_t>(window.count());
+
+  // every board is told to wake at 8:00, their clocks are a few seconds apart
+  auto rtc = MockRTC::get("rtc0", utc_adj);
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<int> second(0, 59);
+  std::vector<unsigned> fired(buckets);
+  for (auto const &id : ids) {
+    const auto now = at(7, 12, second(gen));
+    rtc->set_time(sys_to_rtc(now, *rtc));
+    const auto wakeup = rtc_to_sys(
+        resolve_parsed_time(at(8, 0, 0) - now, *rtc, rtc->get_time(),
+                            spread_offset(id, window)),
+        *rtc);
+    // the RX8130 fires within the minute up to 8:00 plus the offset
+    const auto effective =
+        rx8130_effective_wakeup(now, ch::floor<ch::seconds>(wakeup));
+    const auto minute = ch::ceil<ch::minutes>(effective - at(8, 0, 0));
+    REQUIRE(minute >= 0min);
+    REQUIRE(minute < window);
+    ++fired[static_cast<std::size_t>(minute.count())];
+  }
+  REQUIRE(chi_squared(fired, ids.size()) < chi_squared_bound(buckets));
+  // no minute is left out or gets much more than its share
+  const auto share =
+      static_cast<double>(ids.size()) / static_cast<double>(buckets);
+  for (const auto n : fired) {
+    REQUIRE(n > 0);
+    REQUIRE(n < share + 5 * std::sqrt(share));
+  }
+}
+
+TEST_CASE("spread wake times through the facade", "[spread]") {
+  using Kind = RTCWake::WakeSpec::Kind;
+  RTCWake::Options opts{};
+  opts.status_file.clear();
+  opts.spread_window = 30min;
+  opts.spread_identity = "mrhat-00042";
+  const auto offset = spread_offset(opts.spread_identity, 30min);
+  RTCWake wake(opts, MockRTC::get("rtc0", utc_adj));
+
+  SECTION("relative") {
+    const auto res = wake.schedule({Kind::SECONDS, "600"});
+    REQUIRE(res.wakeup - res.now == 600s + offset);
+  }
+  SECTION("absolute") {
+    const auto res = wake.schedule({Kind::TIME, "4102444800"});
+    REQUIRE(res.wakeup == RTCWake::sys_seconds{4102444800s} + offset);
+  }
+  SECTION("resolved wake times are armed as is") {
+    const auto wakeup = wake.resolve({Kind::SECONDS, "600"});
+    REQUIRE(wake.schedule_at(wakeup).wakeup == wakeup);
+  }
+  SECTION("the same offset every time") {
+    RTCWake again(opts, MockRTC::get("rtc0", utc_adj));
+    REQUIRE(again.resolve({Kind::TIME, "4102444800"}) ==
+            wake.resolve({Kind::TIME, "4102444800"}));
+  }
+}
+
+TEST_CASE("device identity", "[spread]") {
+  const auto dir = fs::temp_directory_path() /
+                   fmt::format("mrhat-rtcwake-spread-{}", getpid());
+  fs::create_directories(dir);
+  std::ofstream(dir / "machine-id") << "4f9c1b2e8d7a4c3b9e0f1a2b3c4d5e6f\n";
+  std::ofstream(dir / "empty");
+  REQUIRE(device_identity(dir / "machine-id") ==
+          "4f9c1b2e8d7a4c3b9e0f1a2b3c4d5e6f");
+  REQUIRE_THROWS_AS(device_identity(dir / "empty"), std::runtime_error);
+  REQUIRE_THROWS_AS(device_identity(dir / "missing"), std::runtime_error);
+  fs::remove_all(dir);
+}
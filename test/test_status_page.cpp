@@ -0,0 +1,118 @@
+#include <catch2/catch_all.hpp>
+
+#include <status_page.hpp>
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+auto get_status_path() {
+  return fs::temp_directory_path() /
+         fmt::format("mrhat-rtcwake-test-{}", getpid()) / "status";
+}
+
+TEST_CASE("status page", "[status-page]") {
+  const auto path = get_status_path();
+  fs::remove_all(path.parent_path());
+
+  SECTION("reader without page") {
+    REQUIRE_FALSE(StatusPage::open_reader(path).has_value());
+  }
+  SECTION("nothing published yet") {
+    auto writer = StatusPage::open_writer(path);
+    auto reader = StatusPage::open_reader(path);
+    REQUIRE(reader.has_value());
+    REQUIRE_FALSE(reader->snapshot().has_value());
+  }
+  SECTION("published state is visible to readers") {
+    auto writer = StatusPage::open_writer(path);
+    auto reader = StatusPage::open_reader(path);
+    REQUIRE(reader.has_value());
+    writer.publish(1723331760, true, IRTC::Clock::UTC);
+    auto snap = reader->snapshot();
+    REQUIRE(snap.has_value());
+    REQUIRE(snap->wakeup == 1723331760);
+    REQUIRE(snap->enabled);
+    REQUIRE(snap->clock == IRTC::Clock::UTC);
+    REQUIRE(snap->sequence == 1);
+    REQUIRE(snap->updated > 0);
+
+    writer.publish(0, false, IRTC::Clock::LOCAL);
+    snap = reader->snapshot();
+    REQUIRE(snap->wakeup == 0);
+    REQUIRE_FALSE(snap->enabled);
+    REQUIRE(snap->clock == IRTC::Clock::LOCAL);
+    REQUIRE(snap->sequence == 2);
+  }
+  SECTION("an unresolved clock keeps the published one") {
+    auto writer = StatusPage::open_writer(path);
+    writer.publish(42, true, IRTC::Clock::LOCAL);
+    writer.publish(0, false, IRTC::Clock::INVALID);
+    const auto snap = StatusPage::open_reader(path)->snapshot();
+    REQUIRE_FALSE(snap->enabled);
+    REQUIRE(snap->clock == IRTC::Clock::LOCAL);
+  }
+  SECTION("state survives reopening") {
+    StatusPage::open_writer(path).publish(42, true, IRTC::Clock::UTC);
+    StatusPage::open_writer(path).publish(43, true, IRTC::Clock::UTC);
+    auto snap = StatusPage::open_reader(path)->snapshot();
+    REQUIRE(snap->wakeup == 43);
+    REQUIRE(snap->sequence == 2);
+  }
+  SECTION("a writer killed mid publish does not hang readers") {
+    StatusPage::open_writer(path).publish(42, true, IRTC::Clock::UTC);
+    {
+      // the seqlock counter follows the magic and the version
+      const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+      REQUIRE(fd >= 0);
+      const std::uint64_t odd = 3;
+      REQUIRE(pwrite(fd, &odd, sizeof(odd), 8) == sizeof(odd));
+      close(fd);
+    }
+    REQUIRE_FALSE(StatusPage::open_reader(path)->snapshot().has_value());
+
+    StatusPage::open_writer(path).publish(43, true, IRTC::Clock::UTC);
+    const auto snap = StatusPage::open_reader(path)->snapshot();
+    REQUIRE(snap.has_value());
+    REQUIRE(snap->wakeup == 43);
+    REQUIRE(snap->sequence == 3);
+  }
+#if not defined(__SANITIZE_THREAD__)
+  SECTION("readers never see torn writes") {
+    auto writer = StatusPage::open_writer(path);
+    auto reader = StatusPage::open_reader(path);
+    std::atomic<bool> done{};
+    std::thread th([&] {
+      for (std::time_t i = 1; i <= 20000; ++i) {
+        // enabled and clock are derived from the wakeup value so a torn
+        // snapshot can be detected
+        writer.publish(i, i % 2 == 0,
+                       i % 3 == 0 ? IRTC::Clock::UTC : IRTC::Clock::LOCAL);
+      }
+      done = true;
+    });
+    bool consistent = true;
+    while (!done) {
+      if (const auto snap = reader->snapshot()) {
+        const auto i = snap->wakeup;
+        consistent &= snap->enabled == (i % 2 == 0);
+        consistent &= snap->clock ==
+                      (i % 3 == 0 ? IRTC::Clock::UTC : IRTC::Clock::LOCAL);
+        consistent &= snap->sequence == static_cast<std::uint64_t>(i);
+      }
+    }
+    th.join();
+    REQUIRE(consistent);
+    REQUIRE(reader->snapshot()->wakeup == 20000);
+  }
+#endif
+  fs::remove_all(path.parent_path());
+}
@@ -0,0 +1,70 @@
+#include <catch2/catch_all.hpp>
+
+#include <time_format.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <random>
+#include <string>
+
+using namespace std::chrono_literals;
+using std::chrono::sys_seconds;
+
+namespace {
+
+std::string iso(std::int64_t epoch) {
+  return std::string(Iso8601(sys_seconds{std::chrono::seconds{epoch}}).view());
+}
+
+std::string epoch(std::int64_t epoch) {
+  return std::string(Epoch(sys_seconds{std::chrono::seconds{epoch}}).view());
+}
+
+std::string gmtime_iso(std::time_t t) {
+  std::tm tm{};
+  gmtime_r(&t, &tm);
+  char buff[32];
+  std::strftime(buff, sizeof(buff), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  return buff;
+}
+
+static_assert(Iso8601(sys_seconds{0s}).view() == "1970-01-01T00:00:00Z");
+
+} // namespace
+
+TEST_CASE("fixed layout iso8601", "[time-format]") {
+  REQUIRE(iso(0) == "1970-01-01T00:00:00Z");
+  REQUIRE(iso(1724016152) == "2024-08-18T21:22:32Z");
+  REQUIRE(iso(1709164800) == "2024-02-29T00:00:00Z");
+  REQUIRE(iso(951782400) == "2000-02-29T00:00:00Z");
+  REQUIRE(iso(-1) == "1969-12-31T23:59:59Z");
+  REQUIRE(iso(4102444799) == "2099-12-31T23:59:59Z");
+  REQUIRE(iso(253402300799) == "9999-12-31T23:59:59Z");
+}
+
+TEST_CASE("iso8601 years outside 0000-9999", "[time-format]") {
+  REQUIRE(iso(253402300800) == "+010000-01-01T00:00:00Z");
+  REQUIRE(iso(-62167219200) == "0000-01-01T00:00:00Z");
+  REQUIRE(iso(-62167219201) == "-000001-12-31T23:59:59Z");
+  // the year of the largest sys_seconds has twelve digits
+  REQUIRE(Iso8601(sys_seconds::max()).view().size() <= iso8601_max_size);
+  REQUIRE(Iso8601(sys_seconds::min()).view().size() <= iso8601_max_size);
+}
+
+TEST_CASE("iso8601 matches gmtime", "[time-format]") {
+  std::mt19937_64 gen(42);
+  // 1900 to 2200
+  std::uniform_int_distribution<std::int64_t> dist(-2208988800, 7258118400);
+  for (int i = 0; i < 10000; ++i) {
+    const auto t = dist(gen);
+    REQUIRE(iso(t) == gmtime_iso(t));
+  }
+}
+
+TEST_CASE("epoch seconds", "[time-format]") {
+  REQUIRE(epoch(0) == "0");
+  REQUIRE(epoch(1724016152) == "1724016152");
+  REQUIRE(epoch(-1) == "-1");
+  REQUIRE(epoch(INT64_MIN) == "-9223372036854775808");
+}
@@ -0,0 +1,292 @@
+#include <catch2/catch_all.hpp>
+
+#include <rtc_utils.hpp>
+#include <tz_transitions.hpp>
+
+#include <date/tz.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono;
+using Choose = TransitionTable::Choose;
+using Transition = TransitionTable::Transition;
+
+// zone with hand written transitions, shaped like date::time_zone
+struct FakeZone {
+  struct Info {
+    sys_seconds begin;
+    sys_seconds end;
+    seconds offset;
+  };
+  seconds initial;
+  std::vector<Transition> rules;
+
+  Info get_info(sys_seconds tp) const {
+    Info info{sys_seconds::min(), sys_seconds::max(), initial};
+    for (auto const &r : rules) {
+      if (r.at <= tp) {
+        info.begin = r.at;
+        info.offset = r.after;
+      } else {
+        info.end = r.at;
+        break;
+      }
+    }
+    return info;
+  }
+};
+
+sys_seconds utc(int y, unsigned m, unsigned d, int h, int min = 0) {
+  return sys_days{year{y} / month{m} / day{d}} + hours{h} + minutes{min};
+}
+
+local_seconds local(int y, unsigned m, unsigned d, int h, int min = 0) {
+  return local_days{year{y} / month{m} / day{d}} + hours{h} + minutes{min};
+}
+
+// every instant that shows lt on the wall clock, by brute force over the
+// offsets of the table
+std::vector<sys_seconds> candidates(TransitionTable const &table,
+                                    local_seconds lt) {
+  std::vector<seconds> offsets{table.offset_at(sys_seconds::min())};
+  for (auto const &t : table.transitions()) {
+    offsets.push_back(t.after);
+  }
+  std::ranges::sort(offsets);
+  const auto [first, last] = std::ranges::unique(offsets);
+  offsets.erase(first, last);
+  std::vector<sys_seconds> res;
+  for (auto o : offsets) {
+    const sys_seconds tp{lt.time_since_epoch() - o};
+    if (table.offset_at(tp) == o) {
+      res.push_back(tp);
+    }
+  }
+  std::ranges::sort(res);
+  return res;
+}
+
+// checks every minute of local time within hours of each transition
+// against the brute force resolution
+void check_around_transitions(TransitionTable const &table,
+                              hours around = hours{3}) {
+  for (auto const &t : table.transitions()) {
+    const auto mid = table.to_local(t.at);
+    for (auto lt = mid - around; lt <= mid + around; lt += minutes{1}) {
+      const auto c = candidates(table, lt);
+      const auto earliest = table.to_sys(lt, Choose::EARLIEST);
+      const auto latest = table.to_sys(lt, Choose::LATEST);
+      INFO("transition at " << t.at.time_since_epoch().count()
+                            << " local time "
+                            << lt.time_since_epoch().count());
+      if (c.empty()) {
+        // gap, the first existing instant and the shifted one
+        REQUIRE(earliest == t.at);
+        REQUIRE(latest == sys_seconds{lt.time_since_epoch() - t.before});
+        REQUIRE(table.to_local(latest) == lt + (t.after - t.before));
+      } else {
+        REQUIRE(earliest == c.front());
+        REQUIRE(latest == c.back());
+        REQUIRE(table.to_local(earliest) == lt);
+        REQUIRE(table.to_local(latest) == lt);
+      }
+    }
+  }
+}
+
+const FakeZone budapest_2024{
+    hours{1},
+    {{utc(2024, 3, 31, 1), hours{1}, hours{2}},
+     {utc(2024, 10, 27, 1), hours{2}, hours{1}}}};
+
+} // namespace
+
+TEST_CASE("transition table build", "[tz]") {
+  SECTION("collects offset changes in the window") {
+    const auto table = TransitionTable::build(
+        &budapest_2024, utc(2024, 1, 1, 0), utc(2025, 1, 1, 0));
+    REQUIRE(table.transitions().size() == 2);
+    REQUIRE(table.transitions()[0].at == utc(2024, 3, 31, 1));
+    REQUIRE(table.transitions()[1].at == utc(2024, 10, 27, 1));
+    REQUIRE(table.offset_at(utc(2024, 1, 1, 0)) == hours{1});
+    REQUIRE(table.offset_at(utc(2024, 3, 31, 1)) == hours{2});
+    REQUIRE(table.offset_at(utc(2024, 10, 27, 1) - seconds{1}) == hours{2});
+    REQUIRE(table.offset_at(utc(2024, 12, 31, 0)) == hours{1});
+  }
+  SECTION("window after the transitions") {
+    const auto table = TransitionTable::build(
+        &budapest_2024, utc(2024, 11, 1, 0), utc(2025, 1, 1, 0));
+    REQUIRE(table.transitions().empty());
+    REQUIRE(table.to_sys(local(2024, 12, 1, 12)) == utc(2024, 12, 1, 11));
+  }
+  SECTION("skips changes that keep the offset") {
+    const FakeZone zone{hours{1},
+                        {{utc(2024, 3, 1, 0), hours{1}, hours{1}},
+                         {utc(2024, 4, 1, 0), hours{1}, hours{2}}}};
+    const auto table =
+        TransitionTable::build(&zone, utc(2024, 1, 1, 0), utc(2025, 1, 1, 0));
+    REQUIRE(table.transitions().size() == 1);
+  }
+}
+
+TEST_CASE("transition table local to sys", "[tz]") {
+  const auto table = TransitionTable::build(
+      &budapest_2024, utc(2024, 1, 1, 0), utc(2025, 1, 1, 0));
+
+  SECTION("unique local times") {
+    REQUIRE(table.to_sys(local(2024, 1, 15, 12)) == utc(2024, 1, 15, 11));
+    REQUIRE(table.to_sys(local(2024, 7, 15, 12)) == utc(2024, 7, 15, 10));
+    REQUIRE(table.to_sys(local(2024, 7, 15, 12), Choose::LATEST) ==
+            utc(2024, 7, 15, 10));
+    REQUIRE(table.to_sys(local(2024, 3, 31, 1, 59)) == utc(2024, 3, 31, 0, 59));
+    REQUIRE(table.to_sys(local(2024, 3, 31, 3)) == utc(2024, 3, 31, 1));
+  }
+  SECTION("gap of the spring transition") {
+    REQUIRE(table.to_sys(local(2024, 3, 31, 2)) == utc(2024, 3, 31, 1));
+    REQUIRE(table.to_sys(local(2024, 3, 31, 2, 30)) == utc(2024, 3, 31, 1));
+    REQUIRE(table.to_sys(local(2024, 3, 31, 2, 30), Choose::LATEST) ==
+            utc(2024, 3, 31, 1, 30));
+  }
+  SECTION("overlap of the autumn transition") {
+    REQUIRE(table.to_sys(local(2024, 10, 27, 2, 30)) ==
+            utc(2024, 10, 27, 0, 30));
+    REQUIRE(table.to_sys(local(2024, 10, 27, 2, 30), Choose::LATEST) ==
+            utc(2024, 10, 27, 1, 30));
+    REQUIRE(table.to_sys(local(2024, 10, 27, 3)) == utc(2024, 10, 27, 2));
+  }
+  SECTION("every minute of the year") {
+    for (auto lt = local(2024, 1, 1, 0); lt < local(2025, 1, 1, 0);
+         lt += minutes{1}) {
+      const auto c = candidates(table, lt);
+      if (c.size() == 1) {
+        REQUIRE(table.to_sys(lt, Choose::EARLIEST) == c.front());
+        REQUIRE(table.to_sys(lt, Choose::LATEST) == c.front());
+      }
+    }
+    check_around_transitions(table);
+  }
+}
+
+TEST_CASE("transition table unusual transitions", "[tz]") {
+  SECTION("half hour daylight saving") {
+    // Lord Howe Island, +11 to +10:30 and back
+    const auto standard = hours{10} + minutes{30};
+    const FakeZone zone{hours{11},
+                        {{utc(2024, 4, 6, 15), hours{11}, standard},
+                         {utc(2024, 10, 5, 15, 30), standard, hours{11}}}};
+    const auto table =
+        TransitionTable::build(&zone, utc(2024, 1, 1, 0), utc(2025, 1, 1, 0));
+    REQUIRE(table.transitions().size() == 2);
+    REQUIRE(table.to_sys(local(2024, 4, 7, 1, 45)) == utc(2024, 4, 6, 14, 45));
+    REQUIRE(table.to_sys(local(2024, 4, 7, 1, 45), Choose::LATEST) ==
+            utc(2024, 4, 6, 15, 15));
+    REQUIRE(table.to_sys(local(2024, 10, 6, 2, 15)) ==
+            utc(2024, 10, 5, 15, 30));
+    check_around_transitions(table);
+  }
+  SECTION("skipped day") {
+    // Samoa moving across the date line, 2011-12-30 did not happen
+    const FakeZone zone{
+        -hours{10}, {{utc(2011, 12, 30, 10), -hours{10}, hours{14}}}};
+    const auto table =
+        TransitionTable::build(&zone, utc(2011, 1, 1, 0), utc(2013, 1, 1, 0));
+    REQUIRE(table.to_sys(local(2011, 12, 30, 12)) == utc(2011, 12, 30, 10));
+    REQUIRE(table.to_sys(local(2011, 12, 31, 0)) == utc(2011, 12, 30, 10));
+    REQUIRE(table.to_sys(local(2011, 12, 29, 23, 59)) ==
+            utc(2011, 12, 30, 9, 59));
+    check_around_transitions(table, hours{26});
+  }
+  SECTION("zone at UTC outside of summer time") {
+    const FakeZone zone{hours{0},
+                        {{utc(2024, 3, 31, 1), hours{0}, hours{1}},
+                         {utc(2024, 10, 27, 1), hours{1}, hours{0}}}};
+    const auto table =
+        TransitionTable::build(&zone, utc(2024, 1, 1, 0), utc(2025, 1, 1, 0));
+    REQUIRE(table.to_sys(local(2024, 10, 27, 1, 30), Choose::LATEST) ==
+            utc(2024, 10, 27, 1, 30));
+    check_around_transitions(table);
+  }
+  SECTION("fixed offset") {
+    const TransitionTable table{hours{-3}};
+    REQUIRE(table.to_sys(local(2024, 6, 1, 0)) == utc(2024, 6, 1, 3));
+    REQUIRE(table.to_local(utc(2024, 6, 1, 3)) == local(2024, 6, 1, 0));
+  }
+}
+
+TEST_CASE("transition table against the zone database", "[tz]") {
+  const auto name = GENERATE("Europe/Budapest", "America/New_York",
+                             "Australia/Lord_Howe", "Europe/Dublin",
+                             "Pacific/Apia", "UTC");
+  const auto *zone = date::locate_zone(name);
+  const auto table =
+      TransitionTable::build(zone, utc(2000, 1, 1, 0), utc(2040, 1, 1, 0));
+  INFO(name);
+  check_around_transitions(table);
+  for (auto const &t : table.transitions()) {
+    const auto mid = table.to_local(t.at);
+    for (auto lt = mid - hours{3}; lt <= mid + hours{3}; lt += minutes{15}) {
+      const auto info =
+          zone->get_info(date::local_seconds{lt.time_since_epoch()});
+      const auto local = lt.time_since_epoch();
+      switch (info.result) {
+      case date::local_info::unique:
+        REQUIRE(table.to_sys(lt) == sys_seconds{local - info.first.offset});
+        break;
+      case date::local_info::nonexistent:
+        REQUIRE(table.to_sys(lt) == info.first.end);
+        REQUIRE(table.to_sys(lt, Choose::LATEST) ==
+                sys_seconds{local - info.first.offset});
+        break;
+      case date::local_info::ambiguous:
+        REQUIRE(table.to_sys(lt) == sys_seconds{local - info.first.offset});
+        REQUIRE(table.to_sys(lt, Choose::LATEST) ==
+                sys_seconds{local - info.second.offset});
+        break;
+      }
+    }
+  }
+}
+
+TEST_CASE("absolute dates resolve through the transition table", "[tz]") {
+  auto const &table = TransitionTable::current();
+  for (auto const &t : table.transitions()) {
+    if (t.at < utc(2020, 1, 1, 0) || t.at > utc(2030, 1, 1, 0)) {
+      continue;
+    }
+    // a local time inside the gap or overlap of the transition
+    const auto lt = table.to_local(t.at) - minutes{1};
+    const auto day = floor<days>(lt);
+    const year_month_day ymd{day};
+    const hh_mm_ss hms{lt - day};
+    const auto text = fmt::format(
+        "{}-{:02}-{:02} {:02}:{:02}:{:02}", static_cast<int>(ymd.year()),
+        static_cast<unsigned>(ymd.month()), static_cast<unsigned>(ymd.day()),
+        hms.hours().count(), hms.minutes().count(), hms.seconds().count());
+    const auto earliest = parse_time_abs(text, {}, Choose::EARLIEST);
+    const auto latest = parse_time_abs(text, {}, Choose::LATEST);
+    REQUIRE(earliest == table.to_sys(lt, Choose::EARLIEST));
+    REQUIRE(latest == table.to_sys(lt, Choose::LATEST));
+  }
+  SECTION("outside of transitions") {
+    const auto res = parse_time_abs("2024-08-19 01:54:11");
+    REQUIRE(res == table.to_sys(local(2024, 8, 19, 1, 54) + seconds{11}));
+  }
+}
+
+TEST_CASE("tomorrow resolves midnight by the chosen policy", "[tz]") {
+  auto const &table = TransitionTable::current();
+  auto rtc = MockRTC::get("rtc0", "0.0 0 0.0\n0\nUTC\n");
+  const auto now = utc(2024, 8, 18, 21);
+  rtc->set_time(sys_to_rtc(now, *rtc));
+  const auto midnight = floor<days>(table.to_local(now)) + days{1};
+  for (const auto choose : {Choose::EARLIEST, Choose::LATEST}) {
+    const auto wakeup =
+        resolve_parsed_time(Tomorrow{choose}, *rtc, rtc->get_time());
+    REQUIRE(rtc_to_sys(wakeup, *rtc) == table.to_sys(midnight, choose));
+  }
+}
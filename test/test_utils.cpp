@@ -13,6 +13,13 @@ auto get_tm_day(int year, int month, int day) {
   return t;
 }
 
+// local time of a parsed absolute date, in the zone it was parsed in
+auto local_of(sys_time_point tp) {
+  const auto lt = TransitionTable::current().to_local(
+      std::chrono::floor<std::chrono::seconds>(tp));
+  return date::local_seconds{lt.time_since_epoch()};
+}
+
 TEST_CASE("relative date parsing", "[utils]") {
 
   SECTION("seconds") {
@@ -143,8 +150,11 @@ TEST_CASE("relative date parsing", "[utils]") {
   }
 }
 TEST_CASE("tomorrow parsing", "[utils]") {
+  using Choose = TransitionTable::Choose;
   const auto res = parse_time("tomorrow");
-  REQUIRE_NOTHROW(std::get<Tomorrow>(res));
+  REQUIRE(std::get<Tomorrow>(res).choose == Choose::EARLIEST);
+  REQUIRE(std::get<Tomorrow>(parse_time("tomorrow", Choose::LATEST)).choose ==
+          Choose::LATEST);
 }
 TEST_CASE("absolute date parsing", "[utils]") {
   SECTION("when long format") {
@@ -152,7 +162,7 @@ TEST_CASE("absolute date parsing", "[utils]") {
     using namespace date::literals;
     using namespace std::chrono_literals;
     const auto res = parse_time_abs("20240819015411");
-    auto syst = res.get_local_time();
+    auto syst = local_of(res);
     auto const dp = date::floor<date::days>(syst);
     auto const hms = make_time(syst - dp);
     auto ymd = date::year_month_day(dp);
@@ -168,7 +178,7 @@ TEST_CASE("absolute date parsing", "[utils]") {
     using namespace date::literals;
     using namespace std::chrono_literals;
     const auto res = parse_time_abs("2024-08-19 01:54:11");
-    auto syst = res.get_local_time();
+    auto syst = local_of(res);
     auto const dp = date::floor<date::days>(syst);
     auto const hms = make_time(syst - dp);
     auto ymd = date::year_month_day(dp);
@@ -184,7 +194,7 @@ TEST_CASE("absolute date parsing", "[utils]") {
     using namespace date::literals;
     using namespace std::chrono_literals;
     const auto res = parse_time_abs("2024-08-19 01:54");
-    auto syst = res.get_local_time();
+    auto syst = local_of(res);
     auto const dp = date::floor<date::days>(syst);
     auto const hms = make_time(syst - dp);
     auto ymd = date::year_month_day(dp);
@@ -200,7 +210,7 @@ TEST_CASE("absolute date parsing", "[utils]") {
     using namespace date::literals;
     using namespace std::chrono_literals;
     const auto res = parse_time_abs("2024-08-19");
-    auto syst = res.get_local_time();
+    auto syst = local_of(res);
     auto const dp = date::floor<date::days>(syst);
     auto const hms = make_time(syst - dp);
     auto ymd = date::year_month_day(dp);
@@ -217,7 +227,7 @@ TEST_CASE("absolute date parsing", "[utils]") {
     using namespace std::chrono_literals;
     const auto tm_now = get_tm_day(2024, 8, 19);
     const auto res = parse_time_abs("01:54:11", tm_now);
-    auto syst = res.get_local_time();
+    auto syst = local_of(res);
     auto const dp = date::floor<date::days>(syst);
     auto const hms = make_time(syst - dp);
     auto ymd = date::year_month_day(dp);
@@ -234,7 +244,7 @@ TEST_CASE("absolute date parsing", "[utils]") {
     using namespace std::chrono_literals;
     const auto tm_now = get_tm_day(2024, 8, 19);
     const auto res = parse_time_abs("01:54", tm_now);
-    auto syst = res.get_local_time();
+    auto syst = local_of(res);
     auto const dp = date::floor<date::days>(syst);
     auto const hms = make_time(syst - dp);
     auto ymd = date::year_month_day(dp);
@@ -369,4 +379,38 @@ TEST_CASE("resolve parsed time", "[utils]") {
   }
 
   // local.get_info().offset
-}
\ No newline at end of file
+}
+TEST_CASE("edge aligned clock sync", "[utils]") {
+  namespace ch = std::chrono;
+
+  SECTION("mock update edge advances a second") {
+    auto rtc = get_mock_rtc();
+    rtc->set_time(get_rtc_time(2024, 8, 18, 23, 59, 59));
+    const auto edge = rtc->wait_update();
+    REQUIRE(edge.tm_year == 124);
+    REQUIRE(edge.tm_mon == 7);
+    REQUIRE(edge.tm_mday == 19);
+    REQUIRE(edge.tm_hour == 0);
+    REQUIRE(edge.tm_min == 0);
+    REQUIRE(edge.tm_sec == 0);
+  }
+  SECTION("hctosys sets the clock at the update edge") {
+    auto rtc = get_mock_rtc();
+    const auto curr = get_rtc_time(2024, 8, 18, 21, 22, 32);
+    rtc->set_time(curr);
+    ch::system_clock::time_point set_to{};
+    const auto res =
+        hctosys(*rtc, [&](ch::system_clock::time_point tp) { set_to = tp; });
+    REQUIRE(res == set_to);
+    REQUIRE(set_to == rtc_to_sys(curr, *rtc) + ch::seconds{1});
+  }
+  SECTION("systohc writes on a second boundary") {
+    auto rtc = get_mock_rtc();
+    ch::system_clock::time_point slept_until{};
+    const auto res = systohc(
+        *rtc, [&](ch::system_clock::time_point tp) { slept_until = tp; });
+    REQUIRE(slept_until == ch::floor<ch::seconds>(slept_until));
+    REQUIRE(rtc_to_sys(rtc->get_time(), *rtc) == slept_until);
+    REQUIRE(rtc_to_sys(res, *rtc) == slept_until);
+  }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Fixed layout timestamp formatting for machine readable output. Unlike
+// date::format it needs no zone database and no allocation, the output is
+// written to a caller provided buffer.
+
+// YYYY-MM-DDTHH:MM:SSZ
+inline constexpr std::size_t iso8601_size = 20;
+// years outside 0000-9999 take a sign and at least six digits, those of
+// sys_seconds up to twelve
+inline constexpr std::size_t iso8601_max_size = iso8601_size + 9;
+// -9223372036854775808
+inline constexpr std::size_t epoch_max_size = 20;
+
+struct CivilTime {
+  std::int64_t year;
+  unsigned month;
+  unsigned day;
+  unsigned hour;
+  unsigned minute;
+  unsigned second;
+};
+
+// proleptic Gregorian calendar from days since 1970-01-01, see
+// http://howardhinnant.github.io/date_algorithms.html#civil_from_days
+constexpr CivilTime to_civil(std::chrono::sys_seconds tp) noexcept {
+  const std::int64_t secs = tp.time_since_epoch().count();
+  std::int64_t days = secs / 86400;
+  std::int64_t sod = secs % 86400;
+  if (sod < 0) {
+    sod += 86400;
+    --days;
+  }
+  const std::int64_t z = days + 719468;
+  const std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const auto doe = static_cast<unsigned>(z - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  return CivilTime{.year = static_cast<std::int64_t>(yoe) + era * 400 +
+                           (m <= 2 ? 1 : 0),
+                   .month = m,
+                   .day = d,
+                   .hour = static_cast<unsigned>(sod / 3600),
+                   .minute = static_cast<unsigned>(sod % 3600 / 60),
+                   .second = static_cast<unsigned>(sod % 60)};
+}
+
+namespace detail {
+constexpr char *put2(char *out, unsigned v) noexcept {
+  out[0] = static_cast<char>('0' + v / 10);
+  out[1] = static_cast<char>('0' + v % 10);
+  return out + 2;
+}
+} // namespace detail
+
+// writes iso8601_size characters for the years 0000-9999, others in the
+// expanded representation of ISO 8601, e.g. +010000-01-01T00:00:00Z, and at
+// most iso8601_max_size characters
+constexpr char *format_iso8601(char *out,
+                               std::chrono::sys_seconds tp) noexcept {
+  const auto ct = to_civil(tp);
+  if (ct.year >= 0 && ct.year <= 9999) {
+    const auto year = static_cast<unsigned>(ct.year);
+    out = detail::put2(out, year / 100);
+    out = detail::put2(out, year % 100);
+  } else {
+    *out++ = ct.year < 0 ? '-' : '+';
+    auto year = static_cast<std::uint64_t>(ct.year < 0 ? -ct.year : ct.year);
+    char digits[12]{};
+    int n = 0;
+    for (; year != 0 || n < 6; year /= 10) {
+      digits[n++] = static_cast<char>('0' + year % 10);
+    }
+    while (n > 0) {
+      *out++ = digits[--n];
+    }
+  }
+  *out++ = '-';
+  out = detail::put2(out, ct.month);
+  *out++ = '-';
+  out = detail::put2(out, ct.day);
+  *out++ = 'T';
+  out = detail::put2(out, ct.hour);
+  *out++ = ':';
+  out = detail::put2(out, ct.minute);
+  *out++ = ':';
+  out = detail::put2(out, ct.second);
+  *out++ = 'Z';
+  return out;
+}
+
+// writes at most epoch_max_size characters
+inline char *format_epoch(char *out, std::chrono::sys_seconds tp) noexcept {
+  return std::to_chars(out, out + epoch_max_size, tp.time_since_epoch().count())
+      .ptr;
+}
+
+// small owning buffers, so the result can be passed around as a string_view
+// without allocating
+struct Iso8601 {
+  explicit constexpr Iso8601(std::chrono::sys_seconds tp) noexcept
+      : len{static_cast<std::size_t>(format_iso8601(buff, tp) - buff)} {}
+  constexpr std::string_view view() const noexcept { return {buff, len}; }
+  char buff[iso8601_max_size]{};
+  std::size_t len;
+};
+
+struct Epoch {
+  explicit Epoch(std::chrono::sys_seconds tp) noexcept
+      : len{static_cast<std::size_t>(format_epoch(buff, tp) - buff)} {}
+  std::string_view view() const noexcept { return {buff, len}; }
+  char buff[epoch_max_size]{};
+  std::size_t len;
+};
@@ -0,0 +1,73 @@
+#include "tz_transitions.hpp"
+
+#include <date/tz.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+using namespace std::chrono;
+
+std::atomic<std::uint64_t> g_lookups{0};
+
+// local time window a transition makes nonexistent or ambiguous
+sys_seconds::duration window_begin(TransitionTable::Transition const &t) {
+  return t.at.time_since_epoch() + std::min(t.before, t.after);
+}
+sys_seconds::duration window_end(TransitionTable::Transition const &t) {
+  return t.at.time_since_epoch() + std::max(t.before, t.after);
+}
+
+} // namespace
+
+TransitionTable::TransitionTable(seconds offset,
+                                 std::vector<Transition> transitions)
+    : m_offset{offset}, m_transitions{std::move(transitions)} {
+  std::ranges::sort(m_transitions, {}, &Transition::at);
+  if (!m_transitions.empty()) {
+    m_offset = m_transitions.front().before;
+  }
+}
+
+TransitionTable const &TransitionTable::current() {
+  g_lookups.fetch_add(1, std::memory_order_relaxed);
+  static const TransitionTable table =
+      build(date::current_zone(), sys_days{year{1970} / January / 1},
+            sys_days{year{2100} / January / 1});
+  return table;
+}
+
+std::uint64_t TransitionTable::lookups() noexcept {
+  return g_lookups.load(std::memory_order_relaxed);
+}
+
+auto TransitionTable::offset_at(sys_seconds tp) const noexcept -> seconds {
+  const auto it = std::ranges::upper_bound(m_transitions, tp, {},
+                                           &Transition::at);
+  return it == m_transitions.begin() ? m_offset : std::prev(it)->after;
+}
+
+auto TransitionTable::to_sys(local_seconds lt, Choose choose) const noexcept
+    -> sys_seconds {
+  const auto local = lt.time_since_epoch();
+  // the windows are disjoint and ordered like the transitions themselves
+  const auto it = std::ranges::upper_bound(
+      m_transitions, local, {},
+      [](Transition const &t) { return window_end(t); });
+  if (it == m_transitions.end()) {
+    const auto offset =
+        m_transitions.empty() ? m_offset : m_transitions.back().after;
+    return sys_seconds{local - offset};
+  }
+  if (local < window_begin(*it)) {
+    return sys_seconds{local - it->before};
+  }
+  const bool earliest = choose == Choose::EARLIEST;
+  if (it->after > it->before) {
+    // gap
+    return earliest ? it->at : sys_seconds{local - it->before};
+  }
+  // overlap
+  return sys_seconds{local - (earliest ? it->before : it->after)};
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// UTC offset changes of a time zone over a window of years, precomputed once
+// so local times resolve with a binary search instead of zone database
+// lookups. Local times in a gap (skipped by a forward transition) or in an
+// overlap (repeated by a backward transition) resolve by an explicit policy.
+class TransitionTable {
+public:
+  using seconds = std::chrono::seconds;
+  using sys_seconds = std::chrono::sys_seconds;
+  using local_seconds = std::chrono::local_seconds;
+
+  // for a local time in an overlap, EARLIEST picks the first occurrence and
+  // LATEST the second one. For a local time in a gap, EARLIEST picks the
+  // instant of the transition, the first existing time after the requested
+  // one, and LATEST the requested time taken at the offset before the gap,
+  // i.e. shifted forward by the length of the gap.
+  enum class Choose { EARLIEST, LATEST };
+
+  struct Transition {
+    sys_seconds at;
+    seconds before;
+    seconds after;
+  };
+
+  explicit TransitionTable(seconds offset = seconds{0},
+                           std::vector<Transition> transitions = {});
+
+  // collects the offset changes of zone between from and to, zone is
+  // anything with a date::time_zone like get_info(sys_seconds)
+  template <typename Zone>
+  static TransitionTable build(Zone const *zone, sys_seconds from,
+                               sys_seconds to) {
+    auto info = zone->get_info(from);
+    const seconds initial = info.offset;
+    std::vector<Transition> res;
+    while (info.end < to) {
+      auto next = zone->get_info(info.end);
+      // abbreviation only changes keep the offset
+      if (next.offset != info.offset) {
+        res.push_back({info.end, info.offset, next.offset});
+      }
+      info = std::move(next);
+    }
+    return TransitionTable(initial, std::move(res));
+  }
+
+  // table of date::current_zone() for 1970-2100, built on first use
+  static TransitionTable const &current();
+  // calls of current() in the process so far
+  static std::uint64_t lookups() noexcept;
+
+  seconds offset_at(sys_seconds tp) const noexcept;
+  local_seconds to_local(sys_seconds tp) const noexcept {
+    return local_seconds{(tp + offset_at(tp)).time_since_epoch()};
+  }
+  sys_seconds to_sys(local_seconds lt,
+                     Choose choose = Choose::EARLIEST) const noexcept;
+
+  std::span<Transition const> transitions() const noexcept {
+    return m_transitions;
+  }
+
+private:
+  seconds m_offset;
+  std::vector<Transition> m_transitions;
+};
@@ -0,0 +1,306 @@
+#include "wake_coordinator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+struct WakeCoordinator::State {
+  std::uint32_t magic;
+  std::uint32_t phase;
+  std::int32_t leader;
+  std::uint32_t members;
+  // seconds since the epoch
+  std::int64_t wakeup;
+  std::uint32_t halt;
+  std::uint32_t reserved;
+  // counts the batches, identifies the one followers wait for
+  std::uint64_t serial;
+  // bit serial % 64 is set once that batch is armed
+  std::uint64_t armed;
+};
+
+namespace {
+
+using State = WakeCoordinator::State;
+using Role = WakeCoordinator::Batch::Role;
+
+constexpr std::uint32_t state_magic = 0x4c57524d; // "MRWL"
+
+static_assert(sizeof(State) == 48);
+
+// how often followers look at the batch they wait for
+constexpr std::chrono::milliseconds poll_interval{10};
+
+enum Phase : std::uint32_t {
+  IDLE = 0,
+  // collecting requests until the leader arms
+  OPEN,
+  // armed, the leader is notifying and halting
+  HALTING,
+};
+
+bool alive(pid_t pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+auto sys(std::int64_t t) {
+  return std::chrono::sys_seconds{std::chrono::seconds{t}};
+}
+
+std::int64_t epoch(std::chrono::sys_seconds t) {
+  return t.time_since_epoch().count();
+}
+
+State idle_state() {
+  return {.magic = state_magic,
+          .phase = IDLE,
+          .leader = 0,
+          .members = 0,
+          .wakeup = 0,
+          .halt = 0,
+          .reserved = 0,
+          .serial = 0,
+          .armed = 0};
+}
+
+std::uint64_t armed_bit(std::uint64_t serial) { return 1ull << (serial % 64); }
+
+} // namespace
+
+WakeCoordinator::WakeCoordinator(fs::path const &path,
+                                 std::chrono::milliseconds window)
+    : m_window{window} {
+  if (path.has_parent_path()) {
+    fs::create_directories(path.parent_path());
+  }
+  m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to open lock file " + path.string());
+  }
+}
+
+WakeCoordinator::~WakeCoordinator() {
+  // an operation of the leader failed before arming, the batch is given up
+  // rather than left to the followers until this process exits
+  if (m_locked && m_role == Role::LEADER) {
+    try {
+      auto state = read_state();
+      state.phase = IDLE;
+      write_state(state);
+    } catch (std::exception const &) {
+    }
+  }
+  unlock();
+  close(m_fd);
+}
+
+auto WakeCoordinator::read_state() const -> State {
+  State state{};
+  const auto read = pread(m_fd, &state, sizeof(state), 0);
+  if (read < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to read lock file");
+  }
+  if (read != sizeof(state) || state.magic != state_magic) {
+    return idle_state();
+  }
+  return state;
+}
+
+void WakeCoordinator::write_state(State const &state) const {
+  if (pwrite(m_fd, &state, sizeof(state), 0) != sizeof(state)) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to write lock file");
+  }
+}
+
+void WakeCoordinator::lock() const {
+  while (flock(m_fd, LOCK_EX) != 0) {
+    if (errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(),
+                              "failed to lock lock file");
+    }
+  }
+}
+
+void WakeCoordinator::unlock() const noexcept { flock(m_fd, LOCK_UN); }
+
+auto WakeCoordinator::join(sys_seconds wakeup, bool halt) -> Batch {
+  const auto self = getpid();
+  lock();
+  m_locked = true;
+  auto state = read_state();
+  while (state.phase != IDLE && state.leader != self &&
+         alive(state.leader)) {
+    if (state.phase == OPEN) {
+      state.wakeup = std::min(state.wakeup, epoch(wakeup));
+      state.halt |= halt ? 1u : 0u;
+      ++state.members;
+      write_state(state);
+    } else if (epoch(wakeup) < state.wakeup) {
+      m_role = Role::LATE;
+      return {.role = Role::LATE,
+              .wakeup = wakeup,
+              .halt = false,
+              .members = state.members,
+              .leader = state.leader};
+    }
+    if (auto batch = follow(state, halt)) {
+      m_role = Role::FOLLOWER;
+      return *batch;
+    }
+    // the batch failed, the request is made again
+    state = read_state();
+  }
+  // no batch, or one whose leader is gone
+  state = {.magic = state_magic,
+           .phase = OPEN,
+           .leader = self,
+           .members = 1,
+           .wakeup = epoch(wakeup),
+           .halt = halt ? 1u : 0u,
+           .reserved = 0,
+           .serial = state.serial + 1,
+           .armed = state.armed & ~armed_bit(state.serial + 1)};
+  write_state(state);
+  m_role = Role::LEADER;
+  if (m_window.count() > 0) {
+    unlock();
+    m_locked = false;
+    std::this_thread::sleep_for(m_window);
+    lock();
+    m_locked = true;
+    state = read_state();
+  }
+  return {.role = Role::LEADER,
+          .wakeup = sys(state.wakeup),
+          .halt = state.halt != 0,
+          .members = state.members,
+          .leader = self};
+}
+
+auto WakeCoordinator::follow(State state, bool halt) -> std::optional<Batch> {
+  const auto serial = state.serial;
+  Batch batch{.role = Role::FOLLOWER,
+              .wakeup = sys(state.wakeup),
+              .halt = state.halt != 0,
+              .members = state.members,
+              .leader = state.leader};
+  for (;;) {
+    // the batch is over once its leader armed without halting, gave up or
+    // is gone, then the next one may have started already
+    const bool current = state.serial == serial;
+    const bool ended = !current || state.phase == IDLE || !alive(state.leader);
+    const bool armed = (state.armed & armed_bit(serial)) != 0;
+    if (current) {
+      batch.wakeup = sys(state.wakeup);
+      batch.halt = state.halt != 0;
+      batch.members = state.members;
+    }
+    // a halting batch only ends if halting failed, which leaves the halt
+    // requested to its members
+    if (armed && !halt) {
+      unlock();
+      m_locked = false;
+      return batch;
+    }
+    if (ended) {
+      return {};
+    }
+    unlock();
+    m_locked = false;
+    std::this_thread::sleep_for(poll_interval);
+    lock();
+    m_locked = true;
+    state = read_state();
+  }
+}
+
+void WakeCoordinator::armed(sys_seconds wakeup, bool halt) {
+  if (!m_locked) {
+    throw std::logic_error("armed without leading or joining late");
+  }
+  auto state = read_state();
+  state.wakeup = epoch(wakeup);
+  if (m_role == Role::LEADER) {
+    state.halt |= halt ? 1u : 0u;
+    state.phase = state.halt != 0 ? HALTING : IDLE;
+    state.armed |= armed_bit(state.serial);
+  }
+  write_state(state);
+  unlock();
+  m_locked = false;
+}
+
+void WakeCoordinator::halt_failed() {
+  lock();
+  auto state = read_state();
+  if (state.leader == getpid()) {
+    state.phase = IDLE;
+    write_state(state);
+  }
+  unlock();
+}
+
+std::unique_ptr<WakeCoordinator>
+open_coordinator(fs::path const &path,
+                 std::chrono::milliseconds window) noexcept try {
+  return std::make_unique<WakeCoordinator>(path, window);
+} catch (std::exception const &e) {
+  fmt::print(stderr, "mrhat-rtcwake: not coordinating with other invocations: "
+                     "{}\n",
+             e.what());
+  return nullptr;
+}
+
+CoalescedWake schedule_coalesced(
+    RTCWake &wake, WakeCoordinator &coordinator,
+    RTCWake::WakeSpec const &spec, bool halt,
+    std::function<void(RTCWake::ScheduleResult const &)> const &on_armed,
+    DecideAction const &decide) {
+  CoalescedWake res;
+  res.batch = coordinator.join(wake.resolve(spec), halt);
+  if (res.batch.role == Role::FOLLOWER) {
+    // the system goes down with a halting batch
+    if (decide && !res.batch.halt) {
+      res.decision = decide(res.batch.wakeup);
+      res.decision->action = cheapest(
+          *res.decision,
+          std::array{PowerAction::WAIT, PowerAction::SUSPEND});
+    }
+    return res;
+  }
+  if (decide && res.batch.role == Role::LEADER) {
+    res.decision = decide(res.batch.wakeup);
+    res.batch.halt |= res.decision->action == PowerAction::HALT;
+  }
+  // resolved already, with the spread applied
+  res.scheduled = wake.schedule_at(res.batch.wakeup);
+  coordinator.armed(res.scheduled->wakeup, res.batch.halt);
+  if (on_armed) {
+    on_armed(*res.scheduled);
+  }
+  if (res.batch.role == Role::LEADER && res.batch.halt) {
+    res.halted = wake.halt();
+    if (res.halted->error != 0) {
+      coordinator.halt_failed();
+    }
+  }
+  return res;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <rtcwake.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include <sys/types.h>
+
+// Advisory lock protocol serializing concurrent invocations on the single
+// alarm. The first invocation leads a batch: it keeps the batch open for the
+// coalescing window, then arms the earliest wake time requested in it and,
+// if any member asked to, is the only one to notify the listener and halt.
+// Invocations joining an open batch merge their request into it and wait
+// until it is armed, or, if they asked to halt, until the system goes down.
+// Ones joining while the batch is halting arm their own wake time only if it
+// is earlier, and neither notify nor halt again. Members of a batch that
+// fails make their request again, so one of them leads the next batch.
+//
+// The batch state lives in the lock file, which belongs on a tmpfs so it
+// does not outlive the boot. A batch is abandoned once its leader is gone.
+class WakeCoordinator {
+public:
+  using sys_seconds = std::chrono::sys_seconds;
+
+  static constexpr auto default_path = "/run/mrhat-rtcwake/wake.lock";
+
+  struct Batch {
+    enum class Role {
+      // arms the wake time of the batch, halts if the batch does
+      LEADER,
+      // joined a halting batch with an earlier wake time, arms it but
+      // neither notifies nor halts
+      LATE,
+      // merged into the batch of another invocation, which armed it, nothing
+      // left to do
+      FOLLOWER,
+    };
+    Role role = Role::LEADER;
+    // the earliest wake time of the batch so far, for LATE the own one
+    sys_seconds wakeup{};
+    bool halt = false;
+    // requests merged into the batch, including the own one
+    unsigned members = 1;
+    pid_t leader = 0;
+  };
+
+  // creates the lock file if needed
+  WakeCoordinator(std::filesystem::path const &path,
+                  std::chrono::milliseconds window);
+  WakeCoordinator(const WakeCoordinator &) = delete;
+  WakeCoordinator &operator=(const WakeCoordinator &) = delete;
+  ~WakeCoordinator();
+
+  // joins or opens a batch, waits the coalescing window when leading it.
+  // LEADER and LATE return holding the lock, until armed() is called. The
+  // wake time has to be in the future, see RTCWake::resolve.
+  Batch join(sys_seconds wakeup, bool halt);
+  // records the wake time armed for the batch and releases the lock, the
+  // batch is halting afterwards if a leader halts it, as a member asked to or
+  // as the leader decided to
+  void armed(sys_seconds wakeup, bool halt = false);
+  // the leader could not halt, the next invocation leads a new batch
+  void halt_failed();
+
+  struct State;
+
+private:
+  // waits for the outcome of the batch of state, unset if it failed
+  std::optional<Batch> follow(State state, bool halt);
+  State read_state() const;
+  void write_state(State const &state) const;
+  void lock() const;
+  void unlock() const noexcept;
+
+  int m_fd = -1;
+  std::chrono::milliseconds m_window;
+  std::optional<Batch::Role> m_role;
+  bool m_locked = false;
+};
+
+// the coordinator of the lock file at path, or none with a warning if it
+// cannot be created or opened, e.g. on a read-only /run or as a non-root
+// user, so arming falls back to not coordinating instead of failing
+std::unique_ptr<WakeCoordinator>
+open_coordinator(std::filesystem::path const &path,
+                 std::chrono::milliseconds window) noexcept;
+
+struct CoalescedWake {
+  // halt is set if the batch halts, including by the decision of the leader
+  WakeCoordinator::Batch batch;
+  // unset for followers
+  std::optional<RTCWake::ScheduleResult> scheduled;
+  // set if the batch halted, which only returns if halting failed
+  std::optional<RTCWake::HaltResult> halted;
+  // of decide, unset if not given, for LATE and for a halting batch the
+  // invocation did not lead
+  std::optional<PowerDecision> decision;
+};
+
+using DecideAction = std::function<PowerDecision(RTCWake::sys_seconds wakeup)>;
+
+// arms the wake time of spec coalesced with the concurrent invocations, and
+// halts if the batch does. on_armed is called once the alarm is armed and
+// before halting. decide chooses how to spend the time until the wake time
+// of the batch once it is known; the leader halts the batch if it decides
+// to, the others cannot and fall back to the cheapest action keeping the
+// system up.
+CoalescedWake schedule_coalesced(
+    RTCWake &wake, WakeCoordinator &coordinator,
+    RTCWake::WakeSpec const &spec, bool halt,
+    std::function<void(RTCWake::ScheduleResult const &)> const &on_armed = {},
+    DecideAction const &decide = {});
@@ -0,0 +1,390 @@
+#include "wake_journal.hpp"
+
+#include <time_format.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+struct WakeJournal::Header {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t slot_size;
+  std::uint32_t capacity;
+  std::uint32_t reserved[4];
+};
+
+struct WakeJournal::Slot {
+  // 0 for a slot never written
+  std::uint64_t seq;
+  std::int64_t at;
+  std::int64_t wakeup;
+  std::uint32_t kind;
+  std::int32_t value;
+  // of the fields above
+  std::uint32_t crc;
+  std::uint32_t reserved;
+};
+
+namespace {
+
+using Header = WakeJournal::Header;
+using Slot = WakeJournal::Slot;
+
+constexpr std::uint32_t journal_magic = 0x4a57524d; // "MRWJ"
+constexpr std::uint32_t journal_version = 1;
+
+static_assert(sizeof(Header) == 32);
+static_assert(sizeof(Slot) == 40);
+
+constexpr auto crc_table = [] {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t i = 0; i < table.size(); ++i) {
+    std::uint32_t c = i;
+    for (int k = 0; k < 8; ++k) {
+      c = (c & 1) != 0 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    table[i] = c;
+  }
+  return table;
+}();
+
+std::uint32_t slot_crc(Slot const &slot) {
+  unsigned char bytes[offsetof(Slot, crc)];
+  std::memcpy(bytes, &slot, sizeof(bytes));
+  std::uint32_t c = 0xffffffff;
+  for (const auto b : bytes) {
+    c = crc_table[(c ^ b) & 0xff] ^ (c >> 8);
+  }
+  return ~c;
+}
+
+bool intact(Slot const &slot) {
+  return slot.seq != 0 && slot.crc == slot_crc(slot);
+}
+
+std::size_t journal_size(std::uint32_t capacity) {
+  return sizeof(Header) + std::size_t{capacity} * sizeof(Slot);
+}
+
+bool valid_header(Header const &h) {
+  return h.magic == journal_magic && h.version == journal_version &&
+         h.slot_size == sizeof(Slot) && h.capacity != 0;
+}
+
+std::system_error errno_error(fs::path const &path, const char *what) {
+  return std::system_error(errno, std::generic_category(),
+                           std::string(what) + " " + path.string());
+}
+
+WakeRecord to_record(Slot const &slot) {
+  return {.seq = slot.seq,
+          .kind = static_cast<WakeRecord::Kind>(slot.kind),
+          .at = slot.at,
+          .wakeup = slot.wakeup,
+          .value = slot.value};
+}
+
+auto sys(std::int64_t t) {
+  return std::chrono::sys_seconds{std::chrono::seconds{t}};
+}
+
+} // namespace
+
+std::string_view to_string(WakeRecord::Kind kind) {
+  using Kind = WakeRecord::Kind;
+  switch (kind) {
+  case Kind::ARMED:
+    return "armed";
+  case Kind::CLEARED:
+    return "cleared";
+  case Kind::NOTIFIED:
+    return "notified";
+  case Kind::HALT_FAILED:
+    return "halt_failed";
+  case Kind::BOOTED:
+    return "booted";
+  case Kind::DECIDED:
+    return "decided";
+  case Kind::RECONCILED:
+    return "reconciled";
+  }
+  return "unknown";
+}
+
+WakeJournal WakeJournal::open_writer(fs::path const &path,
+                                     std::uint32_t capacity) {
+  fs::create_directories(path.parent_path());
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw errno_error(path, "failed to open wake journal");
+  }
+  // construct right away so the fd is closed on any error below
+  WakeJournal journal(fd, nullptr, 0);
+  if (flock(fd, LOCK_EX) != 0) {
+    throw errno_error(path, "failed to lock wake journal");
+  }
+  Header header{};
+  const auto read = pread(fd, &header, sizeof(header), 0);
+  // a new file, or one whose creation was interrupted before the header
+  const bool fresh = read != sizeof(header) || header.magic == 0;
+  if (!fresh && !valid_header(header)) {
+    throw std::runtime_error(fmt::format(
+        "{} is not a wake journal of this version", path.c_str()));
+  }
+  if (fresh) {
+    header = {.magic = journal_magic,
+              .version = journal_version,
+              .slot_size = sizeof(Slot),
+              .capacity = capacity};
+    if (ftruncate(fd, 0) != 0) {
+      throw errno_error(path, "failed to reset wake journal");
+    }
+  }
+  const auto size = journal_size(header.capacity);
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    throw errno_error(path, "failed to stat wake journal");
+  }
+  // missing slots read back as zeroes, i.e. empty
+  if (st.st_size < static_cast<off_t>(size) &&
+      ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    throw errno_error(path, "failed to size wake journal");
+  }
+  void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    throw errno_error(path, "failed to map wake journal");
+  }
+  journal.m_map = map;
+  journal.m_size = size;
+  if (fresh) {
+    // the header goes last, a crash before leaves an invalid one behind
+    std::memcpy(map, &header, sizeof(header));
+  }
+  journal.m_next = journal.scan() + 1;
+  flock(fd, LOCK_UN);
+  return journal;
+}
+
+WakeJournal::WakeJournal(WakeJournal &&other) noexcept
+    : m_fd{std::exchange(other.m_fd, -1)},
+      m_map{std::exchange(other.m_map, nullptr)},
+      m_size{std::exchange(other.m_size, 0)}, m_next{other.m_next} {}
+
+WakeJournal &WakeJournal::operator=(WakeJournal &&other) noexcept {
+  if (this != &other) {
+    this->~WakeJournal();
+    m_fd = std::exchange(other.m_fd, -1);
+    m_map = std::exchange(other.m_map, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_next = other.m_next;
+  }
+  return *this;
+}
+
+WakeJournal::~WakeJournal() {
+  if (m_map != nullptr)
+    munmap(m_map, m_size);
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+std::uint32_t WakeJournal::capacity() const noexcept {
+  return static_cast<Header const *>(m_map)->capacity;
+}
+
+auto WakeJournal::slots() const noexcept -> Slot * {
+  return reinterpret_cast<Slot *>(static_cast<char *>(m_map) +
+                                  sizeof(Header));
+}
+
+// highest sequence number of the intact slots
+std::uint64_t WakeJournal::scan() const noexcept {
+  std::uint64_t last = 0;
+  for (auto const &slot : std::span(slots(), capacity())) {
+    if (intact(slot)) {
+      last = std::max(last, slot.seq);
+    }
+  }
+  return last;
+}
+
+std::uint64_t WakeJournal::append(WakeRecord record) {
+  // writers in other processes are serialized by the file lock
+  flock(m_fd, LOCK_EX);
+  auto *ring = slots();
+  const auto cap = capacity();
+  // another writer got to the slot first
+  if (ring[m_next % cap].seq >= m_next) {
+    m_next = scan() + 1;
+  }
+  Slot slot{.seq = m_next,
+            .at = record.at,
+            .wakeup = record.wakeup,
+            .kind = static_cast<std::uint32_t>(record.kind),
+            .value = record.value,
+            .crc = 0,
+            .reserved = 0};
+  slot.crc = slot_crc(slot);
+  std::memcpy(&ring[m_next % cap], &slot, sizeof(slot));
+  flock(m_fd, LOCK_UN);
+  return m_next++;
+}
+
+void WakeJournal::sync() {
+  if (msync(m_map, m_size, MS_SYNC) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "failed to sync wake journal");
+  }
+}
+
+std::vector<WakeRecord> read_wake_journal(fs::path const &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    return {};
+  }
+  const std::string data{std::istreambuf_iterator<char>(ifs),
+                         std::istreambuf_iterator<char>()};
+  if (data.size() < sizeof(Header)) {
+    return {};
+  }
+  Header header{};
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (!valid_header(header)) {
+    throw std::runtime_error(
+        fmt::format("{} is not a wake journal of this version", path.c_str()));
+  }
+  // a slot cut off by a truncation reads as zero extended, as it does for
+  // the writer, whose checksum tells whether it is still complete
+  const auto body = std::string_view(data).substr(sizeof(Header));
+  const auto slots = std::min<std::size_t>(
+      header.capacity, (body.size() + sizeof(Slot) - 1) / sizeof(Slot));
+  std::vector<WakeRecord> res;
+  for (std::size_t i = 0; i < slots; ++i) {
+    Slot slot{};
+    const auto bytes = body.substr(i * sizeof(Slot), sizeof(Slot));
+    std::memcpy(&slot, bytes.data(), bytes.size());
+    if (intact(slot)) {
+      res.push_back(to_record(slot));
+    }
+  }
+  std::sort(res.begin(), res.end(),
+            [](auto const &a, auto const &b) { return a.seq < b.seq; });
+  return res;
+}
+
+WakeSummary summarize(std::span<WakeRecord const> records) {
+  using Kind = WakeRecord::Kind;
+  WakeSummary res{.records = records.size()};
+  // the alarm armed since the last boot, and whether the system halted on it
+  std::optional<std::int64_t> armed;
+  bool halted = false;
+  std::int64_t error_sum = 0;
+  for (auto const &r : records) {
+    switch (r.kind) {
+    case Kind::ARMED:
+      ++res.armed;
+      armed = r.wakeup;
+      halted = false;
+      break;
+    case Kind::CLEARED:
+      armed.reset();
+      break;
+    case Kind::NOTIFIED:
+      res.notify_failures += r.value == 0 ? 1 : 0;
+      // halting goes ahead without the listener
+      halted = true;
+      break;
+    case Kind::HALT_FAILED:
+      ++res.halt_failures;
+      halted = false;
+      break;
+    case Kind::BOOTED:
+      if (armed && halted) {
+        const std::chrono::seconds error{r.at - *armed};
+        if (res.wakes == 0 || error < res.min_error) {
+          res.min_error = error;
+        }
+        if (res.wakes == 0 || error > res.max_error) {
+          res.max_error = error;
+        }
+        error_sum += error.count();
+        ++res.wakes;
+      } else {
+        ++res.other_boots;
+      }
+      armed.reset();
+      halted = false;
+      break;
+    case Kind::DECIDED:
+    case Kind::RECONCILED:
+      break;
+    }
+  }
+  if (res.wakes != 0) {
+    res.mean_error = std::chrono::seconds{
+        error_sum / static_cast<std::int64_t>(res.wakes)};
+  }
+  return res;
+}
+
+bool listener_notified(std::span<WakeRecord const> records) {
+  using Kind = WakeRecord::Kind;
+  bool notified = false;
+  for (auto const &r : records) {
+    if (r.kind == Kind::NOTIFIED) {
+      notified = r.value != 0;
+    } else if (r.kind == Kind::HALT_FAILED) {
+      // a failed halt reverts the listener
+      notified = false;
+    } else if (r.kind == Kind::RECONCILED) {
+      notified = (r.value & WakeRecord::reconciled_notified) != 0;
+    }
+  }
+  return notified;
+}
+
+std::string to_json(std::span<WakeRecord const> records,
+                    WakeSummary const &summary) {
+  std::string res = "{\"records\":[";
+  for (const char *sep = ""; auto const &r : records) {
+    res += fmt::format("{}{{\"seq\":{},\"kind\":\"{}\",\"at\":{},"
+                       "\"at_iso\":\"{}\",",
+                       std::exchange(sep, ","), r.seq, to_string(r.kind),
+                       r.at, Iso8601(sys(r.at)).view());
+    if (r.kind == WakeRecord::Kind::ARMED ||
+        r.kind == WakeRecord::Kind::DECIDED) {
+      res += fmt::format("\"wakeup\":{},\"wakeup_iso\":\"{}\",", r.wakeup,
+                         Iso8601(sys(r.wakeup)).view());
+    }
+    res += fmt::format("\"value\":{}}}", r.value);
+  }
+  res += fmt::format(
+      "],\"summary\":{{\"records\":{},\"armed\":{},\"wakes\":{},"
+      "\"other_boots\":{},\"notify_failures\":{},\"halt_failures\":{},"
+      "\"error_s\":{{\"mean\":{},\"min\":{},\"max\":{}}}}}}}",
+      summary.records, summary.armed, summary.wakes, summary.other_boots,
+      summary.notify_failures, summary.halt_failures,
+      summary.mean_error.count(), summary.min_error.count(),
+      summary.max_error.count());
+  return res;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An event of the wake cycle
+struct WakeRecord {
+  enum class Kind : std::uint32_t {
+    ARMED = 1,
+    CLEARED,
+    // reset on halt was signalled, value is 1 if the listener acknowledged it
+    NOTIFIED,
+    // value is the errno of the failed halt
+    HALT_FAILED,
+    // at is when the system came back, as seen by hctosys at boot, value is
+    // the seconds it took from starting the kernel to hctosys
+    BOOTED,
+    // --mode auto chose how to spend the time until wakeup, value is the
+    // PowerAction
+    DECIDED,
+    // --mode reconcile ran at boot, value has reconciled_alarm set if the
+    // alarm woke the system and reconciled_notified if the reset on halt bit
+    // could not be cleared
+    RECONCILED,
+  };
+  static constexpr std::int32_t reconciled_alarm = 1;
+  static constexpr std::int32_t reconciled_notified = 2;
+  // assigned by WakeJournal::append, increasing over the life of the journal
+  std::uint64_t seq = 0;
+  Kind kind = Kind::ARMED;
+  // seconds since the epoch the event happened at
+  std::int64_t at = 0;
+  // the wake time of ARMED and DECIDED records
+  std::int64_t wakeup = 0;
+  std::int32_t value = 0;
+  bool operator==(WakeRecord const &) const = default;
+};
+
+std::string_view to_string(WakeRecord::Kind kind);
+
+// Ring buffer of fixed size records in a memory mapped file, the oldest
+// records are overwritten once it is full. Each slot carries its sequence
+// number and a checksum, so readers skip torn slots and the ring needs no
+// head pointer that could go out of sync with the records: a crash or a
+// truncated file loses at most the affected records.
+class WakeJournal {
+public:
+  static constexpr auto default_path = "/var/lib/mrhat-rtcwake/wake.journal";
+  static constexpr std::uint32_t default_capacity = 256;
+
+  // creates the journal if needed, an existing one keeps its capacity and a
+  // truncated one is extended with empty slots. Throws rather than overwrite
+  // a file that is not a journal of this version.
+  static WakeJournal open_writer(std::filesystem::path const &path,
+                                 std::uint32_t capacity = default_capacity);
+
+  WakeJournal(const WakeJournal &) = delete;
+  WakeJournal &operator=(const WakeJournal &) = delete;
+  WakeJournal(WakeJournal &&other) noexcept;
+  WakeJournal &operator=(WakeJournal &&other) noexcept;
+  ~WakeJournal();
+
+  // copies the record with the next sequence number into its slot, returns
+  // the sequence number
+  std::uint64_t append(WakeRecord record);
+  // writes the mapping back to the file, the records are durable afterwards
+  void sync();
+  std::uint32_t capacity() const noexcept;
+
+  struct Header;
+  struct Slot;
+
+private:
+  WakeJournal(int fd, void *map, std::size_t size)
+      : m_fd{fd}, m_map{map}, m_size{size} {}
+  Slot *slots() const noexcept;
+  std::uint64_t scan() const noexcept;
+
+  int m_fd = -1;
+  void *m_map = nullptr;
+  std::size_t m_size = 0;
+  std::uint64_t m_next = 1;
+};
+
+// the intact records in sequence order, empty if the journal does not exist
+// or is too short for its header. Throws if the file is not a journal.
+std::vector<WakeRecord> read_wake_journal(std::filesystem::path const &path);
+
+// How accurately the armed alarms woke the system
+struct WakeSummary {
+  std::size_t records = 0;
+  std::size_t armed = 0;
+  // boots after halting with an armed alarm
+  std::size_t wakes = 0;
+  // boots without an armed alarm, e.g. powered on by hand
+  std::size_t other_boots = 0;
+  std::size_t notify_failures = 0;
+  std::size_t halt_failures = 0;
+  // boot time minus the armed wake time over the wakes
+  std::chrono::seconds mean_error{};
+  std::chrono::seconds min_error{};
+  std::chrono::seconds max_error{};
+};
+
+WakeSummary summarize(std::span<WakeRecord const> records);
+
+// whether the reset on halt bit the listener acknowledged before the last
+// halt is still set, i.e. neither a failed halt nor --mode reconcile cleared
+// it since
+bool listener_notified(std::span<WakeRecord const> records);
+
+std::string to_json(std::span<WakeRecord const> records,
+                    WakeSummary const &summary);
@@ -0,0 +1,16 @@
+#include "wake_spread.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+std::string device_identity(std::filesystem::path const &path) {
+  std::ifstream ifs(path);
+  std::string id;
+  if (!(ifs >> id)) {
+    throw std::runtime_error(fmt::format(
+        "no device identity in {} to spread the wake time by", path.c_str()));
+  }
+  return id;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// Boards given the same wake time are woken at different minutes within a
+// window, each one always at the same offset, so a fleet does not come up at
+// once.
+
+// FNV-1a with a final mix, the same on every build and boot, unlike
+// std::hash
+constexpr std::uint64_t identity_hash(std::string_view identity) noexcept {
+  std::uint64_t h = 0xcbf29ce484222325;
+  for (const char c : identity) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3;
+  }
+  // the low bits of FNV-1a are weak for similar identities, e.g. serials
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53;
+  h ^= h >> 33;
+  return h;
+}
+
+// delay of the device in [0, window), in whole minutes as the RX8130 wakeup
+// timer counts them, so every offset fires at a distinct minute
+constexpr std::chrono::minutes
+spread_offset(std::string_view identity, std::chrono::minutes window) noexcept {
+  if (window.count() <= 1) {
+    return std::chrono::minutes{0};
+  }
+  return std::chrono::minutes{static_cast<std::chrono::minutes::rep>(
+      identity_hash(identity) % static_cast<std::uint64_t>(window.count()))};
+}
+
+// the machine id, stable across reboots. Throws if it is missing or empty.
+std::string device_identity(std::filesystem::path const &path =
+                                "/etc/machine-id");